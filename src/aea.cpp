@@ -23,7 +23,9 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <string.h>
+#include <algorithm>
 #include <memory>
+#include <stdexcept>
 
 using std::string;
 using std::array;
@@ -62,7 +64,7 @@ class TAeaInput : public ICompressedInput, public TAeaCommon {
     static TAeaCommon::TMeta ReadMeta(const string& filename);
 public:
     TAeaInput(const string& filename);
-    unique_ptr<TFrame> ReadFrame() override; 
+    size_t ReadFrame(char* buf, size_t size) override;
     uint64_t GetLengthInSamples() const override;
 
     size_t GetChannelNum() const override {
@@ -107,14 +109,15 @@ uint64_t TAeaInput::GetLengthInSamples() const {
     return (uint64_t)512 * ((sb.st_size - AeaMetaSize) / 212 / nChannels - 5); 
 }
 
-unique_ptr<ICompressedIO::TFrame> TAeaInput::ReadFrame() {
-    unique_ptr<ICompressedIO::TFrame>frame(new TFrame(212));
-    if(fread(frame->Get(), frame->Size(), 1, Meta.AeaFile) != 1) {
+size_t TAeaInput::ReadFrame(char* buf, size_t size) {
+    if (size < 212)
+        throw std::length_error("buffer is too small for AEA frame");
+    if(fread(buf, 212, 1, Meta.AeaFile) != 1) {
         const int errnum = errno;
         fclose(Meta.AeaFile);
         throw TAeaIOError("Can't read AEA frame", errnum);
     }
-    return frame;
+    return 212;
 }
 
 class TAeaOutput : public ICompressedOutput, public TAeaCommon {
@@ -122,9 +125,15 @@ class TAeaOutput : public ICompressedOutput, public TAeaCommon {
         size_t numChannel, uint32_t numFrames);
 
     bool FirstWrite = true;
+    const bool UnknownLength;
+    uint32_t NumFrames = UnknownFrames;
 public:
     TAeaOutput(const string& filename, const string& title, size_t numChannel, uint32_t numFrames);
-    void WriteFrame(vector<char> data) override;
+    ~TAeaOutput();
+    void WriteFrame(const char* data, size_t size) override;
+    void SetNumFrames(uint32_t numFrames) override {
+        NumFrames = numFrames;
+    }
 
     size_t GetChannelNum() const override {
         return TAeaCommon::GetChannelNum();
@@ -136,12 +145,23 @@ public:
 
 TAeaOutput::TAeaOutput(const string& filename, const string& title, size_t numChannels, uint32_t numFrames)
     : TAeaCommon(CreateMeta(filename, title, numChannels, numFrames))
+    , UnknownLength(numFrames == UnknownFrames)
 {}
 
+TAeaOutput::~TAeaOutput() {
+    // Patch frame counter written as 0 for unknown length input,
+    // not possible for pipe - the header is left as is
+    if (!UnknownLength || NumFrames == UnknownFrames || !NAtracDEnc::IsSeekable(Meta.AeaFile))
+        return;
+    if (fseek(Meta.AeaFile, 260, SEEK_SET) == 0) {
+        fwrite(&NumFrames, sizeof(NumFrames), 1, Meta.AeaFile);
+    }
+}
+
 TAeaCommon::TMeta TAeaOutput::CreateMeta(const string& filename, const string& title,
     size_t channelsNum, uint32_t numFrames)
 {
-    FILE* fp = NAtracDEnc::FOpenUtf8(filename, "wb");
+    FILE* fp = NAtracDEnc::FOpenOutputUtf8(filename);
     if (!fp)
         throw TAeaIOError("unable to open output file '" + filename + "'", errno);
 
@@ -154,7 +174,7 @@ TAeaCommon::TMeta TAeaOutput::CreateMeta(const string& filename, const string& t
     strncpy(&buf[4], title.c_str(), 16);
     buf[19] = 0;
 //    buf[210] = 0x08;
-    *(uint32_t*)&buf[260] = numFrames;
+    *(uint32_t*)&buf[260] = numFrames == UnknownFrames ? 0 : numFrames;
     buf[264] = (char)channelsNum;
 
     if (fwrite(&buf[0], AeaMetaSize, 1, fp) != 1) {
@@ -173,15 +193,17 @@ TAeaCommon::TMeta TAeaOutput::CreateMeta(const string& filename, const string& t
     return {fp, buf};
 }
 
-void TAeaOutput::WriteFrame(vector<char> data) {
+void TAeaOutput::WriteFrame(const char* data, size_t size) {
     if (FirstWrite) {
         FirstWrite = false;
         return;
     }
 
-    data.resize(212);
+    // Sound unit is always 212 bytes, pad short ones with zeros
+    char unit[212] = {};
+    memcpy(unit, data, std::min<size_t>(size, sizeof(unit)));
 
-    if (fwrite(data.data(), data.size(), 1, Meta.AeaFile) != 1) {
+    if (fwrite(unit, sizeof(unit), 1, Meta.AeaFile) != 1) {
         const int errnum = errno;
         fclose(Meta.AeaFile);
         throw TAeaIOError("Can't write AEA frame", errnum);
@@ -139,6 +139,10 @@ static void BackfillWaveHeader(FILE* Fp, size_t headerSize, uint64_t framesWritt
     if (actualFileSize >= UINT32_MAX) {
         return;
     }
+    // Stream output keeps provisional header
+    if (!NAtracDEnc::IsSeekable(Fp)) {
+        return;
+    }
 
     const uint32_t chunkSize = uint32_t(actualFileSize - 8);
     const uint32_t totalSamples = uint32_t(framesWritten) * samplesPerFrame;
@@ -147,19 +151,19 @@ static void BackfillWaveHeader(FILE* Fp, size_t headerSize, uint64_t framesWritt
     const uint32_t totalSamplesLE = swapbyte32_on_be(totalSamples);
     const uint32_t dataSizeLE = swapbyte32_on_be(dataSize);
 
-    fseek(Fp, offsetof(At3WaveHeader, chunk_size), SEEK_SET);
-    fwrite(&chunkSizeLE, sizeof(uint32_t), 1, Fp);
-    fseek(Fp, static_cast<long>(totalSamplesOffset), SEEK_SET);
-    fwrite(&totalSamplesLE, sizeof(uint32_t), 1, Fp);
-    fseek(Fp, static_cast<long>(dataSizeOffset), SEEK_SET);
-    fwrite(&dataSizeLE, sizeof(uint32_t), 1, Fp);
+    if (fseek(Fp, offsetof(At3WaveHeader, chunk_size), SEEK_SET) == 0)
+        fwrite(&chunkSizeLE, sizeof(uint32_t), 1, Fp);
+    if (fseek(Fp, static_cast<long>(totalSamplesOffset), SEEK_SET) == 0)
+        fwrite(&totalSamplesLE, sizeof(uint32_t), 1, Fp);
+    if (fseek(Fp, static_cast<long>(dataSizeOffset), SEEK_SET) == 0)
+        fwrite(&dataSizeLE, sizeof(uint32_t), 1, Fp);
 }
 
 class TAt3 : public ICompressedOutput {
 public:
     TAt3(const std::string &filename, size_t numChannels,
         uint32_t numFrames, uint32_t frameSize, bool jointStereo)
-        : Fp(NAtracDEnc::FOpenUtf8(filename, "wb"))
+        : Fp(NAtracDEnc::FOpenOutputUtf8(filename))
         , FrameSize(frameSize)
         , FramesWritten(0)
     {
@@ -170,6 +174,13 @@ public:
         At3WaveHeader header;
         memset(&header, 0, sizeof(header));
 
+        // Unknown length: sizes are set to 0xFFFFFFFF (read till the end of stream)
+        // and patched on close if the output is seekable.
+        const bool unknownLength = numFrames == ICompressedOutput::UnknownFrames;
+        if (unknownLength) {
+            numFrames = 0;
+        }
+
         uint64_t file_size = At3HeaderSize + uint64_t(numFrames) * uint64_t(frameSize);
 
         if (file_size >= UINT32_MAX) {
@@ -179,7 +190,7 @@ public:
         memcpy(header.riff_chunk_id, "RIFF", 4);
         // RIFF spec: chunk_size is the size of everything after this field,
         // i.e. file_size - 8 (RIFF marker + size field itself).
-        header.chunk_size = swapbyte32_on_be(file_size - 8);
+        header.chunk_size = swapbyte32_on_be(unknownLength ? UINT32_MAX : file_size - 8);
         memcpy(header.riff_format, "WAVE", 4);
 
         memcpy(header.subchunk1_id, "fmt ", 4);
@@ -212,7 +223,7 @@ public:
         header.codec.at3.samples_per_frame = swapbyte32_on_be(At3SamplesPerFrame);
 
         memcpy(header.codec.at3.subchunk2_id, "data", 4);
-        header.codec.at3.subchunk2_size = swapbyte32_on_be(numFrames * frameSize);
+        header.codec.at3.subchunk2_size = swapbyte32_on_be(unknownLength ? UINT32_MAX : numFrames * frameSize);
 
         if (fwrite(&header, 1, At3HeaderSize, Fp.get()) != At3HeaderSize) {
             throw std::runtime_error("Cannot write WAV header to file");
@@ -233,8 +244,8 @@ public:
         }
     }
 
-    virtual void WriteFrame(std::vector<char> data) override {
-        if (fwrite(data.data(), 1, data.size(), Fp.get()) != data.size()) {
+    virtual void WriteFrame(const char* data, size_t size) override {
+        if (fwrite(data, 1, size, Fp.get()) != size) {
             throw std::runtime_error("Cannot write AT3 data to file");
         }
         ++FramesWritten;
@@ -274,7 +285,7 @@ class TAt3p : public ICompressedOutput {
 public:
     TAt3p(const std::string &filename, size_t numChannels,
         uint32_t numFrames, uint32_t frameSize)
-        : Fp(NAtracDEnc::FOpenUtf8(filename, "wb"))
+        : Fp(NAtracDEnc::FOpenOutputUtf8(filename))
         , FrameSize(frameSize)
         , FramesWritten(0)
         , NumChannels(numChannels)
@@ -292,13 +303,18 @@ public:
         At3WaveHeader header;
         memset(&header, 0, sizeof(header));
 
+        const bool unknownLength = numFrames == ICompressedOutput::UnknownFrames;
+        if (unknownLength) {
+            numFrames = 0;
+        }
+
         const uint64_t file_size = At3pHeaderSize + uint64_t(numFrames) * uint64_t(frameSize);
         if (file_size >= UINT32_MAX) {
             throw std::runtime_error("File size is too big for this file format");
         }
 
         memcpy(header.riff_chunk_id, "RIFF", 4);
-        header.chunk_size = swapbyte32_on_be(uint32_t(file_size - 8));
+        header.chunk_size = swapbyte32_on_be(unknownLength ? UINT32_MAX : uint32_t(file_size - 8));
         memcpy(header.riff_format, "WAVE", 4);
 
         memcpy(header.subchunk1_id, "fmt ", 4);
@@ -319,7 +335,7 @@ public:
         header.codec.at3p.total_samples = swapbyte32_on_be(uint32_t(numFrames) * At3pSamplesPerFrame);
 
         memcpy(header.codec.at3p.subchunk2_id, "data", 4);
-        header.codec.at3p.subchunk2_size = swapbyte32_on_be(numFrames * frameSize);
+        header.codec.at3p.subchunk2_size = swapbyte32_on_be(unknownLength ? UINT32_MAX : numFrames * frameSize);
 
         if (fwrite(&header, 1, At3pHeaderSize, Fp.get()) != At3pHeaderSize) {
             throw std::runtime_error("Cannot write WAV header to file");
@@ -336,11 +352,11 @@ public:
         }
     }
 
-    virtual void WriteFrame(std::vector<char> data) override {
-        if (data.size() != FrameSize) {
+    virtual void WriteFrame(const char* data, size_t size) override {
+        if (size != FrameSize) {
             throw std::runtime_error("Unexpected ATRAC3plus frame size");
         }
-        if (fwrite(data.data(), 1, data.size(), Fp.get()) != data.size()) {
+        if (fwrite(data, 1, size, Fp.get()) != size) {
             throw std::runtime_error("Cannot write AT3 data to file");
         }
         ++FramesWritten;
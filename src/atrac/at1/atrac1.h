@@ -40,17 +40,21 @@ private:
     const uint32_t BfuIdxConst = 0;
     EWindowMode WindowMode = EWindowMode::EWM_AUTO;
     const uint32_t WindowMask = 0;
+    const uint32_t PipelineDepth = 0;
 public:
     TAtrac1EncodeSettings()
     {}
-    TAtrac1EncodeSettings(uint32_t bfuIdxConst, EWindowMode windowMode, uint32_t windowMask)
+    TAtrac1EncodeSettings(uint32_t bfuIdxConst, EWindowMode windowMode, uint32_t windowMask, uint32_t pipelineDepth = 0)
         : BfuIdxConst(bfuIdxConst)
         , WindowMode(windowMode)
         , WindowMask(windowMask)
+        , PipelineDepth(pipelineDepth)
     {}
     uint32_t GetBfuIdxConst() const { return BfuIdxConst; }
     EWindowMode GetWindowMode() const {return WindowMode; }
     uint32_t GetWindowMask() const {return WindowMask; }
+    // frames queued to bit allocation thread, 0 - no thread
+    uint32_t GetPipelineDepth() const {return PipelineDepth; }
 };
 
 class TAtrac1Data {
@@ -375,7 +375,7 @@ static std::vector<IBitStreamPartEncoder::TPtr> CreateEncParts(uint32_t bfuIdxCo
 }
 
 TAt1BitAlloc::TAt1BitAlloc(ICompressedOutput* container, uint32_t bfuIdxConst) noexcept
-    : Encoder(CreateEncParts(bfuIdxConst))
+    : Encoder(CreateEncParts(bfuIdxConst), TBitStreamEncoder::ESearch::Interpolate)
     , Container(container)
     , BfuIdxConst(bfuIdxConst)
 {
@@ -397,13 +397,13 @@ uint32_t TAt1BitAlloc::Write(const std::vector<TScaledBlock>& scaledBlocks, cons
         bitsPerEachBlock,
     };
 
-    NBitStream::TBitStream bitStream;
+    BitStream.Reset();
 
-    Encoder.Do(&ctx, bitStream);
+    Encoder.Do(&ctx, BitStream);
 
-    std::vector<char> buf = bitStream.GetBytes();
+    const std::vector<char>& buf = BitStream.GetBytes();
 
-    Container->WriteFrame(buf);
+    Container->WriteFrame(buf.data(), buf.size());
 
     return 0;
 }
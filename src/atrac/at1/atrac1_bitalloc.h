@@ -19,6 +19,7 @@
 #pragma once
 #include "atrac1.h"
 #include <atrac/atrac_scale.h>
+#include <bitstream/bitstream.h>
 #include <lib/bs_encode/encode.h>
 #include <compressed_io.h>
 #include <vector>
@@ -50,8 +51,12 @@ class TAt1BitAlloc : public TBitsBooster, public IAtrac1BitAlloc {
 public:
     TAt1BitAlloc(ICompressedOutput* container, uint32_t bfuIdxConst) noexcept;
     uint32_t Write(const std::vector<TScaledBlock>& scaledBlocks, const TAtrac1Data::TBlockSizeMod& blockSize, float loudness) override;
+    const TBitStreamEncoder::TSearchStat& GetSearchStat() const noexcept {
+        return Encoder.GetSearchStat();
+    }
 private:
     TBitStreamEncoder Encoder;
+    NBitStream::TBitStream BitStream;
     ICompressedOutput* Container;
     const uint32_t BfuIdxConst;
 };
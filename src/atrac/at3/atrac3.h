@@ -260,13 +260,14 @@ public:
 struct TAtrac3EncoderSettings {
     TAtrac3EncoderSettings(uint32_t bitrate, bool noGainControll,
                            bool noTonalComponents, uint8_t sourceChannels, uint32_t bfuIdxConst,
-                           std::ostream* yamlLog = nullptr)
+                           std::ostream* yamlLog = nullptr, uint32_t pipelineDepth = 0)
         : ConteinerParams(TAtrac3Data::GetContainerParamsForBitrate(bitrate))
         , NoGainControll(noGainControll)
         , NoTonalComponents(noTonalComponents)
         , SourceChannels(sourceChannels)
         , BfuIdxConst(bfuIdxConst)
         , YamlLog(yamlLog)
+        , PipelineDepth(pipelineDepth)
     { }
     const TContainerParams* ConteinerParams;
     const bool NoGainControll;
@@ -274,6 +275,7 @@ struct TAtrac3EncoderSettings {
     const uint8_t SourceChannels;
     const uint32_t BfuIdxConst;
     std::ostream* YamlLog;  // nullable; gain control debug log (--yaml-log)
+    const uint32_t PipelineDepth; // frames queued to bit allocation thread, 0 - no thread
 };
 
 } // namespace NAtrac3
@@ -80,6 +80,9 @@ struct TEncodeCtx {
     float Spread = 0.0f;
     uint16_t NumBfu = 1;
     uint8_t CodingMode = 1; // 0 - VLC, 1 - CLC
+    // Shift independent part of the allocation, see CalcAllocBase()
+    std::array<float, 32> AllocBase{};
+    uint32_t AudibleBfus = 0;
     std::vector<uint32_t> PrecisionPerBlock = {0};
     std::vector<float> EnergyErr = {0.0f};
     std::array<int, TAtrac3Data::MaxSpecs> Mantissas{};
@@ -153,23 +156,21 @@ uint32_t VLCEnc(const uint32_t selector, const int mantissas[TAtrac3Data::MaxSpe
 // mantissas and their CLC/VLC costs are deterministic, so we compute them once.
 class TAt3SpecUnit : public TUnit {
 public:
-    // TEncCache::TProvideUnit factory: build the unit and quantize `values`.
-    static TUnit* Provide(size_t /*ch*/, size_t bfu, size_t wordlen, const float* values, void*) {
-        auto* u = new TAt3SpecUnit();
+    // TEncCache::TProvideUnit: quantize `values` into the unit.
+    static void Provide(TAt3SpecUnit& u, size_t /*ch*/, size_t bfu, size_t wordlen, const float* values, void*) {
         const uint32_t first = TAtrac3Data::BlockSizeTab[bfu];
         const uint32_t last = TAtrac3Data::BlockSizeTab[bfu + 1];
         const uint32_t blockSize = last - first;
         const float mul = TAtrac3Data::MaxQuant[std::min((uint32_t)wordlen, (uint32_t)7)];
 
-        u->Wordlen = wordlen;
-        u->Multiplier = mul;
-        u->Mantisas.resize(blockSize);
+        u.Wordlen = wordlen;
+        u.Multiplier = mul;
+        u.NumMantisas = blockSize;
         // `ea` (extended/adaptive rounding) depends only on bfu, so it is
         // constant for a given cache key.
-        u->EnergyErr = QuantMantisas(values, 0, blockSize, mul, bfu > LOSY_NAQ_START, u->Mantisas.data());
-        u->ClcBits = CLCEnc(wordlen, u->Mantisas.data(), blockSize, nullptr);
-        u->VlcBits = VLCEnc(wordlen, u->Mantisas.data(), blockSize, nullptr);
-        return u;
+        u.EnergyErr = QuantMantisas(values, 0, blockSize, mul, bfu > LOSY_NAQ_START, u.Mantisas);
+        u.ClcBits = CLCEnc(wordlen, u.Mantisas, blockSize, nullptr);
+        u.VlcBits = VLCEnc(wordlen, u.Mantisas, blockSize, nullptr);
     }
 
     float EnergyErr = 0.0f;
@@ -187,45 +188,6 @@ static size_t MakeAt3SpecKey(size_t /*ch*/, size_t bfu, size_t wordlen) {
 // Upper bound on MakeAt3SpecKey(): bfu < 32, wordlen < 8.
 static constexpr size_t kAt3SpecCacheKeys = 1u << 8;
 
-std::pair<uint8_t, uint32_t> CalcSpecsBitsConsumption(const TAtrac3BitStreamWriter::TSingleChannelElement& sce,
-                                                      const vector<uint32_t>& precisionPerEachBlocks,
-                                                      int* mantisas,
-                                                      vector<float>& energyErr,
-                                                      TEncCache& cache)
-{
-    const vector<TScaledBlock>& scaledBlocks = sce.ScaledBlocks;
-    const uint32_t numBlocks = precisionPerEachBlocks.size();
-    uint32_t bitsUsed = numBlocks * 3;
-
-    // Per-block header (sfi) bits are common to both coding modes; only the
-    // spectrum cost differs. We accumulate the CLC and VLC spectrum costs from
-    // the cached units and pick the cheaper mode once at the end.
-    uint32_t clcSpecBits = 0;
-    uint32_t vlcSpecBits = 0;
-    for (uint32_t i = 0; i < numBlocks; ++i) {
-        if (precisionPerEachBlocks[i] == 0) {
-            continue;
-        }
-        bitsUsed += 6; // sfi
-        const uint32_t first = TAtrac3Data::BlockSizeTab[i];
-        const uint32_t last = TAtrac3Data::BlockSizeTab[i + 1];
-        const uint32_t blockSize = last - first;
-
-        auto* unit = static_cast<TAt3SpecUnit*>(
-            cache.GetOrCompute(0, i, precisionPerEachBlocks[i], scaledBlocks[i].Values.data()));
-
-        // Mirror the cached block-local mantissas into the frame-global array
-        // for the eventual EncodeSpecs() dump.
-        std::copy_n(unit->GetMantisas().data(), blockSize, mantisas + first);
-        energyErr[i] = unit->EnergyErr;
-        clcSpecBits += unit->ClcBits;
-        vlcSpecBits += unit->VlcBits;
-    }
-
-    const bool mode = clcSpecBits <= vlcSpecBits;
-    return std::make_pair(mode, bitsUsed + (mode ? clcSpecBits : vlcSpecBits));
-}
-
 static inline bool CheckBfus(uint16_t* numBfu, const vector<uint32_t>& precisionPerEachBlocks)
 {
     ASSERT(*numBfu);
@@ -269,15 +231,18 @@ float EnergyScaleToScaleFactorOffset(float energyScale)
     return 1.5f * std::log2(SanitizeGainEnergyScale(energyScale));
 }
 
-vector<uint32_t> CalcBitsAllocation(const TAtrac3BitStreamWriter::TSingleChannelElement& sce,
-                                    const uint32_t bfuNum,
-                                    const float spread,
-                                    const float shift,
-                                    const float loudness)
+// The part of CalcBitsAllocation() which does not depend on the shift,
+// computed once per channel. BFUs below the ATH are left out of `audible`.
+void CalcAllocBase(const TAtrac3BitStreamWriter::TSingleChannelElement& sce,
+                   const float spread,
+                   const float loudness,
+                   std::array<float, 32>& base,
+                   uint32_t& audible)
 {
     const std::vector<TScaledBlock>& scaledBlocks = sce.ScaledBlocks;
-    vector<uint32_t> bitsPerEachBlock(bfuNum);
-    for (size_t i = 0; i < bitsPerEachBlock.size(); ++i) {
+    ASSERT(scaledBlocks.size() <= base.size());
+    audible = 0;
+    for (size_t i = 0; i < scaledBlocks.size(); ++i) {
         uint32_t bfuBand = 0;
         for (uint32_t b = 1; b < TAtrac3Data::NumQMF; ++b) {
             if (i >= TAtrac3Data::BlocksPerBand[b]) {
@@ -289,27 +254,46 @@ vector<uint32_t> CalcBitsAllocation(const TAtrac3BitStreamWriter::TSingleChannel
         const float correctedEnergy = scaledBlocks[i].Energy * gainEnergyScale;
         const float ath = ATH[i] * loudness;
 
+        base[i] = 0.0f;
         if (correctedEnergy < ath) {
+            continue;
+        }
+        audible |= 1u << i;
+
+        const uint32_t fix = FixedBitAllocTable[i];
+        float x = 6;
+        if (i < 3) {
+            x = 2.8;
+        } else if (i < 10) {
+            x = 2.6;
+        } else if (i < 15) {
+            x = 3.3;
+        } else if (i <= 20) {
+            x = 3.6;
+        } else if (i <= 28) {
+            x = 4.2;
+        }
+
+        const float correctedScaleFactorIndex = std::max(0.0f, std::min(63.0f,
+            static_cast<float>(scaledBlocks[i].ScaleFactorIndex)
+            + EnergyScaleToScaleFactorOffset(gainEnergyScale)));
+        base[i] = spread * (correctedScaleFactorIndex / x) + (1.0f - spread) * fix;
+    }
+}
+
+void CalcBitsAllocation(const TAtrac3BitStreamWriter::TSingleChannelElement& sce,
+                        const std::array<float, 32>& base,
+                        const uint32_t audible,
+                        const uint32_t bfuNum,
+                        const float shift,
+                        vector<uint32_t>& bitsPerEachBlock)
+{
+    bitsPerEachBlock.resize(bfuNum);
+    for (size_t i = 0; i < bitsPerEachBlock.size(); ++i) {
+        if (!(audible & (1u << i))) {
             bitsPerEachBlock[i] = 0;
         } else {
-            const uint32_t fix = FixedBitAllocTable[i];
-            float x = 6;
-            if (i < 3) {
-                x = 2.8;
-            } else if (i < 10) {
-                x = 2.6;
-            } else if (i < 15) {
-                x = 3.3;
-            } else if (i <= 20) {
-                x = 3.6;
-            } else if (i <= 28) {
-                x = 4.2;
-            }
-
-            const float correctedScaleFactorIndex = std::max(0.0f, std::min(63.0f,
-                static_cast<float>(scaledBlocks[i].ScaleFactorIndex)
-                + EnergyScaleToScaleFactorOffset(gainEnergyScale)));
-            const int tmp = spread * (correctedScaleFactorIndex / x) + (1.0f - spread) * fix - shift;
+            const int tmp = base[i] - shift;
             if (tmp > 7) {
                 bitsPerEachBlock[i] = 7;
             } else if (tmp < 0) {
@@ -331,8 +315,6 @@ vector<uint32_t> CalcBitsAllocation(const TAtrac3BitStreamWriter::TSingleChannel
             }
         }
     }
-
-    return bitsPerEachBlock;
 }
 
 uint32_t GroupTonalComponents(const std::vector<TTonalBlock>& tonalComponents,
@@ -523,6 +505,113 @@ uint16_t EncodeTonalComponents(const TAtrac3BitStreamWriter::TSingleChannelEleme
     return bitsUsed;
 }
 
+// Bit cost of the allocation being searched for one channel. The search
+// moves only a few word lengths per pass, so the per-BFU costs are kept and
+// only BFUs whose word length changed are looked up again (in the TEncCache).
+// The CLC/VLC decision and the tonal component cost follow from the totals.
+class TAllocCost {
+public:
+    // Update to the allocation `precisionPerEachBlocks`, mirror the mantissas
+    // of changed BFUs into `mantisas` and the errors of all of them into
+    // `energyErr`. Returns coding mode (0 - VLC, 1 - CLC) and bits used.
+    std::pair<uint8_t, uint32_t> Update(const TAtrac3BitStreamWriter::TSingleChannelElement& sce,
+                                        const vector<uint32_t>& precisionPerEachBlocks,
+                                        int* mantisas,
+                                        vector<float>& energyErr,
+                                        TEncCache<TAt3SpecUnit>& cache)
+    {
+        const vector<TScaledBlock>& scaledBlocks = sce.ScaledBlocks;
+        const uint32_t numBlocks = precisionPerEachBlocks.size();
+        ASSERT(numBlocks <= MaxBfus);
+
+        if (!Valid) {
+            TonalBfus = 0;
+            for (const TTonalBlock& tc : sce.TonalBlocks) {
+                if (tc.ValPtr->Bfu < MaxBfus) {
+                    TonalBfus |= 1u << tc.ValPtr->Bfu;
+                }
+            }
+        }
+
+        uint32_t changed = Valid ? 0 : ~0u;
+        // BFUs dropped from the tail are not coded any more
+        for (uint32_t i = numBlocks; i < NumBlocks; ++i) {
+            Remove(i);
+            changed |= 1u << i;
+        }
+        NumBlocks = numBlocks;
+
+        for (uint32_t i = 0; i < numBlocks; ++i) {
+            const uint32_t wordlen = precisionPerEachBlocks[i];
+            if (wordlen != Bfus[i].Wordlen) {
+                Remove(i);
+                changed |= 1u << i;
+                if (wordlen) {
+                    const uint32_t first = TAtrac3Data::BlockSizeTab[i];
+                    const uint32_t blockSize = TAtrac3Data::BlockSizeTab[i + 1] - first;
+                    const TAt3SpecUnit& unit = cache.GetOrCompute(0, i, wordlen, scaledBlocks[i].Values.data());
+                    // Mirror the cached block-local mantissas into the frame-global
+                    // array for the eventual EncodeSpecs() dump.
+                    std::copy_n(unit.GetMantisas(), blockSize, mantisas + first);
+                    Bfus[i] = {wordlen, unit.ClcBits, unit.VlcBits, unit.EnergyErr};
+                    Coded++;
+                    ClcSpecBits += unit.ClcBits;
+                    VlcSpecBits += unit.VlcBits;
+                }
+            }
+            energyErr[i] = Bfus[i].EnergyErr;
+        }
+
+        if (changed & TonalBfus) {
+            TonalBits = EncodeTonalComponents(sce, precisionPerEachBlocks, nullptr);
+        } else if (!Valid) {
+            // No tonal components in coded BFUs, the count field only
+            TonalBits = 5;
+        }
+        Valid = true;
+
+        // Per-block header: word length (3 bits), plus sfi (6 bits) if coded.
+        // Only the spectrum cost depends on the coding mode.
+        const uint32_t bitsUsed = TonalBits + numBlocks * 3 + Coded * 6;
+        const bool mode = ClcSpecBits <= VlcSpecBits;
+        return std::make_pair(mode, bitsUsed + (mode ? ClcSpecBits : VlcSpecBits));
+    }
+
+    // Forget the allocation, the next Update() computes everything
+    void Reset() noexcept {
+        *this = TAllocCost();
+    }
+
+private:
+    static constexpr uint32_t MaxBfus = 32;
+
+    struct TBfuCost {
+        uint32_t Wordlen = 0;
+        uint32_t ClcBits = 0;
+        uint32_t VlcBits = 0;
+        float EnergyErr = 0.0f;
+    };
+
+    void Remove(uint32_t i) noexcept {
+        TBfuCost& bfu = Bfus[i];
+        if (bfu.Wordlen) {
+            Coded--;
+            ClcSpecBits -= bfu.ClcBits;
+            VlcSpecBits -= bfu.VlcBits;
+        }
+        bfu = TBfuCost();
+    }
+
+    std::array<TBfuCost, MaxBfus> Bfus{};
+    uint32_t NumBlocks = 0;
+    uint32_t Coded = 0;
+    uint32_t ClcSpecBits = 0;
+    uint32_t VlcSpecBits = 0;
+    uint32_t TonalBits = 0;
+    uint32_t TonalBfus = 0; // mask of BFUs with tonal components
+    bool Valid = false;
+};
+
 void EncodeSpecs(const TAtrac3BitStreamWriter::TSingleChannelElement& sce,
                  NBitStream::TBitStream* bitStream,
                  const vector<uint32_t>& precisionPerEachBlocks,
@@ -600,6 +689,7 @@ public:
 
         if (!ctx->AllocInitDone) {
             ctx->Spread = AnalizeScaleFactorSpread(ctx->Sce->ScaledBlocks);
+            CalcAllocBase(*ctx->Sce, ctx->Spread, ctx->Loudness, ctx->AllocBase, ctx->AudibleBfus);
             ctx->NumBfu = CalcInitialNumBfu(ctx->BfuIdxConst, ctx->TargetBits);
             ctx->AllocInitDone = true;
         }
@@ -627,30 +717,24 @@ public:
         }
 
         const float shift = ba.Continue();
-        vector<uint32_t> tmpAlloc = CalcBitsAllocation(*ctx->Sce,
-                                                       ctx->NumBfu,
-                                                       ctx->Spread,
-                                                       shift,
-                                                       ctx->Loudness);
+        CalcBitsAllocation(*ctx->Sce, ctx->AllocBase, ctx->AudibleBfus, ctx->NumBfu, shift, Alloc);
 
-        ctx->EnergyErr.assign(ctx->NumBfu, 0.0f);
         std::pair<uint8_t, uint32_t> consumption;
         do {
-            consumption = CalcSpecsBitsConsumption(*ctx->Sce, tmpAlloc, ctx->Mantissas.data(),
-                                                   ctx->EnergyErr, SpecCache);
-        } while (ConsiderEnergyErr(ctx->EnergyErr, tmpAlloc));
+            consumption = Cost.Update(*ctx->Sce, Alloc, ctx->Mantissas.data(), ctx->EnergyErr, SpecCache);
+        } while (ConsiderEnergyErr(ctx->EnergyErr, Alloc));
 
-        uint32_t totalBits = consumption.second + EncodeTonalComponents(*ctx->Sce, tmpAlloc, nullptr);
+        const uint32_t totalBits = consumption.second;
 
         if (ba.Submit(totalBits)) {
             if (!ctx->BfuIdxConst && ctx->NumBfu > 1) {
                 uint16_t numBfu = ctx->NumBfu;
-                if (CheckBfus(&numBfu, tmpAlloc)) {
+                if (CheckBfus(&numBfu, Alloc)) {
                     ctx->NumBfu = numBfu;
                     return EStatus::Repeat;
                 }
             }
-            ctx->PrecisionPerBlock = std::move(tmpAlloc);
+            ctx->PrecisionPerBlock = Alloc;
             ctx->CodingMode = consumption.first;
             Ctx = ctx;
         }
@@ -666,6 +750,7 @@ public:
         // The cached quantization results are only valid for the channel/frame
         // just finished; drop them before the next channel reuses this part.
         SpecCache.Reset();
+        Cost.Reset();
     }
 
     void Reset() noexcept override {
@@ -678,7 +763,11 @@ public:
 
 private:
     TEncodeCtx* Ctx = nullptr;
-    TEncCache SpecCache{kAt3SpecCacheKeys, &TAt3SpecUnit::Provide, &MakeAt3SpecKey};
+    TEncCache<TAt3SpecUnit> SpecCache{kAt3SpecCacheKeys, TAtrac3Data::MaxSpecsPerBlock,
+                                      &TAt3SpecUnit::Provide, &MakeAt3SpecKey};
+    TAllocCost Cost;
+    // Word lengths of the current pass, kept to reuse the storage
+    vector<uint32_t> Alloc;
 };
 
 std::vector<IBitStreamPartEncoder::TPtr> CreateEncParts()
@@ -695,7 +784,8 @@ TAtrac3BitStreamWriter::TAtrac3BitStreamWriter(ICompressedOutput* container, con
     : Container(container)
     , Params(params)
     , BfuIdxConst(bfuIdxConst)
-    , Encoder(CreateEncParts())
+    , Encoders{TBitStreamEncoder(CreateEncParts(), TBitStreamEncoder::ESearch::Interpolate),
+               TBitStreamEncoder(CreateEncParts(), TBitStreamEncoder::ESearch::Interpolate)}
 {
     NEnv::SetRoundFloat();
     if (!ATH.empty()) {
@@ -763,7 +853,9 @@ void TAtrac3BitStreamWriter::WriteSoundUnit(const vector<TSingleChannelElement>&
 
     const int halfFrameSz = Params.FrameSz >> 1;
 
-    NBitStream::TBitStream bitStreams[2];
+    NBitStream::TBitStream* bitStreams = BitStreams;
+    bitStreams[0].Reset();
+    bitStreams[1].Reset();
 
     int32_t bitsToAlloc[2] = {-6, -6}; // 6 bits used always to write num blocks and coding mode
                                        // See EncodeSpecs
@@ -818,19 +910,24 @@ void TAtrac3BitStreamWriter::WriteSoundUnit(const vector<TSingleChannelElement>&
         ctx.BfuIdxConst = BfuIdxConst;
         ctx.Loudness = laudness;
 
-        Encoder.Do(&ctx, *bitStream);
+        Encoders[channel].Do(&ctx, *bitStream);
 
         if (!Container)
             abort();
 
-        std::vector<char> channelData = bitStream->GetBytes();
-
-        if (Params.Js && channel == 1) {
-            channelData.resize(halfFrameSz - msBytesShift);
-            OutBuffer.insert(OutBuffer.end(), channelData.rbegin(), channelData.rend());
+        const std::vector<char>& channelData = bitStream->GetBytes();
+
+        // Channel data is zero padded (or truncated) to its part of the frame,
+        // second channel of joint stereo is stored in reverse byte order
+        const bool reversed = Params.Js && channel == 1;
+        const size_t sz = reversed ? halfFrameSz - msBytesShift : halfFrameSz + msBytesShift;
+        const size_t n = std::min(sz, channelData.size());
+        const size_t at = OutBuffer.size();
+        OutBuffer.resize(at + sz, 0);
+        if (reversed) {
+            std::reverse_copy(channelData.begin(), channelData.begin() + n, OutBuffer.begin() + at + sz - n);
         } else {
-            channelData.resize(halfFrameSz + msBytesShift);
-            OutBuffer.insert(OutBuffer.end(), channelData.begin(), channelData.end());
+            std::copy_n(channelData.begin(), n, OutBuffer.begin() + at);
         }
     }
 
@@ -842,7 +939,7 @@ void TAtrac3BitStreamWriter::WriteSoundUnit(const vector<TSingleChannelElement>&
         std::copy_n(OutBuffer.begin(), sz, OutBuffer.begin() + sz);
     }
 
-    Container->WriteFrame(OutBuffer);
+    Container->WriteFrame(OutBuffer.data(), OutBuffer.size());
     OutBuffer.clear();
 }
 
@@ -20,6 +20,7 @@
 #include "atrac3.h"
 #include <compressed_io.h>
 #include <atrac/atrac_scale.h>
+#include <bitstream/bitstream.h>
 #include <lib/bs_encode/encode.h>
 #include <vector>
 #include <utility>
@@ -59,12 +60,19 @@ private:
     ICompressedOutput* Container;
     const TContainerParams Params;
     const uint32_t BfuIdxConst;
-    TBitStreamEncoder Encoder;
+    // One per channel, each lambda search is warm started from the
+    // previous frame of its own channel
+    TBitStreamEncoder Encoders[2];
+    NBitStream::TBitStream BitStreams[2];
     std::vector<char> OutBuffer;
 public:
     TAtrac3BitStreamWriter(ICompressedOutput* container, const TContainerParams& params, uint32_t bfuIdxConst);
 
     void WriteSoundUnit(const std::vector<TSingleChannelElement>& singleChannelElements, float laudness);
+
+    const TBitStreamEncoder::TSearchStat& GetSearchStat(uint32_t channel) const noexcept {
+        return Encoders[channel].GetSearchStat();
+    }
 };
 
 } // namespace NAtrac3
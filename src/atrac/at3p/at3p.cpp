@@ -25,8 +25,10 @@
 #include "at3p_mdct.h"
 #include "at3p_tables.h"
 #include <atrac/atrac_scale.h>
+#include <pipeline.h>
 
 #include <cassert>
+#include <cstring>
 #include <vector>
 #include <unordered_map>
 
@@ -41,11 +43,22 @@ public:
         , ChannelCtx(channels)
         , GhaProcessor(MakeGhaProcessor0(channels == 2, settings.UseGha & TSettings::GHA_WIDEBAND, settings.WidebandRefineMode))
         , Settings(settings)
+        , Sces(channels)
     {
         delay.NumToneBands = 0;
+        if (settings.PipelineDepth) {
+            AllocStage.reset(new TPipelineStage<TAllocJob>(settings.PipelineDepth, [this](TAllocJob& job) {
+                BitStream.WriteFrame(job.Channels, job.HasTonal ? &job.Tonal : nullptr, job.Sces);
+            }));
+        }
     }
 
-    TPCMEngine::EProcessResult EncodeFrame(const float* data, int channels);
+    TPCMEngine::EProcessResult EncodeFrame(const float* data, const TPCMEngine::ProcessMeta& meta);
+
+    void Flush() {
+        if (AllocStage)
+            AllocStage->Flush();
+    }
 private:
     struct TChannelCtx {
         TChannelCtx()
@@ -84,16 +97,30 @@ private:
     std::unique_ptr<IGhaProcessor> GhaProcessor;
     TAt3PGhaData delay;
     const TSettings Settings;
+    // Scaled blocks are refilled in place every frame
+    std::vector<TAt3PBitStream::TSingleChannelElement> Sces;
+
+    struct TAllocJob {
+        int Channels;
+        bool HasTonal;
+        TAt3PGhaData Tonal;
+        std::vector<TAt3PBitStream::TSingleChannelElement> Sces;
+    };
+    // Bit allocation and container write of previous frame run here while
+    // the next frame is analysed. Declared last to be stopped first.
+    std::unique_ptr<TPipelineStage<TAllocJob>> AllocStage;
 };
 
 TPCMEngine::EProcessResult TAt3PEnc::TImpl::
-EncodeFrame(const float* data, int channels)
+EncodeFrame(const float* data, const TPCMEngine::ProcessMeta& meta)
 {
+    const int channels = meta.Channels;
     int needMore = 0;
     for (int ch = 0; ch < channels; ch++) {
         float* src = ChannelCtx[ch].RawNextBuf;
-        for (size_t i = 0; i < NumSamples; ++i) {
-            src[i] = data[i * channels  + ch];
+        const float* in = meta.GetChannel(data, ch, NumSamples, src);
+        if (in != src) {
+            memcpy(src, in, NumSamples * sizeof(float));
         }
 
         at3plus_pqf_do_analyse(ChannelCtx[ch].PqfCtx, src, ChannelCtx[ch].NextBuf);
@@ -132,8 +159,6 @@ EncodeFrame(const float* data, int channels)
 
     const TAt3PGhaData* tonalBlock = GhaProcessor->DoAnalize({b1Cur, b1Next}, {b2Cur, b2Next}, b1Prev, b2Prev, raw1Cur, raw2Cur);
 
-    std::vector<TAt3PBitStream::TSingleChannelElement> sces;
-    sces.resize(channels);
     for (int ch = 0; ch < channels; ch++) {
         float* x = (ch == 0) ? b1Prev : b2Prev;
         auto& c = ChannelCtx[ch];
@@ -154,12 +179,26 @@ EncodeFrame(const float* data, int channels)
             p[b] = tmp + b * 128;
         }
 
-        Mdct.Do(c.Specs.data(), p, c.MdctBuf, sces[ch].SubbandInfo.Win);
+        Mdct.Do(c.Specs.data(), p, c.MdctBuf, Sces[ch].SubbandInfo.Win);
 
-        sces[ch].ScaledBlocks = Scaler.ScaleFrame(c.Specs, NAt3p::TScaleTable::TBlockSizeMod());
+        Scaler.ScaleFrame(c.Specs, NAt3p::TScaleTable::TBlockSizeMod(), Sces[ch].ScaledBlocks);
     }
 
-    BitStream.WriteFrame(channels, p, sces);
+    if (AllocStage) {
+        TAllocJob job;
+        // Elements of a handled frame are filled by the next frame
+        AllocStage->Reclaim(job);
+        job.Channels = channels;
+        job.HasTonal = p != nullptr;
+        if (p)
+            job.Tonal = *p;
+        std::swap(job.Sces, Sces);
+        AllocStage->Push(std::move(job));
+        if (Sces.empty())
+            Sces.resize(channels);
+    } else {
+        BitStream.WriteFrame(channels, p, Sces);
+    }
 
     for (int ch = 0; ch < channels; ch++) {
         if (Settings.UseGha & TSettings::GHA_PASS_INPUT) {
@@ -182,13 +221,20 @@ EncodeFrame(const float* data, int channels)
 TAt3PEnc::TAt3PEnc(TCompressedOutputPtr&& out, int channels, TSettings settings)
     : Out(std::move(out))
     , Channels(channels)
+    , PipelineDepth(settings.PipelineDepth)
     , Impl(new TImpl(Out.get(), Channels, settings))
 {
 }
 
+void TAt3PEnc::Flush() {
+    Impl->Flush();
+    Out->Flush();
+}
+
 TPCMEngine::TProcessLambda TAt3PEnc::GetLambda() {
-    return [this](float* data, const TPCMEngine::ProcessMeta&) {
-        return Impl->EncodeFrame(data, Channels);
+    return [this](float* data, const TPCMEngine::ProcessMeta& meta) {
+        assert(meta.Channels == Channels);
+        return Impl->EncodeFrame(data, meta);
     };
 }
 
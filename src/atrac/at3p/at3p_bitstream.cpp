@@ -25,6 +25,7 @@
 
 #include "ff/atrac3plus_data.h"
 
+#include <algorithm>
 #include <iostream>
 #include <limits>
 #include <memory>
@@ -356,31 +357,28 @@ void TQuantUnitsEncoder::EncodeQuSpectra(const int* qspec, const size_t num_spec
     }
 }
 
-size_t TQuantUnitsEncoder::TUnit::MakeKey(size_t ch, size_t qu, size_t worlen) {
+size_t TQuantUnitsEncoder::MakeKey(size_t ch, size_t qu, size_t worlen) {
+    ASSERT(ch < 2);
     ASSERT(qu < 32);
     ASSERT(worlen < 8);
     return (ch << 8) | (qu << 3) | worlen;
 }
 
-TQuantUnitsEncoder::TUnit::TUnit(size_t qu, size_t wordlen)
-    : Wordlen(wordlen)
-    , Multiplier(1.0f / atrac3p_mant_tab[wordlen])
+void TQuantUnitsEncoder::Provide(TQuUnit& unit, size_t, size_t qu, size_t wordlen, const float* val, void* opaque)
 {
-    Mantisas.resize(TScaleTable::SpecsPerBlock[qu]);
-}
+    auto& tmp = *static_cast<std::vector<std::pair<uint16_t, uint8_t>>*>(opaque);
 
-size_t TQuantUnitsEncoder::TUnit::GetOrCompute(const float* val, std::vector<std::pair<uint16_t, uint8_t>>& res)
-{
-    QuantMantisas(val, 0, Mantisas.size(), Multiplier, false, Mantisas.data());
+    unit.Wordlen = wordlen;
+    unit.Multiplier = 1.0f / atrac3p_mant_tab[wordlen];
+    unit.NumMantisas = TScaleTable::SpecsPerBlock[qu];
 
-    std::vector<std::pair<uint16_t, uint8_t>> tmp;
+    QuantMantisas(val, 0, unit.NumMantisas, unit.Multiplier, false, unit.Mantisas);
 
-    size_t bestTab = 0;
     size_t consumed = std::numeric_limits<size_t>::max();
 
-    for (size_t i = 0, tabIndex = Wordlen - 1; i < 8; i++, tabIndex += 7) {
-
-        EncodeQuSpectra(Mantisas.data(), Mantisas.size(), tabIndex, tmp);
+    for (size_t i = 0, tabIndex = unit.Wordlen - 1; i < 8; i++, tabIndex += 7) {
+        tmp.clear();
+        EncodeQuSpectra(unit.Mantisas, unit.NumMantisas, tabIndex, tmp);
 
         size_t t = std::accumulate(tmp.begin(), tmp.end(), 0,
             [](size_t acc, const std::pair<uint8_t, uint16_t>& x) noexcept -> size_t
@@ -388,58 +386,53 @@ size_t TQuantUnitsEncoder::TUnit::GetOrCompute(const float* val, std::vector<std
 
         if (t < consumed) {
             consumed = t;
-            ConsumedBits = t;
-            bestTab = i;
-            res.clear();
-            res.swap(tmp);
-            tmp.clear();
-        } else {
-            tmp.clear();
+            unit.ConsumedBits = t;
+            unit.BestTab = i;
         }
     }
-    return bestTab;
 }
 
+TQuantUnitsEncoder::TQuantUnitsEncoder()
+    : UnitCache(2 << 8, TScaleTable::SpecsPerBlock[TScaleTable::MaxBfus - 1], &Provide, &MakeKey, &Scratch)
+{}
+
 IBitStreamPartEncoder::EStatus TQuantUnitsEncoder::Encode(void* frameData, TBitAllocHandler&)
 {
     auto specFrame = TSpecFrame::Cast(frameData);
-    std::vector<
-            std::vector<std::pair<uint16_t, uint8_t>>> data;
+    size_t numData = 0;
+    auto nextData = [this, &numData]() -> std::vector<std::pair<uint16_t, uint8_t>>& {
+        if (numData == Data.size()) {
+            Data.emplace_back();
+        }
+        Data[numData].clear();
+        return Data[numData++];
+    };
+
     for (size_t ch = 0; ch < specFrame->Chs.size(); ch++) {
         auto& chData = specFrame->Chs.at(ch);
-        auto scaledBlocks = chData.Sce.ScaledBlocks;
+        const auto& scaledBlocks = chData.Sce.ScaledBlocks;
 
         for (size_t qu = 0; qu < specFrame->NumQuantUnits; qu++) {
             size_t len = (ch == 0) ?
                 specFrame->WordLen.at(qu).first :
                 specFrame->WordLen.at(qu).second;
 
-            size_t key = TUnit::MakeKey(ch, qu, len);
-
-            TUnit* unit;
-            //  try_emplace
-            auto it = UnitBuffers.find(key);
-            if (it == UnitBuffers.end()) {
-                unit = &(UnitBuffers.emplace(key, TUnit(qu, len)).first->second);
-            } else {
-                unit = &it->second;
-            }
-
             const float* values = scaledBlocks.at(qu).Values.data();
+            const TQuUnit& unit = UnitCache.GetOrCompute(ch, qu, len, values);
 
-            data.push_back(std::vector<std::pair<uint16_t, uint8_t>>());
-            auto tabIdx = unit->GetOrCompute(values, data.back());
+            // Only the cheapest table is written
+            EncodeQuSpectra(unit.GetMantisas(), unit.GetNumMantisas(), unit.GetWordlen() - 1 + 7 * unit.BestTab,
+                nextData());
 
             if (ch == 0) {
-                specFrame->SpecTabIdx[qu].first = tabIdx;
+                specFrame->SpecTabIdx[qu].first = unit.BestTab;
             } else {
-                specFrame->SpecTabIdx[qu].second = tabIdx;
+                specFrame->SpecTabIdx[qu].second = unit.BestTab;
             }
         }
         if (true /*frame.NumUsedQuantUnits > 2*/) {
             size_t numPwrSpec = atrac3p_subband_to_num_powgrps[atrac3p_qu_to_subband[specFrame->NumQuantUnits - 1]];
-            data.push_back(std::vector<std::pair<uint16_t, uint8_t>>());
-            auto& t = data.back();
+            auto& t = nextData();
             for (size_t i = 0; i < numPwrSpec; i++) {
                 t.emplace_back(15, 4);
             }
@@ -447,16 +440,17 @@ IBitStreamPartEncoder::EStatus TQuantUnitsEncoder::Encode(void* frameData, TBitA
     }
 
     {
-        std::vector<std::pair<uint16_t, uint8_t>> tabIdxData;
+        std::vector<std::pair<uint16_t, uint8_t>>& tabIdxData = Scratch;
+        tabIdxData.clear();
         EncodeCodeTab(true, specFrame->Chs.size(), specFrame->NumQuantUnits, specFrame->SpecTabIdx, tabIdxData);
         for (size_t i = 0; i < tabIdxData.size(); i++) {
             Insert(tabIdxData[i].first, tabIdxData[i].second);
         }
     }
 
-    for (const auto& x : data) {
-        for (size_t i = 0; i < x.size(); i++) {
-            Insert(x[i].first, x[i].second);
+    for (size_t d = 0; d < numData; d++) {
+        for (const auto& x : Data[d]) {
+            Insert(x.first, x.second);
         }
     }
 
@@ -477,6 +471,8 @@ static std::vector<IBitStreamPartEncoder::TPtr> CreateEncParts()
 
 TAt3PBitStream::TAt3PBitStream(ICompressedOutput* container, uint16_t frameSz)
     : Container(container)
+    // No part runs the lambda search (TBitAllocHandler::Start/Continue), the frame is fitted
+    // by dropping quant units on Repeat, so the search mode of the encoder does not apply
     , Encoder(CreateEncParts())
     , FrameSzToAllocBits((uint32_t)frameSz * 8 - 3) //Size of frame in bits for allocation. 3 bits is start bit and channel configuration
     , FrameSz(frameSz)
@@ -702,7 +698,8 @@ IBitStreamPartEncoder::EStatus TTonalComponentEncoder::Encode(void* frameData, T
 
 void TAt3PBitStream::WriteFrame(int channels, const TAt3PGhaData* tonalBlock, const std::vector<TSingleChannelElement>& sces)
 {
-    NBitStream::TBitStream bitStream;
+    NBitStream::TBitStream& bitStream = BitStream;
+    bitStream.Reset();
     // First bit must be zero
     bitStream.Write(0, 1);
     // Channel block type
@@ -717,12 +714,12 @@ void TAt3PBitStream::WriteFrame(int channels, const TAt3PGhaData* tonalBlock, co
 
     Encoder.Do(&frame, bitStream);
 
-    std::vector<char> buf = bitStream.GetBytes();
-
     ASSERT(bitStream.GetSizeInBits() <= FrameSz * 8);
 
-    buf.resize(FrameSz);
-    Container->WriteFrame(buf);
+    const std::vector<char>& bytes = bitStream.GetBytes();
+    Frame.assign(FrameSz, 0);
+    std::copy_n(bytes.begin(), std::min<size_t>(bytes.size(), FrameSz), Frame.begin());
+    Container->WriteFrame(Frame.data(), Frame.size());
 }
 
 }
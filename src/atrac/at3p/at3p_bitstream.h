@@ -21,6 +21,7 @@
 #include "compressed_io.h"
 #include "at3p_gha.h"
 #include "at3p_mdct.h"
+#include <bitstream/bitstream.h>
 #include <lib/bs_encode/encode.h>
 
 namespace NAtracDEnc {
@@ -60,6 +61,8 @@ public:
 private:
     ICompressedOutput* Container;
     TBitStreamEncoder Encoder;
+    NBitStream::TBitStream BitStream;
+    std::vector<char> Frame;
     const uint32_t FrameSzToAllocBits;
     const uint16_t FrameSz;
 };
@@ -22,6 +22,7 @@
 #include "at3p_bitstream.h"
 #include <lib/bitstream/bitstream.h>
 #include <lib/bs_encode/encode.h>
+#include <atrac/atrac_enc_cache.h>
 #include <atrac/atrac_scale.h>
 #include <vector>
 
@@ -107,32 +108,35 @@ private:
 
 class TQuantUnitsEncoder : public TDumper {
 public:
-    TQuantUnitsEncoder() = default;
+    TQuantUnitsEncoder();
     EStatus Encode(void* frameData, TBitAllocHandler& ba) override;
+    void Dump(NBitStream::TBitStream& bs) override {
+        TDumper::Dump(bs);
+        // Next frame has another spectrum
+        UnitCache.Reset();
+    }
     static void EncodeQuSpectra(const int* qspec, const size_t num_spec, const size_t idx,
         std::vector<std::pair<uint16_t, uint8_t>>& data);
     static void EncodeCodeTab(bool useFullTable, size_t channels,
         size_t numQuantUnits, const std::vector<std::pair<uint8_t, uint8_t>>& specTabIdx,
         std::vector<std::pair<uint16_t, uint8_t>>& data);
 
-private:
-    class TUnit {
-    public:
-        static size_t MakeKey(size_t ch, size_t qu, size_t worlen);
-        TUnit(size_t qu, size_t wordlen);
-        size_t GetOrCompute(const float* val, std::vector<std::pair<uint16_t, uint8_t>>& res);
-        const std::vector<int>& GetMantisas() const { return Mantisas; }
-
-    private:
-        uint32_t Wordlen;
-        float Multiplier;
-        uint16_t ConsumedBits; // Number of bits consumed by QuSpectr
-
-        std::vector<int> Mantisas;
+    struct TQuUnit : public TUnit {
+        uint8_t BestTab = 0; // the cheapest of the 8 spectrum tables for the wordlen
     };
+    const TEncCache<TQuUnit>::TStat& GetCacheStat() const noexcept { return UnitCache.GetStat(); }
+
+private:
+    static size_t MakeKey(size_t ch, size_t qu, size_t worlen);
+    // opaque is the scratch buffer to measure the tables
+    static void Provide(TQuUnit& unit, size_t ch, size_t qu, size_t wordlen, const float* val, void* opaque);
+
+    std::vector<std::pair<uint16_t, uint8_t>> Scratch;
+    // Encoded spectra of the quant units of the current pass, storage is kept
+    std::vector<std::vector<std::pair<uint16_t, uint8_t>>> Data;
     // The key is <ch_id, unit_id, wordlen>
     // will be used to cache unit encoding result duting bit allocation
-    std::map<size_t, TUnit> UnitBuffers;
+    TEncCache<TQuUnit> UnitCache;
 };
 
 class TTonalComponentEncoder : public TDumper {
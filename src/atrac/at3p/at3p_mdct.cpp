@@ -51,10 +51,11 @@ TAt3pMDCT::TAt3pMDCT()
 
 void TAt3pMDCT::Do(float specs[2048], const TPcmBandsData& bands, THistBuf& work, TAt3pMDCTWin winType)
 {
+    const float* in[16];
+    float* out[16];
+
     for (size_t b = 0, flag = 1; b < 16; b++, flag <<= 1) {
         const float* srcBuff = bands[b];
-        float* const curSpec = &specs[b*128];
-
         std::array<float, 256>& tmp = work[b];
 
         if (winType.Flags & flag) {
@@ -70,13 +71,19 @@ void TAt3pMDCT::Do(float specs[2048], const TPcmBandsData& bands, THistBuf& work
                 tmp[128 + i] = SineWin128[127 - i] * srcBuff[i];
             }
         }
+        in[b] = tmp.data();
+        out[b] = &specs[b*128];
+    }
 
-        const vector<float>& sp = Mdct(tmp.data());
+    // All 16 sub-bands at once, straight into the spectrum
+    Mdct(in, out, 16);
 
-        memcpy(curSpec, sp.data(), 128 * sizeof(float));
+    for (size_t b = 0, flag = 1; b < 16; b++, flag <<= 1) {
+        const float* srcBuff = bands[b];
+        std::array<float, 256>& tmp = work[b];
 
         if (b & 1) {
-            SwapArray(curSpec, 128);
+            SwapArray(out[b], 128);
         }
 
         if (winType.Flags & flag) {
@@ -102,17 +109,23 @@ TAt3pMIDCT::TAt3pMIDCT()
 
 void TAt3pMIDCT::Do(float specs[2048], TPcmBandsData& bands, THistBuf& work, TAt3pMDCTWin winType)
 {
-    for (size_t b = 0, flag = 1; b < 16; b++, flag <<= 1) {
-        float* dstBuff = bands[b];
+    const float* in[16];
+    float* out[16];
+    for (size_t b = 0; b < 16; b++) {
         float* const curSpec = &specs[b*128];
-
-        std::array<float, 128>& tmp = work.Buf[b];
-
         if (b & 1) {
             SwapArray(curSpec, 128);
         }
+        in[b] = curSpec;
+        out[b] = Inv[b].data();
+    }
 
-        vector<float> inv  = Midct(curSpec);
+    Midct(in, out, 16);
+
+    for (size_t b = 0, flag = 1; b < 16; b++, flag <<= 1) {
+        float* dstBuff = bands[b];
+        std::array<float, 128>& tmp = work.Buf[b];
+        float* inv = Inv[b].data();
 
         if (work.Win.Flags & flag) {
             memset(&inv[0], 0, sizeof(float) * 32);
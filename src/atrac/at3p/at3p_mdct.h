@@ -22,7 +22,7 @@
 #include <cstdint>
 #include <config.h>
 
-#include "lib/mdct/mdct.h"
+#include "lib/mdct/mdct_batch.h"
 
 namespace NAtracDEnc {
 
@@ -74,7 +74,7 @@ public:
 
     void Do(float specs[2048], const TPcmBandsData& bands, THistBuf& work, TAt3pMDCTWin winType);
 private:
-    NMDCT::TMDCT<256> Mdct;
+    NMDCT::TMDCTBatch<256, 16> Mdct;
 };
 
 class TAt3pMIDCT {
@@ -88,7 +88,8 @@ public:
 
     void Do(float specs[2048], TPcmBandsData& bands, THistBuf& work, TAt3pMDCTWin winType);
 private:
-    NMDCT::TMIDCT<256> Midct;
+    NMDCT::TMIDCTBatch<256, 16> Midct;
+    std::array<std::array<float, 256>, 16> Inv;
 };
 
 }
@@ -47,6 +47,7 @@
  *       src/atrac/at3p/tools/pqf_wideband_calibrate.cpp \
  *       src/atrac/atrac3plus_pqf/atrac3plus_pqf.c \
  *       src/lib/mdct/mdct.cpp \
+ *       src/lib/mdct/mdct_kernels.cpp \
  *       src/lib/fft/kissfft_impl/kiss_fft.c \
  *       -o /tmp/pqf_wideband_calibrate
  *   /tmp/pqf_wideband_calibrate > src/atrac/at3p/at3p_pqf_wideband_table.h
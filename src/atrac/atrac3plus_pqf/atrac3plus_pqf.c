@@ -27,11 +27,17 @@
 #include <stdio.h>
 #include <math.h>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ATDE_PQF_SSE2
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#include <arm_neon.h>
+#define ATDE_PQF_NEON
+#endif
+
 #include "atrac3plus_pqf.h"
 #include "atrac3plus_pqf_data.h"
 
-#include "lib/mdct/dct.h"
-
 /*
  * Number of subbands to split input signal
  */
@@ -44,21 +50,41 @@
  * Size of filter prototype
  */
 #define PROTO_SZ 384
+/*
+ * Number of polyphase components
+ */
+#define PHASES_NUM 32
 
 #define FRAME_SZ ((SUBBANDS_NUM * SUBBAND_SIZE))
 #define OVERLAP_SZ ((PROTO_SZ - SUBBANDS_NUM))
+/*
+ * Frames the analysis window slides over before its overlap is carried
+ * back to the front of the buffer
+ */
+#define BUF_FRAMES 4
+#define BUF_SZ ((OVERLAP_SZ + BUF_FRAMES * FRAME_SZ))
 
-
-static float fir[PROTO_SZ];
+/*
+ * Prototype in [tap][phase] order: the 32 phases of one tap are contiguous,
+ * as are the input samples they are applied to.
+ */
+static float fir_t[ATRAC3P_PQF_FIR_LEN * PHASES_NUM];
+/*
+ * DCT-IV of the folded phases as a matrix, row i holds the contribution of
+ * input i to the 16 subbands (already in output order).
+ */
+static float dct_m[SUBBANDS_NUM * SUBBANDS_NUM];
 
 struct at3plus_pqf_a_ctx {
-    float buf[FRAME_SZ + OVERLAP_SZ];
-    atde_dct_ctx_t dct_ctx;
+    float buf[BUF_SZ];
+    /* start of the current window: overlap followed by the new frame */
+    int pos;
 };
 
 static void init(void)
 {
     static int inited = 0;
+    float fir[PROTO_SZ];
 
     if (inited)
         return;
@@ -76,32 +102,112 @@ static void init(void)
 	    }
         }
     }
-}
 
-static void vectoring(const float* const x, double* y)
-{
-    for (int i = 0; i < 32; i++) {
-        y[i] = 0;
+    for (int i = 0; i < PHASES_NUM; i++) {
         for (int j = 0; j < ATRAC3P_PQF_FIR_LEN; j++) {
-            y[i] += fir[i * 12 + j] * x[j * 32 + i];
+            fir_t[j * PHASES_NUM + i] = fir[i * 12 + j];
         }
     }
+
+    /* The DCT-IV scaled by 128 * 512, in double */
+    for (int i = 0; i < SUBBANDS_NUM; i++) {
+        for (int k = 0; k < SUBBANDS_NUM; k++) {
+            dct_m[i * SUBBANDS_NUM + k] = 128 * 512.0 * cos(M_PI / SUBBANDS_NUM * (i + 0.5) * (k + 0.5));
+        }
+    }
+}
+
+#if defined(ATDE_PQF_SSE2)
+typedef __m128 vec4;
+static inline vec4 v_load(const float* p) { return _mm_loadu_ps(p); }
+static inline void v_store(float* p, vec4 v) { _mm_storeu_ps(p, v); }
+static inline vec4 v_add(vec4 a, vec4 b) { return _mm_add_ps(a, b); }
+static inline vec4 v_mul(vec4 a, vec4 b) { return _mm_mul_ps(a, b); }
+static inline vec4 v_set1(float x) { return _mm_set1_ps(x); }
+static inline vec4 v_rev(vec4 v) { return _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 1, 2, 3)); }
+#define ATDE_PQF_SIMD
+#elif defined(ATDE_PQF_NEON)
+typedef float32x4_t vec4;
+static inline vec4 v_load(const float* p) { return vld1q_f32(p); }
+static inline void v_store(float* p, vec4 v) { vst1q_f32(p, v); }
+static inline vec4 v_add(vec4 a, vec4 b) { return vaddq_f32(a, b); }
+static inline vec4 v_mul(vec4 a, vec4 b) { return vmulq_f32(a, b); }
+static inline vec4 v_set1(float x) { return vdupq_n_f32(x); }
+static inline vec4 v_rev(vec4 v) {
+    v = vrev64q_f32(v);
+    return vcombine_f32(vget_high_f32(v), vget_low_f32(v));
 }
+#define ATDE_PQF_SIMD
+#endif
 
-static void matrixing(atde_dct_ctx_t ctx, const double* y, float* samples )
+/*
+ * One 16 sample step: polyphase vectoring over the 384 taps, folding of the
+ * 32 phases and the DCT-IV. samples[i * SUBBAND_SIZE] receives subband i.
+ */
+static void analyse_step(const float* x, float* samples)
 {
     float yy[SUBBANDS_NUM];
     float res[SUBBANDS_NUM];
 
+#ifdef ATDE_PQF_SIMD
+    vec4 y[PHASES_NUM / 4];
+
+    for (int v = 0; v < PHASES_NUM / 4; v++) {
+        y[v] = v_set1(0.0f);
+    }
+    for (int j = 0; j < ATRAC3P_PQF_FIR_LEN; j++) {
+        const float* f = fir_t + j * PHASES_NUM;
+        const float* s = x + j * PHASES_NUM;
+        for (int v = 0; v < PHASES_NUM / 4; v++) {
+            y[v] = v_add(y[v], v_mul(v_load(f + 4 * v), v_load(s + 4 * v)));
+        }
+    }
+
+    /* yy[i] = y[i + 8] + y[7 - i], yy[i + 8] = y[i + 16] + y[31 - i] */
+    v_store(yy + 0,  v_add(y[2], v_rev(y[1])));
+    v_store(yy + 4,  v_add(y[3], v_rev(y[0])));
+    v_store(yy + 8,  v_add(y[4], v_rev(y[7])));
+    v_store(yy + 12, v_add(y[5], v_rev(y[6])));
+
+    /* Four partial sums, added pairwise: the error of a 16 term float sum
+     * would exceed the one of the MDCT based DCT-IV */
+    for (int v = 0; v < SUBBANDS_NUM / 4; v++) {
+        vec4 p[4];
+        for (int q = 0; q < 4; q++) {
+            p[q] = v_set1(0.0f);
+        }
+        for (int i = 0; i < SUBBANDS_NUM; i++) {
+            p[i & 3] = v_add(p[i & 3], v_mul(v_load(dct_m + i * SUBBANDS_NUM + 4 * v), v_set1(yy[i])));
+        }
+        v_store(res + 4 * v, v_add(v_add(p[0], p[1]), v_add(p[2], p[3])));
+    }
+#else
+    float y[PHASES_NUM] = {0};
+
+    for (int j = 0; j < ATRAC3P_PQF_FIR_LEN; j++) {
+        const float* f = fir_t + j * PHASES_NUM;
+        const float* s = x + j * PHASES_NUM;
+        for (int i = 0; i < PHASES_NUM; i++) {
+            y[i] += f[i] * s[i];
+        }
+    }
+
     for (int i = 0; i < 8; i++) {
         yy[i] = y[i + 8] + y[7 - i];
         yy[i + 8] = y[i + 16] + y[31 - i];
     }
 
-    atde_do_dct4_16(ctx, yy, res);
+    for (int k = 0; k < SUBBANDS_NUM; k++) {
+        float p[4] = {0};
+        for (int i = 0; i < SUBBANDS_NUM; i++) {
+            p[i & 3] += dct_m[i * SUBBANDS_NUM + k] * yy[i];
+        }
+        res[k] = (p[0] + p[1]) + (p[2] + p[3]);
+    }
+#endif
 
     for (int i = 0; i < SUBBANDS_NUM; i++) {
-        samples[i * SUBBAND_SIZE] = res[SUBBANDS_NUM - 1 - i];
+        samples[i * SUBBAND_SIZE] = res[i];
     }
 }
 
@@ -109,11 +215,10 @@ at3plus_pqf_a_ctx_t at3plus_pqf_create_a_ctx()
 {
     at3plus_pqf_a_ctx_t ctx = (at3plus_pqf_a_ctx_t)malloc(sizeof(struct at3plus_pqf_a_ctx));
 
-    for (int i = 0; i < FRAME_SZ + OVERLAP_SZ; i++) {
+    for (int i = 0; i < BUF_SZ; i++) {
         ctx->buf[i] = 0.0;
     }
-
-    ctx->dct_ctx = atde_create_dct4_16(128 * 512.0);
+    ctx->pos = 0;
 
     init();
 
@@ -122,26 +227,25 @@ at3plus_pqf_a_ctx_t at3plus_pqf_create_a_ctx()
 
 void at3plus_pqf_free_a_ctx(at3plus_pqf_a_ctx_t ctx)
 {
-    atde_free_dct_ctx(ctx->dct_ctx);
-
     free(ctx);
 }
 
 void at3plus_pqf_do_analyse(at3plus_pqf_a_ctx_t ctx, const float* in, float* out)
 {
-    double y[SUBBANDS_NUM * 2];
-
-    float* const buf = ctx->buf;
+    float* const buf = ctx->buf + ctx->pos;
 
     const float* x = buf;
 
     memcpy(buf + OVERLAP_SZ, in, sizeof(in[0]) * FRAME_SZ);
 
     for (int i = 0; i < SUBBAND_SIZE; i++) {
-        vectoring(x, y);
-        matrixing (ctx->dct_ctx, y, &out[i]);
+        analyse_step(x, &out[i]);
         x += SUBBANDS_NUM;
     }
 
-    memcpy(buf, buf + FRAME_SZ, sizeof(buf[0]) * OVERLAP_SZ);
+    ctx->pos += FRAME_SZ;
+    if (ctx->pos + FRAME_SZ + OVERLAP_SZ > BUF_SZ) {
+        memcpy(ctx->buf, ctx->buf + ctx->pos, sizeof(buf[0]) * OVERLAP_SZ);
+        ctx->pos = 0;
+    }
 }
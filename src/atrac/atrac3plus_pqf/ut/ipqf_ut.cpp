@@ -19,6 +19,7 @@
 #include "atrac3plusdsp.h"
 #include "../atrac3plus_pqf.h"
 #include "../atrac3plus_pqf_data.h"
+#include "lib/mdct/dct.h"
 
 #include <gtest/gtest.h>
 
@@ -27,7 +28,9 @@
 #include <string.h>
 #include <math.h>
 
+#include <algorithm>
 #include <cstdlib>
+#include <vector>
 
 #define SAMPLES 8192
 
@@ -306,3 +309,73 @@ TEST(pqf, Noise_Long) {
     at3plus_pqf_free_a_ctx(actx);
 }
 
+
+// The original analysis: double accumulators and the DCT-IV through the MDCT
+static void ref_analyse(float* buf, atde_dct_ctx_t dct, const float* in, float* out) {
+    float fir[384];
+    for (int i = 0; i < 16; i++) {
+        for (int j = 0; j < ATRAC3P_PQF_FIR_LEN; j++) {
+            if (i >= 8) {
+                fir[j + 96  + (i - 8) * 12] = ff_ipqf_coeffs1[j][i];
+                fir[j + 288 + (i - 8) * 12] = ff_ipqf_coeffs2[j][i];
+            } else {
+                fir[j + 192 + i * 12] = ff_ipqf_coeffs2[j][i];
+                fir[j + 0   + i * 12] = ff_ipqf_coeffs1[j][i];
+            }
+        }
+    }
+
+    memcpy(buf + 368, in, sizeof(float) * 2048);
+    for (int n = 0; n < 128; n++) {
+        const float* x = buf + n * 16;
+        double y[32];
+        for (int i = 0; i < 32; i++) {
+            y[i] = 0;
+            for (int j = 0; j < ATRAC3P_PQF_FIR_LEN; j++) {
+                y[i] += fir[i * 12 + j] * x[j * 32 + i];
+            }
+        }
+        float yy[16];
+        float res[16];
+        for (int i = 0; i < 8; i++) {
+            yy[i] = y[i + 8] + y[7 - i];
+            yy[i + 8] = y[i + 16] + y[31 - i];
+        }
+        atde_do_dct4_16(dct, yy, res);
+        for (int i = 0; i < 16; i++) {
+            out[i * 128 + n] = res[15 - i];
+        }
+    }
+    memcpy(buf, buf + 2048, sizeof(float) * 368);
+}
+
+// Single precision accumulation: every subband sample must stay within
+// 1e-6 of the peak subband magnitude of the double precision analysis.
+TEST(pqf, FloatMatchesDouble) {
+    float x[8192];
+    for (int i = 0; i < 8192; i++)
+        x[i] = (float)rand() / (float)RAND_MAX - 0.5 + 0.3 * sinf(i * 0.37);
+    create_chirp(4096, x + 4096);
+
+    at3plus_pqf_a_ctx_t actx = at3plus_pqf_create_a_ctx();
+    atde_dct_ctx_t dct = atde_create_dct4_16(128 * 512.0);
+    std::vector<float> refBuf(2048 + 368);
+
+    for (int f = 0; f < 4; f++) {
+        float subbands[2048];
+        float ref[2048];
+        at3plus_pqf_do_analyse(actx, x + f * 2048, subbands);
+        ref_analyse(refBuf.data(), dct, x + f * 2048, ref);
+
+        float peak = 0;
+        for (int i = 0; i < 2048; i++)
+            peak = std::max(peak, fabsf(ref[i]));
+        ASSERT_GT(peak, 0.0f);
+        for (int i = 0; i < 2048; i++) {
+            EXPECT_NEAR(subbands[i], ref[i], 1e-6 * peak) << "frame " << f << " sample " << i;
+        }
+    }
+
+    atde_free_dct_ctx(dct);
+    at3plus_pqf_free_a_ctx(actx);
+}
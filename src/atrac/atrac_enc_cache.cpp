@@ -20,32 +20,18 @@
 
 namespace NAtracDEnc {
 
-TEncCache::TEncCache(size_t numKeys, TProvideUnit provideUnit, TMakeKey makeKey, void* opaque)
-    : UnitBuffers(numKeys)
-    , ProvideUnit(provideUnit)
-    , MakeKey(makeKey)
-    , Opaque(opaque)
+TMantisaArena::TMantisaArena(size_t slotSize)
+    : SlotSize(slotSize)
 {
 }
 
-TUnit* TEncCache::GetOrCompute(size_t ch, size_t bfu, size_t wordlen, const float* values)
+int* TMantisaArena::Take()
 {
-    const size_t key = MakeKey(ch, bfu, wordlen);
-
-    std::unique_ptr<TUnit>& slot = UnitBuffers[key];
-    if (!slot) {
-        slot.reset(ProvideUnit(ch, bfu, wordlen, values, Opaque));
-    }
-
-    return slot.get();
-}
-
-void TEncCache::Reset()
-{
-    // Keep the vector sized; just drop the cached units for the next frame.
-    for (std::unique_ptr<TUnit>& slot : UnitBuffers) {
-        slot.reset();
+    const size_t chunk = Used / SlotsPerChunk;
+    if (chunk == Chunks.size()) {
+        Chunks.emplace_back(new int[SlotsPerChunk * SlotSize]);
     }
+    return Chunks[chunk].get() + (Used++ % SlotsPerChunk) * SlotSize;
 }
 
 } // namespace NAtracDEnc
@@ -25,31 +25,50 @@
 
 namespace NAtracDEnc {
 
-// Codec-agnostic base for a single cached encoding unit (BFU / quant unit).
+// Codec-agnostic part of a single cached encoding unit (BFU / quant unit).
 //
-// A codec subclasses TUnit and quantizes the scaled spectrum into Mantisas,
-// filling the bookkeeping fields needed to later write the unit into the
-// stream. The actual computation lives in the user-supplied ProvideUnit
-// factory (see TEncCache) so the cached hot path carries no extra virtual
-// dispatch. The result is produced once per cache lifetime for a given key
-// and then reused across the bit-allocation search.
+// A codec derives its unit from TUnit and adds the bookkeeping fields needed
+// to later write the unit into the stream. The actual computation lives in
+// the user-supplied ProvideUnit function (see TEncCache), which quantizes
+// the scaled spectrum into the mantissa slot the cache hands out. The result
+// is produced once per cache generation for a given key and then reused
+// across the bit-allocation search.
 class TUnit {
 public:
-    virtual ~TUnit() = default;
-
-    const std::vector<int>& GetMantisas() const { return Mantisas; }
+    const int* GetMantisas() const { return Mantisas; }
+    uint32_t GetNumMantisas() const { return NumMantisas; }
     uint32_t GetWordlen() const { return Wordlen; }
     float GetMultiplier() const { return Multiplier; }
     uint16_t GetConsumedBits() const { return ConsumedBits; }
 
-protected:
     // Info needed to write the unit into the stream after encoding.
-    std::vector<int> Mantisas;
+    int* Mantisas = nullptr; // slot of the cache arena, valid until Reset()
+    uint32_t NumMantisas = 0;
     uint32_t Wordlen = 0;
     float Multiplier = 1.0f;
     uint16_t ConsumedBits = 0; // Number of bits consumed by the quantized spectrum
 };
 
+// Mantissa storage of one cache generation: fixed capacity slots handed
+// out in order. Chunks of slots are kept on Reset(), so once the arena has
+// grown to the largest frame no further allocation happens, and slots never
+// move while the generation lasts.
+class TMantisaArena {
+public:
+    explicit TMantisaArena(size_t slotSize);
+
+    int* Take();
+    void Reset() noexcept { Used = 0; }
+
+    size_t GetSlotSize() const noexcept { return SlotSize; }
+
+private:
+    static constexpr size_t SlotsPerChunk = 32;
+    const size_t SlotSize;
+    std::vector<std::unique_ptr<int[]>> Chunks;
+    size_t Used = 0;
+};
+
 // Caches per-unit encoding results during the bit-allocation search.
 //
 // Within a single frame the scaled spectrum of a given (ch, bfu, wordlen)
@@ -58,38 +77,84 @@ protected:
 // computes each one once.
 //
 // The key space is small and dense, so units are stored in a vector that is
-// directly indexed by a user-supplied key function (nullptr slot == not yet
-// computed) rather than in a std::map.
+// directly indexed by a user-supplied key function. A unit is valid if it
+// was computed in the current generation, so Reset() only bumps the
+// generation and rewinds the arena.
+template<class TUnitType>
 class TEncCache {
 public:
-    // Build the right TUnit subclass for this key and quantize `values` into
-    // it. Invoked only on a cache miss. `opaque` carries user context
-    // (e.g. scale tables / per-frame data).
-    using TProvideUnit = TUnit* (*)(size_t ch, size_t bfu, size_t wordlen,
-                                    const float* values, void* opaque);
+    // Fill `unit` for this key, quantizing `values` into unit.Mantisas
+    // (GetSlotSize() ints). Invoked only on a cache miss. `opaque` carries
+    // user context (e.g. scale tables / scratch buffers).
+    using TProvideUnit = void (*)(TUnitType& unit, size_t ch, size_t bfu, size_t wordlen,
+                                  const float* values, void* opaque);
 
     // Pack (ch, bfu, wordlen) into a dense vector index. Codec specific.
     using TMakeKey = size_t (*)(size_t ch, size_t bfu, size_t wordlen);
 
-    // `numKeys` is the upper bound on MakeKey() values; the backing vector is
-    // sized once to it. ProvideUnit/MakeKey must agree on this bound.
-    TEncCache(size_t numKeys, TProvideUnit provideUnit, TMakeKey makeKey, void* opaque = nullptr);
+    struct TStat {
+        uint64_t Hits = 0;
+        uint64_t Misses = 0;
+    };
+
+    // `numKeys` is the upper bound on MakeKey() values, `slotSize` on the
+    // number of mantissas of a unit.
+    TEncCache(size_t numKeys, size_t slotSize, TProvideUnit provideUnit, TMakeKey makeKey,
+              void* opaque = nullptr)
+        : Entries(numKeys)
+        , Arena(slotSize)
+        , ProvideUnit(provideUnit)
+        , MakeKey(makeKey)
+        , Opaque(opaque)
+    {}
 
     TEncCache(const TEncCache&) = delete;
     TEncCache& operator=(const TEncCache&) = delete;
 
-    // Return the cached unit for (ch, bfu, wordlen), creating and computing
-    // it via ProvideUnit on the first request.
-    TUnit* GetOrCompute(size_t ch, size_t bfu, size_t wordlen, const float* values);
+    // Return the cached unit for (ch, bfu, wordlen), computing it via
+    // ProvideUnit on the first request of the generation.
+    const TUnitType& GetOrCompute(size_t ch, size_t bfu, size_t wordlen, const float* values) {
+        TEntry& entry = Entries[MakeKey(ch, bfu, wordlen)];
+        if (entry.Generation == Generation) {
+            Stat.Hits++;
+            return entry.Unit;
+        }
+        Stat.Misses++;
+        entry.Generation = Generation;
+        entry.Unit = TUnitType();
+        entry.Unit.Mantisas = Arena.Take();
+        ProvideUnit(entry.Unit, ch, bfu, wordlen, values, Opaque);
+        return entry.Unit;
+    }
 
     // Drop all cached units. Call at frame boundaries.
-    void Reset();
+    void Reset() noexcept {
+        Arena.Reset();
+        if (++Generation == 0) {
+            // Wrapped around, entries of the old generation 1 would look valid
+            for (TEntry& entry : Entries) {
+                entry.Generation = 0;
+            }
+            Generation = 1;
+        }
+    }
+
+    size_t GetSlotSize() const noexcept { return Arena.GetSlotSize(); }
+    const TStat& GetStat() const noexcept { return Stat; }
 
 private:
-    std::vector<std::unique_ptr<TUnit>> UnitBuffers; // direct-indexed by MakeKey()
+    struct TEntry {
+        uint32_t Generation = 0;
+        TUnitType Unit;
+    };
+
+    std::vector<TEntry> Entries; // direct-indexed by MakeKey()
+    TMantisaArena Arena;
+    uint32_t Generation = 1;
     TProvideUnit ProvideUnit;
     TMakeKey MakeKey;
     void* Opaque;
+    TStat Stat;
 };
 
 } // namespace NAtracDEnc
@@ -0,0 +1,100 @@
+/*
+ * This file is part of AtracDEnc.
+ *
+ * AtracDEnc is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * AtracDEnc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with AtracDEnc; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+
+#include "atrac_enc_cache.h"
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+using namespace NAtracDEnc;
+
+namespace {
+
+struct TTestUnit : public TUnit {
+    float Sum = 0.0f;
+};
+
+size_t Provided = 0;
+
+void ProvideTestUnit(TTestUnit& unit, size_t, size_t bfu, size_t wordlen, const float* values, void*) {
+    Provided++;
+    unit.Wordlen = wordlen;
+    unit.NumMantisas = bfu + 1;
+    for (size_t i = 0; i < unit.NumMantisas; i++) {
+        unit.Mantisas[i] = values[i] * wordlen;
+        unit.Sum += values[i];
+    }
+}
+
+size_t MakeTestKey(size_t ch, size_t bfu, size_t wordlen) {
+    return (ch * 4 + bfu) * 8 + wordlen;
+}
+
+} // namespace
+
+TEST(TEncCache, HitsWithinGeneration) {
+    TEncCache<TTestUnit> cache(2 * 4 * 8, 4, &ProvideTestUnit, &MakeTestKey);
+    const std::vector<float> values = {1.0f, 2.0f, 3.0f, 4.0f};
+    Provided = 0;
+
+    const TTestUnit& a = cache.GetOrCompute(0, 3, 2, values.data());
+    EXPECT_EQ(a.GetNumMantisas(), 4);
+    EXPECT_EQ(a.GetMantisas()[3], 8);
+    EXPECT_EQ(a.Sum, 10.0f);
+
+    EXPECT_EQ(&cache.GetOrCompute(0, 3, 2, values.data()), &a);
+    cache.GetOrCompute(1, 3, 2, values.data());
+    cache.GetOrCompute(0, 3, 5, values.data());
+
+    EXPECT_EQ(Provided, 3);
+    EXPECT_EQ(cache.GetStat().Hits, 1);
+    EXPECT_EQ(cache.GetStat().Misses, 3);
+}
+
+TEST(TEncCache, ResetStartsNewGeneration) {
+    TEncCache<TTestUnit> cache(2 * 4 * 8, 4, &ProvideTestUnit, &MakeTestKey);
+    std::vector<float> values = {1.0f, 2.0f, 3.0f, 4.0f};
+    Provided = 0;
+
+    std::vector<const int*> slots;
+    for (size_t bfu = 0; bfu < 4; bfu++) {
+        for (size_t wl = 0; wl < 8; wl++) {
+            slots.push_back(cache.GetOrCompute(1, bfu, wl, values.data()).GetMantisas());
+        }
+    }
+
+    cache.Reset();
+    values[0] = -1.0f;
+    const TTestUnit& u = cache.GetOrCompute(1, 3, 2, values.data());
+    EXPECT_EQ(Provided, 33);
+    // Fresh unit, computed from the new values
+    EXPECT_EQ(u.GetMantisas()[0], -2);
+    EXPECT_EQ(u.Sum, 8.0f);
+
+    // The arena is rewound, the mantissas go to the first slot again
+    EXPECT_EQ(u.GetMantisas(), slots[0]);
+    for (size_t bfu = 0; bfu < 4; bfu++) {
+        for (size_t wl = 0; wl < 8; wl++) {
+            cache.GetOrCompute(0, bfu, wl, values.data());
+        }
+    }
+    EXPECT_EQ(cache.GetStat().Misses, 65);
+    EXPECT_EQ(cache.GetStat().Hits, 0);
+}
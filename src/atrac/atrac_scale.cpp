@@ -21,14 +21,25 @@
 #include "at3/atrac3.h"
 #include "atrac/at3p/at3p_tables.h"
 #include "util.h"
+#include <lib/plan_registry/plan_registry.h>
 #include <cmath>
+#include <cstring>
 #include <iostream>
 #include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ATDE_SCALE_SSE2
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#include <arm_neon.h>
+#define ATDE_SCALE_NEON
+#endif
 
 namespace NAtracDEnc {
 
 using std::vector;
-using std::map;
 
 using std::cerr;
 using std::endl;
@@ -37,94 +48,282 @@ using std::abs;
 
 static constexpr float MAX_SCALE = 1.0;
 
+namespace {
+
+// Values with the magnitude of 1 or more are stored as +-Clip
+const float Clip = 0.99999;
+
+#if defined(ATDE_SCALE_SSE2)
+struct TVec {
+    typedef __m128 T;
+    static constexpr size_t W = 4;
+    static T Load(const float* p) { return _mm_loadu_ps(p); }
+    static void Store(float* p, T v) { _mm_storeu_ps(p, v); }
+    static T Add(T a, T b) { return _mm_add_ps(a, b); }
+    static T Sub(T a, T b) { return _mm_sub_ps(a, b); }
+    static T Mul(T a, T b) { return _mm_mul_ps(a, b); }
+    // For |v| < 2^31
+    static T Trunc(T v) { return _mm_cvtepi32_ps(_mm_cvttps_epi32(v)); }
+    static T Div(T a, T b) { return _mm_div_ps(a, b); }
+    static T Max(T a, T b) { return _mm_max_ps(a, b); }
+    // Rounds to nearest even as lrint does, stores the integers and returns them as floats
+    static T RoundToInt(T v, int* p) {
+        const __m128i i = _mm_cvtps_epi32(v);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p), i);
+        return _mm_cvtepi32_ps(i);
+    }
+    static T Abs(T v) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), v); }
+    static T Set1(float x) { return _mm_set1_ps(x); }
+    static float MaxAcross(T v) {
+        v = _mm_max_ps(v, _mm_movehl_ps(v, v));
+        v = _mm_max_ss(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1)));
+        return _mm_cvtss_f32(v);
+    }
+    // +-Clip where |v| >= 1
+    static T Saturate(T v) {
+        const T sign = _mm_set1_ps(-0.0f);
+        const T over = _mm_cmpge_ps(_mm_andnot_ps(sign, v), _mm_set1_ps(1.0f));
+        const T clip = _mm_or_ps(_mm_and_ps(v, sign), _mm_set1_ps(Clip));
+        return _mm_or_ps(_mm_and_ps(over, clip), _mm_andnot_ps(over, v));
+    }
+};
+#elif defined(ATDE_SCALE_NEON)
+struct TVec {
+    typedef float32x4_t T;
+    static constexpr size_t W = 4;
+    static T Load(const float* p) { return vld1q_f32(p); }
+    static void Store(float* p, T v) { vst1q_f32(p, v); }
+    static T Add(T a, T b) { return vaddq_f32(a, b); }
+    static T Sub(T a, T b) { return vsubq_f32(a, b); }
+    static T Mul(T a, T b) { return vmulq_f32(a, b); }
+    static T Trunc(T v) { return vcvtq_f32_s32(vcvtq_s32_f32(v)); }
+#if defined(__aarch64__)
+    static T RoundToInt(T v, int* p) {
+        const int32x4_t i = vcvtnq_s32_f32(v);
+        vst1q_s32(p, i);
+        return vcvtq_f32_s32(i);
+    }
+    static T Div(T a, T b) { return vdivq_f32(a, b); }
+#else
+    static T Div(T a, T b) {
+        float x[4], y[4];
+        vst1q_f32(x, a);
+        vst1q_f32(y, b);
+        for (int i = 0; i < 4; i++)
+            x[i] /= y[i];
+        return vld1q_f32(x);
+    }
+    static T RoundToInt(T v, int* p) {
+        float x[4];
+        vst1q_f32(x, v);
+        for (int i = 0; i < 4; i++) {
+            p[i] = ToInt(x[i]);
+            x[i] = p[i];
+        }
+        return vld1q_f32(x);
+    }
+#endif
+    static T Max(T a, T b) { return vmaxq_f32(a, b); }
+    static T Abs(T v) { return vabsq_f32(v); }
+    static T Set1(float x) { return vdupq_n_f32(x); }
+    static float MaxAcross(T v) {
+        const float32x2_t m = vpmax_f32(vget_low_f32(v), vget_high_f32(v));
+        return vget_lane_f32(vpmax_f32(m, m), 0);
+    }
+    static T Saturate(T v) {
+        const uint32x4_t over = vcgeq_f32(vabsq_f32(v), vdupq_n_f32(1.0f));
+        const T clip = vbslq_f32(vdupq_n_u32(0x80000000u), v, vdupq_n_f32(Clip));
+        return vbslq_f32(over, clip, v);
+    }
+};
+#else
+struct TVec {
+    typedef float T;
+    static constexpr size_t W = 1;
+    static T Load(const float* p) { return *p; }
+    static void Store(float* p, T v) { *p = v; }
+    static T Add(T a, T b) { return a + b; }
+    static T Sub(T a, T b) { return a - b; }
+    static T Mul(T a, T b) { return a * b; }
+    static T Trunc(T v) { return std::trunc(v); }
+    static T Div(T a, T b) { return a / b; }
+    static T RoundToInt(T v, int* p) {
+        *p = ToInt(v);
+        return *p;
+    }
+    static T Max(T a, T b) { return std::max(a, b); }
+    static T Abs(T v) { return std::abs(v); }
+    static T Set1(float x) { return x; }
+    static float MaxAcross(T v) { return v; }
+    static T Saturate(T v) { return std::abs(v) >= 1.0f ? (v > 0 ? Clip : -Clip) : v; }
+};
+#endif
+
+float Peak(const float* in, size_t len) {
+    size_t i = 0;
+    float peak = 0;
+    if (len >= TVec::W) {
+        TVec::T m = TVec::Set1(0.0f);
+        for (; i + TVec::W <= len; i += TVec::W) {
+            m = TVec::Max(m, TVec::Abs(TVec::Load(in + i)));
+        }
+        peak = TVec::MaxAcross(m);
+    }
+    for (; i < len; i++) {
+        peak = std::max(peak, std::abs(in[i]));
+    }
+    return peak;
+}
+
+// in / scale, saturated to +-Clip. Only for blocks whose peak fits the scale.
+void ScaleValues(const float* in, size_t len, float scale, float* out) {
+    size_t i = 0;
+    const TVec::T s = TVec::Set1(scale);
+    for (; i + TVec::W <= len; i += TVec::W) {
+        TVec::Store(out + i, TVec::Saturate(TVec::Div(TVec::Load(in + i), s)));
+    }
+    for (; i < len; i++) {
+        const float v = in[i] / scale;
+        out[i] = std::abs(v) >= 1.0f ? (v > 0 ? Clip : -Clip) : v;
+    }
+}
+
+uint32_t FloatExp(float x) {
+    uint32_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    return (bits >> 23) & 0xff;
+}
+
+// Quantisation works on chunks of this size in stack buffers
+constexpr uint32_t QuantChunk = 128;
+
+struct TQuantCandidate {
+    float AbsDelta;
+    uint32_t Pos;
+    // Closest to the rounding midpoint first, then by position
+    bool operator<(const TQuantCandidate& other) const {
+        return AbsDelta != other.AbsDelta ? AbsDelta > other.AbsDelta : Pos > other.Pos;
+    }
+};
+
+// Mantissas of in[0, len) times mul, to mantisas[0, len). Adds the energy
+// of the input and of the dequantised mantissas to e1 and e2, element by
+// element in order as the scalar loop does. ts receives in * mul and
+// absDelta, if given, the distance of it from the rounding midpoint.
+void QuantChunkTerms(const float* in, uint32_t len, float mul, float inv2, int* mantisas,
+                     float* ts, float* absDelta, float& e1, float& e2) {
+    float e1Terms[QuantChunk];
+    float e2Terms[QuantChunk];
+    uint32_t i = 0;
+    const TVec::T m = TVec::Set1(mul);
+    const TVec::T d = TVec::Set1(inv2);
+    for (; i + TVec::W <= len; i += TVec::W) {
+        const TVec::T v = TVec::Load(in + i);
+        const TVec::T t = TVec::Mul(v, m);
+        TVec::Store(ts + i, t);
+        const TVec::T q = TVec::RoundToInt(t, mantisas + i);
+        TVec::Store(e1Terms + i, TVec::Mul(v, v));
+        // q * q is exact up to the rounding of the integer square to float
+        TVec::Store(e2Terms + i, TVec::Mul(TVec::Mul(q, q), d));
+        if (absDelta) {
+            TVec::Store(absDelta + i, TVec::Abs(TVec::Sub(t, TVec::Add(TVec::Trunc(t), TVec::Set1(0.5f)))));
+        }
+    }
+    for (; i < len; i++) {
+        ts[i] = in[i] * mul;
+        mantisas[i] = ToInt(ts[i]);
+        e1Terms[i] = in[i] * in[i];
+        e2Terms[i] = mantisas[i] * mantisas[i] * inv2;
+        if (absDelta) {
+            absDelta[i] = std::abs(ts[i] - (std::trunc(ts[i]) + 0.5f));
+        }
+    }
+    for (i = 0; i < len; i++) {
+        e1 += e1Terms[i];
+        e2 += e2Terms[i];
+    }
+}
+
+} // namespace
+
 float QuantMantisas(const float* in, const uint32_t first, const uint32_t last, const float mul, bool ea, int* const mantisas)
 {
     float e1 = 0.0;
     float e2 = 0.0;
 
     const float inv2 = 1.0 / (mul * mul);
+    const uint32_t len = last - first;
 
-    if (!ea) {
-        for (uint32_t j = 0, f = first; f < last; f++, j++) {
-            float t = in[j] * mul;
-            e1 += in[j] * in[j];
-            mantisas[f] = ToInt(t);
-            e2 += mantisas[f] * mantisas[f] * inv2;
+    float ts[QuantChunk];
+    if (!ea || len > QuantChunk) {
+        for (uint32_t j = 0; j < len; j += QuantChunk) {
+            QuantChunkTerms(in + j, std::min(len - j, QuantChunk), mul, inv2, mantisas + first + j, ts, nullptr, e1, e2);
         }
-        return e1 / e2;
+        if (!ea) {
+            return e1 / e2;
+        }
+        // Longer than any block of the codecs, refinement below needs ts of the whole block
+        throw std::runtime_error("QuantMantisas: energy adjustment of a block longer than 128 values");
     }
 
-    std::vector<std::pair<float, int>> candidates;
-    candidates.reserve(last - first);
-
-    for (uint32_t j = 0, f = first; f < last; f++, j++) {
-        float t = in[j] * mul;
-        e1 += in[j] * in[j];
-        mantisas[f] = ToInt(t);
-        e2 += mantisas[f] * mantisas[f] * inv2;
+    float absDelta[QuantChunk];
+    QuantChunkTerms(in, len, mul, inv2, mantisas + first, ts, absDelta, e1, e2);
 
-        float delta = t - (std::truncf(t) + 0.5f);
-        // 0 ... 0.25 ... 0.5 ... 0.75 ... 1
-        //        ^----------------^ candidates to be rounded to opposite side
-        // to decrease overall energy error in the band
-        if (std::abs(delta) < 0.25f) {
-            candidates.push_back({delta, f});
+    // 0 ... 0.25 ... 0.5 ... 0.75 ... 1
+    //        ^----------------^ candidates to be rounded to opposite side
+    // to decrease overall energy error in the band
+    TQuantCandidate candidates[QuantChunk];
+    uint32_t numCandidates = 0;
+    for (uint32_t j = 0; j < len; j++) {
+        if (absDelta[j] < 0.25f) {
+            candidates[numCandidates++] = {absDelta[j], j};
         }
     }
 
-    if (candidates.empty()) {
+    if (numCandidates == 0 || e1 == e2) {
         return e1 / e2;
     }
 
-    static auto cmp = [](const std::pair<float, int>& a, const std::pair<float, int>& b) {
-        return std::abs(a.first) < std::abs(b.first);
-    };
-
-    std::sort(candidates.begin(), candidates.end(), cmp);
-
-    if (e2 < e1) {
-        for (const auto& x : candidates) {
-            auto f = x.second;
-            auto j = f - first;
-            auto t = in[j] * mul;
-            if (static_cast<float>(std::abs(mantisas[f])) < std::abs(t) && static_cast<float>(std::abs(mantisas[f])) < (mul - 1)) {
-                int m = mantisas[f];
-                if (m > 0) m++;
-                if (m < 0) m--;
-                if (m == 0) m = t > 0 ? 1 : -1;
-                auto ex = e2;
-                ex -= mantisas[f] * mantisas[f] * inv2;
-                ex += m * m * inv2;
-                if (std::abs(ex - e1) < std::abs(e2 - e1)) {
-                    mantisas[f] = m;
-                    e2 = ex;
-                }
-            }
+    // Candidates are taken in order from a heap, so the walk stops without
+    // sorting the rest once no change can bring e2 closer to e1: every
+    // change moves e2 by at least inv2 and is accepted only if that is less
+    // than twice the remaining error. Slack bounds the rounding of ex.
+    TQuantCandidate* const end = candidates + numCandidates;
+    std::make_heap(candidates, end);
+    const bool up = e2 < e1;
+    for (TQuantCandidate* heapEnd = end; heapEnd != candidates; --heapEnd) {
+        const float slack = 16 * std::numeric_limits<float>::epsilon() * (e1 + e2 + 4);
+        // Past e1 a further step in the same direction only moves away
+        const bool crossed = up ? e2 > e1 : e2 < e1;
+        if (inv2 > slack && (crossed || 2 * std::abs(e2 - e1) + slack < inv2)) {
+            break;
         }
-        return e1 / e2;
-    }
-
-    if (e2 > e1) {
-        for (const auto& x : candidates) {
-            auto f = x.second;
-            auto j = f - first;
-            auto t = in[j] * mul;
-            if (static_cast<float>(std::abs(mantisas[f])) > std::abs(t)) {
-                auto m = mantisas[f];
-                if (m > 0) m--;
-                if (m < 0) m++;
-
-                auto ex = e2;
-                ex -= mantisas[f] * mantisas[f] * inv2;
-                ex += m * m * inv2;
-
-                if (std::abs(ex - e1) < std::abs(e2 - e1)) {
-                    mantisas[f] = m;
-                    e2 = ex;
-                }
+        std::pop_heap(candidates, heapEnd);
+        const uint32_t j = heapEnd[-1].Pos;
+        const uint32_t f = first + j;
+        const float t = ts[j];
+        int m = mantisas[f];
+        if (up) {
+            if (!(static_cast<float>(std::abs(m)) < std::abs(t) && static_cast<float>(std::abs(m)) < (mul - 1))) {
+                continue;
+            }
+            if (m > 0) m++;
+            if (m < 0) m--;
+            if (m == 0) m = t > 0 ? 1 : -1;
+        } else {
+            if (!(static_cast<float>(std::abs(m)) > std::abs(t))) {
+                continue;
             }
+            if (m > 0) m--;
+            if (m < 0) m++;
+        }
+        float ex = e2;
+        ex -= mantisas[f] * mantisas[f] * inv2;
+        ex += m * m * inv2;
+        if (std::abs(ex - e1) < std::abs(e2 - e1)) {
+            mantisas[f] = m;
+            e2 = ex;
         }
-        return e1 / e2;
     }
     return e1 / e2;
 }
@@ -132,58 +331,103 @@ float QuantMantisas(const float* in, const uint32_t first, const uint32_t last,
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 template<class TBaseData>
-TScaler<TBaseData>::TScaler() {
-    for (int i = 0; i < 64; i++) {
-        ScaleIndex[TBaseData::ScaleTable[i]] = i;
-    }
+TScaler<TBaseData>::TScaler()
+    : ExpIndexPlan(TPlanRegistry::Get<vector<uint8_t>>("scale_exp_index",
+        static_cast<const float*>(TBaseData::ScaleTable), [] {
+            // The codec data fills its static tables on construction
+            const TBaseData data;
+            (void)data;
+            // Peaks do not exceed MAX_SCALE, exponents up to its one are enough.
+            // Entry e is the first scale not below 2^(e - 127), the smallest
+            // float with the exponent e.
+            const float* table = TBaseData::ScaleTable;
+            vector<uint8_t> index(FloatExp(MAX_SCALE) + 1);
+            for (size_t e = 0; e < index.size(); e++) {
+                const float low = e ? std::ldexp(1.0f, (int)e - 127) : 0.0f;
+                index[e] = std::lower_bound(table, table + 63, low) - table;
+            }
+            return index;
+        }))
+    , ExpIndex(ExpIndexPlan->data())
+{
 }
 
+// Smallest scale not below the peak, ScaleTable is sorted
 template<class TBaseData>
-TScaledBlock TScaler<TBaseData>::Scale(const float* in, uint16_t len) {
-    float maxAbsSpec = 0;
-    for (uint16_t i = 0; i < len; ++i) {
-        const float absSpec = abs(in[i]);
-        if (absSpec > maxAbsSpec) {
-            maxAbsSpec = absSpec;
-        }
+uint8_t TScaler<TBaseData>::FindScaleIndex(float peak) const {
+    // NaN has the largest exponent
+    uint8_t i = ExpIndex[std::min(FloatExp(peak), FloatExp(MAX_SCALE))];
+    while (i < 63 && TBaseData::ScaleTable[i] < peak) {
+        i++;
     }
-    if (maxAbsSpec > MAX_SCALE) {
+    return i;
+}
+
+template<class TBaseData>
+void TScaler<TBaseData>::Scale(const float* in, uint16_t len, TScaledBlock& res) {
+    float maxAbsSpec = Peak(in, len);
+    const bool overflow = maxAbsSpec > MAX_SCALE;
+    if (overflow) {
         cerr << "Scale error: absSpec > MAX_SCALE, val: " << maxAbsSpec << endl;
         maxAbsSpec = MAX_SCALE;
     }
-    const map<float, uint8_t>::const_iterator scaleIter = ScaleIndex.lower_bound(maxAbsSpec);
-    const float scaleFactor = scaleIter->first;
-    const uint8_t scaleFactorIndex = scaleIter->second;
-    TScaledBlock res(scaleFactorIndex);
-    res.Energy = 0.0;
+    res.ScaleFactorIndex = FindScaleIndex(maxAbsSpec);
+    const float scaleFactor = TBaseData::ScaleTable[res.ScaleFactorIndex];
+    // Kept sequential, bit allocation compares it against fixed thresholds
+    float energy = 0.0;
+    for (uint16_t i = 0; i < len; ++i) {
+        energy += in[i] * in[i];
+    }
+    res.Energy = energy;
+    res.Values.resize(len);
+    if (!overflow) {
+        ScaleValues(in, len, scaleFactor, res.Values.data());
+        return;
+    }
     for (uint16_t i = 0; i < len; ++i) {
         float scaledValue = in[i] / scaleFactor;
-        float energy = in[i] * in[i];
-        res.Energy += energy;
         if (abs(scaledValue) >= 1.0) {
             if (abs(scaledValue) > 1.0) {
                 cerr << "clipping, scaled value: "<< scaledValue << endl;
             }
-            scaledValue = (scaledValue > 0) ? 0.99999 : -0.99999;
+            scaledValue = (scaledValue > 0) ? Clip : -Clip;
         }
-        res.Values.push_back(scaledValue);
+        res.Values[i] = scaledValue;
     }
+}
+
+template<class TBaseData>
+TScaledBlock TScaler<TBaseData>::Scale(const float* in, uint16_t len) {
+    TScaledBlock res;
+    Scale(in, len, res);
     return res;
 }
 
 template<class TBaseData>
-vector<TScaledBlock> TScaler<TBaseData>::ScaleFrame(const vector<float>& specs, const typename TBaseData::TBlockSizeMod& blockSize) {
-    vector<TScaledBlock> scaledBlocks;
-    scaledBlocks.reserve(TBaseData::MaxBfus);
+void TScaler<TBaseData>::ScaleFrame(const vector<float>& specs, const typename TBaseData::TBlockSizeMod& blockSize,
+                                    vector<TScaledBlock>& scaledBlocks) {
+    size_t n = 0;
+    for (uint8_t bandNum = 0; bandNum < TBaseData::NumQMF; ++bandNum) {
+        n += TBaseData::BlocksPerBand[bandNum + 1] - TBaseData::BlocksPerBand[bandNum];
+    }
+    scaledBlocks.resize(n);
+    n = 0;
     for (uint8_t bandNum = 0; bandNum < TBaseData::NumQMF; ++bandNum) {
         const bool shortWinMode = blockSize.ShortWin(bandNum);
 
         for (uint8_t blockNum = TBaseData::BlocksPerBand[bandNum]; blockNum < TBaseData::BlocksPerBand[bandNum + 1]; ++blockNum) {
             const uint16_t specNumStart = shortWinMode ? TBaseData::SpecsStartShort[blockNum] :
                                                          TBaseData::SpecsStartLong[blockNum];
-            scaledBlocks.emplace_back(Scale(&specs[specNumStart], TBaseData::SpecsPerBlock[blockNum]));
+            Scale(&specs[specNumStart], TBaseData::SpecsPerBlock[blockNum], scaledBlocks[n++]);
         }
     }
+}
+
+template<class TBaseData>
+vector<TScaledBlock> TScaler<TBaseData>::ScaleFrame(const vector<float>& specs, const typename TBaseData::TBlockSizeMod& blockSize) {
+    vector<TScaledBlock> scaledBlocks;
+    scaledBlocks.reserve(TBaseData::MaxBfus);
+    ScaleFrame(specs, blockSize, scaledBlocks);
     return scaledBlocks;
 }
 
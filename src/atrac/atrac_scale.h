@@ -19,27 +19,42 @@
 #pragma once
 #include <array>
 #include <vector>
-#include <map>
+#include <memory>
 #include <cstdint>
 
 namespace NAtracDEnc {
 
+// Rounds in[0, last - first) * mul to mantisas[first, last) and returns the
+// ratio of the input energy to the energy of the quantised values. ea moves
+// values close to the rounding midpoint to the other side while that brings
+// the energies closer, for blocks of up to 128 values.
 float QuantMantisas(const float* in, uint32_t first, uint32_t last, float mul, bool ea, int* mantisas);
 
 struct TScaledBlock {
+    TScaledBlock() = default;
     TScaledBlock(uint8_t sfi) : ScaleFactorIndex(sfi) {}
     /* const */ uint8_t ScaleFactorIndex = 0;
     std::vector<float> Values;
-    float Energy;
+    float Energy = 0;
 };
 
 template <class TBaseData>
 class TScaler {
-    std::map<float, uint8_t> ScaleIndex;
+    // First ScaleTable index to try for each float exponent of the block
+    // peak, shared by all scalers of the codec
+    std::shared_ptr<const std::vector<uint8_t>> ExpIndexPlan;
+    const uint8_t* const ExpIndex;
+    uint8_t FindScaleIndex(float peak) const;
 public:
     TScaler();
     TScaledBlock Scale(const float* in, uint16_t len);
+    // Reuses the Values storage of res
+    void Scale(const float* in, uint16_t len, TScaledBlock& res);
     std::vector<TScaledBlock> ScaleFrame(const std::vector<float>& specs, const typename TBaseData::TBlockSizeMod& blockSize);
+    // Same as above, into a frame kept by the caller: no allocation once
+    // the blocks have grown to the frame size
+    void ScaleFrame(const std::vector<float>& specs, const typename TBaseData::TBlockSizeMod& blockSize,
+                    std::vector<TScaledBlock>& scaledBlocks);
 };
 
 } //namespace NAtracDEnc
@@ -17,11 +17,112 @@
  */
 
 #include "atrac_scale.h"
+#include "at1/atrac1.h"
+#include "at3p/at3p_tables.h"
+#include "util.h"
 
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
 using namespace NAtracDEnc;
 
+// The sort based version the quantiser started from
+static float RefQuantMantisas(const float* in, const uint32_t first, const uint32_t last, const float mul, bool ea, int* const mantisas)
+{
+    float e1 = 0.0;
+    float e2 = 0.0;
+
+    const float inv2 = 1.0 / (mul * mul);
+
+    if (!ea) {
+        for (uint32_t j = 0, f = first; f < last; f++, j++) {
+            float t = in[j] * mul;
+            e1 += in[j] * in[j];
+            mantisas[f] = ToInt(t);
+            e2 += mantisas[f] * mantisas[f] * inv2;
+        }
+        return e1 / e2;
+    }
+
+    std::vector<std::pair<float, int>> candidates;
+    candidates.reserve(last - first);
+
+    for (uint32_t j = 0, f = first; f < last; f++, j++) {
+        float t = in[j] * mul;
+        e1 += in[j] * in[j];
+        mantisas[f] = ToInt(t);
+        e2 += mantisas[f] * mantisas[f] * inv2;
+
+        float delta = t - (std::truncf(t) + 0.5f);
+        // 0 ... 0.25 ... 0.5 ... 0.75 ... 1
+        //        ^----------------^ candidates to be rounded to opposite side
+        // to decrease overall energy error in the band
+        if (std::abs(delta) < 0.25f) {
+            candidates.push_back({delta, f});
+        }
+    }
+
+    if (candidates.empty()) {
+        return e1 / e2;
+    }
+
+    static auto cmp = [](const std::pair<float, int>& a, const std::pair<float, int>& b) {
+        return std::abs(a.first) < std::abs(b.first);
+    };
+
+    // Ties by position, std::sort leaves their order unspecified
+    std::stable_sort(candidates.begin(), candidates.end(), cmp);
+
+    if (e2 < e1) {
+        for (const auto& x : candidates) {
+            auto f = x.second;
+            auto j = f - first;
+            auto t = in[j] * mul;
+            if (static_cast<float>(std::abs(mantisas[f])) < std::abs(t) && static_cast<float>(std::abs(mantisas[f])) < (mul - 1)) {
+                int m = mantisas[f];
+                if (m > 0) m++;
+                if (m < 0) m--;
+                if (m == 0) m = t > 0 ? 1 : -1;
+                auto ex = e2;
+                ex -= mantisas[f] * mantisas[f] * inv2;
+                ex += m * m * inv2;
+                if (std::abs(ex - e1) < std::abs(e2 - e1)) {
+                    mantisas[f] = m;
+                    e2 = ex;
+                }
+            }
+        }
+        return e1 / e2;
+    }
+
+    if (e2 > e1) {
+        for (const auto& x : candidates) {
+            auto f = x.second;
+            auto j = f - first;
+            auto t = in[j] * mul;
+            if (static_cast<float>(std::abs(mantisas[f])) > std::abs(t)) {
+                auto m = mantisas[f];
+                if (m > 0) m--;
+                if (m < 0) m++;
+
+                auto ex = e2;
+                ex -= mantisas[f] * mantisas[f] * inv2;
+                ex += m * m * inv2;
+
+                if (std::abs(ex - e1) < std::abs(e2 - e1)) {
+                    mantisas[f] = m;
+                    e2 = ex;
+                }
+            }
+        }
+        return e1 / e2;
+    }
+    return e1 / e2;
+}
+
 TEST(Quant, SaveEnergyLost) {
     struct TTestData {
         const std::vector<float> In;
@@ -65,3 +166,102 @@ TEST(Quant, SaveEnergyLost) {
         std::cerr << "(e1): " << e1 << " (e2): " << e2 << " (e2-e1) " << e2 - e1 << " (e2/e1) " << e2 / e1 << std::endl;
     }
 }
+
+// Scale factor: the smallest table entry not below the block peak,
+// values are in / scale with magnitudes of 1 and above saturated
+template<class TBaseData>
+static void CheckScale(const std::vector<float>& in) {
+    TScaler<TBaseData> scaler;
+    const float* table = TBaseData::ScaleTable;
+    float peak = 0;
+    float energy = 0;
+    for (float x : in) {
+        peak = std::max(peak, std::abs(x));
+        energy += x * x;
+    }
+    const uint8_t expected = std::lower_bound(table, table + 63, peak) - table;
+
+    TScaledBlock block;
+    scaler.Scale(in.data(), in.size(), block);
+    ASSERT_EQ(block.ScaleFactorIndex, expected) << "peak " << peak;
+    EXPECT_EQ(block.Energy, energy);
+    ASSERT_EQ(block.Values.size(), in.size());
+    for (size_t i = 0; i < in.size(); i++) {
+        float v = in[i] / table[expected];
+        if (std::abs(v) >= 1.0f)
+            v = v > 0 ? 0.99999 : -0.99999;
+        EXPECT_EQ(block.Values[i], v);
+    }
+}
+
+TEST(TScaler, DirectIndexMatchesSearch) {
+    NAtrac1::TAtrac1Data data;
+    uint32_t seed = 1;
+    for (int n = 0; n < 2000; n++) {
+        // len 4..20 to cover the scalar tail, peaks over the whole table range
+        std::vector<float> in(4 + n % 17);
+        const float amp = std::pow(2.0f, -(float)(n % 25)) * ((n % 3) ? 1.0f : 0.7937f);
+        for (auto& x : in) {
+            seed = seed * 1664525u + 1013904223u;
+            x = amp * ((int32_t)seed / 2147483648.0f);
+        }
+        CheckScale<NAtrac1::TAtrac1Data>(in);
+        CheckScale<NAt3p::TScaleTable>(in);
+    }
+    // exactly on the table and the upper limit
+    for (int i = 0; i < 64; i++) {
+        CheckScale<NAtrac1::TAtrac1Data>({0.0f, -NAtrac1::TAtrac1Data::ScaleTable[i], 0.0f, 0.0f});
+        CheckScale<NAt3p::TScaleTable>({NAt3p::TScaleTable::ScaleTable[i], 0.0f, 0.0f, 0.0f, 0.5f * NAt3p::TScaleTable::ScaleTable[i]});
+    }
+    CheckScale<NAtrac1::TAtrac1Data>({0.0f, 0.0f, 0.0f, 0.0f});
+}
+
+TEST(TScaler, FrameReusesBlocks) {
+    NAtrac1::TAtrac1Data data;
+    TScaler<NAtrac1::TAtrac1Data> scaler;
+    std::vector<float> specs(512);
+    for (size_t i = 0; i < specs.size(); i++) {
+        specs[i] = std::sin(i * 0.37f) * 0.5f / (1 + i / 32);
+    }
+    const NAtrac1::TAtrac1Data::TBlockSizeMod blockSize;
+    const std::vector<TScaledBlock> expected = scaler.ScaleFrame(specs, blockSize);
+
+    std::vector<TScaledBlock> frame;
+    scaler.ScaleFrame(specs, blockSize, frame);
+    const float* first = frame[0].Values.data();
+    scaler.ScaleFrame(specs, blockSize, frame);
+    EXPECT_EQ(frame[0].Values.data(), first);
+    ASSERT_EQ(frame.size(), expected.size());
+    for (size_t i = 0; i < frame.size(); i++) {
+        EXPECT_EQ(frame[i].ScaleFactorIndex, expected[i].ScaleFactorIndex);
+        EXPECT_EQ(frame[i].Values, expected[i].Values);
+        EXPECT_EQ(frame[i].Energy, expected[i].Energy);
+    }
+}
+
+TEST(Quant, MatchesReference) {
+    uint32_t seed = 7;
+    const float muls[] = {1.5f, 3.5f, 7.5f, 15.5f, 31.5f, 63.5f, 127.5f, 255.5f, 32767.5f};
+    for (int n = 0; n < 3000; n++) {
+        const uint32_t len = 1 + n % 128;
+        const uint32_t first = n % 5;
+        std::vector<float> in(len);
+        for (auto& x : in) {
+            seed = seed * 1664525u + 1013904223u;
+            x = (int32_t)seed / 2147483648.0f;
+        }
+        const float mul = muls[n % 9];
+        for (bool ea : {false, true}) {
+            std::vector<int> expected(first + len, -1000);
+            std::vector<int> mantisas(first + len, -1000);
+            const float re = RefQuantMantisas(in.data(), first, first + len, mul, ea, expected.data());
+            const float r = QuantMantisas(in.data(), first, first + len, mul, ea, mantisas.data());
+            ASSERT_EQ(mantisas, expected) << "len " << len << " mul " << mul << " ea " << ea;
+            if (std::isnan(re)) {
+                EXPECT_TRUE(std::isnan(r));
+            } else {
+                EXPECT_EQ(r, re);
+            }
+        }
+    }
+}
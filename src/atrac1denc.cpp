@@ -16,6 +16,7 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include <array>
 #include <vector>
 
 #include "atrac1denc.h"
@@ -40,11 +41,22 @@ TAtrac1Encoder::TAtrac1Encoder(TCompressedOutputPtr&& aea, TAtrac1EncodeSettings
     , PcmBufMid({{{0}}})
     , PcmBufHi({{{0}}})
     , LoudnessCurve(CreateLoudnessCurve(TAtrac1Data::NumSamples))
+    , TransientDetector(2, {{16, 128, false}, {16, 128, true}, {16, 256, true}})
 {
 }
 
+void TAtrac1Encoder::Flush()
+{
+    if (AllocStage)
+        AllocStage->Flush();
+    Aea->Flush();
+}
+
 TAtrac1Decoder::TAtrac1Decoder(TCompressedInputPtr&& aea)
     : Aea(std::move(aea))
+    , PcmBufLow()
+    , PcmBufMid()
+    , PcmBufHi()
 {
 }
 
@@ -68,6 +80,12 @@ static void vector_fmul_window(float *dst, const float *src0,
 }
 
 void TAtrac1MDCT::Mdct(float Specs[512], float* low, float* mid, float* hi, const TAtrac1Data::TBlockSizeMod& blockSize) {
+    // Short blocks of all bands are transformed together at the end
+    const float* shortIn[MaxShortBlocks];
+    float* shortOut[MaxShortBlocks];
+    uint32_t shortBand[MaxShortBlocks];
+    size_t numShort = 0;
+
     uint32_t pos = 0;
     for (uint32_t band = 0; band < TAtrac1Data::NumQMF; band++) {
         const uint32_t numMdctBlocks = 1 << blockSize.LogCount[band];
@@ -75,33 +93,76 @@ void TAtrac1MDCT::Mdct(float Specs[512], float* low, float* mid, float* hi, cons
         uint32_t bufSz = (band == 2) ? 256 : 128;
         const uint32_t blockSz = (numMdctBlocks == 1) ? bufSz : 32;
         uint32_t winStart = (numMdctBlocks == 1) ? ((band == 2) ? 112 : 48) : 0;
-        //compensate level for 3rd band in case of short window
-        const float multiple = (numMdctBlocks != 1 && band == 2) ? 2.0 : 1.0;
-        vector<float> tmp(512);
+        std::array<float, 512> longBuf{};
         uint32_t blockPos = 0;
 
         for (size_t k = 0; k < numMdctBlocks; ++k) {
+            float* tmp = (numMdctBlocks == 1) ? longBuf.data() : ShortBuf[numShort];
             memcpy(&tmp[winStart], &srcBuf[bufSz], 32 * sizeof(float));
             for (size_t i = 0; i < 32; i++) {
                 srcBuf[bufSz + i] = TAtrac1Data::SineWindow[i] * srcBuf[blockPos + blockSz - 32 + i];
                 srcBuf[blockPos + blockSz - 32 + i] = TAtrac1Data::SineWindow[31 - i] * srcBuf[blockPos + blockSz - 32 + i];
             }
             memcpy(&tmp[winStart+32], &srcBuf[blockPos], blockSz * sizeof(float));
-            const vector<float>&  sp = (numMdctBlocks == 1) ? ((band == 2) ? Mdct512(&tmp[0]) : Mdct256(&tmp[0])) : Mdct64(&tmp[0]);
-            for (size_t i = 0; i < sp.size(); i++) {
-                Specs[blockPos + pos + i] = sp[i] * multiple;
-            }
-            if (band) {
-                SwapArray(&Specs[blockPos + pos], sp.size());
+            if (numMdctBlocks == 1) {
+                const vector<float>& sp = (band == 2) ? Mdct512(&tmp[0]) : Mdct256(&tmp[0]);
+                memcpy(&Specs[pos], sp.data(), sp.size() * sizeof(float));
+                if (band) {
+                    SwapArray(&Specs[pos], sp.size());
+                }
+            } else {
+                shortIn[numShort] = tmp;
+                shortOut[numShort] = &Specs[blockPos + pos];
+                shortBand[numShort] = band;
+                numShort++;
             }
 
             blockPos += 32;
         }
         pos += bufSz;
     }
+
+    Mdct64(shortIn, shortOut, numShort);
+    for (size_t k = 0; k < numShort; k++) {
+        //compensate level for 3rd band in case of short window
+        if (shortBand[k] == 2) {
+            for (size_t i = 0; i < 32; i++) {
+                shortOut[k][i] *= 2.0f;
+            }
+        }
+        if (shortBand[k]) {
+            SwapArray(shortOut[k], 32);
+        }
+    }
 }
+
 void TAtrac1MDCT::IMdct(float Specs[512], const TAtrac1Data::TBlockSizeMod& mode, float* low, float* mid, float* hi) {
+    const float* shortIn[MaxShortBlocks];
+    float* shortOut[MaxShortBlocks];
+    size_t numShort = 0;
+
     uint32_t pos = 0;
+    for (size_t band = 0; band < TAtrac1Data::NumQMF; band++) {
+        const uint32_t numMdctBlocks = 1 << mode.LogCount[band];
+        const uint32_t bufSz = (band == 2) ? 256 : 128;
+        if (numMdctBlocks == 1) {
+            pos += bufSz;
+            continue;
+        }
+        for (uint32_t block = 0; block < numMdctBlocks; block++) {
+            if (band) {
+                SwapArray(&Specs[pos], 32);
+            }
+            shortIn[numShort] = &Specs[pos];
+            shortOut[numShort] = ShortBuf[numShort];
+            numShort++;
+            pos += 32;
+        }
+    }
+    Midct64(shortIn, shortOut, numShort);
+
+    numShort = 0;
+    pos = 0;
     for (size_t band = 0; band < TAtrac1Data::NumQMF; band++) {
         const uint32_t numMdctBlocks = 1 << mode.LogCount[band];
         const uint32_t bufSz = (band == 2) ? 256 : 128;
@@ -110,15 +171,23 @@ void TAtrac1MDCT::IMdct(float Specs[512], const TAtrac1Data::TBlockSizeMod& mode
 
         float* dstBuf = (band == 0) ? low : (band == 1) ? mid : hi;
 
-        vector<float> invBuf(512);
+        std::array<float, 512> invBuf{};
         float* prevBuf = &dstBuf[bufSz * 2  - 16];
         for (uint32_t block = 0; block < numMdctBlocks; block++) {
-            if (band) {
-                SwapArray(&Specs[pos], blockSz);
+            const float* inv;
+            size_t invSz;
+            if (numMdctBlocks != 1) {
+                inv = ShortBuf[numShort++];
+                invSz = 64;
+            } else {
+                if (band) {
+                    SwapArray(&Specs[pos], blockSz);
+                }
+                inv = (bufSz == 128) ? Midct256(&Specs[pos]).data() : Midct512(&Specs[pos]).data();
+                invSz = bufSz * 2;
             }
-            vector<float> inv = (numMdctBlocks != 1) ? Midct64(&Specs[pos]) : (bufSz == 128) ? Midct256(&Specs[pos]) : Midct512(&Specs[pos]);
-            for (size_t i = 0; i < (inv.size()/2); i++) {
-                invBuf[start+i] = inv[i + inv.size()/4];
+            for (size_t i = 0; i < (invSz/2); i++) {
+                invBuf[start+i] = inv[i + invSz/4];
             }
 
             vector_fmul_window(dstBuf + start, prevBuf, &invBuf[start], &TAtrac1Data::SineWindow[0], 16);
@@ -137,27 +206,26 @@ void TAtrac1MDCT::IMdct(float Specs[512], const TAtrac1Data::TBlockSizeMod& mode
 }
 
 TPCMEngine::TProcessLambda TAtrac1Decoder::GetLambda() {
-    return [this](float* data, const TPCMEngine::ProcessMeta& /*meta*/) {
+    return [this](float* data, const TPCMEngine::ProcessMeta& meta) {
         float sum[512];
         const uint32_t srcChannels = Aea->GetChannelNum();
         for (uint32_t channel = 0; channel < srcChannels; channel++) {
-            std::unique_ptr<ICompressedIO::TFrame> frame(Aea->ReadFrame());
-
-            TBitStream bitstream(frame->Get(), frame->Size());
+            const size_t frameSz = Aea->ReadFrame(Frame, sizeof(Frame));
+            BitStream.Reset(Frame, frameSz);
 
-            vector<float> specs(512, 0.0f);
+            float specs[512] = {};
             TAtrac1Data::TBlockSizeMod mode;
 
             try {
-                mode = TAtrac1Data::TBlockSizeMod(&bitstream);
+                mode = TAtrac1Data::TBlockSizeMod(&BitStream);
                 TAtrac1Dequantiser dequantiser;
-                dequantiser.Dequant(&bitstream, mode, &specs[0]);
+                dequantiser.Dequant(&BitStream, mode, specs);
             } catch (const std::exception& e) {
                 // Malformed frame: decode it as a silent frame (zero spectrum,
                 // neutral block size) so the per-channel overlap/QMF state stays
                 // consistent for the frames that follow.
                 std::cerr << "Skipping invalid ATRAC1 frame: " << e.what() << std::endl;
-                specs.assign(512, 0.0f);
+                std::fill_n(specs, 512, 0.0f);
                 mode = TAtrac1Data::TBlockSizeMod();
             }
 
@@ -168,9 +236,8 @@ TPCMEngine::TProcessLambda TAtrac1Decoder::GetLambda() {
                     sum[i] = PcmValueMax;
                 if (sum[i] < PcmValueMin)
                     sum[i] = PcmValueMin;
-
-                data[i * srcChannels + channel] = sum[i];
             }
+            meta.SetChannel(data, channel, sum, TAtrac1Data::NumSamples);
         }
         return TPCMEngine::EProcessResult::PROCESSED;
     };
@@ -198,29 +265,41 @@ TPCMEngine::TProcessLambda TAtrac1Encoder::GetLambda() {
     using TData = vector<TChannelData>;
     auto buf = std::make_shared<TData>(srcChannels);
 
-    return [this, srcChannels, buf](float* data, const TPCMEngine::ProcessMeta& /*meta*/) {
-        TAtrac1Data::TBlockSizeMod blockSz[2];
-
-        uint32_t windowMasks[2] = {0};
-        for (uint32_t channel = 0; channel < srcChannels; channel++) {
-            float src[TAtrac1Data::NumSamples];
-            for (size_t i = 0; i < TAtrac1Data::NumSamples; ++i) {
-                src[i] = data[i * srcChannels + channel];
+    if (Settings.GetPipelineDepth()) {
+        AllocStage.reset(new TPipelineStage<TAllocJob>(Settings.GetPipelineDepth(), [this, srcChannels](TAllocJob& job) {
+            for (uint32_t channel = 0; channel < srcChannels; channel++) {
+                BitAllocs[channel]->Write(job.ScaledBlocks[channel], job.BlockSize[channel], job.Loudness);
             }
+        }));
+    }
 
-            AnalysisFilterBank[channel].Analysis(&src[0], &PcmBufLow[channel][0], &PcmBufMid[channel][0], &PcmBufHi[channel][0]);
+    return [this, srcChannels, buf](float* data, const TPCMEngine::ProcessMeta& meta) {
+        TAtrac1Data::TBlockSizeMod blockSz[2];
 
-            uint32_t& windowMask = windowMasks[channel];
-            if (Settings.GetWindowMode() == TAtrac1EncodeSettings::EWindowMode::EWM_AUTO) {
-                windowMask |= (uint32_t)TransientDetectors.GetDetector(channel, 0).Detect(&PcmBufLow[channel][0]);
+        for (uint32_t channel = 0; channel < srcChannels; channel++) {
+            float tmp[TAtrac1Data::NumSamples];
+            const float* src = meta.GetChannel(data, channel, TAtrac1Data::NumSamples, tmp);
 
-                const vector<float>& invMid = InvertSpectr<128>(&PcmBufMid[channel][0]);
-                windowMask |= (uint32_t)TransientDetectors.GetDetector(channel, 1).Detect(&invMid[0]) << 1;
+            AnalysisFilterBank[channel].Analysis(src, &PcmBufLow[channel][0], &PcmBufMid[channel][0], &PcmBufHi[channel][0]);
+        }
 
-                const vector<float>& invHi = InvertSpectr<256>(&PcmBufHi[channel][0]);
-                windowMask |= (uint32_t)TransientDetectors.GetDetector(channel, 2).Detect(&invHi[0]) << 2;
+        const bool autoWindow = Settings.GetWindowMode() == TAtrac1EncodeSettings::EWindowMode::EWM_AUTO;
+        TMultiBandTransientDetector::TResult transients[2 * 3];
+        if (autoWindow) {
+            const float* bands[2 * 3] = {
+                &PcmBufLow[0][0], &PcmBufMid[0][0], &PcmBufHi[0][0],
+                &PcmBufLow[1][0], &PcmBufMid[1][0], &PcmBufHi[1][0]
+            };
+            TransientDetector.Detect(bands, transients, srcChannels);
+        }
 
-                //std::cout << "trans: " << windowMask << std::endl;
+        uint32_t windowMasks[2] = {0};
+        for (uint32_t channel = 0; channel < srcChannels; channel++) {
+            uint32_t& windowMask = windowMasks[channel];
+            if (autoWindow) {
+                for (uint32_t band = 0; band < 3; band++) {
+                    windowMask |= (uint32_t)transients[channel * 3 + band].Transient << band;
+                }
             } else {
                 //no transient detection, use given mask
                 windowMask = Settings.GetWindowMask();
@@ -246,8 +325,21 @@ TPCMEngine::TProcessLambda TAtrac1Encoder::GetLambda() {
             Loudness = TrackLoudness(Loudness, (*buf)[0].Loudness);
         }
 
-        for (uint32_t channel = 0; channel < srcChannels; channel++) {
-            BitAllocs[channel]->Write(Scaler.ScaleFrame((*buf)[channel].Specs, blockSz[channel]), blockSz[channel], Loudness / LoudFactor);
+        if (AllocStage) {
+            TAllocJob job;
+            // Scaled blocks of a handled frame are refilled in place
+            AllocStage->Reclaim(job);
+            for (uint32_t channel = 0; channel < srcChannels; channel++) {
+                Scaler.ScaleFrame((*buf)[channel].Specs, blockSz[channel], job.ScaledBlocks[channel]);
+                job.BlockSize[channel] = blockSz[channel];
+            }
+            job.Loudness = Loudness / LoudFactor;
+            AllocStage->Push(std::move(job));
+        } else {
+            for (uint32_t channel = 0; channel < srcChannels; channel++) {
+                Scaler.ScaleFrame((*buf)[channel].Specs, blockSz[channel], ScaledFrame);
+                BitAllocs[channel]->Write(ScaledFrame, blockSz[channel], Loudness / LoudFactor);
+            }
         }
 
         return TPCMEngine::EProcessResult::PROCESSED;
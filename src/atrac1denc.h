@@ -23,7 +23,10 @@
 #include "atrac/at1/atrac1.h"
 #include "atrac/at1/atrac1_qmf.h"
 #include "atrac/atrac_scale.h"
+#include "bitstream/bitstream.h"
 #include "lib/mdct/mdct.h"
+#include "lib/mdct/mdct_batch.h"
+#include "pipeline.h"
 
 #include <assert.h>
 #include <vector>
@@ -36,12 +39,15 @@ namespace NAtrac1 {
 }
 
 class TAtrac1MDCT {
+    // Short windows of all bands: 4 + 4 + 8 blocks
+    static constexpr size_t MaxShortBlocks = 16;
     NMDCT::TMDCT<512> Mdct512;
     NMDCT::TMDCT<256> Mdct256;
-    NMDCT::TMDCT<64> Mdct64;
+    NMDCT::TMDCTBatch<64, MaxShortBlocks> Mdct64;
     NMDCT::TMIDCT<512> Midct512;
     NMDCT::TMIDCT<256> Midct256;
-    NMDCT::TMIDCT<64> Midct64;
+    NMDCT::TMIDCTBatch<64, MaxShortBlocks> Midct64;
+    float ShortBuf[MaxShortBlocks][64];
 public:
     void IMdct(float specs[512], const NAtrac1::TAtrac1Data::TBlockSizeMod& mode, float* low, float* mid, float* hi);
     void Mdct(float specs[512], float* low, float* mid, float* hi, const NAtrac1::TAtrac1Data::TBlockSizeMod& blockSize);
@@ -68,48 +74,39 @@ class TAtrac1Encoder : public IProcessor, public TAtrac1MDCT {
     const std::vector<float> LoudnessCurve;
     std::vector<std::unique_ptr<NAtrac1::IAtrac1BitAlloc>> BitAllocs;
 
-    class TTransientDetectors {
-        std::vector<TTransientDetector> transientDetectorLow;
-        std::vector<TTransientDetector> transientDetectorMid;
-        std::vector<TTransientDetector> transientDetectorHi;
-    public:
-        TTransientDetectors()
-            : transientDetectorLow(2, TTransientDetector(16, 128))
-            , transientDetectorMid(2, TTransientDetector(16, 128))
-            , transientDetectorHi(2, TTransientDetector(16, 256))
-        {}
-        TTransientDetector& GetDetector(uint32_t channel, uint32_t band) {
-            switch (band) {
-                case 0:
-                    return transientDetectorLow[channel];
-                break;
-                case 1:
-                    return transientDetectorMid[channel];
-                break;
-                case 2:
-                    return transientDetectorHi[channel];
-                break;
-                default:
-                    assert(false);
-                    return transientDetectorLow[channel];
-            }
-        }
-    };
-    TAtrac1Encoder::TTransientDetectors TransientDetectors;
+    // low, mid and hi bands of both channels, mid and hi have inverted spectrum
+    TMultiBandTransientDetector TransientDetector;
 
     TScaler<NAtrac1::TAtrac1Data> Scaler;
+    // Scaled spectrum of the channel being written, without the pipeline
+    std::vector<TScaledBlock> ScaledFrame;
     static constexpr float LoudFactor = 0.006;
     float Loudness = LoudFactor;
 
+    struct TAllocJob {
+        std::vector<TScaledBlock> ScaledBlocks[2];
+        NAtrac1::TAtrac1Data::TBlockSizeMod BlockSize[2];
+        float Loudness;
+    };
+    // Bit allocation and container write of previous frame run here while
+    // the next frame is analysed. Declared last to be stopped first.
+    std::unique_ptr<TPipelineStage<TAllocJob>> AllocStage;
+
 public:
     TAtrac1Encoder(TCompressedOutputPtr&& aea, NAtrac1::TAtrac1EncodeSettings&& settings);
     TPCMEngine::TProcessLambda GetLambda() override;
+    void Flush() override;
+    uint32_t GetPipelineDepth() const override { return Settings.GetPipelineDepth(); }
 };
 
 class TAtrac1Decoder : public IProcessor, public TAtrac1MDCT {
     TCompressedInputPtr Aea;
     const NAtrac1::TAtrac1EncodeSettings Settings;
 
+    // Reused for every sound unit
+    char Frame[NAtrac1::TAtrac1Data::SoundUnitSize];
+    NBitStream::TBitStream BitStream;
+
     float PcmBufLow[2][256 + 16];
     float PcmBufMid[2][256 + 16];
     float PcmBufHi[2][512 + 16];
@@ -24,29 +24,139 @@
 #include <iostream>
 #include <iomanip>
 #include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ATDE_AT3_SSE2
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#include <arm_neon.h>
+#define ATDE_AT3_NEON
+#endif
+
 namespace NAtracDEnc {
 
 using namespace NMDCT;
 using namespace NAtrac3;
 using std::vector;
 
-void TAtrac3MDCT::Mdct(float specs[1024], float* bands[4], float maxLevels[4], TGainModulatorArray gainModulators)
+namespace {
+
+#if defined(ATDE_AT3_SSE2)
+struct TVec {
+    typedef __m128 T;
+    static constexpr size_t W = 4;
+    static T Load(const float* p) { return _mm_loadu_ps(p); }
+    // p[3], p[2], p[1], p[0]
+    static T LoadRev(const float* p) { return _mm_shuffle_ps(_mm_loadu_ps(p), _mm_loadu_ps(p), _MM_SHUFFLE(0, 1, 2, 3)); }
+    static void Store(float* p, T v) { _mm_storeu_ps(p, v); }
+    static T Add(T a, T b) { return _mm_add_ps(a, b); }
+    static T Mul(T a, T b) { return _mm_mul_ps(a, b); }
+    static T Max(T a, T b) { return _mm_max_ps(a, b); }
+    static T Abs(T v) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), v); }
+    static T Set1(float x) { return _mm_set1_ps(x); }
+    static float MaxAcross(T v) {
+        v = _mm_max_ps(v, _mm_movehl_ps(v, v));
+        v = _mm_max_ss(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1)));
+        return _mm_cvtss_f32(v);
+    }
+};
+#elif defined(ATDE_AT3_NEON)
+struct TVec {
+    typedef float32x4_t T;
+    static constexpr size_t W = 4;
+    static T Load(const float* p) { return vld1q_f32(p); }
+    static T LoadRev(const float* p) {
+        const T v = vrev64q_f32(vld1q_f32(p));
+        return vcombine_f32(vget_high_f32(v), vget_low_f32(v));
+    }
+    static void Store(float* p, T v) { vst1q_f32(p, v); }
+    static T Add(T a, T b) { return vaddq_f32(a, b); }
+    // Separate multiply and add, the same rounding as the scalar code
+    static T Mul(T a, T b) { return vmulq_f32(a, b); }
+    static T Max(T a, T b) { return vmaxq_f32(a, b); }
+    static T Abs(T v) { return vabsq_f32(v); }
+    static T Set1(float x) { return vdupq_n_f32(x); }
+    static float MaxAcross(T v) {
+        const float32x2_t m = vpmax_f32(vget_low_f32(v), vget_high_f32(v));
+        return vget_lane_f32(vpmax_f32(m, m), 0);
+    }
+};
+#else
+struct TVec {
+    typedef float T;
+    static constexpr size_t W = 1;
+    static T Load(const float* p) { return *p; }
+    static T LoadRev(const float* p) { return *p; }
+    static void Store(float* p, T v) { *p = v; }
+    static T Add(T a, T b) { return a + b; }
+    static T Mul(T a, T b) { return a * b; }
+    static T Max(T a, T b) { return std::max(a, b); }
+    static T Abs(T v) { return std::abs(v); }
+    static T Set1(float x) { return x; }
+    static float MaxAcross(T v) { return v; }
+};
+#endif
+
+// Gain modulation and the MDCT window in one pass over [b, e), a multiple
+// of the vector width: src[256 + i] (new half) is multiplied by the gain,
+// gain[i - b] if Ramp or gain[0] otherwise, the old half by invScale.
+template<bool Ramp>
+float ModulateWindow(float* src, float* tmp, float invScale, uint32_t b, uint32_t e, const float* gain, float max)
+{
+    using V = TVec;
+    const float* window = NAtrac3::TAtrac3Data::EncodeWindow;
+    const V::T vInvScale = V::Set1(invScale);
+    const V::T vGain = V::Set1(gain[0]);
+    V::T vMax = V::Set1(max);
+    for (uint32_t i = b; i < e; i += V::W) {
+        const V::T x = V::Mul(V::Load(src + 256 + i), Ramp ? V::Load(gain + i - b) : vGain);
+        V::Store(src + 256 + i, x);
+        vMax = V::Max(vMax, V::Abs(x));
+        V::Store(tmp + i, V::Mul(V::Load(src + i), vInvScale));
+        V::Store(src + i, V::Mul(V::Load(window + i), x));
+        V::Store(tmp + 256 + i, V::Mul(V::LoadRev(window + 256 - V::W - i), x));
+    }
+    return V::MaxAcross(vMax);
+}
+
+// IMDCT window and gain demodulation in one pass over [b, e)
+template<bool Ramp>
+void DemodulateWindow(float* out, const float* inv, const float* prev, float scale, uint32_t b, uint32_t e, const float* gain)
+{
+    using V = TVec;
+    const float* window = NAtrac3::TAtrac3Data::DecodeWindow;
+    const V::T two = V::Set1(2.0f);
+    const V::T vScale = V::Set1(scale);
+    const V::T vGain = V::Set1(gain[0]);
+    for (uint32_t j = b; j < e; j += V::W) {
+        const V::T x = V::Mul(V::Load(inv + j), V::Mul(two, V::Load(window + j)));
+        const V::T y = V::Add(V::Mul(x, vScale), V::Load(prev + j));
+        V::Store(out + j, V::Mul(y, Ramp ? V::Load(gain + j - b) : vGain));
+    }
+}
+
+} // namespace
+
+void TAtrac3MDCT::Mdct(float specs[1024], float* bands[4], float maxLevels[4], const TGainModulatorArray& gainModulators)
 {
     for (int band = 0; band < 4; ++band) {
         float* srcBuff = bands[band];
         float* const curSpec = &specs[band*256];
-        TGainModulator modFn = gainModulators[band];
+        const TGainModulator& mod = gainModulators[band];
+        const float invScale = mod.GetInvScale();
         float tmp[512];
-        memcpy(&tmp[0], srcBuff, 256 * sizeof(float));
-        if (modFn) {
-            modFn(&tmp[0], &srcBuff[256]);
-        }
         float max = 0.0;
-        for (int i = 0; i < 256; i++) {
-            max = std::max(max, std::abs(srcBuff[256+i]));
-            srcBuff[i] = TAtrac3Data::EncodeWindow[i] * srcBuff[256+i];
-            tmp[256+i] = TAtrac3Data::EncodeWindow[255-i] * srcBuff[256+i];
-        }
+        const uint32_t end = mod.ForEachSegment(
+            [&](uint32_t b, uint32_t e, float invLevel) {
+                max = ModulateWindow<false>(srcBuff, tmp, invScale, b, e, &invLevel, max);
+            },
+            [&](uint32_t b, uint32_t e, const float* invLevels) {
+                max = ModulateWindow<true>(srcBuff, tmp, invScale, b, e, invLevels, max);
+            });
+        // the rest of the new half is not modulated
+        const float one = 1.0f;
+        max = ModulateWindow<false>(srcBuff, tmp, invScale, end, 256, &one, max);
+
         const vector<float>& sp = Mdct512(&tmp[0]);
         assert(sp.size() == 256);
         memcpy(curSpec, sp.data(), 256 * sizeof(float));
@@ -57,36 +167,40 @@ void TAtrac3MDCT::Mdct(float specs[1024], float* bands[4], float maxLevels[4], T
     }
 }
 
-void TAtrac3MDCT::Mdct(float specs[1024], float* bands[4], TGainModulatorArray gainModulators)
+void TAtrac3MDCT::Mdct(float specs[1024], float* bands[4], const TGainModulatorArray& gainModulators)
 {
     static float dummy[4];
     Mdct(specs, bands, dummy, gainModulators);
 }
 
-void TAtrac3MDCT::Midct(float specs[1024], float* bands[4], TGainDemodulatorArray gainDemodulators)
+void TAtrac3MDCT::Midct(float specs[1024], float* bands[4], const TGainDemodulatorArray& gainDemodulators)
 {
     for (int band = 0; band < 4; ++band) {
         float* dstBuff = bands[band];
         float* curSpec = &specs[band*256];
         float* prevBuff = dstBuff + 256;
-        TAtrac3GainProcessor::TGainDemodulator demodFn = gainDemodulators[band];
+        const TGainDemodulator& demod = gainDemodulators[band];
         if (band & 1) {
             SwapArray(curSpec, 256);
         }
         vector<float> inv  = Midct512(curSpec);
         assert(inv.size()/2 == 256);
-        for (int j = 0; j < 256; ++j) {
-            inv[j] *= 2 * TAtrac3Data::DecodeWindow[j];
-            inv[511 - j] *= 2 * TAtrac3Data::DecodeWindow[j];
-        }
-        if (demodFn) {
-            demodFn(dstBuff, inv.data(), prevBuff);
+        const float scale = demod ? demod.GetScale() : 1.0f;
+        if (demod) {
+            demod.ForEachSegment(
+                [&](uint32_t b, uint32_t e, float level) {
+                    DemodulateWindow<false>(dstBuff, inv.data(), prevBuff, scale, b, e, &level);
+                },
+                [&](uint32_t b, uint32_t e, const float* levels) {
+                    DemodulateWindow<true>(dstBuff, inv.data(), prevBuff, scale, b, e, levels);
+                });
         } else {
-            for (uint32_t j = 0; j < 256; ++j) {
-                dstBuff[j] = inv[j] + prevBuff[j];
-            }
+            const float one = 1.0f;
+            DemodulateWindow<false>(dstBuff, inv.data(), prevBuff, scale, 0, 256, &one);
+        }
+        for (int j = 0; j < 256; ++j) {
+            prevBuff[j] = inv[256 + j] * (2 * TAtrac3Data::DecodeWindow[255 - j]);
         }
-        memcpy(prevBuff, &inv[256], sizeof(float)*256);
     }
 }
 
@@ -105,6 +219,13 @@ TAtrac3Encoder::TAtrac3Encoder(TCompressedOutputPtr&& oma, TAtrac3EncoderSetting
 TAtrac3Encoder::~TAtrac3Encoder()
 {}
 
+void TAtrac3Encoder::Flush()
+{
+    if (AllocStage)
+        AllocStage->Flush();
+    Oma->Flush();
+}
+
 TAtrac3MDCT::TGainModulatorArray TAtrac3MDCT::MakeGainModulatorArray(const TAtrac3Data::SubbandInfo& si)
 {
     switch (si.GetQmfNum()) {
@@ -314,13 +435,17 @@ void TAtrac3Encoder::CreateSubbandInfo(const float* upInput[4],
             *YamlLog << "      - band: " << band << "\n";
         }
 
-        auto result = Upsampler.Process(upInput[band]);
+        // Upsampled [1024..3136): the analysis region and the look-ahead start
+        float upsampled[TSpectralUpsampler::kGainRegionEnd - TSpectralUpsampler::kGainRegionBegin];
+        const float highFreqRatio = Upsampler.Process(upInput[band], upsampled,
+                                                      TSpectralUpsampler::kGainRegionBegin,
+                                                      TSpectralUpsampler::kGainRegionEnd);
 
-        if (result.highFreqRatio < TSpectralUpsampler::kHighFreqThreshold) {
+        if (highFreqRatio < TSpectralUpsampler::kHighFreqThreshold) {
             if (YamlLog) {
                 *YamlLog << std::fixed << std::setprecision(4)
                          << "        skip: low_hfr  # high_freq_ratio "
-                         << result.highFreqRatio << " < threshold\n";
+                         << highFreqRatio << " < threshold\n";
             }
             CurveCtx[channel][band].LastLevel = 0.0f;
             continue;
@@ -329,11 +454,11 @@ void TAtrac3Encoder::CreateSubbandInfo(const float* upInput[4],
         // Analysis region [1024..3072) = current frame upsampled (8x)
         std::vector<float> gainLow;
         std::vector<float> gainHigh;
-        const auto gain = AnalyzeGain(result.signal.data() + 1024, 2048, 32, true,
+        const auto gain = AnalyzeGain(upsampled, 2048, 32, true,
                                       &gainLow, &gainHigh);
 
         // nextLevel from first 64-sample subframe of upsampled lookahead [3072..3072+64)
-        const float nextLevel = AnalyzeGain(result.signal.data() + 3072, 64, 1, true)[0];
+        const float nextLevel = AnalyzeGain(upsampled + 2048, 64, 1, true)[0];
 
         // HPF-domain overlap ratio: mean HPF RMS of previous frame vs current frame.
         // This is domain-matched with gain[] (both HPF-upsampled), unlike full-band
@@ -374,7 +499,7 @@ void TAtrac3Encoder::CreateSubbandInfo(const float* upInput[4],
 
         if (YamlLog) {
             *YamlLog << std::fixed << std::setprecision(4)
-                     << "        high_freq_ratio: " << result.highFreqRatio << "\n"
+                     << "        high_freq_ratio: " << highFreqRatio << "\n"
                      << "        overlap_ratio: " << overlapRatio
                      << "  # prev_E/cur_E full-band; >1 means prev frame louder\n"
                      << "        hpf_overlap_ratio: " << hpfOverlapRatio
@@ -428,7 +553,7 @@ void TAtrac3Encoder::CreateSubbandInfo(const float* upInput[4],
         // can produce level 9 (×32 amplification) on a loud full-band signal,
         // catastrophically over-inflating MDCT coefficients.
         static constexpr float kMinHfrForAmplify = 0.3f;
-        if (result.highFreqRatio < kMinHfrForAmplify) {
+        if (highFreqRatio < kMinHfrForAmplify) {
             if (YamlLog)
                 *YamlLog << "        skip: amplify_low_hfr\n";
             curvePoints.clear();
@@ -691,6 +816,13 @@ TPCMEngine::TProcessLambda TAtrac3Encoder::GetLambda()
     using TData = vector<TChannelData>;
     auto buf = std::make_shared<TData>(2);
 
+    if (Params.PipelineDepth) {
+        AllocStage.reset(new TPipelineStage<TAllocJob>(Params.PipelineDepth, [bitStreamWriter](TAllocJob& job) {
+            assert(job.TonalsInPlace());
+            bitStreamWriter->WriteSoundUnit(job.Sces, job.Loudness);
+        }));
+    }
+
     return [this, bitStreamWriter, buf](float* data, const TPCMEngine::ProcessMeta& meta) {
         using TSce = TAtrac3BitStreamWriter::TSingleChannelElement;
 
@@ -700,14 +832,15 @@ TPCMEngine::TProcessLambda TAtrac3Encoder::GetLambda()
         const int qmfOffset = LookAheadPending ? 128 : 384;
         for (uint32_t channel = 0; channel < meta.Channels; channel++) {
             float src[TAtrac3Data::NumSamples];
+            const float* in = meta.GetChannel(data, channel, TAtrac3Data::NumSamples, src);
             for (size_t i = 0; i < TAtrac3Data::NumSamples; ++i) {
-                src[i] = data[i * meta.Channels + channel] / 4.0;
+                src[i] = in[i] / 4.0;
             }
             float* p[4] = {
-                &LookAheadBuf[channel][0][qmfOffset],
-                &LookAheadBuf[channel][1][qmfOffset],
-                &LookAheadBuf[channel][2][qmfOffset],
-                &LookAheadBuf[channel][3][qmfOffset]
+                LookAheadBuf[channel][0].Get() + qmfOffset,
+                LookAheadBuf[channel][1].Get() + qmfOffset,
+                LookAheadBuf[channel][2].Get() + qmfOffset,
+                LookAheadBuf[channel][3].Get() + qmfOffset
             };
             AnalysisFilterBank[channel].Analysis(&src[0], p);
         }
@@ -721,7 +854,7 @@ TPCMEngine::TProcessLambda TAtrac3Encoder::GetLambda()
         for (uint32_t channel = 0; channel < meta.Channels; channel++) {
             for (int b = 0; b < 4; b++) {
                 memcpy(PcmBuffer.GetSecond(channel + b * 2),
-                       &LookAheadBuf[channel][b][128], 256 * sizeof(float));
+                       LookAheadBuf[channel][b].Get() + 128, 256 * sizeof(float));
             }
         }
 
@@ -730,8 +863,8 @@ TPCMEngine::TProcessLambda TAtrac3Encoder::GetLambda()
         if (jsStereo) {
             for (uint32_t band = 0; band < 4; ++band) {
                 for (uint32_t i = 0; i < TSpectralUpsampler::kInN; ++i) {
-                    const float left = LookAheadBuf[0][band][i];
-                    const float right = LookAheadBuf[1][band][i];
+                    const float left = LookAheadBuf[0][band].Get()[i];
+                    const float right = LookAheadBuf[1][band].Get()[i];
                     jsGainInput[0][band][i] = (left + right) * 0.5f;
                     jsGainInput[1][band][i] = (left - right) * 0.5f;
                 }
@@ -768,10 +901,10 @@ TPCMEngine::TProcessLambda TAtrac3Encoder::GetLambda()
                 // must use the same channel domain.
                 // Ready to pass directly to TSpectralUpsampler::Process()
                 const float* up[4] = {
-                    jsStereo ? jsGainInput[channel][0] : LookAheadBuf[channel][0],
-                    jsStereo ? jsGainInput[channel][1] : LookAheadBuf[channel][1],
-                    jsStereo ? jsGainInput[channel][2] : LookAheadBuf[channel][2],
-                    jsStereo ? jsGainInput[channel][3] : LookAheadBuf[channel][3]
+                    jsStereo ? jsGainInput[channel][0] : LookAheadBuf[channel][0].Get(),
+                    jsStereo ? jsGainInput[channel][1] : LookAheadBuf[channel][1].Get(),
+                    jsStereo ? jsGainInput[channel][2] : LookAheadBuf[channel][2].Get(),
+                    jsStereo ? jsGainInput[channel][3] : LookAheadBuf[channel][3].Get()
                 };
                 CreateSubbandInfo(up, channel, &sce->SubbandInfo);
             }
@@ -827,7 +960,7 @@ TPCMEngine::TProcessLambda TAtrac3Encoder::GetLambda()
             }
 
             //TBlockSize for ATRAC3 - 4 subband, all are long (no short window)
-            sce->ScaledBlocks = Scaler.ScaleFrame(specs, TAtrac3Data::TBlockSizeMod());
+            Scaler.ScaleFrame(specs, TAtrac3Data::TBlockSizeMod(), sce->ScaledBlocks);
         }
 
         if (meta.Channels == 2 && !Params.ConteinerParams->Js) {
@@ -848,16 +981,28 @@ TPCMEngine::TProcessLambda TAtrac3Encoder::GetLambda()
             SingleChannelElements[1].SubbandInfo.Info.resize(1);
         }
 
-        bitStreamWriter->WriteSoundUnit(SingleChannelElements, Loudness / LoudFactor);
+        if (AllocStage) {
+            TAllocJob job;
+            // Elements of a handled frame are filled by the next frame instead of copying
+            AllocStage->Reclaim(job);
+            std::swap(job.Sces, SingleChannelElements);
+            job.Tonals[0] = std::move(tonals[0]);
+            job.Tonals[1] = std::move(tonals[1]);
+            job.Loudness = Loudness / LoudFactor;
+            AllocStage->Push(std::move(job));
+            if (SingleChannelElements.empty())
+                SingleChannelElements.resize(Params.SourceChannels);
+        } else {
+            bitStreamWriter->WriteSoundUnit(SingleChannelElements, Loudness / LoudFactor);
+        }
 
-        // Advance look-ahead state: shift buffer left by 256 samples per band
+        // Advance look-ahead state: move the window by 256 samples per band
         //   old [256..383] (last 128 of current) → [0..127]  new prev tail
         //   old [384..639] (lookahead)            → [128..383] new current
         //   [384..639] will be filled by the next QMF call
         for (uint32_t channel = 0; channel < meta.Channels; channel++) {
             for (int b = 0; b < 4; b++) {
-                memmove(LookAheadBuf[channel][b],
-                        LookAheadBuf[channel][b] + 256, 384 * sizeof(float));
+                LookAheadBuf[channel][b].Advance();
             }
         }
 
@@ -22,6 +22,8 @@
 #include "atrac/at3/atrac3.h"
 #include "atrac/at3/atrac3_qmf.h"
 #include "delay_buffer.h"
+#include "sliding_buffer.h"
+#include "pipeline.h"
 #include "util.h"
 
 #include "atrac/at3/atrac3_bitstream.h"
@@ -80,13 +82,13 @@ public:
     void Mdct(float specs[1024],
               float* bands[4],
               float maxLevels[4],
-              TGainModulatorArray gainModulators);
+              const TGainModulatorArray& gainModulators);
     void Mdct(float specs[1024],
               float* bands[4],
-              TGainModulatorArray gainModulators = TGainModulatorArray());
+              const TGainModulatorArray& gainModulators = TGainModulatorArray());
     void Midct(float specs[1024],
                float* bands[4],
-               TGainDemodulatorArray gainDemodulators = TGainDemodulatorArray());
+               const TGainDemodulatorArray& gainDemodulators = TGainDemodulatorArray());
 protected:
     TAtrac3MDCT::TGainModulatorArray MakeGainModulatorArray(const TAtrac3Data::SubbandInfo& si);
 };
@@ -108,14 +110,40 @@ class TAtrac3Encoder : public IProcessor, public TAtrac3MDCT {
 private:
     bool LookAheadPending = true;
     // [channel][band][prev_128 | current_256 | lookahead_256]
-    // &LookAheadBuf[ch][b][0] is the 512-sample input for TSpectralUpsampler
-    float LookAheadBuf[2][4][640] = {};
+    // LookAheadBuf[ch][b].Get() is the 512-sample input for TSpectralUpsampler
+    TSlidingBuffer<float, 640, 256> LookAheadBuf[2][4];
     TCurveBuilderCtx CurveCtx[2][4] = {};
     TSpectralUpsampler Upsampler;
     static constexpr float LoudFactor = 0.006;
     float Loudness = LoudFactor;
     uint64_t FrameNum = 0;       // incremented each processed frame; used in YAML log
     std::ostream* YamlLog = nullptr;  // non-null when --yaml-log is active
+
+    struct TAllocJob {
+        TAllocJob() = default;
+        TAllocJob(TAllocJob&&) = default;
+        TAllocJob& operator=(TAllocJob&&) = default;
+
+        std::vector<NAtrac3::TAtrac3BitStreamWriter::TSingleChannelElement> Sces;
+        // ValPtr of tonal blocks in Sces[ch] point in to Tonals[ch]. Jobs are only
+        // moved or swapped (copy is disabled) and a moved std::vector keeps its
+        // element storage, so the pointers stay valid while the job is queued.
+        TAtrac3Data::TTonalComponents Tonals[2];
+        float Loudness;
+
+        bool TonalsInPlace() const {
+            for (size_t ch = 0; ch < Sces.size() && ch < 2; ch++) {
+                for (const auto& block : Sces[ch].TonalBlocks) {
+                    if (block.ValPtr < Tonals[ch].data() || block.ValPtr >= Tonals[ch].data() + Tonals[ch].size())
+                        return false;
+                }
+            }
+            return true;
+        }
+    };
+    // Bit allocation and container write of previous frame run here while
+    // the next frame is analysed. Declared last to be stopped first.
+    std::unique_ptr<TPipelineStage<TAllocJob>> AllocStage;
 #ifdef ATRAC_UT_PUBLIC
 public:
 #endif
@@ -131,5 +159,7 @@ public:
     TAtrac3Encoder(TCompressedOutputPtr&& oma, NAtrac3::TAtrac3EncoderSettings&& encoderSettings);
     ~TAtrac3Encoder();
     TPCMEngine::TProcessLambda GetLambda() override;
+    void Flush() override;
+    uint32_t GetPipelineDepth() const override { return Params.PipelineDepth; }
 };
 }
@@ -51,19 +51,26 @@ public:
         // GHA_WIDEBAND is set.
         uint8_t WidebandRefineMode;
 
+        // Frames queued to bit allocation thread, 0 - no thread
+        uint32_t PipelineDepth;
+
         TSettings()
             : UseGha(GHA_ENABLED)
             , WidebandRefineMode(0)
+            , PipelineDepth(0)
         {}
     };
     TAt3PEnc(TCompressedOutputPtr&& out, int channels, TSettings settings);
     TPCMEngine::TProcessLambda GetLambda() override;
+    void Flush() override;
+    uint32_t GetPipelineDepth() const override { return PipelineDepth; }
     static constexpr int NumSamples = 2048;
     static void ParseAdvancedOpt(const char* opt, TSettings& settings);
 
 private:
     TCompressedOutputPtr Out;
     int Channels;
+    const uint32_t PipelineDepth;
     class TImpl;
     std::unique_ptr<TImpl> Impl;
 };
@@ -0,0 +1,176 @@
+/*
+ * This file is part of AtracDEnc.
+ *
+ * AtracDEnc is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * AtracDEnc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with AtracDEnc; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "atracdenc_api.h"
+#include "stream_codec.h"
+
+#include <exception>
+#include <new>
+#include <stdexcept>
+#include <string>
+
+using namespace NAtracDEnc;
+
+struct atracdenc_encoder {
+    explicit atracdenc_encoder(const TStreamEncoder::TSettings& settings)
+        : Encoder(settings)
+    {}
+    TStreamEncoder Encoder;
+    std::string Error;
+};
+
+struct atracdenc_decoder {
+    explicit atracdenc_decoder(const TStreamDecoder::TSettings& settings)
+        : Decoder(settings)
+    {}
+    TStreamDecoder Decoder;
+    std::string Error;
+};
+
+namespace {
+
+// Exceptions must not cross the C boundary
+template<class THandle, class TFunc>
+ptrdiff_t Call(THandle* h, TFunc func) {
+    if (!h)
+        return ATRACDENC_ERROR;
+    try {
+        return func();
+    } catch (const std::length_error& ex) {
+        h->Error = ex.what();
+        return ATRACDENC_BUFFER_TOO_SMALL;
+    } catch (const std::exception& ex) {
+        h->Error = ex.what();
+    } catch (...) {
+        h->Error = "unknown error";
+    }
+    return ATRACDENC_ERROR;
+}
+
+EStreamCodec ToCodec(atracdenc_codec codec) {
+    switch (codec) {
+        case ATRACDENC_ATRAC1:
+            return EStreamCodec::ATRAC1;
+        case ATRACDENC_ATRAC3:
+            return EStreamCodec::ATRAC3;
+        case ATRACDENC_ATRAC3PLUS:
+            return EStreamCodec::ATRAC3PLUS;
+    }
+    throw std::invalid_argument("unsupported codec");
+}
+
+} // namespace
+
+extern "C" {
+
+atracdenc_encoder* atracdenc_encoder_create(atracdenc_codec codec, unsigned channels, unsigned bitrate)
+{
+    try {
+        TStreamEncoder::TSettings settings;
+        settings.Codec = ToCodec(codec);
+        settings.Channels = channels;
+        settings.Bitrate = bitrate;
+        return new atracdenc_encoder(settings);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void atracdenc_encoder_destroy(atracdenc_encoder* enc)
+{
+    delete enc;
+}
+
+unsigned atracdenc_encoder_frame_samples(const atracdenc_encoder* enc)
+{
+    return enc ? enc->Encoder.GetFrameSamples() : 0;
+}
+
+int atracdenc_encoder_push(atracdenc_encoder* enc, const float* pcm, size_t samples)
+{
+    return Call(enc, [&]() { enc->Encoder.Push(pcm, samples); return ATRACDENC_OK; });
+}
+
+int atracdenc_encoder_push_planar(atracdenc_encoder* enc, const float* const* pcm, size_t samples)
+{
+    return Call(enc, [&]() { enc->Encoder.PushPlanar(pcm, samples); return ATRACDENC_OK; });
+}
+
+int atracdenc_encoder_finish(atracdenc_encoder* enc)
+{
+    return Call(enc, [&]() { enc->Encoder.Finish(); return ATRACDENC_OK; });
+}
+
+size_t atracdenc_encoder_next_frame_size(const atracdenc_encoder* enc)
+{
+    return enc ? enc->Encoder.NextFrameSize() : 0;
+}
+
+ptrdiff_t atracdenc_encoder_read_frame(atracdenc_encoder* enc, void* buf, size_t size)
+{
+    return Call(enc, [&]() { return static_cast<ptrdiff_t>(enc->Encoder.ReadFrame(buf, size)); });
+}
+
+const char* atracdenc_encoder_error(const atracdenc_encoder* enc)
+{
+    return enc ? enc->Error.c_str() : "";
+}
+
+atracdenc_decoder* atracdenc_decoder_create(atracdenc_codec codec, unsigned channels)
+{
+    try {
+        TStreamDecoder::TSettings settings;
+        settings.Codec = ToCodec(codec);
+        settings.Channels = channels;
+        return new atracdenc_decoder(settings);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void atracdenc_decoder_destroy(atracdenc_decoder* dec)
+{
+    delete dec;
+}
+
+int atracdenc_decoder_push(atracdenc_decoder* dec, const void* data, size_t size)
+{
+    return Call(dec, [&]() { dec->Decoder.Push(data, size); return ATRACDENC_OK; });
+}
+
+size_t atracdenc_decoder_samples(const atracdenc_decoder* dec)
+{
+    return dec ? dec->Decoder.GetSamplesNum() : 0;
+}
+
+ptrdiff_t atracdenc_decoder_read(atracdenc_decoder* dec, float* pcm, size_t samples)
+{
+    return Call(dec, [&]() { return static_cast<ptrdiff_t>(dec->Decoder.Read(pcm, samples)); });
+}
+
+ptrdiff_t atracdenc_decoder_read_planar(atracdenc_decoder* dec, float* const* pcm, size_t samples)
+{
+    return Call(dec, [&]() { return static_cast<ptrdiff_t>(dec->Decoder.ReadPlanar(pcm, samples)); });
+}
+
+const char* atracdenc_decoder_error(const atracdenc_decoder* dec)
+{
+    return dec ? dec->Error.c_str() : "";
+}
+
+} // extern "C"
@@ -0,0 +1,112 @@
+/*
+ * This file is part of AtracDEnc.
+ *
+ * AtracDEnc is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * AtracDEnc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with AtracDEnc; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * C interface of libatracdenc.
+ *
+ * Push style encoding and decoding over memory buffers, no file I/O.
+ * PCM is 32 bit float in [-1; 1] range, 44100 Hz, 1 or 2 channels.
+ * Sample counts are always per channel.
+ *
+ * Encoded frames are the bytes the RAW container of atracdenc gets:
+ * ATRAC1 - one 212 byte sound unit per channel, ATRAC3 and ATRAC3PLUS -
+ * one frame with all channels.
+ *
+ * A handle must not be used from several threads at the same time,
+ * different handles are independent.
+ */
+
+#ifndef ATRACDENC_API_H
+#define ATRACDENC_API_H
+
+#include <stddef.h>
+
+#if defined(_WIN32) && defined(ATRACDENC_SHARED)
+#  ifdef ATRACDENC_BUILD
+#    define ATRACDENC_API __declspec(dllexport)
+#  else
+#    define ATRACDENC_API __declspec(dllimport)
+#  endif
+#else
+#  define ATRACDENC_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    ATRACDENC_ATRAC1 = 0,
+    ATRACDENC_ATRAC3 = 1,
+    ATRACDENC_ATRAC3PLUS = 2
+} atracdenc_codec;
+
+enum {
+    ATRACDENC_OK = 0,
+    ATRACDENC_ERROR = -1,
+    ATRACDENC_BUFFER_TOO_SMALL = -2
+};
+
+typedef struct atracdenc_encoder atracdenc_encoder;
+typedef struct atracdenc_decoder atracdenc_decoder;
+
+/* bitrate in kbit/s is used by ATRAC3 only, 0 - codec default. Returns NULL on error. */
+ATRACDENC_API atracdenc_encoder* atracdenc_encoder_create(atracdenc_codec codec, unsigned channels, unsigned bitrate);
+ATRACDENC_API void atracdenc_encoder_destroy(atracdenc_encoder* enc);
+
+/* Number of samples consumed by one codec frame */
+ATRACDENC_API unsigned atracdenc_encoder_frame_samples(const atracdenc_encoder* enc);
+
+/* Feeds interleaved or planar PCM of any length */
+ATRACDENC_API int atracdenc_encoder_push(atracdenc_encoder* enc, const float* pcm, size_t samples);
+ATRACDENC_API int atracdenc_encoder_push_planar(atracdenc_encoder* enc, const float* const* pcm, size_t samples);
+
+/* Encodes the buffered tail and the codec look-ahead, no push is allowed after it */
+ATRACDENC_API int atracdenc_encoder_finish(atracdenc_encoder* enc);
+
+/* Size of the next encoded frame, 0 if there is no frame ready */
+ATRACDENC_API size_t atracdenc_encoder_next_frame_size(const atracdenc_encoder* enc);
+
+/* Copies the next frame into buf. Returns its size, 0 if there is no frame ready,
+ * ATRACDENC_BUFFER_TOO_SMALL (the frame is kept) or ATRACDENC_ERROR. */
+ATRACDENC_API ptrdiff_t atracdenc_encoder_read_frame(atracdenc_encoder* enc, void* buf, size_t size);
+
+/* Message of the last error, empty string if none */
+ATRACDENC_API const char* atracdenc_encoder_error(const atracdenc_encoder* enc);
+
+/* Only ATRAC1 decoding is supported. Returns NULL on error. */
+ATRACDENC_API atracdenc_decoder* atracdenc_decoder_create(atracdenc_codec codec, unsigned channels);
+ATRACDENC_API void atracdenc_decoder_destroy(atracdenc_decoder* dec);
+
+/* Feeds encoded stream, it may be split at any byte */
+ATRACDENC_API int atracdenc_decoder_push(atracdenc_decoder* dec, const void* data, size_t size);
+
+/* Number of decoded samples ready to read */
+ATRACDENC_API size_t atracdenc_decoder_samples(const atracdenc_decoder* dec);
+
+/* Copy up to samples decoded samples, return number of copied samples or ATRACDENC_ERROR */
+ATRACDENC_API ptrdiff_t atracdenc_decoder_read(atracdenc_decoder* dec, float* pcm, size_t samples);
+ATRACDENC_API ptrdiff_t atracdenc_decoder_read_planar(atracdenc_decoder* dec, float* const* pcm, size_t samples);
+
+ATRACDENC_API const char* atracdenc_decoder_error(const atracdenc_decoder* dec);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ATRACDENC_API_H */
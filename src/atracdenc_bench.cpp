@@ -0,0 +1,673 @@
+/*
+ * This file is part of AtracDEnc.
+ *
+ * AtracDEnc is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * AtracDEnc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with AtracDEnc; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+// Microbenchmarks of the codec hot paths on deterministic synthetic signals.
+// Results are printed as JSON, so runs of different revisions can be diffed
+// or compared by a script. --footprint reports the heap held by one codec
+// instance and by the shared plan registry instead.
+
+#include "atrac1denc.h"
+#include "atrac3denc.h"
+#include "atrac3p.h"
+#include "transient_detector.h"
+#include "transient_spectral_upsampler.h"
+#include "atrac/atrac_scale.h"
+#include "atrac/at1/atrac1.h"
+#include "atrac/at1/atrac1_bitalloc.h"
+#include "atrac/at1/atrac1_qmf.h"
+#include "atrac/at3/atrac3.h"
+#include "atrac/at3/atrac3_bitstream.h"
+#include "atrac/at3/atrac3_qmf.h"
+#include "atrac/at3p/at3p_bitstream.h"
+#include "atrac/at3p/at3p_gha.h"
+#include "atrac/at3p/at3p_tables.h"
+#include "atrac/atrac3plus_pqf/atrac3plus_pqf.h"
+#include "lib/mdct/mdct.h"
+#include "lib/mdct/mdct_batch.h"
+#include "lib/plan_registry/plan_registry.h"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+using namespace NAtracDEnc;
+
+namespace {
+
+// Live heap bytes of the process, every block carries its size in front
+std::atomic<size_t> HeapBytes{0};
+constexpr size_t HeapHeader = alignof(std::max_align_t);
+
+void* CountedAlloc(size_t size) {
+    char* p = static_cast<char*>(malloc(size + HeapHeader));
+    if (!p)
+        return nullptr;
+    *reinterpret_cast<size_t*>(p) = size;
+    HeapBytes.fetch_add(size, std::memory_order_relaxed);
+    return p + HeapHeader;
+}
+
+void CountedFree(void* ptr) {
+    if (!ptr)
+        return;
+    char* p = static_cast<char*>(ptr) - HeapHeader;
+    HeapBytes.fetch_sub(*reinterpret_cast<size_t*>(p), std::memory_order_relaxed);
+    free(p);
+}
+
+} // namespace
+
+void* operator new(size_t size) {
+    if (void* p = CountedAlloc(size))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept {
+    CountedFree(p);
+}
+
+void operator delete[](void* p) noexcept {
+    CountedFree(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    CountedFree(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+    CountedFree(p);
+}
+
+namespace {
+
+// Keeps results alive, so the compiler can't drop benchmarked code
+volatile float Sink;
+
+void Consume(const float* data, size_t n) {
+    float s = 0;
+    for (size_t i = 0; i < n; i += 64) {
+        s += data[i];
+    }
+    Sink = Sink + s;
+}
+
+// Sum of a few tones, a decaying noise burst every 4096 samples and white noise.
+// Same sequence for every run.
+std::vector<float> MakeSignal(size_t len, float amp = 0.5f) {
+    std::vector<float> res(len);
+    uint32_t seed = 12345;
+    for (size_t i = 0; i < len; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        const float noise = (int32_t)seed / 2147483648.0f;
+        const float burst = expf(-(float)(i % 4096) / 64.0f);
+        const float t = i / 44100.0f;
+        const float tones = sinf(2 * M_PI * 440 * t) + 0.5f * sinf(2 * M_PI * 3520 * t) +
+                            0.25f * sinf(2 * M_PI * 12000 * t);
+        res[i] = amp * (0.5f * tones / 1.75f + 0.3f * burst * noise + 0.02f * noise);
+    }
+    return res;
+}
+
+// Spectrum shaped like a music frame, values fit into the scale tables
+std::vector<float> MakeSpectrum(size_t len) {
+    std::vector<float> res = MakeSignal(len);
+    for (size_t i = 0; i < len; i++) {
+        res[i] *= 0.9f * expf(-4.0f * i / len);
+    }
+    return res;
+}
+
+// Consecutive frames of the signal shaped the same way, so the frames of a
+// stream differ as in real music
+std::vector<std::vector<float>> MakeSpectrumStream(size_t len, size_t frames) {
+    const std::vector<float> signal = MakeSignal(len * frames);
+    std::vector<std::vector<float>> res(frames);
+    for (size_t f = 0; f < frames; f++) {
+        res[f].resize(len);
+        for (size_t i = 0; i < len; i++) {
+            res[f][i] = signal[f * len + i] * 0.9f * expf(-4.0f * i / len);
+        }
+    }
+    return res;
+}
+
+class TNullOutput : public ICompressedOutput {
+public:
+    void WriteFrame(const char* data, size_t size) override {
+        if (size)
+            Sink = Sink + data[0];
+    }
+    std::string GetName() const override {
+        return {};
+    }
+    size_t GetChannelNum() const override {
+        return 2;
+    }
+};
+
+// Bit allocation passes per frame, set by the benches of a rate control loop
+double AllocPassesPerFrame = -1;
+
+struct TResult {
+    std::string Name;
+    uint64_t Iterations;
+    double NsPerOp;
+    double FramesPerSec;
+    double AllocPassesPerFrame;
+};
+
+struct TBench {
+    std::string Name;
+    // Number of codec frames (or transforms for plain DSP blocks) one call processes
+    double FramesPerOp;
+    std::function<std::function<void()>()> Setup;
+};
+
+TResult Run(const TBench& bench, double minTime) {
+    typedef std::chrono::steady_clock TClock;
+    AllocPassesPerFrame = -1;
+    const std::function<void()> op = bench.Setup();
+    op(); // warm up caches and lazy tables
+
+    uint64_t iterations = 1;
+    for (;;) {
+        const auto start = TClock::now();
+        for (uint64_t i = 0; i < iterations; i++) {
+            op();
+        }
+        const double elapsed = std::chrono::duration<double>(TClock::now() - start).count();
+        if (elapsed >= minTime || iterations >= (1ull << 40)) {
+            const double ns = elapsed * 1e9 / iterations;
+            return {bench.Name, iterations, ns, bench.FramesPerOp * 1e9 / ns, AllocPassesPerFrame};
+        }
+        // Aim a bit over the target to not finish just below it
+        const double scale = elapsed > 0 ? minTime * 1.2 / elapsed : 100;
+        iterations = std::max<uint64_t>(iterations + 1, iterations * std::min(scale, 100.0));
+    }
+}
+
+template<size_t N>
+TBench MdctBench() {
+    return {"mdct_" + std::to_string(N), 1, [] {
+        auto mdct = std::make_shared<NMDCT::TMDCT<N>>();
+        auto in = std::make_shared<std::vector<float>>(MakeSignal(N));
+        return [=] {
+            const auto& out = (*mdct)(in->data());
+            Consume(out.data(), out.size());
+        };
+    }};
+}
+
+template<size_t N>
+TBench MidctBench() {
+    return {"imdct_" + std::to_string(N), 1, [] {
+        auto midct = std::make_shared<NMDCT::TMIDCT<N>>();
+        auto in = std::make_shared<std::vector<float>>(MakeSpectrum(N / 2));
+        return [=] {
+            const auto& out = (*midct)(in->data());
+            Consume(out.data(), out.size());
+        };
+    }};
+}
+
+// Count blocks per op, compare with Count runs of mdct_N
+template<size_t N, size_t Lanes, size_t Count>
+TBench MdctBatchBench() {
+    return {"mdct_batch_" + std::to_string(N) + "x" + std::to_string(Count), 1, [] {
+        auto mdct = std::make_shared<NMDCT::TMDCTBatch<N, Lanes>>();
+        auto in = std::make_shared<std::vector<float>>(MakeSignal(N * Count));
+        auto out = std::make_shared<std::vector<float>>(N / 2 * Count);
+        return [=] {
+            const float* src[Count];
+            float* dst[Count];
+            for (size_t i = 0; i < Count; i++) {
+                src[i] = in->data() + i * N;
+                dst[i] = out->data() + i * N / 2;
+            }
+            (*mdct)(src, dst, Count);
+            Consume(out->data(), out->size());
+        };
+    }};
+}
+
+std::vector<TBench> MakeBenches() {
+    std::vector<TBench> res;
+
+    res.push_back(MdctBench<64>());
+    res.push_back(MdctBench<256>());
+    res.push_back(MdctBench<512>());
+    res.push_back(MidctBench<64>());
+    res.push_back(MidctBench<256>());
+    res.push_back(MidctBench<512>());
+    res.push_back(MdctBatchBench<64, 16, 16>());
+    res.push_back(MdctBatchBench<256, 16, 16>());
+
+    res.push_back({"qmf_atrac1_analysis", 1, [] {
+        auto qmf = std::make_shared<Atrac1AnalysisFilterBank>();
+        auto in = std::make_shared<std::vector<float>>(MakeSignal(512));
+        auto out = std::make_shared<std::vector<float>>(512);
+        return [=] {
+            float* o = out->data();
+            qmf->Analysis(in->data(), o, o + 128, o + 256);
+            Consume(o, 512);
+        };
+    }});
+
+    res.push_back({"qmf_atrac1_synthesis", 1, [] {
+        auto qmf = std::make_shared<Atrac1SynthesisFilterBank>();
+        auto in = std::make_shared<std::vector<float>>(MakeSignal(512));
+        auto out = std::make_shared<std::vector<float>>(512);
+        return [=] {
+            const float* i = in->data();
+            qmf->Synthesis(out->data(), i, i + 128, i + 256);
+            Consume(out->data(), 512);
+        };
+    }});
+
+    res.push_back({"qmf_atrac3_analysis", 1, [] {
+        auto qmf = std::make_shared<Atrac3AnalysisFilterBank>();
+        auto in = std::make_shared<std::vector<float>>(MakeSignal(1024));
+        auto out = std::make_shared<std::vector<float>>(1024);
+        return [=] {
+            float* subs[4] = {out->data(), out->data() + 256, out->data() + 512, out->data() + 768};
+            qmf->Analysis(in->data(), subs);
+            Consume(out->data(), 1024);
+        };
+    }});
+
+    res.push_back({"pqf_atrac3plus_analysis", 1, [] {
+        std::shared_ptr<at3plus_pqf_a_ctx> ctx(at3plus_pqf_create_a_ctx(), at3plus_pqf_free_a_ctx);
+        auto in = std::make_shared<std::vector<float>>(MakeSignal(2048));
+        auto out = std::make_shared<std::vector<float>>(2048);
+        return [=] {
+            at3plus_pqf_do_analyse(ctx.get(), in->data(), out->data());
+            Consume(out->data(), 2048);
+        };
+    }});
+
+    // ATRAC3 sub-band rate, called for every band of every frame
+    res.push_back({"spectral_upsampler", 0.25, [] {
+        auto upsampler = std::make_shared<TSpectralUpsampler>(11025.0f, 500.0f);
+        auto in = std::make_shared<std::vector<float>>(MakeSignal(TSpectralUpsampler::kInN));
+        auto out = std::make_shared<std::vector<float>>(
+            TSpectralUpsampler::kGainRegionEnd - TSpectralUpsampler::kGainRegionBegin);
+        return [=] {
+            upsampler->Process(in->data(), out->data(), TSpectralUpsampler::kGainRegionBegin,
+                               TSpectralUpsampler::kGainRegionEnd);
+            Consume(out->data(), out->size());
+        };
+    }});
+
+    res.push_back({"transient_detect_256", 1, [] {
+        auto detector = std::make_shared<TTransientDetector>(16, 256);
+        auto in = std::make_shared<std::vector<float>>(MakeSignal(256 * 16));
+        auto pos = std::make_shared<size_t>(0);
+        return [=] {
+            Sink = Sink + detector->Detect(in->data() + *pos);
+            *pos = (*pos + 256) % in->size();
+        };
+    }});
+
+    res.push_back({"transient_detect_atrac1_stereo", 1, [] {
+        auto detector = std::make_shared<TMultiBandTransientDetector>(2,
+            std::vector<TMultiBandTransientDetector::TBand>{{16, 128, false}, {16, 128, true}, {16, 256, true}});
+        auto in = std::make_shared<std::vector<float>>(MakeSignal(512 * 2 * 16));
+        auto pos = std::make_shared<size_t>(0);
+        return [=] {
+            const float* p = in->data() + *pos;
+            const float* bands[6] = {p, p + 128, p + 256, p + 512, p + 640, p + 768};
+            TMultiBandTransientDetector::TResult res[6];
+            detector->Detect(bands, res, 2);
+            Sink = Sink + res[0].Transient + res[5].Transient;
+            *pos = (*pos + 1024) % in->size();
+        };
+    }});
+
+    res.push_back({"scale_frame_atrac1", 1, [] {
+        NAtrac1::TAtrac1Data data;
+        auto scaler = std::make_shared<TScaler<NAtrac1::TAtrac1Data>>();
+        auto specs = std::make_shared<std::vector<float>>(MakeSpectrum(512));
+        auto blocks = std::make_shared<std::vector<TScaledBlock>>();
+        return [=] {
+            scaler->ScaleFrame(*specs, NAtrac1::TAtrac1Data::TBlockSizeMod(), *blocks);
+            Sink = Sink + blocks->back().Energy;
+        };
+    }});
+
+    // Gain modulated MDCT of all four ATRAC3 bands, the modulators are
+    // built per frame as in the encoder
+    res.push_back({"mdct_gain_atrac3", 1, [] {
+        auto mdct = std::make_shared<TAtrac3MDCT>();
+        auto src = std::make_shared<std::vector<float>>(MakeSignal(4 * 512));
+        auto pcm = std::make_shared<std::vector<float>>(4 * 512);
+        auto specs = std::make_shared<std::vector<float>>(1024);
+        auto points = std::make_shared<std::vector<NAtrac3::TAtrac3Data::SubbandInfo::TGainPoint>>(
+            std::vector<NAtrac3::TAtrac3Data::SubbandInfo::TGainPoint>{{2, 4}, {5, 12}, {3, 20}});
+        return [=] {
+            // the modulation works in place, start from the same input
+            *pcm = *src;
+            float* bands[4] = {pcm->data(), pcm->data() + 512, pcm->data() + 1024, pcm->data() + 1536};
+            const auto& gp = mdct->GainProcessor;
+            mdct->Mdct(specs->data(), bands, {{gp.Modulate(*points), gp.Modulate(*points),
+                                               gp.Modulate(*points), gp.Modulate(*points)}});
+            Sink = Sink + (*specs)[0];
+        };
+    }});
+
+    res.push_back({"scale_frame_atrac3", 1, [] {
+        NAtrac3::TAtrac3Data data;
+        auto scaler = std::make_shared<TScaler<NAtrac3::TAtrac3Data>>();
+        auto specs = std::make_shared<std::vector<float>>(MakeSpectrum(1024));
+        auto blocks = std::make_shared<std::vector<TScaledBlock>>();
+        return [=] {
+            scaler->ScaleFrame(*specs, NAtrac3::TAtrac3Data::TBlockSizeMod(), *blocks);
+            Sink = Sink + blocks->back().Energy;
+        };
+    }});
+
+    res.push_back({"scale_frame_atrac3plus", 1, [] {
+        auto scaler = std::make_shared<TScaler<NAt3p::TScaleTable>>();
+        auto specs = std::make_shared<std::vector<float>>(MakeSpectrum(2048));
+        auto blocks = std::make_shared<std::vector<TScaledBlock>>();
+        return [=] {
+            scaler->ScaleFrame(*specs, NAt3p::TScaleTable::TBlockSizeMod(), *blocks);
+            Sink = Sink + blocks->back().Energy;
+        };
+    }});
+
+    // One block of 16 values, as used by bit allocation of every codec
+    res.push_back({"quant_mantisas_16", 1, [] {
+        auto in = std::make_shared<std::vector<float>>(MakeSpectrum(16));
+        auto out = std::make_shared<std::vector<int>>(16);
+        return [=] {
+            Sink = Sink + QuantMantisas(in->data(), 0, 16, 7.5f, false, out->data());
+        };
+    }});
+
+    // Energy adjusted rounding, as the lossy high BFUs of ATRAC3 use it
+    res.push_back({"quant_mantisas_ea_32", 1, [] {
+        auto in = std::make_shared<std::vector<float>>(MakeSpectrum(32));
+        auto out = std::make_shared<std::vector<int>>(32);
+        return [=] {
+            Sink = Sink + QuantMantisas(in->data(), 0, 32, 7.5f, true, out->data());
+        };
+    }});
+
+    res.push_back({"bitalloc_atrac1", 1, [] {
+        NAtrac1::TAtrac1Data data;
+        auto out = std::make_shared<TNullOutput>();
+        auto alloc = std::make_shared<NAtrac1::TAt1BitAlloc>(out.get(), 0);
+        TScaler<NAtrac1::TAtrac1Data> scaler;
+        auto blocks = std::make_shared<std::vector<TScaledBlock>>(
+            scaler.ScaleFrame(MakeSpectrum(512), NAtrac1::TAtrac1Data::TBlockSizeMod()));
+        // The writer keeps a raw pointer to the output
+        return [out, alloc, blocks] {
+            alloc->Write(*blocks, NAtrac1::TAtrac1Data::TBlockSizeMod(), 1.0f);
+        };
+    }});
+
+    res.push_back({"bitalloc_atrac3", 1, [] {
+        NAtrac3::TAtrac3Data data;
+        auto out = std::make_shared<TNullOutput>();
+        const NAtrac3::TContainerParams* params = NAtrac3::TAtrac3Data::GetContainerParamsForBitrate(132300);
+        auto writer = std::make_shared<NAtrac3::TAtrac3BitStreamWriter>(out.get(), *params, 0);
+        TScaler<NAtrac3::TAtrac3Data> scaler;
+        auto sces = std::make_shared<std::vector<NAtrac3::TAtrac3BitStreamWriter::TSingleChannelElement>>(2);
+        for (auto& sce : *sces) {
+            sce.ScaledBlocks = scaler.ScaleFrame(MakeSpectrum(1024), NAtrac3::TAtrac3Data::TBlockSizeMod());
+            sce.Loudness = 1.0f;
+        }
+        return [out, writer, sces] {
+            writer->WriteSoundUnit(*sces, 1.0f);
+        };
+    }});
+
+    // Rate control over changing frames, the lambda search is warm started
+    // from the previous frame
+    res.push_back({"bitalloc_atrac1_stream", 1, [] {
+        NAtrac1::TAtrac1Data data;
+        auto out = std::make_shared<TNullOutput>();
+        auto alloc = std::make_shared<NAtrac1::TAt1BitAlloc>(out.get(), 0);
+        TScaler<NAtrac1::TAtrac1Data> scaler;
+        auto frames = std::make_shared<std::vector<std::vector<TScaledBlock>>>();
+        for (const auto& spec : MakeSpectrumStream(512, 16)) {
+            frames->push_back(scaler.ScaleFrame(spec, NAtrac1::TAtrac1Data::TBlockSizeMod()));
+        }
+        auto pos = std::make_shared<size_t>(0);
+        return [out, alloc, frames, pos] {
+            alloc->Write((*frames)[*pos], NAtrac1::TAtrac1Data::TBlockSizeMod(), 1.0f);
+            *pos = (*pos + 1) % frames->size();
+            const auto& stat = alloc->GetSearchStat();
+            AllocPassesPerFrame = (double)stat.TotalPasses / stat.Frames;
+        };
+    }});
+
+    res.push_back({"bitalloc_atrac3_stream", 1, [] {
+        NAtrac3::TAtrac3Data data;
+        auto out = std::make_shared<TNullOutput>();
+        const NAtrac3::TContainerParams* params = NAtrac3::TAtrac3Data::GetContainerParamsForBitrate(132300);
+        auto writer = std::make_shared<NAtrac3::TAtrac3BitStreamWriter>(out.get(), *params, 0);
+        TScaler<NAtrac3::TAtrac3Data> scaler;
+        // Two channels of 16 frames, one sound unit per call
+        auto units = std::make_shared<std::vector<std::vector<NAtrac3::TAtrac3BitStreamWriter::TSingleChannelElement>>>(16);
+        const auto stream = MakeSpectrumStream(1024, 32);
+        for (size_t f = 0; f < units->size(); f++) {
+            (*units)[f].resize(2);
+            for (size_t ch = 0; ch < 2; ch++) {
+                auto& sce = (*units)[f][ch];
+                sce.ScaledBlocks = scaler.ScaleFrame(stream[2 * f + ch], NAtrac3::TAtrac3Data::TBlockSizeMod());
+                sce.Loudness = 1.0f;
+            }
+        }
+        auto pos = std::make_shared<size_t>(0);
+        return [out, writer, units, pos] {
+            writer->WriteSoundUnit((*units)[*pos], 1.0f);
+            *pos = (*pos + 1) % units->size();
+            const auto& left = writer->GetSearchStat(0);
+            const auto& right = writer->GetSearchStat(1);
+            AllocPassesPerFrame = (double)(left.TotalPasses + right.TotalPasses) / (left.Frames + right.Frames);
+        };
+    }});
+
+    res.push_back({"bitalloc_atrac3plus", 1, [] {
+        auto out = std::make_shared<TNullOutput>();
+        auto writer = std::make_shared<TAt3PBitStream>(out.get(), 2048);
+        TScaler<NAt3p::TScaleTable> scaler;
+        auto sces = std::make_shared<std::vector<TAt3PBitStream::TSingleChannelElement>>(2);
+        for (auto& sce : *sces) {
+            sce.ScaledBlocks = scaler.ScaleFrame(MakeSpectrum(2048), NAt3p::TScaleTable::TBlockSizeMod());
+        }
+        return [out, writer, sces] {
+            writer->WriteFrame(2, nullptr, *sces);
+        };
+    }});
+
+    res.push_back({"gha_atrac3plus", 1, [] {
+        std::shared_ptr<IGhaProcessor> gha(MakeGhaProcessor0(false, false));
+        // PQF output domain: 16 sub-bands of 128 samples, 32768 scaled as in the encoder
+        std::vector<float> signal = MakeSignal(2048 * 8);
+        for (auto& v : signal) {
+            v *= 32768.0f;
+        }
+        auto pcm = std::make_shared<std::vector<float>>(std::move(signal));
+        auto prev = std::make_shared<std::vector<float>>(2048);
+        auto pos = std::make_shared<size_t>(0);
+        return [=] {
+            const float* cur = pcm->data() + *pos;
+            const float* next = pcm->data() + (*pos + 2048) % pcm->size();
+            const TAt3PGhaData* res = gha->DoAnalize({cur, next}, {nullptr, nullptr}, prev->data(), nullptr,
+                nullptr, nullptr);
+            Sink = Sink + (res ? res->NumToneBands : 0);
+            memcpy(prev->data(), cur, 2048 * sizeof(float));
+            *pos = (*pos + 2048) % pcm->size();
+        };
+    }});
+
+    return res;
+}
+
+void PrintJson(FILE* out, const std::vector<TResult>& results, double minTime) {
+    fprintf(out, "{\n");
+    fprintf(out, "  \"min_time_sec\": %g,\n", minTime);
+    fprintf(out, "  \"benchmarks\": [\n");
+    for (size_t i = 0; i < results.size(); i++) {
+        const TResult& r = results[i];
+        fprintf(out, "    {\"name\": \"%s\", \"iterations\": %llu, \"ns_per_op\": %.1f, \"frames_per_sec\": %.1f",
+            r.Name.c_str(), (unsigned long long)r.Iterations, r.NsPerOp, r.FramesPerSec);
+        if (r.AllocPassesPerFrame >= 0) {
+            fprintf(out, ", \"alloc_passes_per_frame\": %.2f", r.AllocPassesPerFrame);
+        }
+        fprintf(out, "}%s\n", i + 1 < results.size() ? "," : "");
+    }
+    fprintf(out, "  ]\n");
+    fprintf(out, "}\n");
+}
+
+struct TFootprint {
+    std::string Name;
+    std::function<std::unique_ptr<IProcessor>()> Create;
+};
+
+std::vector<TFootprint> MakeFootprints() {
+    std::vector<TFootprint> res;
+    res.push_back({"atrac1_encoder", [] {
+        return std::unique_ptr<IProcessor>(new TAtrac1Encoder(TCompressedOutputPtr(new TNullOutput),
+            NAtrac1::TAtrac1EncodeSettings()));
+    }});
+    res.push_back({"atrac1_decoder", [] {
+        return std::unique_ptr<IProcessor>(new TAtrac1Decoder(TCompressedInputPtr()));
+    }});
+    res.push_back({"atrac3_encoder", [] {
+        return std::unique_ptr<IProcessor>(new TAtrac3Encoder(TCompressedOutputPtr(new TNullOutput),
+            NAtrac3::TAtrac3EncoderSettings(132300, false, false, 2, 0)));
+    }});
+    res.push_back({"atrac3plus_encoder", [] {
+        return std::unique_ptr<IProcessor>(new TAt3PEnc(TCompressedOutputPtr(new TNullOutput), 2,
+            TAt3PEnc::TSettings()));
+    }});
+    return res;
+}
+
+// The first instance builds the shared plans, the second one shows what
+// every further stream costs
+void PrintFootprint(FILE* out, const std::string& filter) {
+    fprintf(out, "{\n");
+    fprintf(out, "  \"footprint\": [\n");
+    bool first = true;
+    for (const TFootprint& fp : MakeFootprints()) {
+        if (!filter.empty() && fp.Name.find(filter) == std::string::npos)
+            continue;
+        const size_t sharedBefore = TPlanRegistry::GetSharedBytes();
+        size_t heap = HeapBytes;
+        std::unique_ptr<IProcessor> a = fp.Create();
+        const size_t firstBytes = HeapBytes - heap;
+        heap = HeapBytes;
+        std::unique_ptr<IProcessor> b = fp.Create();
+        const size_t instanceBytes = HeapBytes - heap;
+        fprintf(out, "%s    {\"name\": \"%s\", \"instance_bytes\": %zu, \"first_instance_bytes\": %zu, "
+            "\"new_shared_bytes\": %zu}",
+            first ? "" : ",\n", fp.Name.c_str(), instanceBytes, firstBytes,
+            TPlanRegistry::GetSharedBytes() - sharedBefore);
+        first = false;
+    }
+    fprintf(out, "\n  ],\n");
+    fprintf(out, "  \"shared_bytes\": %zu,\n", TPlanRegistry::GetSharedBytes());
+    fprintf(out, "  \"shared_plans\": %zu\n", TPlanRegistry::GetNumPlans());
+    fprintf(out, "}\n");
+}
+
+void PrintUsage() {
+    std::cerr << "Usage: atracdenc_bench [--filter <substring>] [--min-time <sec>] [--list]\n"
+                 "                       [--output <file.json>] [--footprint]" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::string filter;
+    std::string output;
+    double minTime = 0.5;
+    bool list = false;
+    bool footprint = false;
+
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (arg == "--filter" && hasValue) {
+            filter = argv[++i];
+        } else if (arg == "--min-time" && hasValue) {
+            minTime = atof(argv[++i]);
+        } else if (arg == "--output" && hasValue) {
+            output = argv[++i];
+        } else if (arg == "--list") {
+            list = true;
+        } else if (arg == "--footprint") {
+            footprint = true;
+        } else {
+            PrintUsage();
+            return arg == "-h" || arg == "--help" ? 0 : 1;
+        }
+    }
+
+    std::vector<TResult> results;
+    for (const TBench& bench : footprint ? std::vector<TBench>() : MakeBenches()) {
+        if (!filter.empty() && bench.Name.find(filter) == std::string::npos)
+            continue;
+        if (list) {
+            std::cout << bench.Name << std::endl;
+            continue;
+        }
+        results.push_back(Run(bench, minTime));
+        std::cerr << bench.Name << ": " << results.back().NsPerOp << " ns/op" << std::endl;
+    }
+    if (list)
+        return 0;
+
+    FILE* out = stdout;
+    if (!output.empty()) {
+        out = fopen(output.c_str(), "w");
+        if (!out) {
+            std::cerr << "unable to open output file '" << output << "'" << std::endl;
+            return 1;
+        }
+    }
+    if (footprint) {
+        PrintFootprint(out, filter);
+    } else {
+        PrintJson(out, results, minTime);
+    }
+    if (out != stdout)
+        fclose(out);
+    return 0;
+}
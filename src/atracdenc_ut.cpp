@@ -20,6 +20,9 @@
 #include <lib/mdct/mdct_ut_common.h>
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <cstring>
+#include <new>
 #include <vector>
 using std::vector;
 using namespace NAtracDEnc;
@@ -114,3 +117,44 @@ TEST(TAtrac1MDCT, TAtrac1MDCTShortEncDec) {
     CheckResult256(hiCopy, hiRes);
 }
 
+
+namespace {
+
+// Every sound unit is zero: long blocks and no spectral data
+class TSilentAeaInput : public ICompressedInput {
+public:
+    size_t ReadFrame(char* buf, size_t size) override {
+        memset(buf, 0, std::min<size_t>(size, TAtrac1Data::SoundUnitSize));
+        return TAtrac1Data::SoundUnitSize;
+    }
+    uint64_t GetLengthInSamples() const override {
+        return 0;
+    }
+    std::string GetName() const override {
+        return {};
+    }
+    size_t GetChannelNum() const override {
+        return 1;
+    }
+};
+
+} // namespace
+
+TEST(TAtrac1Decoder, FirstFrameOfSilence) {
+    // The decoder is constructed over memory filled with a non zero pattern,
+    // state left uninitialised by the constructor shows up in the output
+    const std::align_val_t align{alignof(TAtrac1Decoder)};
+    void* mem = ::operator new(sizeof(TAtrac1Decoder), align);
+    memset(mem, 0x7f, sizeof(TAtrac1Decoder));
+    TAtrac1Decoder* decoder = new (mem) TAtrac1Decoder(TCompressedInputPtr(new TSilentAeaInput));
+
+    auto lambda = decoder->GetLambda();
+    float data[TAtrac1Data::NumSamples];
+    lambda(data, TPCMEngine::ProcessMeta{1});
+    for (size_t i = 0; i < TAtrac1Data::NumSamples; i++) {
+        ASSERT_EQ(data[i], 0.0f) << "sample " << i;
+    }
+
+    decoder->~TAtrac1Decoder();
+    ::operator delete(mem, align);
+}
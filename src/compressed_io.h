@@ -25,23 +25,6 @@
 
 class ICompressedIO {
 public:
-    class TFrame {
-        size_t Sz;
-        char* Data;
-        TFrame(const TFrame& src) = delete;
-        TFrame() = delete;
-    public:
-        TFrame(size_t sz)
-            : Sz(sz)
-        {
-            Data = new char[Sz];
-        }
-        ~TFrame() {
-            delete[] Data;
-        }
-        size_t Size() const { return Sz; }
-        char* Get() { return Data; }
-    };
     virtual std::string GetName() const = 0;
     virtual size_t GetChannelNum() const = 0;
     virtual ~ICompressedIO() {}
@@ -49,13 +32,26 @@ public:
 
 class ICompressedInput : public ICompressedIO {
 public:
-    virtual std::unique_ptr<TFrame> ReadFrame() = 0;
+    // Reads next frame into caller provided buffer, returns size of the frame.
+    // Throws if the frame can't be read or does not fit into the buffer.
+    virtual size_t ReadFrame(char* buf, size_t size) = 0;
     virtual uint64_t GetLengthInSamples() const = 0;
 };
 
 class ICompressedOutput : public ICompressedIO {
 public:
-    virtual void WriteFrame(std::vector<char> data) = 0;
+    // Number of frames passed to containers when the input length is not known.
+    // Containers write provisional header and patch it on close if the output is seekable.
+    static constexpr uint32_t UnknownFrames = UINT32_MAX;
+
+    // Data is valid only during the call, implementation must copy it to keep
+    virtual void WriteFrame(const char* data, size_t size) = 0;
+    // Waits until all written frames reach the destination
+    virtual void Flush() {}
+    // Number of frames for the header of output created with UnknownFrames, passed
+    // when the end of input is reached. Computed the same way as the number passed
+    // on creation for known length, so both headers are equal for the same input.
+    virtual void SetNumFrames(uint32_t /*numFrames*/) {}
 };
 
 typedef std::unique_ptr<ICompressedInput> TCompressedInputPtr;
@@ -17,36 +17,37 @@
  */
 
 #pragma once
+#include "sliding_buffer.h"
+
 #include <cstring>
 
 namespace NAtracDEnc {
 
+// N rows of two halves of S samples, Shift() makes the second half the first
+// one by moving the window of the row
 template<class T, int N, int S>
 class TDelayBuffer {
 public:
-    TDelayBuffer() {
-        static_assert(std::is_pod<T>::value, "T must be a POD type.");
-        memset(Buffer_, 0, sizeof(T) * N * S * 2);
-    }
-
     void Shift(bool erace = true) {
         for (int i = 0; i < N; i++) {
-            memcpy(&Buffer_[i][0], &Buffer_[i][S], sizeof(T) * S);
+            Rows[i].Advance();
             if (erace)
-                memset(&Buffer_[i][S], 0, sizeof(T) * S);
+                memset(GetSecond(i), 0, sizeof(T) * S);
+            else
+                memcpy(GetSecond(i), GetFirst(i), sizeof(T) * S);
         }
     }
 
     T* GetFirst(int i) {
-        return &Buffer_[i][0];
+        return Rows[i].Get();
     }
 
     T* GetSecond(int i) {
-        return &Buffer_[i][S];
+        return Rows[i].Get() + S;
     }
 
 private:
-    T Buffer_[N][S*2];    
+    TSlidingBuffer<T, 2 * S, S> Rows[N];
 };
 
 } // namespace NAtracDEnc
@@ -0,0 +1,85 @@
+/*
+ * This file is part of AtracDEnc.
+ *
+ * AtracDEnc is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * AtracDEnc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with AtracDEnc; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+namespace NAtracDEnc {
+
+// FIFO of variable size frames packed into one byte buffer.
+// Consumed space is reclaimed in place, so a queue which is drained
+// regularly does not allocate after the first few frames.
+class TFrameQueue {
+public:
+    void Push(const char* data, size_t size) {
+        Bytes.insert(Bytes.end(), data, data + size);
+        Sizes.push_back(size);
+    }
+
+    bool Empty() const {
+        return Head == Sizes.size();
+    }
+
+    size_t Size() const {
+        return Sizes.size() - Head;
+    }
+
+    // 0 if the queue is empty
+    size_t FrontSize() const {
+        return Empty() ? 0 : Sizes[Head];
+    }
+
+    // Copies the front frame to buf and removes it from the queue
+    size_t Pop(char* buf, size_t size) {
+        if (Empty())
+            throw std::logic_error("frame queue is empty");
+        const size_t sz = Sizes[Head];
+        if (size < sz)
+            throw std::length_error("buffer is too small for encoded frame");
+        memcpy(buf, &Bytes[BytesHead], sz);
+        BytesHead += sz;
+        if (++Head == Sizes.size()) {
+            Clear();
+        } else if (BytesHead * 2 >= Bytes.size()) {
+            Bytes.erase(Bytes.begin(), Bytes.begin() + BytesHead);
+            Sizes.erase(Sizes.begin(), Sizes.begin() + Head);
+            Head = 0;
+            BytesHead = 0;
+        }
+        return sz;
+    }
+
+    void Clear() {
+        Bytes.clear();
+        Sizes.clear();
+        Head = 0;
+        BytesHead = 0;
+    }
+
+private:
+    std::vector<char> Bytes;
+    std::vector<uint32_t> Sizes;
+    size_t Head = 0;
+    size_t BytesHead = 0;
+};
+
+} // namespace NAtracDEnc
@@ -0,0 +1,52 @@
+/*
+ * This file is part of AtracDEnc.
+ *
+ * AtracDEnc is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * AtracDEnc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with AtracDEnc; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "frame_buffer.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+using namespace NAtracDEnc;
+
+TEST(TFrameQueue, Fifo) {
+    TFrameQueue q;
+    EXPECT_TRUE(q.Empty());
+    EXPECT_EQ(q.FrontSize(), 0);
+
+    char buf[16];
+    for (int round = 0; round < 3; round++) {
+        q.Push("abc", 3);
+        q.Push("", 0);
+        q.Push("defgh", 5);
+        EXPECT_EQ(q.Size(), 3);
+        EXPECT_EQ(q.FrontSize(), 3);
+        EXPECT_EQ(q.Pop(buf, sizeof(buf)), 3);
+        EXPECT_EQ(std::string(buf, 3), "abc");
+        EXPECT_EQ(q.Pop(buf, sizeof(buf)), 0);
+        EXPECT_THROW(q.Pop(buf, 4), std::length_error);
+        // Keep one frame queued while pushing more, storage is compacted in place
+        q.Push("ij", 2);
+        EXPECT_EQ(q.Pop(buf, sizeof(buf)), 5);
+        EXPECT_EQ(std::string(buf, 5), "defgh");
+        EXPECT_EQ(q.Pop(buf, sizeof(buf)), 2);
+        EXPECT_EQ(std::string(buf, 2), "ij");
+        EXPECT_TRUE(q.Empty());
+    }
+    EXPECT_THROW(q.Pop(buf, sizeof(buf)), std::logic_error);
+}
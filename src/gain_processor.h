@@ -16,15 +16,115 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
-#include <functional>
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <vector>
 
 #include "config.h"
 
 template<class T>
 class TGainProcessor : public T {
+    using TGainPoint = typename T::SubbandInfo::TGainPoint;
+    static constexpr uint32_t MaxPoints = T::SubbandInfo::MaxGainPointsNum;
+    static constexpr uint32_t BlockSz = T::MDCTSz/2;
+
+    // Constant part [Begin, End) of a gain point, then LocSz samples of
+    // interpolation to the next level starting at End (if Ramp)
+    struct TSegment {
+        uint32_t Begin;
+        uint32_t End;
+        bool Ramp;
+        float Level;
+        float RampLevels[T::LocSz];
+    };
+
+    // Walks the points the same way as the decoder, levelFn maps every gain
+    // to what is stored (the gain or its reciprocal)
+    template<class TFn>
+    static uint32_t BuildSegments(const std::vector<TGainPoint>& gi, TSegment* segments, TFn&& levelFn) {
+        assert(gi.size() <= MaxPoints);
+        uint32_t pos = 0;
+        for (uint32_t i = 0; i < gi.size(); ++i) {
+            const uint32_t lastPos = gi[i].Location << T::LocScale;
+            const uint32_t levelPos = gi[i].Level;
+            assert(levelPos < sizeof(T::GainLevel)/sizeof(T::GainLevel[0]));
+            float level = T::GainLevel[levelPos];
+            const int incPos = ((i + 1) < gi.size() ? gi[i + 1].Level : T::ExponentOffset)
+                               - gi[i].Level + T::GainInterpolationPosShift;
+            const float gainInc = T::GainInterpolation[incPos];
+            TSegment& seg = segments[i];
+            seg.Begin = pos;
+            seg.End = std::max(pos, lastPos);
+            seg.Level = levelFn(level);
+            // positions are multiples of LocSz, so the ramp is whole or absent
+            seg.Ramp = pos <= lastPos;
+            if (seg.Ramp) {
+                for (uint32_t k = 0; k < T::LocSz; k++) {
+                    seg.RampLevels[k] = levelFn(level);
+                    level *= gainInc;
+                }
+                pos = lastPos + T::LocSz;
+            }
+        }
+        return gi.size();
+    }
+
+    // fn(begin, end, level) for constant parts, fn(begin, end, levels) for
+    // interpolated ones, returns the end of the curve
+    template<class TConstFn, class TRampFn>
+    static uint32_t ForEachSegment(const TSegment* segments, uint32_t n, TConstFn&& constFn, TRampFn&& rampFn) {
+        uint32_t pos = 0;
+        for (uint32_t i = 0; i < n; ++i) {
+            const TSegment& seg = segments[i];
+            if (seg.Begin < seg.End)
+                constFn(seg.Begin, seg.End, seg.Level);
+            pos = seg.End;
+            if (seg.Ramp) {
+                rampFn(seg.End, seg.End + T::LocSz, seg.RampLevels);
+                pos = seg.End + T::LocSz;
+            }
+        }
+        return pos;
+    }
 
 public:
-    typedef std::function<void(float* out, float* cur, float* prev)> TGainDemodulator;
+    /*
+     * Gain curve applied on the IMDCT overlap-add:
+     *     out = (cur * Scale + prev) * level
+     * where level follows the curve of the current frame and Scale is the
+     * first level of the next frame. A plain descriptor, nothing is allocated.
+     */
+    class TGainDemodulator {
+        friend class TGainProcessor;
+        bool Active = false;
+        uint32_t NumSegments = 0;
+        float Scale = 1.0f;
+        TSegment Segments[MaxPoints];
+    public:
+        explicit operator bool() const { return Active; }
+        float GetScale() const { return Scale; }
+        // Gain of the overlap-add in [begin, end), 1 past the curve
+        template<class TConstFn, class TRampFn>
+        void ForEachSegment(TConstFn&& constFn, TRampFn&& rampFn) const {
+            const uint32_t pos = TGainProcessor::ForEachSegment(Segments, NumSegments, constFn, rampFn);
+            if (pos < BlockSz)
+                constFn(pos, BlockSz, 1.0f);
+        }
+        void operator()(float* out, const float* cur, const float* prev) const {
+            const float scale = Scale;
+            ForEachSegment(
+                [&](uint32_t b, uint32_t e, float level) {
+                    for (uint32_t pos = b; pos < e; pos++)
+                        out[pos] = (cur[pos] * scale + prev[pos]) * level;
+                },
+                [&](uint32_t b, uint32_t e, const float* levels) {
+                    for (uint32_t pos = b; pos < e; pos++)
+                        out[pos] = (cur[pos] * scale + prev[pos]) * levels[pos - b];
+                });
+        }
+    };
+
     /*
      * example GainModulation:
      * PCMinput:
@@ -40,8 +140,39 @@ public:
      *     bufNext - is a buffer of second half of mdct transformation and overlaping
      *               (i.e the input buffer started at b point)
      * so next transformation (mdct #3) gets modulated first part
+     *
+     * bufCur is multiplied by InvScale, bufNext by the reciprocal of the curve
+     * up to its last point and kept as is after it. The reciprocals are
+     * precomputed, the per sample work is a multiplication.
      */
-    typedef std::function<void(float* bufCur, float* bufNext)> TGainModulator;
+    class TGainModulator {
+        friend class TGainProcessor;
+        uint32_t NumSegments = 0;
+        float InvScale = 1.0f;
+        TSegment Segments[MaxPoints];
+    public:
+        explicit operator bool() const { return NumSegments != 0; }
+        float GetInvScale() const { return InvScale; }
+        // Factor of bufNext in [begin, end), returns the end of the curve
+        template<class TConstFn, class TRampFn>
+        uint32_t ForEachSegment(TConstFn&& constFn, TRampFn&& rampFn) const {
+            return TGainProcessor::ForEachSegment(Segments, NumSegments, constFn, rampFn);
+        }
+        void operator()(float* bufCur, float* bufNext) const {
+            for (uint32_t pos = 0; pos < BlockSz; pos++)
+                bufCur[pos] *= InvScale;
+            ForEachSegment(
+                [&](uint32_t b, uint32_t e, float invLevel) {
+                    for (uint32_t pos = b; pos < e; pos++)
+                        bufNext[pos] *= invLevel;
+                },
+                [&](uint32_t b, uint32_t e, const float* invLevels) {
+                    for (uint32_t pos = b; pos < e; pos++)
+                        bufNext[pos] *= invLevels[pos - b];
+                });
+        }
+    };
+
     static float GetGainInc(uint32_t levelIdxCur)
     {
         const int incPos = T::ExponentOffset - levelIdxCur + T::GainInterpolationPosShift;
@@ -54,69 +185,21 @@ public:
     }
 
 
-    TGainDemodulator Demodulate(const std::vector<typename T::SubbandInfo::TGainPoint>& giNow,
-                                const std::vector<typename T::SubbandInfo::TGainPoint>& giNext)
+    TGainDemodulator Demodulate(const std::vector<TGainPoint>& giNow,
+                                const std::vector<TGainPoint>& giNext) const
     {
-        return [=](float* out, float* cur, float* prev) {
-            uint32_t pos = 0;
-            const float scale = giNext.size() ? T::GainLevel[giNext[0].Level] : 1;
-            for (uint32_t i = 0; i < giNow.size(); ++i) {
-                uint32_t lastPos = giNow[i].Location << T::LocScale;
-                const uint32_t levelPos = giNow[i].Level;
-                assert(levelPos < sizeof(T::GainLevel)/sizeof(T::GainLevel[0]));
-                float level = T::GainLevel[levelPos];
-                const int incPos = ((i + 1) < giNow.size() ? giNow[i + 1].Level : T::ExponentOffset)
-                                   - giNow[i].Level + T::GainInterpolationPosShift;
-                float gainInc = T::GainInterpolation[incPos];
-                for (; pos < lastPos; pos++) {
-                    //std::cout << "pos: " << pos << " scale: " << scale << " level: " << level << " | cur: " <<  cur[pos] << " prev: " << prev[pos] << std::endl;
-                    out[pos] = (cur[pos] * scale + prev[pos]) * level;
-                }
-                for (; pos < lastPos + T::LocSz; pos++) {
-                    //std::cout << "pos: " << pos << " scale: " << scale << " level: " << level << " gainInc: " << gainInc << " | cur: " <<  cur[pos] << " prev: " << prev[pos] << std::endl;
-                    out[pos] = (cur[pos] * scale + prev[pos]) * level;
-                    level *= gainInc;
-                }
-            }
-            for (; pos < T::MDCTSz/2; pos++) {
-                //std::cout << "pos: " << pos << " scale: " << scale << " | cur: " <<  cur[pos] << " prev: " << prev[pos] << std::endl;
-                out[pos] = cur[pos] * scale + prev[pos];
-            }
-        };
+        TGainDemodulator res;
+        res.Active = true;
+        res.Scale = giNext.size() ? T::GainLevel[giNext[0].Level] : 1;
+        res.NumSegments = BuildSegments(giNow, res.Segments, [](float level) { return level; });
+        return res;
     }
-    TGainModulator Modulate(const std::vector<typename T::SubbandInfo::TGainPoint>& giCur) {
+    TGainModulator Modulate(const std::vector<TGainPoint>& giCur) const {
+        TGainModulator res;
         if (giCur.empty())
-            return {};
-        return [=](float* bufCur, float* bufNext) {
-            uint32_t pos = 0;
-            const float scale = T::GainLevel[giCur[0].Level];
-            for (uint32_t i = 0; i < giCur.size(); ++i) {
-                uint32_t lastPos = giCur[i].Location << T::LocScale;
-                const uint32_t levelPos = giCur[i].Level;
-                assert(levelPos < sizeof(T::GainLevel)/sizeof(T::GainLevel[0]));
-                float level = T::GainLevel[levelPos];
-                const int incPos = ((i + 1) < giCur.size() ? giCur[i + 1].Level : T::ExponentOffset)
-                                   - giCur[i].Level + T::GainInterpolationPosShift;
-                float gainInc = T::GainInterpolation[incPos];
-                for (; pos < lastPos; pos++) {
-                    //std::cout << "mod pos: " << pos << " scale: " << scale << " bufCur: " <<  bufCur[pos]  << " level: " << level << " new bufNext: "
-                    //          << (bufNext[pos] / level) << " new bufCur: " << (bufCur[pos] / scale) << std::endl;
-                    bufCur[pos] /= scale;
-                    bufNext[pos] /= level;
-                }
-                for (; pos < lastPos + T::LocSz; pos++) {
-                    //std::cout << "mod pos: " << pos << " scale: " << scale << " bufCur: " <<  bufCur[pos]  << " level: " << level << " (gainInc) " << gainInc << " new bufNext: "
-                    //          << (bufNext[pos] / level) << " new bufCur: " << (bufCur[pos] / scale) << std::endl;
-                    bufCur[pos] /= scale;
-                    bufNext[pos] /= level;
-                    //std::cout << "mod pos: " << pos << " scale: " << scale << " level: " << level << " gainInc: " << gainInc << std::endl;
-                    level *= gainInc;
-                }
-            }
-            for (; pos < T::MDCTSz/2; pos++) {
-                //std::cout << "mod pos: " << pos << " scale: " << scale << " bufCur: " << bufCur[pos] << " new bufCur: " << bufCur[pos] / scale << "next: " << bufNext[pos] <<std::endl;
-                bufCur[pos] /= scale;
-            }
-        };
+            return res;
+        res.InvScale = 1.0f / T::GainLevel[giCur[0].Level];
+        res.NumSegments = BuildSegments(giCur, res.Segments, [](float level) { return 1.0f / level; });
+        return res;
     }
 };
@@ -11,8 +11,8 @@ atracdenc {-e <codec> | --encode=<codec> | -d | --decode} -i <in> -o <out>
 -e or --encode		encode file using one of codecs
 	{atrac1 | atrac3 | atrac3_lp | atrac3plus}
 -d or --decode		decode file (only ATRAC1 supported for decoding)
--i			path to input file
--o			path to output file
+-i			path to input file, - to read from stdin
+-o			path to output file, - to write to stdout
 -h			print help and exit
 
 --container		explicitly select output container: aea, oma, riff, rm, raw
@@ -23,6 +23,28 @@ atracdenc {-e <codec> | --encode=<codec> | -d | --decode} -i <in> -o <out>
 
 --bitrate		allow to specify bitrate (for ATRAC3 + RealMedia container only)
 
+--threads		encode using given number of threads (input must be a seekable file).
+			The input is split in to segments, each segment is encoded with a short
+			pre-roll and the result is stitched, segment boundaries which do not
+			match serial encode are reported
+
+--pipeline		number of frames queued between analysis, bit allocation and
+			container write threads (default 4), 0 runs all stages in one thread
+
+--prefetch		number of input blocks read ahead by a background thread
+			(default 0 - input is read by the encoding thread)
+--prefetch-block	size of one read ahead block in samples (default 65536)
+
+--batch			file with jobs to run, one "input<TAB>output" pair per line.
+			Repeating -i/-o pairs also runs a batch. Jobs are run on a pool
+			of --threads workers (default - number of CPUs)
+--batch-summary		write per job status and timing of the batch as JSON
+
+--stream		ignore the length in the input header and read it till the end
+			(stdin is always read this way). Container header fields
+			which depend on the length are written after the encoding
+			if the output is seekable
+
 Advanced options:
 --bfuidxconst		Set constant amount of used BFU (ATRAC1, ATRAC3).
 --notransient[=mask]	Disable transient detection and use optional mask
@@ -37,6 +37,18 @@ TBitStream::TBitStream(const char* buf, int size)
 TBitStream::TBitStream()
 {}
 
+void TBitStream::Reset() {
+    Buf.clear();
+    BitsUsed = 0;
+    ReadPos = 0;
+}
+
+void TBitStream::Reset(const char* buf, int size) {
+    Buf.assign(buf, buf + size);
+    BitsUsed = 0;
+    ReadPos = 0;
+}
+
 void TBitStream::Write(uint32_t val, int n) {
     if (n > 23 || n < 0)
         abort();
@@ -37,6 +37,9 @@ class TBitStream {
     public:
         TBitStream(const char* buf, int size);
         TBitStream();
+        // Start over keeping allocated buffer, to reuse one stream for every frame
+        void Reset();
+        void Reset(const char* buf, int size);
         void Write(uint32_t val, int n);
         uint32_t Read(int n);
         unsigned long long GetSizeInBits() const;
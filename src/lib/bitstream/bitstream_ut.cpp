@@ -132,3 +132,19 @@ TEST(TBitStream, SignWriteRead) {
     EXPECT_EQ(-7, MakeSign(bs.Read(4), 4));
 }
 
+
+TEST(TBitStream, Reset) {
+    TBitStream bs;
+    bs.Write(0x7f, 7);
+    bs.Write(0x3, 2);
+    bs.Reset();
+    EXPECT_EQ(0, bs.GetSizeInBits());
+    EXPECT_EQ(0, bs.GetBufSize());
+    bs.Write(0x5, 3);
+    EXPECT_EQ(0x5, bs.Read(3));
+
+    const char frame[2] = {(char)0xA5, 0x0F};
+    bs.Reset(frame, 2);
+    EXPECT_EQ(0xA, bs.Read(4));
+    EXPECT_EQ(0x50F, bs.Read(12));
+}
@@ -18,23 +18,41 @@
 
 #include "encode.h"
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 
 namespace NAtracDEnc {
 
 using NBitStream::TBitStream;
 
+// Bounds of the first step away from the previous lambda
+static constexpr float MinWarmStep = 0.05f;
+static constexpr float MaxWarmStep = 0.5f;
+
 class TBitStreamEncoder::TImpl : public TBitAllocHandler {
 public:
-    explicit TImpl(std::vector<IBitStreamPartEncoder::TPtr>&& encoders);
+    TImpl(std::vector<IBitStreamPartEncoder::TPtr>&& encoders, ESearch search);
     void DoStart(size_t targetBits, float minLambda, float maxLambda) noexcept;
     float DoContinue() noexcept;
     bool DoSubmit(size_t gotBits) noexcept;
     bool DoCheck(size_t gotBits) const noexcept;
     void DoRun(void* frameData, TBitStream& bs);
     uint32_t DoGetCurGlobalConsumption() const noexcept;
+    const TSearchStat& DoGetSearchStat() const noexcept { return Stat; }
 private:
+    // Observed point of the bits(lambda) curve, bits do not grow with lambda
+    struct TPoint {
+        float Lambda = 0.0f;
+        float Delta = 0.0f; // gotBits - TargetBits, scaled down by Illinois steps
+    };
+
+    float Interpolate() noexcept;
+    void Update(TPoint& point, bool& have, int side, size_t gotBits) noexcept;
+    void Converged(float lambda) noexcept;
+
     std::vector<IBitStreamPartEncoder::TPtr> Encoders;
+    const ESearch Search;
     size_t CurEncPos;
     size_t RepeatEncPos;
 
@@ -45,10 +63,31 @@ private:
     float LastLambda;
 
     bool NeedRepeat = false;
+
+    // Interpolating search: the lowest lambda under the target and the
+    // highest one over it, the answer lies between them
+    TPoint Under;
+    TPoint Over;
+    bool HaveUnder = false;
+    bool HaveOver = false;
+    int LastSide = 0;
+    size_t SameSide = 0;
+    // Started from PrevLambda, walk away from it until the answer is bracketed
+    bool Warm = false;
+    float Step = 0.0f;
+
+    // Result of the previous search and how far it moved from the one before
+    float PrevLambda = 0.0f;
+    float PrevMove = MaxWarmStep;
+    bool HavePrev = false;
+
+    size_t Passes = 0;
+    TSearchStat Stat;
 };
 
-TBitStreamEncoder::TImpl::TImpl(std::vector<IBitStreamPartEncoder::TPtr>&& encoders)
+TBitStreamEncoder::TImpl::TImpl(std::vector<IBitStreamPartEncoder::TPtr>&& encoders, ESearch search)
     : Encoders(std::move(encoders))
+    , Search(search)
     , CurEncPos(0)
     , RepeatEncPos(0)
 {
@@ -60,34 +99,118 @@ void TBitStreamEncoder::TImpl::DoStart(size_t targetBits, float minLambda, float
     MinLambda = minLambda;
     MaxLambda = maxLambda;
     LastLambda = maxLambda;
+
+    HaveUnder = false;
+    HaveOver = false;
+    LastSide = 0;
+    SameSide = 0;
+    Warm = false;
+    // Expect the answer to move about as far as it did last time
+    Step = std::min(std::max(PrevMove, MinWarmStep), MaxWarmStep);
+}
+
+float TBitStreamEncoder::TImpl::Interpolate() noexcept
+{
+    float x;
+    if (!HaveUnder && !HaveOver && HavePrev) {
+        Warm = true;
+        x = PrevLambda;
+    } else if (HaveUnder && HaveOver && SameSide < 2) {
+        x = Over.Lambda + Over.Delta * (Under.Lambda - Over.Lambda) / (Over.Delta - Under.Delta);
+    } else if (HaveUnder != HaveOver && Warm) {
+        // Under the target: the answer is at a lower lambda, over: higher
+        x = HaveUnder ? Under.Lambda - Step : Over.Lambda + Step;
+        Step *= 2.0f;
+    } else {
+        x = (MaxLambda + MinLambda) / 2.0;
+    }
+    return std::min(std::max(x, MinLambda), MaxLambda);
 }
 
 float TBitStreamEncoder::TImpl::DoContinue() noexcept
 {
+    Passes++;
     if (MaxLambda <= MinLambda) {
         return LastLambda;
     }
 
-    CurLambda = (MaxLambda + MinLambda) / 2.0;
+    if (Search == ESearch::Interpolate) {
+        CurLambda = Interpolate();
+    } else {
+        CurLambda = (MaxLambda + MinLambda) / 2.0;
+    }
     RepeatEncPos = CurEncPos;
     return CurLambda;
 }
 
-bool TBitStreamEncoder::TImpl::DoSubmit(size_t gotBits) noexcept
+void TBitStreamEncoder::TImpl::Update(TPoint& point, bool& have, int side, size_t gotBits) noexcept
 {
-    if  (MaxLambda <= MinLambda) {
-        NeedRepeat = false;
+    point.Lambda = CurLambda;
+    point.Delta = (float)gotBits - (float)TargetBits;
+    have = true;
+
+    // Illinois: the same end moved again, so the other one is stale,
+    // halve its weight to pull the next point across. Bisect if that
+    // does not help either.
+    if (side == LastSide) {
+        SameSide++;
+        TPoint& other = (&point == &Under) ? Over : Under;
+        other.Delta *= 0.5f;
     } else {
-        if (gotBits < TargetBits) {
-            LastLambda = CurLambda;
-            MaxLambda = CurLambda - 0.01f;
-            NeedRepeat = true;
-        } else if (gotBits > TargetBits) {
-            MinLambda = CurLambda + 0.01f;
-            NeedRepeat = true;
-        } else {
+        SameSide = 0;
+    }
+    LastSide = side;
+}
+
+void TBitStreamEncoder::TImpl::Converged(float lambda) noexcept
+{
+    if (HavePrev) {
+        PrevMove = std::fabs(lambda - PrevLambda);
+    }
+    PrevLambda = lambda;
+    HavePrev = true;
+}
+
+bool TBitStreamEncoder::TImpl::DoSubmit(size_t gotBits) noexcept
+{
+    if (Search == ESearch::Bisection) {
+        if  (MaxLambda <= MinLambda) {
             NeedRepeat = false;
+        } else {
+            if (gotBits < TargetBits) {
+                LastLambda = CurLambda;
+                MaxLambda = CurLambda - 0.01f;
+                NeedRepeat = true;
+            } else if (gotBits > TargetBits) {
+                MinLambda = CurLambda + 0.01f;
+                NeedRepeat = true;
+            } else {
+                NeedRepeat = false;
+            }
         }
+        return !NeedRepeat;
+    }
+
+    if (MaxLambda <= MinLambda) {
+        // Final pass with the best lambda found
+        NeedRepeat = false;
+        Converged(LastLambda);
+    } else if (gotBits < TargetBits) {
+        LastLambda = CurLambda;
+        MaxLambda = CurLambda - 0.01f;
+        Update(Under, HaveUnder, -1, gotBits);
+        // Nothing left to try below, this pass already is the answer
+        NeedRepeat = MaxLambda > MinLambda;
+        if (!NeedRepeat) {
+            Converged(CurLambda);
+        }
+    } else if (gotBits > TargetBits) {
+        MinLambda = CurLambda + 0.01f;
+        Update(Over, HaveOver, 1, gotBits);
+        NeedRepeat = true;
+    } else {
+        NeedRepeat = false;
+        Converged(CurLambda);
     }
     return !NeedRepeat;
 }
@@ -99,6 +222,7 @@ bool TBitStreamEncoder::TImpl::DoCheck(size_t gotBits) const noexcept
 
 void TBitStreamEncoder::TImpl::DoRun(void* frameData, TBitStream& bs)
 {
+    Passes = 0;
     bool cont = false;
     do {
         for (CurEncPos = RepeatEncPos; CurEncPos < Encoders.size(); CurEncPos++) {
@@ -126,6 +250,10 @@ void TBitStreamEncoder::TImpl::DoRun(void* frameData, TBitStream& bs)
     }
 
     RepeatEncPos = 0;
+
+    Stat.LastFramePasses = Passes;
+    Stat.TotalPasses += Passes;
+    Stat.Frames++;
 }
 
 uint32_t TBitStreamEncoder::TImpl::DoGetCurGlobalConsumption() const noexcept
@@ -139,8 +267,8 @@ uint32_t TBitStreamEncoder::TImpl::DoGetCurGlobalConsumption() const noexcept
 
 /////
 
-TBitStreamEncoder::TBitStreamEncoder(std::vector<IBitStreamPartEncoder::TPtr>&& encoders)
-    : Impl(new TBitStreamEncoder::TImpl(std::move(encoders)))
+TBitStreamEncoder::TBitStreamEncoder(std::vector<IBitStreamPartEncoder::TPtr>&& encoders, ESearch search)
+    : Impl(new TBitStreamEncoder::TImpl(std::move(encoders), search))
 {}
 
 TBitStreamEncoder::~TBitStreamEncoder()
@@ -153,6 +281,11 @@ void TBitStreamEncoder::Do(void* frameData, TBitStream& bs)
     Impl->DoRun(frameData, bs);
 }
 
+const TBitStreamEncoder::TSearchStat& TBitStreamEncoder::GetSearchStat() const noexcept
+{
+    return Impl->DoGetSearchStat();
+}
+
 /////
 
 void TBitAllocHandler::Start(size_t targetBits, float minLambda, float maxLambda) noexcept
@@ -59,10 +59,29 @@ public:
 class TBitStreamEncoder {
 public:
     class TImpl;
-    explicit TBitStreamEncoder(std::vector<IBitStreamPartEncoder::TPtr>&& encoders);
+    // How Continue() picks the next lambda
+    enum class ESearch {
+        // Halve [minLambda, maxLambda] on every pass
+        Bisection,
+        // Start from the lambda the previous search converged to, then
+        // interpolate between the observed (lambda, bits) points
+        // (regula falsi, Illinois variant). Bisection if no usable points.
+        Interpolate,
+    };
+
+    struct TSearchStat {
+        // Allocation passes (Continue() calls) of the last Do()
+        size_t LastFramePasses = 0;
+        size_t TotalPasses = 0;
+        size_t Frames = 0;
+    };
+
+    explicit TBitStreamEncoder(std::vector<IBitStreamPartEncoder::TPtr>&& encoders,
+                               ESearch search = ESearch::Bisection);
     ~TBitStreamEncoder();
 
     void Do(void* frameData, NBitStream::TBitStream& bs);
+    const TSearchStat& GetSearchStat() const noexcept;
     TBitStreamEncoder(const TBitStreamEncoder&) = delete;
     TBitStreamEncoder& operator=(const TBitStreamEncoder&) = delete;
 private:
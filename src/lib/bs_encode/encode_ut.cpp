@@ -176,3 +176,127 @@ TEST(BsEncode, NotExactAlloc) {
 }
 
 
+
+struct TStreamFrame {
+    size_t Frame;
+    size_t TargetBits;
+};
+
+class TStartAlloc : public IBitStreamPartEncoder {
+public:
+    EStatus Encode(void* frameData, TBitAllocHandler& ba) override {
+        ba.Start(static_cast<TStreamFrame*>(frameData)->TargetBits, -15, -1);
+        return EStatus::Ok;
+    }
+
+    void Dump(NBitStream::TBitStream& bs) override {}
+
+    uint32_t GetConsumption() const noexcept override {
+        return 0;
+    }
+};
+
+// Frame n of the stream needs a slightly different lambda, as music does
+template<size_t (*F)(float)>
+class TDriftingAlloc : public IBitStreamPartEncoder {
+public:
+    EStatus Encode(void* frameData, TBitAllocHandler& ba) override {
+        const size_t frame = static_cast<TStreamFrame*>(frameData)->Frame;
+        const float lambda = ba.Continue();
+        Bits = F(lambda - 0.3f * (frame % 4));
+        ba.Submit(Bits);
+        return EStatus::Ok;
+    }
+
+    void Dump(NBitStream::TBitStream& bs) override {
+         for (size_t i = 0; i < Bits; i++) {
+             bs.Write(1, 1);
+         }
+    }
+
+    uint32_t GetConsumption() const noexcept override {
+        return Bits;
+    }
+private:
+    size_t Bits = 0;
+};
+
+template<size_t (*F)(float)>
+static std::vector<size_t> RunStream(TBitStreamEncoder::ESearch search, size_t frames, size_t* passes, size_t targetBits = 1000) {
+    std::vector<IBitStreamPartEncoder::TPtr> encoders;
+    encoders.emplace_back(std::make_unique<TStartAlloc>());
+    encoders.emplace_back(std::make_unique<TDriftingAlloc<F>>());
+    TBitStreamEncoder encoder(std::move(encoders), search);
+    std::vector<size_t> res;
+    for (size_t frame = 0; frame < frames; frame++) {
+        NBitStream::TBitStream bs;
+        TStreamFrame data = {frame, targetBits};
+        encoder.Do(&data, bs);
+        res.push_back(bs.GetSizeInBits());
+    }
+    EXPECT_EQ(encoder.GetSearchStat().Frames, frames);
+    *passes = encoder.GetSearchStat().TotalPasses;
+    return res;
+}
+
+TEST(BsEncode, InterpolatingSearch) {
+    size_t bisectionPasses = 0;
+    size_t interpolatePasses = 0;
+
+    auto exact = RunStream<SomeBitFn1>(TBitStreamEncoder::ESearch::Bisection, 16, &bisectionPasses);
+    auto warm = RunStream<SomeBitFn1>(TBitStreamEncoder::ESearch::Interpolate, 16, &interpolatePasses);
+    EXPECT_EQ(warm, exact);
+    EXPECT_LT(interpolatePasses * 2, bisectionPasses);
+
+    exact = RunStream<SomeBitFn2>(TBitStreamEncoder::ESearch::Bisection, 16, &bisectionPasses);
+    warm = RunStream<SomeBitFn2>(TBitStreamEncoder::ESearch::Interpolate, 16, &interpolatePasses);
+    for (size_t bits : warm) {
+        EXPECT_EQ(bits, 993);
+    }
+    EXPECT_EQ(warm, exact);
+    EXPECT_LT(interpolatePasses, bisectionPasses);
+}
+
+static std::unique_ptr<TBitStreamEncoder> CreateStreamEncoder() {
+    std::vector<IBitStreamPartEncoder::TPtr> encoders;
+    encoders.emplace_back(std::make_unique<TStartAlloc>());
+    encoders.emplace_back(std::make_unique<TDriftingAlloc<SomeBitFn1>>());
+    return std::make_unique<TBitStreamEncoder>(std::move(encoders), TBitStreamEncoder::ESearch::Interpolate);
+}
+
+// Frames of two channels with very different targets alternate, as in a
+// stereo writer. The warm start must follow each channel separately.
+static std::vector<size_t> RunAlternating(TBitStreamEncoder& left, TBitStreamEncoder& right, size_t frames) {
+    std::vector<size_t> res;
+    for (size_t frame = 0; frame < frames; frame++) {
+        NBitStream::TBitStream bs[2];
+        TStreamFrame data[2] = {{frame, 1000}, {frame, 500}};
+        left.Do(&data[0], bs[0]);
+        right.Do(&data[1], bs[1]);
+        res.push_back(bs[0].GetSizeInBits());
+        res.push_back(bs[1].GetSizeInBits());
+    }
+    return res;
+}
+
+TEST(BsEncode, InterpolatingSearchPerChannel) {
+    auto shared = CreateStreamEncoder();
+    RunAlternating(*shared, *shared, 16);
+    const size_t sharedPasses = shared->GetSearchStat().TotalPasses;
+
+    auto left = CreateStreamEncoder();
+    auto right = CreateStreamEncoder();
+    const auto bits = RunAlternating(*left, *right, 16);
+    const size_t passes = left->GetSearchStat().TotalPasses + right->GetSearchStat().TotalPasses;
+
+    size_t exactPasses = 0;
+    const auto exactLeft = RunStream<SomeBitFn1>(TBitStreamEncoder::ESearch::Bisection, 16, &exactPasses, 1000);
+    const auto exactRight = RunStream<SomeBitFn1>(TBitStreamEncoder::ESearch::Bisection, 16, &exactPasses, 500);
+    for (size_t frame = 0; frame < 16; frame++) {
+        EXPECT_EQ(bits[2 * frame], exactLeft[frame]);
+        EXPECT_EQ(bits[2 * frame + 1], exactRight[frame]);
+    }
+    // Each stream warm starts from its own previous frame
+    EXPECT_EQ(left->GetSearchStat().Frames, 16);
+    EXPECT_LT(passes, sharedPasses);
+}
@@ -0,0 +1,206 @@
+/*
+ * This file is part of AtracDEnc.
+ *
+ * AtracDEnc is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * AtracDEnc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with AtracDEnc; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#pragma once
+
+#include "config.h"
+#include <lib/fft/kissfft_impl/kiss_fft.h>
+#include <lib/plan_registry/plan_registry.h>
+
+#include <cmath>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// Forward complex FFT of a size known at compile time, no scaling.
+// Buffers are interleaved (re, im) floats, in and out must not overlap.
+// The backend is chosen at build time: TFixedFFT unless
+// ATRACDENC_FFT_KISSFFT is defined.
+
+namespace NFFT {
+
+// Owns a kissfft configuration. kiss_fft only reads it for out of place
+// transforms, so one configuration serves any number of users.
+class TKissPlan {
+    kiss_fft_cfg Cfg;
+    size_t Bytes = 0;
+public:
+    explicit TKissPlan(size_t n)
+    {
+        kiss_fft_alloc(n, false, nullptr, &Bytes);
+        Cfg = kiss_fft_alloc(n, false, nullptr, nullptr);
+    }
+    TKissPlan(TKissPlan&& other)
+        : Cfg(other.Cfg)
+        , Bytes(other.Bytes)
+    {
+        other.Cfg = nullptr;
+    }
+    ~TKissPlan() {
+        kiss_fft_free(Cfg);
+    }
+    TKissPlan(const TKissPlan&) = delete;
+    TKissPlan& operator=(const TKissPlan&) = delete;
+
+    kiss_fft_cfg Get() const { return Cfg; }
+    size_t GetBytes() const { return Bytes; }
+};
+
+inline size_t PlanBytes(const TKissPlan& plan) {
+    return plan.GetBytes();
+}
+
+// Generic kissfft plan
+template<size_t N>
+class TKissFFT {
+    std::shared_ptr<const TKissPlan> Plan;
+public:
+    TKissFFT()
+        : Plan(NAtracDEnc::TPlanRegistry::Get<TKissPlan>("kissfft", N, [] { return TKissPlan(N); }))
+    {}
+
+    void operator()(const float* in, float* out) {
+        kiss_fft(Plan->Get(), reinterpret_cast<const kiss_fft_cpx*>(in), reinterpret_cast<kiss_fft_cpx*>(out));
+    }
+};
+
+// Stockham autosort radix-4 with a final radix-2 pass for odd powers of two.
+// The passes are unrolled at compile time, each one reads its twiddles
+// (w^p, w^2p, w^3p for every p) sequentially from one table.
+// L > 1 runs L independent transforms at once: every complex value is stored
+// as L real parts followed by L imaginary parts, so the innermost loops go
+// across the transforms and vectorize.
+template<size_t N, size_t L = 1>
+class TFixedFFT {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "FFT size must be a power of two");
+
+    static constexpr size_t Passes(size_t n) {
+        return n == 1 ? 0 : n == 2 ? 1 : 1 + Passes(n / 4);
+    }
+
+    // Depend on N only, shared by all transforms of the size
+    std::shared_ptr<const std::vector<float>> Twiddles;
+    std::vector<float> Work;
+
+    static std::vector<float> CalcTwiddles() {
+        std::vector<float> res;
+        for (size_t len = N; len >= 4; len /= 4) {
+            for (size_t p = 0; p < len / 4; p++) {
+                for (size_t k = 1; k <= 3; k++) {
+                    const double a = -2.0 * M_PI * k * p / len;
+                    res.push_back(cos(a));
+                    res.push_back(sin(a));
+                }
+            }
+        }
+        return res;
+    }
+
+    template<size_t S>
+    static void Radix2(const float* x, float* y) {
+        for (size_t q = 0; q < S; q++) {
+            const float* a = x + 2 * L * q;
+            const float* b = x + 2 * L * (q + S);
+            float* y0 = y + 2 * L * q;
+            float* y1 = y + 2 * L * (q + S);
+            for (size_t l = 0; l < 2 * L; l++) {
+                const float av = a[l], bv = b[l];
+                y0[l] = av + bv;
+                y1[l] = av - bv;
+            }
+        }
+    }
+
+    template<size_t Len, size_t S>
+    static void Radix4(const float* x, float* y, const float* tw) {
+        constexpr size_t m = Len / 4;
+        for (size_t p = 0; p < m; p++, tw += 6) {
+            const float w1r = tw[0], w1i = tw[1];
+            const float w2r = tw[2], w2i = tw[3];
+            const float w3r = tw[4], w3i = tw[5];
+            for (size_t q = 0; q < S; q++) {
+                const float* a = x + 2 * L * (q + S * p);
+                const float* b = x + 2 * L * (q + S * (p + m));
+                const float* c = x + 2 * L * (q + S * (p + 2 * m));
+                const float* d = x + 2 * L * (q + S * (p + 3 * m));
+                float* y0 = y + 2 * L * (q + S * (4 * p));
+                float* y1 = y + 2 * L * (q + S * (4 * p + 1));
+                float* y2 = y + 2 * L * (q + S * (4 * p + 2));
+                float* y3 = y + 2 * L * (q + S * (4 * p + 3));
+                for (size_t l = 0; l < L; l++) {
+                    const size_t r = l, i = L + l;
+                    const float apcr = a[r] + c[r], apci = a[i] + c[i];
+                    const float amcr = a[r] - c[r], amci = a[i] - c[i];
+                    const float bpdr = b[r] + d[r], bpdi = b[i] + d[i];
+                    // j * (b - d)
+                    const float jbmdr = d[i] - b[i], jbmdi = b[r] - d[r];
+
+                    y0[r] = apcr + bpdr;
+                    y0[i] = apci + bpdi;
+
+                    const float t1r = amcr - jbmdr, t1i = amci - jbmdi;
+                    y1[r] = t1r * w1r - t1i * w1i;
+                    y1[i] = t1r * w1i + t1i * w1r;
+
+                    const float t2r = apcr - bpdr, t2i = apci - bpdi;
+                    y2[r] = t2r * w2r - t2i * w2i;
+                    y2[i] = t2r * w2i + t2i * w2r;
+
+                    const float t3r = amcr + jbmdr, t3i = amci + jbmdi;
+                    y3[r] = t3r * w3r - t3i * w3i;
+                    y3[i] = t3r * w3i + t3i * w3r;
+                }
+            }
+        }
+    }
+
+    // The last pass must land in out, so passes alternate between out and Work
+    template<size_t Len, size_t S>
+    void Pass(const float* x, float* out, const float* tw) {
+        if constexpr (Len == 2) {
+            Radix2<S>(x, out);
+        } else {
+            constexpr size_t rest = Passes(Len / 4);
+            float* y = (rest % 2 == 0) ? out : Work.data();
+            Radix4<Len, S>(x, y, tw);
+            if constexpr (rest != 0) {
+                Pass<Len / 4, S * 4>(y, out, tw + 6 * (Len / 4));
+            }
+        }
+    }
+
+public:
+    TFixedFFT()
+        : Twiddles(NAtracDEnc::TPlanRegistry::Get<std::vector<float>>("fft_twiddles", N, CalcTwiddles))
+        , Work(2 * N * L)
+    {}
+
+    void operator()(const float* in, float* out) {
+        Pass<N, 1>(in, out, Twiddles->data());
+    }
+};
+
+#ifdef ATRACDENC_FFT_KISSFFT
+template<size_t N>
+using TFFT = TKissFFT<N>;
+#else
+template<size_t N>
+using TFFT = TFixedFFT<N>;
+#endif
+
+} //namespace NFFT
@@ -28,6 +28,10 @@
 
 #ifdef _WIN32
 #include <windows.h>
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <unistd.h>
 #endif
 
 #define OMA_HEADER_SIZE 96
@@ -103,6 +107,24 @@ static FILE* fopen_utf8(const char* path, const char* mode) {
 }
 #endif
 
+/* "-" in write mode means standard output, it is duplicated to be closed as a regular file */
+static FILE* open_file(const char* path, int mode) {
+    const static char* modes[3] = {"", "rb", "wb"};
+    int fd;
+    if (mode != OMAM_W || strcmp(path, "-")) {
+        return fopen_utf8(path, modes[mode]);
+    }
+    fflush(stdout);
+#ifdef _WIN32
+    _setmode(_fileno(stdout), _O_BINARY);
+    fd = _dup(_fileno(stdout));
+    return fd == -1 ? NULL : _fdopen(fd, "wb");
+#else
+    fd = dup(fileno(stdout));
+    return fd == -1 ? NULL : fdopen(fd, "wb");
+#endif
+}
+
 static int oma_check_header(const char* buf) {
     if (memcmp(buf, &ea3_str[0], 3) || buf[4] != 0 || buf[5] != OMA_HEADER_SIZE) {
         return OMAERR_FMT;
@@ -270,8 +292,7 @@ static int oma_parse_header(OMAFILE* file) {
 }
 
 OMAFILE* oma_open(const char *path, int mode, oma_info_t *info) {
-    const static char* modes[3] = {"", "rb", "wb"};
-    FILE* file = fopen_utf8(path, modes[mode]);
+    FILE* file = open_file(path, mode);
     int err = 0;
     if (NULL == file) {
         return NULL;
@@ -22,7 +22,7 @@
 
 namespace NMDCT {
 
-static std::vector<float> CalcSinCos(size_t n, float scale)
+std::vector<float> CalcSinCos(size_t n, float scale)
 {
     std::vector<float> tmp(n >> 1);
     const float alpha = 2.0 * M_PI / (8.0 * n);
@@ -35,20 +35,24 @@ static std::vector<float> CalcSinCos(size_t n, float scale)
     return tmp;
 }
 
+std::shared_ptr<const std::vector<float>> GetSinCos(size_t n, float scale)
+{
+    return NAtracDEnc::TPlanRegistry::Get<std::vector<float>>("mdct_sincos", std::make_pair(n, scale),
+        [n, scale] { return CalcSinCos(n, scale); });
+}
+
 TMDCTBase::TMDCTBase(size_t n, float scale)
     : N(n)
-    , SinCos(CalcSinCos(n, scale))
+    , SinCosPlan(GetSinCos(n, scale))
+    , SinCos(SinCosPlan->data())
+    , Kernels(GetMDCTKernels())
+    , FFTIn(N >> 1)
+    , FFTOut(N >> 1)
 {
-    FFTIn = (kiss_fft_cpx*) malloc(sizeof(kiss_fft_cpx) * N >> 2);
-    FFTOut = (kiss_fft_cpx*) malloc(sizeof(kiss_fft_cpx) * N >> 2);
-    FFTPlan = kiss_fft_alloc(N >> 2, false, nullptr, nullptr);
 }
 
 TMDCTBase::~TMDCTBase()
 {
-    kiss_fft_free(FFTPlan);
-    free(FFTOut);
-    free(FFTIn);
 }
 
 } // namespace NMDCT
@@ -19,21 +19,28 @@
 #pragma once
 
 #include "config.h"
-#include <lib/fft/kissfft_impl/kiss_fft.h>
+#include "mdct_kernels.h"
+#include <lib/fft/fft.h>
+#include <memory>
 #include <vector>
 #include <type_traits>
 
 namespace NMDCT {
 
-static_assert(sizeof(kiss_fft_scalar) == sizeof(float), "size of fft_scalar is not equal to size of float");
+// Interleaved (cos, sin) twiddles of the size n transform
+std::vector<float> CalcSinCos(size_t n, float scale);
+// The same, built once per process and shared
+std::shared_ptr<const std::vector<float>> GetSinCos(size_t n, float scale);
 
 class TMDCTBase {
 protected:
     const size_t N;
-    const std::vector<float> SinCos;
-    kiss_fft_cpx*   FFTIn;
-    kiss_fft_cpx*   FFTOut;
-    kiss_fft_cfg    FFTPlan;
+    const std::shared_ptr<const std::vector<float>> SinCosPlan;
+    const float* const SinCos;
+    const TMDCTKernels& Kernels;
+    // n/4 interleaved complex values each
+    std::vector<float> FFTIn;
+    std::vector<float> FFTOut;
     TMDCTBase(size_t n, float scale);
     virtual ~TMDCTBase();
 };
@@ -41,6 +48,8 @@ protected:
 
 template<size_t TN, typename TIO = float>
 class TMDCT : public TMDCTBase {
+    static_assert(std::is_same<TIO, float>::value, "only float transforms are implemented");
+    NFFT::TFFT<TN/4> FFT;
     std::vector<TIO> Buf;
 public:
     TMDCT(float scale = 1.0)
@@ -49,63 +58,17 @@ public:
     {
     }
     const std::vector<TIO>& operator()(const TIO* in) {
-
-        const size_t n2 = N >> 1;
-        const size_t n4 = N >> 2;
-        const size_t n34 = 3 * n4;
-        const size_t n54 = 5 * n4;
-        const float* cos = &SinCos[0];
-        const float* sin = &SinCos[1];
-
-        float  *xr, *xi, r0, i0;
-        float  c, s;
-        size_t n;
-
-        xr = (float*)FFTIn;
-        xi = (float*)FFTIn + 1;
-        for (n = 0; n < n4; n += 2) {
-            r0 = in[n34 - 1 - n] + in[n34 + n];
-            i0 = in[n4 + n] - in[n4 - 1 - n];
-
-            c = cos[n];
-            s = sin[n];
-
-            xr[n] = r0 * c + i0 * s;
-            xi[n] = i0 * c - r0 * s;
-        }
-
-        for (; n < n2; n += 2) {
-            r0 = in[n34 - 1 - n] - in[n - n4];
-            i0 = in[n4 + n]    + in[n54 - 1 - n];
-
-            c = cos[n];
-            s = sin[n];
-
-            xr[n] = r0 * c + i0 * s;
-            xi[n] = i0 * c - r0 * s;
-        }
-
-        kiss_fft(FFTPlan, FFTIn, FFTOut);
-
-        xr = (float*)FFTOut;
-        xi = (float*)FFTOut + 1;
-        for (n = 0; n < n2; n += 2) {
-            r0 = xr[n];
-            i0 = xi[n];
-
-            c = cos[n];
-            s = sin[n];
-
-            Buf[n] = - r0 * c - i0 * s;
-            Buf[n2 - 1 -n] = - r0 * s + i0 * c;
-        }
-
+        Kernels.MdctPre(in, N, SinCos, FFTIn.data());
+        FFT(FFTIn.data(), FFTOut.data());
+        Kernels.MdctPost(FFTOut.data(), N, SinCos, FFTIn.data(), Buf.data());
         return Buf;
     }
 };
 
 template<size_t TN, typename TIO = float>
 class TMIDCT : public TMDCTBase {
+    static_assert(std::is_same<TIO, float>::value, "only float transforms are implemented");
+    NFFT::TFFT<TN/4> FFT;
     std::vector<TIO> Buf;
 public:
     TMIDCT(float scale = TN)
@@ -113,68 +76,9 @@ public:
         , Buf(TN)
     {}
     const std::vector<TIO>& operator()(const TIO* in) {
-
-        const size_t n2 = N >> 1;
-        const size_t n4 = N >> 2;
-        const size_t n34 = 3 * n4;
-        const size_t n54 = 5 * n4;
-        const float* cos = &SinCos[0];
-        const float* sin = &SinCos[1];
-
-        float *xr, *xi, r0, i0, r1, i1;
-        float c, s;
-        size_t n;
-
-        xr = (float*)FFTIn;
-        xi = (float*)FFTIn + 1;
-
-        for (n = 0; n < n2; n += 2) {
-            r0 = in[n];
-            i0 = in[n2 - 1 - n];
-
-            c = cos[n];
-            s = sin[n];
-
-            xr[n] = -2.0 * (i0 * s + r0 * c);
-            xi[n] = -2.0 * (i0 * c - r0 * s);
-        }
-
-        kiss_fft(FFTPlan, FFTIn, FFTOut);
-
-        xr = (float*)FFTOut;
-        xi = (float*)FFTOut + 1;
-
-        for (n = 0; n < n4; n += 2) {
-            r0 = xr[n];
-            i0 = xi[n];
-
-            c = cos[n];
-            s = sin[n];
-
-            r1 = r0 * c + i0 * s;
-            i1 = r0 * s - i0 * c;
-
-            Buf[n34 - 1 - n] = r1;
-            Buf[n34 + n] = r1;
-            Buf[n4 + n] = i1;
-            Buf[n4 - 1 - n] = -i1;
-        }
-
-        for (; n < n2; n += 2) {
-            r0 = xr[n];
-            i0 = xi[n];
-
-            c = cos[n];
-            s = sin[n];
-
-            r1 = r0 * c + i0 * s;
-            i1 = r0 * s - i0 * c;
-
-            Buf[n34 - 1 - n] = r1;
-            Buf[n - n4] = -r1;
-            Buf[n4 + n] = i1;
-            Buf[n54 - 1 - n] = i1;
-        }
+        Kernels.MidctPre(in, N, SinCos, FFTIn.data());
+        FFT(FFTIn.data(), FFTOut.data());
+        Kernels.MidctPost(FFTOut.data(), N, SinCos, FFTIn.data(), Buf.data());
         return Buf;
     }
 };
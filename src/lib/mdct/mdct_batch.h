@@ -0,0 +1,217 @@
+/*
+ * This file is part of AtracDEnc.
+ *
+ * AtracDEnc is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * AtracDEnc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with AtracDEnc; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#pragma once
+
+#include "mdct.h"
+#include "mdct_kernels.h"
+#include <lib/fft/fft.h>
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+// Many equal size transforms at once. Blocks are transposed into a
+// structure of arrays (sample i of lane l at [i * TLanes + l]) and every
+// loop runs across TLanes blocks, so it vectorizes whatever the block size.
+// The arithmetic is the same as TMDCT/TMIDCT with the fixed FFT.
+// No allocation after construction.
+
+namespace NMDCT {
+
+template<size_t TN, size_t TLanes>
+class TMDCTBatch {
+    static_assert(TN >= 16, "transform is too short");
+    const std::shared_ptr<const std::vector<float>> SinCos;
+    NFFT::TFixedFFT<TN/4, TLanes> FFT;
+    std::vector<float> Soa;
+    std::vector<float> FFTIn;
+    std::vector<float> FFTOut;
+
+    void Chunk(const float* const* in, float* const* out, size_t count) {
+        constexpr size_t L = TLanes;
+        constexpr size_t n2 = TN >> 1;
+        constexpr size_t n4 = TN >> 2;
+        constexpr size_t n34 = 3 * n4;
+        constexpr size_t n54 = 5 * n4;
+        const float* cs = SinCos->data();
+        float* x = Soa.data();
+
+        TransposeToLanes(in, count, TN, L, x);
+
+        size_t k;
+        for (k = 0; k < n4; k += 2) {
+            const float c = cs[k];
+            const float s = cs[k + 1];
+            const float* a = x + (n34 - 1 - k) * L;
+            const float* b = x + (n34 + k) * L;
+            const float* p = x + (n4 + k) * L;
+            const float* q = x + (n4 - 1 - k) * L;
+            float* xr = FFTIn.data() + k * L;
+            float* xi = xr + L;
+            for (size_t l = 0; l < L; l++) {
+                const float r0 = a[l] + b[l];
+                const float i0 = p[l] - q[l];
+                xr[l] = r0 * c + i0 * s;
+                xi[l] = i0 * c - r0 * s;
+            }
+        }
+        for (; k < n2; k += 2) {
+            const float c = cs[k];
+            const float s = cs[k + 1];
+            const float* a = x + (n34 - 1 - k) * L;
+            const float* b = x + (k - n4) * L;
+            const float* p = x + (n4 + k) * L;
+            const float* q = x + (n54 - 1 - k) * L;
+            float* xr = FFTIn.data() + k * L;
+            float* xi = xr + L;
+            for (size_t l = 0; l < L; l++) {
+                const float r0 = a[l] - b[l];
+                const float i0 = p[l] + q[l];
+                xr[l] = r0 * c + i0 * s;
+                xi[l] = i0 * c - r0 * s;
+            }
+        }
+
+        FFT(FFTIn.data(), FFTOut.data());
+
+        for (k = 0; k < n2; k += 2) {
+            const float c = cs[k];
+            const float s = cs[k + 1];
+            const float* xr = FFTOut.data() + k * L;
+            const float* xi = xr + L;
+            float* y0 = x + k * L;
+            float* y1 = x + (n2 - 1 - k) * L;
+            for (size_t l = 0; l < L; l++) {
+                y0[l] = - xr[l] * c - xi[l] * s;
+                y1[l] = - xr[l] * s + xi[l] * c;
+            }
+        }
+
+        TransposeFromLanes(x, L, count, n2, out);
+    }
+
+public:
+    explicit TMDCTBatch(float scale = 1.0)
+        : SinCos(GetSinCos(TN, scale))
+        , Soa(TN * TLanes)
+        , FFTIn(TN / 2 * TLanes)
+        , FFTOut(TN / 2 * TLanes)
+    {}
+
+    // in[b]: TN samples, out[b]: TN/2 coefficients, b < count
+    void operator()(const float* const* in, float* const* out, size_t count) {
+        for (size_t b = 0; b < count; b += TLanes) {
+            Chunk(in + b, out + b, std::min(count - b, TLanes));
+        }
+    }
+};
+
+template<size_t TN, size_t TLanes>
+class TMIDCTBatch {
+    static_assert(TN >= 16, "transform is too short");
+    const std::shared_ptr<const std::vector<float>> SinCos;
+    NFFT::TFixedFFT<TN/4, TLanes> FFT;
+    std::vector<float> Soa;
+    std::vector<float> FFTIn;
+    std::vector<float> FFTOut;
+
+    void Chunk(const float* const* in, float* const* out, size_t count) {
+        constexpr size_t L = TLanes;
+        constexpr size_t n2 = TN >> 1;
+        constexpr size_t n4 = TN >> 2;
+        constexpr size_t n34 = 3 * n4;
+        constexpr size_t n54 = 5 * n4;
+        const float* cs = SinCos->data();
+        float* x = Soa.data();
+
+        TransposeToLanes(in, count, n2, L, x);
+
+        size_t k;
+        for (k = 0; k < n2; k += 2) {
+            const float c = cs[k];
+            const float s = cs[k + 1];
+            const float* a = x + k * L;
+            const float* b = x + (n2 - 1 - k) * L;
+            float* xr = FFTIn.data() + k * L;
+            float* xi = xr + L;
+            for (size_t l = 0; l < L; l++) {
+                xr[l] = -2.0f * (b[l] * s + a[l] * c);
+                xi[l] = -2.0f * (b[l] * c - a[l] * s);
+            }
+        }
+
+        FFT(FFTIn.data(), FFTOut.data());
+
+        for (k = 0; k < n4; k += 2) {
+            const float c = cs[k];
+            const float s = cs[k + 1];
+            const float* xr = FFTOut.data() + k * L;
+            const float* xi = xr + L;
+            float* y0 = x + (n34 - 1 - k) * L;
+            float* y1 = x + (n34 + k) * L;
+            float* y2 = x + (n4 + k) * L;
+            float* y3 = x + (n4 - 1 - k) * L;
+            for (size_t l = 0; l < L; l++) {
+                const float r1 = xr[l] * c + xi[l] * s;
+                const float i1 = xr[l] * s - xi[l] * c;
+                y0[l] = r1;
+                y1[l] = r1;
+                y2[l] = i1;
+                y3[l] = -i1;
+            }
+        }
+        for (; k < n2; k += 2) {
+            const float c = cs[k];
+            const float s = cs[k + 1];
+            const float* xr = FFTOut.data() + k * L;
+            const float* xi = xr + L;
+            float* y0 = x + (n34 - 1 - k) * L;
+            float* y1 = x + (k - n4) * L;
+            float* y2 = x + (n4 + k) * L;
+            float* y3 = x + (n54 - 1 - k) * L;
+            for (size_t l = 0; l < L; l++) {
+                const float r1 = xr[l] * c + xi[l] * s;
+                const float i1 = xr[l] * s - xi[l] * c;
+                y0[l] = r1;
+                y1[l] = -r1;
+                y2[l] = i1;
+                y3[l] = i1;
+            }
+        }
+
+        TransposeFromLanes(x, L, count, TN, out);
+    }
+
+public:
+    explicit TMIDCTBatch(float scale = TN)
+        : SinCos(GetSinCos(TN, scale / 2))
+        , Soa(TN * TLanes)
+        , FFTIn(TN / 2 * TLanes)
+        , FFTOut(TN / 2 * TLanes)
+    {}
+
+    // in[b]: TN/2 coefficients, out[b]: TN samples, b < count
+    void operator()(const float* const* in, float* const* out, size_t count) {
+        for (size_t b = 0; b < count; b += TLanes) {
+            Chunk(in + b, out + b, std::min(count - b, TLanes));
+        }
+    }
+};
+
+} //namespace NMDCT
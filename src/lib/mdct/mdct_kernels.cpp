@@ -0,0 +1,372 @@
+/*
+ * This file is part of AtracDEnc.
+ *
+ * AtracDEnc is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * AtracDEnc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with AtracDEnc; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "mdct_kernels_impl.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define ATDE_MDCT_X86
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ATDE_MDCT_SSE2
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#include <arm_neon.h>
+#define ATDE_MDCT_NEON
+#endif
+
+#if defined(ATDE_MDCT_X86) && defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+namespace NMDCT {
+
+void ScalarMdctPre(const float* in, size_t n, const float* sinCos, float* fft)
+{
+    const size_t n2 = n >> 1;
+    const size_t n4 = n >> 2;
+    const size_t n34 = 3 * n4;
+    const size_t n54 = 5 * n4;
+    const float* cos = &sinCos[0];
+    const float* sin = &sinCos[1];
+
+    float  *xr, *xi, r0, i0;
+    float  c, s;
+    size_t k;
+
+    xr = fft;
+    xi = fft + 1;
+    for (k = 0; k < n4; k += 2) {
+        r0 = in[n34 - 1 - k] + in[n34 + k];
+        i0 = in[n4 + k] - in[n4 - 1 - k];
+
+        c = cos[k];
+        s = sin[k];
+
+        xr[k] = r0 * c + i0 * s;
+        xi[k] = i0 * c - r0 * s;
+    }
+
+    for (; k < n2; k += 2) {
+        r0 = in[n34 - 1 - k] - in[k - n4];
+        i0 = in[n4 + k]    + in[n54 - 1 - k];
+
+        c = cos[k];
+        s = sin[k];
+
+        xr[k] = r0 * c + i0 * s;
+        xi[k] = i0 * c - r0 * s;
+    }
+}
+
+void ScalarMdctPost(const float* fft, size_t n, const float* sinCos, float*, float* out)
+{
+    const size_t n2 = n >> 1;
+    const float* cos = &sinCos[0];
+    const float* sin = &sinCos[1];
+
+    const float *xr = fft;
+    const float *xi = fft + 1;
+    for (size_t k = 0; k < n2; k += 2) {
+        const float r0 = xr[k];
+        const float i0 = xi[k];
+
+        const float c = cos[k];
+        const float s = sin[k];
+
+        out[k] = - r0 * c - i0 * s;
+        out[n2 - 1 - k] = - r0 * s + i0 * c;
+    }
+}
+
+void ScalarMidctPre(const float* in, size_t n, const float* sinCos, float* fft)
+{
+    const size_t n2 = n >> 1;
+    const float* cos = &sinCos[0];
+    const float* sin = &sinCos[1];
+
+    float *xr = fft;
+    float *xi = fft + 1;
+    for (size_t k = 0; k < n2; k += 2) {
+        const float r0 = in[k];
+        const float i0 = in[n2 - 1 - k];
+
+        const float c = cos[k];
+        const float s = sin[k];
+
+        xr[k] = -2.0 * (i0 * s + r0 * c);
+        xi[k] = -2.0 * (i0 * c - r0 * s);
+    }
+}
+
+void ScalarMidctPost(const float* fft, size_t n, const float* sinCos, float*, float* out)
+{
+    const size_t n2 = n >> 1;
+    const size_t n4 = n >> 2;
+    const size_t n34 = 3 * n4;
+    const size_t n54 = 5 * n4;
+    const float* cos = &sinCos[0];
+    const float* sin = &sinCos[1];
+
+    const float *xr = fft;
+    const float *xi = fft + 1;
+    float r0, i0, r1, i1;
+    float c, s;
+    size_t k;
+
+    for (k = 0; k < n4; k += 2) {
+        r0 = xr[k];
+        i0 = xi[k];
+
+        c = cos[k];
+        s = sin[k];
+
+        r1 = r0 * c + i0 * s;
+        i1 = r0 * s - i0 * c;
+
+        out[n34 - 1 - k] = r1;
+        out[n34 + k] = r1;
+        out[n4 + k] = i1;
+        out[n4 - 1 - k] = -i1;
+    }
+
+    for (; k < n2; k += 2) {
+        r0 = xr[k];
+        i0 = xi[k];
+
+        c = cos[k];
+        s = sin[k];
+
+        r1 = r0 * c + i0 * s;
+        i1 = r0 * s - i0 * c;
+
+        out[n34 - 1 - k] = r1;
+        out[k - n4] = -r1;
+        out[n4 + k] = i1;
+        out[n54 - 1 - k] = i1;
+    }
+}
+
+namespace {
+
+const TMDCTKernels ScalarKernels = {
+    "scalar", &ScalarMdctPre, &ScalarMdctPost, &ScalarMidctPre, &ScalarMidctPost
+};
+
+#if defined(ATDE_MDCT_SSE2)
+struct TSse2 {
+    typedef __m128 T;
+    static constexpr size_t W = 4;
+    static T Load(const float* p) { return _mm_loadu_ps(p); }
+    static void Store(float* p, T v) { _mm_storeu_ps(p, v); }
+    static T LoadEven(const float* p) {
+        return _mm_shuffle_ps(_mm_loadu_ps(p), _mm_loadu_ps(p + 4), _MM_SHUFFLE(2, 0, 2, 0));
+    }
+    static T LoadOdd(const float* p) {
+        return _mm_shuffle_ps(_mm_loadu_ps(p), _mm_loadu_ps(p + 4), _MM_SHUFFLE(3, 1, 3, 1));
+    }
+    static void StoreInterleave(float* p, T a, T b) {
+        _mm_storeu_ps(p, _mm_unpacklo_ps(a, b));
+        _mm_storeu_ps(p + 4, _mm_unpackhi_ps(a, b));
+    }
+    static T Rev(T v) { return _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 1, 2, 3)); }
+    static T Add(T a, T b) { return _mm_add_ps(a, b); }
+    static T Sub(T a, T b) { return _mm_sub_ps(a, b); }
+    static T Mul(T a, T b) { return _mm_mul_ps(a, b); }
+    static T Neg(T v) { return _mm_xor_ps(v, _mm_set1_ps(-0.0f)); }
+    static T Set1(float x) { return _mm_set1_ps(x); }
+};
+
+const TMDCTKernels Sse2Kernels = MakeKernels<TSse2>("sse2");
+#endif
+
+#if defined(ATDE_MDCT_NEON)
+struct TNeon {
+    typedef float32x4_t T;
+    static constexpr size_t W = 4;
+    static T Load(const float* p) { return vld1q_f32(p); }
+    static void Store(float* p, T v) { vst1q_f32(p, v); }
+    static T LoadEven(const float* p) { return vld2q_f32(p).val[0]; }
+    static T LoadOdd(const float* p) { return vld2q_f32(p).val[1]; }
+    static void StoreInterleave(float* p, T a, T b) {
+        float32x4x2_t v;
+        v.val[0] = a;
+        v.val[1] = b;
+        vst2q_f32(p, v);
+    }
+    static T Rev(T v) {
+        v = vrev64q_f32(v);
+        return vcombine_f32(vget_high_f32(v), vget_low_f32(v));
+    }
+    static T Add(T a, T b) { return vaddq_f32(a, b); }
+    static T Sub(T a, T b) { return vsubq_f32(a, b); }
+    static T Mul(T a, T b) { return vmulq_f32(a, b); }
+    static T Neg(T v) { return vnegq_f32(v); }
+    static T Set1(float x) { return vdupq_n_f32(x); }
+};
+
+const TMDCTKernels NeonKernels = MakeKernels<TNeon>("neon");
+#endif
+
+#if defined(ATDE_MDCT_X86) && defined(ATRACDENC_MDCT_AVX2)
+bool HasAvx2() {
+#if defined(_MSC_VER) && !defined(__clang__)
+    int regs[4];
+    __cpuid(regs, 0);
+    if (regs[0] < 7)
+        return false;
+    __cpuid(regs, 1);
+    // OSXSAVE and AVX, then the OS must save the YMM state
+    if ((regs[2] & (1 << 27)) == 0 || (regs[2] & (1 << 28)) == 0)
+        return false;
+    if ((_xgetbv(0) & 6) != 6)
+        return false;
+    __cpuidex(regs, 7, 0);
+    return (regs[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+const TMDCTKernels& SelectKernels() {
+    const std::vector<const TMDCTKernels*> kernels = GetAvailableMDCTKernels();
+    return *kernels.back();
+}
+
+#if defined(ATDE_MDCT_SSE2)
+typedef __m128 TQuad;
+inline TQuad LoadQuad(const float* p) { return _mm_loadu_ps(p); }
+inline void StoreQuad(float* p, TQuad v) { _mm_storeu_ps(p, v); }
+inline void Transpose4(TQuad& r0, TQuad& r1, TQuad& r2, TQuad& r3) { _MM_TRANSPOSE4_PS(r0, r1, r2, r3); }
+#define ATDE_MDCT_QUAD
+#elif defined(ATDE_MDCT_NEON)
+typedef float32x4_t TQuad;
+inline TQuad LoadQuad(const float* p) { return vld1q_f32(p); }
+inline void StoreQuad(float* p, TQuad v) { vst1q_f32(p, v); }
+inline void Transpose4(TQuad& r0, TQuad& r1, TQuad& r2, TQuad& r3) {
+    const float32x4x2_t t01 = vtrnq_f32(r0, r1);
+    const float32x4x2_t t23 = vtrnq_f32(r2, r3);
+    r0 = vcombine_f32(vget_low_f32(t01.val[0]), vget_low_f32(t23.val[0]));
+    r1 = vcombine_f32(vget_low_f32(t01.val[1]), vget_low_f32(t23.val[1]));
+    r2 = vcombine_f32(vget_high_f32(t01.val[0]), vget_high_f32(t23.val[0]));
+    r3 = vcombine_f32(vget_high_f32(t01.val[1]), vget_high_f32(t23.val[1]));
+}
+#define ATDE_MDCT_QUAD
+#endif
+
+} // namespace
+
+void TransposeToLanes(const float* const* in, size_t count, size_t n, size_t numLanes, float* lanes)
+{
+    size_t l = 0;
+#if defined(ATDE_MDCT_QUAD)
+    // 4x4 tiles: four blocks by four samples
+    for (; l + 4 <= count; l += 4) {
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            TQuad r0 = LoadQuad(in[l] + i);
+            TQuad r1 = LoadQuad(in[l + 1] + i);
+            TQuad r2 = LoadQuad(in[l + 2] + i);
+            TQuad r3 = LoadQuad(in[l + 3] + i);
+            Transpose4(r0, r1, r2, r3);
+            StoreQuad(lanes + i * numLanes + l, r0);
+            StoreQuad(lanes + (i + 1) * numLanes + l, r1);
+            StoreQuad(lanes + (i + 2) * numLanes + l, r2);
+            StoreQuad(lanes + (i + 3) * numLanes + l, r3);
+        }
+        for (; i < n; i++) {
+            for (size_t j = 0; j < 4; j++) {
+                lanes[i * numLanes + l + j] = in[l + j][i];
+            }
+        }
+    }
+#endif
+    for (; l < count; l++) {
+        for (size_t i = 0; i < n; i++) {
+            lanes[i * numLanes + l] = in[l][i];
+        }
+    }
+    for (; l < numLanes; l++) {
+        for (size_t i = 0; i < n; i++) {
+            lanes[i * numLanes + l] = 0.0f;
+        }
+    }
+}
+
+void TransposeFromLanes(const float* lanes, size_t numLanes, size_t count, size_t n, float* const* out)
+{
+    size_t l = 0;
+#if defined(ATDE_MDCT_QUAD)
+    for (; l + 4 <= count; l += 4) {
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            TQuad r0 = LoadQuad(lanes + i * numLanes + l);
+            TQuad r1 = LoadQuad(lanes + (i + 1) * numLanes + l);
+            TQuad r2 = LoadQuad(lanes + (i + 2) * numLanes + l);
+            TQuad r3 = LoadQuad(lanes + (i + 3) * numLanes + l);
+            Transpose4(r0, r1, r2, r3);
+            StoreQuad(out[l] + i, r0);
+            StoreQuad(out[l + 1] + i, r1);
+            StoreQuad(out[l + 2] + i, r2);
+            StoreQuad(out[l + 3] + i, r3);
+        }
+        for (; i < n; i++) {
+            for (size_t j = 0; j < 4; j++) {
+                out[l + j][i] = lanes[i * numLanes + l + j];
+            }
+        }
+    }
+#endif
+    for (; l < count; l++) {
+        for (size_t i = 0; i < n; i++) {
+            out[l][i] = lanes[i * numLanes + l];
+        }
+    }
+}
+
+const TMDCTKernels& GetScalarMDCTKernels()
+{
+    return ScalarKernels;
+}
+
+std::vector<const TMDCTKernels*> GetAvailableMDCTKernels()
+{
+    std::vector<const TMDCTKernels*> res;
+    res.push_back(&ScalarKernels);
+#if defined(ATDE_MDCT_SSE2)
+    res.push_back(&Sse2Kernels);
+#endif
+#if defined(ATDE_MDCT_NEON)
+    res.push_back(&NeonKernels);
+#endif
+#if defined(ATDE_MDCT_X86) && defined(ATRACDENC_MDCT_AVX2)
+    if (HasAvx2())
+        res.push_back(&MDCTKernelsAvx2);
+#endif
+    return res;
+}
+
+const TMDCTKernels& GetMDCTKernels()
+{
+    static const TMDCTKernels& kernels = SelectKernels();
+    return kernels;
+}
+
+} //namespace NMDCT
@@ -0,0 +1,54 @@
+/*
+ * This file is part of AtracDEnc.
+ *
+ * AtracDEnc is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * AtracDEnc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with AtracDEnc; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace NMDCT {
+
+// Steps of the MDCT/IMDCT of size n around the n/4 point complex FFT.
+// sinCos holds interleaved (cos, sin) twiddles, fft buffers are interleaved
+// complex. scratch is n/2 floats, it may be the (consumed) FFT input.
+struct TMDCTKernels {
+    const char* Name;
+    // Fold the n input samples and rotate them into the FFT input
+    void (*MdctPre)(const float* in, size_t n, const float* sinCos, float* fft);
+    // Rotate the FFT output into n/2 coefficients
+    void (*MdctPost)(const float* fft, size_t n, const float* sinCos, float* scratch, float* out);
+    // Rotate n/2 coefficients into the FFT input
+    void (*MidctPre)(const float* in, size_t n, const float* sinCos, float* fft);
+    // Rotate the FFT output and unfold it into n samples
+    void (*MidctPost)(const float* fft, size_t n, const float* sinCos, float* scratch, float* out);
+};
+
+const TMDCTKernels& GetScalarMDCTKernels();
+
+// Kernels supported by the build and the running CPU, scalar first
+std::vector<const TMDCTKernels*> GetAvailableMDCTKernels();
+
+// The fastest available kernels, detected once
+const TMDCTKernels& GetMDCTKernels();
+
+// Sample i of block l goes to lanes[i * numLanes + l], lanes past count are zeroed
+void TransposeToLanes(const float* const* in, size_t count, size_t n, size_t numLanes, float* lanes);
+// The reverse, for the first count lanes
+void TransposeFromLanes(const float* lanes, size_t numLanes, size_t count, size_t n, float* const* out);
+
+} //namespace NMDCT
@@ -0,0 +1,67 @@
+/*
+ * This file is part of AtracDEnc.
+ *
+ * AtracDEnc is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * AtracDEnc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with AtracDEnc; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+// Built with AVX2 code generation, used only after the runtime CPU check.
+// Do not call anything inline from other headers here: a copy compiled
+// for AVX2 could be picked by the linker for the generic callers.
+
+#include "mdct_kernels_impl.h"
+
+#if defined(__AVX2__)
+
+#include <immintrin.h>
+
+namespace NMDCT {
+
+namespace {
+
+struct TAvx2 {
+    typedef __m256 T;
+    static constexpr size_t W = 8;
+    static T Load(const float* p) { return _mm256_loadu_ps(p); }
+    static void Store(float* p, T v) { _mm256_storeu_ps(p, v); }
+    // In lane shuffle gives a0 a2 b0 b2 | a4 a6 b4 b6, then reorder the 64 bit halves
+    static T LoadEven(const float* p) {
+        const T t = _mm256_shuffle_ps(_mm256_loadu_ps(p), _mm256_loadu_ps(p + 8), _MM_SHUFFLE(2, 0, 2, 0));
+        return _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(t), _MM_SHUFFLE(3, 1, 2, 0)));
+    }
+    static T LoadOdd(const float* p) {
+        const T t = _mm256_shuffle_ps(_mm256_loadu_ps(p), _mm256_loadu_ps(p + 8), _MM_SHUFFLE(3, 1, 3, 1));
+        return _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(t), _MM_SHUFFLE(3, 1, 2, 0)));
+    }
+    static void StoreInterleave(float* p, T a, T b) {
+        const T lo = _mm256_unpacklo_ps(a, b);
+        const T hi = _mm256_unpackhi_ps(a, b);
+        _mm256_storeu_ps(p, _mm256_permute2f128_ps(lo, hi, 0x20));
+        _mm256_storeu_ps(p + 8, _mm256_permute2f128_ps(lo, hi, 0x31));
+    }
+    static T Rev(T v) { return _mm256_permutevar8x32_ps(v, _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0)); }
+    static T Add(T a, T b) { return _mm256_add_ps(a, b); }
+    static T Sub(T a, T b) { return _mm256_sub_ps(a, b); }
+    static T Mul(T a, T b) { return _mm256_mul_ps(a, b); }
+    static T Neg(T v) { return _mm256_xor_ps(v, _mm256_set1_ps(-0.0f)); }
+    static T Set1(float x) { return _mm256_set1_ps(x); }
+};
+
+} // namespace
+
+extern const TMDCTKernels MDCTKernelsAvx2 = MakeKernels<TAvx2>("avx2");
+
+} //namespace NMDCT
+
+#endif
@@ -0,0 +1,175 @@
+/*
+ * This file is part of AtracDEnc.
+ *
+ * AtracDEnc is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * AtracDEnc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with AtracDEnc; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#pragma once
+
+// Private to the mdct kernel sources.
+// The loops are written once over a vector traits class V:
+//   W                      - number of floats in a vector
+//   Load / Store           - W contiguous floats
+//   LoadEven / LoadOdd     - even / odd elements of 2*W contiguous floats
+//   StoreInterleave(p,a,b) - p[2i] = a[i], p[2i + 1] = b[i]
+//   Rev                    - reverse the elements
+//   Add / Sub / Mul / Neg / Set1
+// Every operation matches the scalar code one to one (no fused multiply-add),
+// so results are the same as the scalar kernels unless the compiler contracts.
+// Everything here has internal linkage: the file is compiled with different
+// target flags and the instances must not be merged by the linker.
+
+#include "mdct_kernels.h"
+
+namespace NMDCT {
+
+void ScalarMdctPre(const float* in, size_t n, const float* sinCos, float* fft);
+void ScalarMdctPost(const float* fft, size_t n, const float* sinCos, float* scratch, float* out);
+void ScalarMidctPre(const float* in, size_t n, const float* sinCos, float* fft);
+void ScalarMidctPost(const float* fft, size_t n, const float* sinCos, float* scratch, float* out);
+
+extern const TMDCTKernels MDCTKernelsAvx2;
+
+namespace {
+
+template<class V>
+inline bool Supported(size_t n) {
+    return n % (8 * V::W) == 0;
+}
+
+template<class V>
+void VecMdctPre(const float* in, size_t n, const float* sinCos, float* fft) {
+    if (!Supported<V>(n))
+        return ScalarMdctPre(in, n, sinCos, fft);
+
+    typedef typename V::T T;
+    const size_t w2 = 2 * V::W;
+    const size_t n4 = n >> 2;
+    const size_t n8 = n >> 3;
+    const size_t n34 = 3 * n4;
+    const size_t n54 = 5 * n4;
+
+    size_t k = 0;
+    for (; k < n8; k += V::W) {
+        const T r = V::Add(V::Rev(V::LoadOdd(in + n34 - 2 * k - w2)), V::LoadEven(in + n34 + 2 * k));
+        const T i = V::Sub(V::LoadEven(in + n4 + 2 * k), V::Rev(V::LoadOdd(in + n4 - 2 * k - w2)));
+        const T c = V::LoadEven(sinCos + 2 * k);
+        const T s = V::LoadOdd(sinCos + 2 * k);
+        V::StoreInterleave(fft + 2 * k,
+            V::Add(V::Mul(r, c), V::Mul(i, s)),
+            V::Sub(V::Mul(i, c), V::Mul(r, s)));
+    }
+    for (; k < n4; k += V::W) {
+        const T r = V::Sub(V::Rev(V::LoadOdd(in + n34 - 2 * k - w2)), V::LoadEven(in + 2 * k - n4));
+        const T i = V::Add(V::LoadEven(in + n4 + 2 * k), V::Rev(V::LoadOdd(in + n54 - 2 * k - w2)));
+        const T c = V::LoadEven(sinCos + 2 * k);
+        const T s = V::LoadOdd(sinCos + 2 * k);
+        V::StoreInterleave(fft + 2 * k,
+            V::Add(V::Mul(r, c), V::Mul(i, s)),
+            V::Sub(V::Mul(i, c), V::Mul(r, s)));
+    }
+}
+
+template<class V>
+void VecMdctPost(const float* fft, size_t n, const float* sinCos, float* scratch, float* out) {
+    if (!Supported<V>(n))
+        return ScalarMdctPost(fft, n, sinCos, scratch, out);
+
+    typedef typename V::T T;
+    const size_t n4 = n >> 2;
+    float* a = scratch;
+    float* b = scratch + n4;
+
+    for (size_t k = 0; k < n4; k += V::W) {
+        const T r = V::LoadEven(fft + 2 * k);
+        const T i = V::LoadOdd(fft + 2 * k);
+        const T c = V::LoadEven(sinCos + 2 * k);
+        const T s = V::LoadOdd(sinCos + 2 * k);
+        V::Store(a + k, V::Sub(V::Neg(V::Mul(r, c)), V::Mul(i, s)));
+        V::Store(b + k, V::Add(V::Neg(V::Mul(r, s)), V::Mul(i, c)));
+    }
+
+    // out[2m] = a[m], out[2m + 1] = b[n/4 - 1 - m]
+    for (size_t m = 0; m < n4; m += V::W) {
+        V::StoreInterleave(out + 2 * m, V::Load(a + m), V::Rev(V::Load(b + n4 - m - V::W)));
+    }
+}
+
+template<class V>
+void VecMidctPre(const float* in, size_t n, const float* sinCos, float* fft) {
+    if (!Supported<V>(n))
+        return ScalarMidctPre(in, n, sinCos, fft);
+
+    typedef typename V::T T;
+    const size_t n2 = n >> 1;
+    const size_t n4 = n >> 2;
+    const T m2 = V::Set1(-2.0f);
+
+    for (size_t k = 0; k < n4; k += V::W) {
+        const T r = V::LoadEven(in + 2 * k);
+        const T i = V::Rev(V::LoadOdd(in + n2 - 2 * k - 2 * V::W));
+        const T c = V::LoadEven(sinCos + 2 * k);
+        const T s = V::LoadOdd(sinCos + 2 * k);
+        V::StoreInterleave(fft + 2 * k,
+            V::Mul(m2, V::Add(V::Mul(i, s), V::Mul(r, c))),
+            V::Mul(m2, V::Sub(V::Mul(i, c), V::Mul(r, s))));
+    }
+}
+
+template<class V>
+void VecMidctPost(const float* fft, size_t n, const float* sinCos, float* scratch, float* out) {
+    if (!Supported<V>(n))
+        return ScalarMidctPost(fft, n, sinCos, scratch, out);
+
+    typedef typename V::T T;
+    const size_t n4 = n >> 2;
+    const size_t n8 = n >> 3;
+    const size_t n34 = 3 * n4;
+    float* r1 = scratch;
+    float* i1 = scratch + n4;
+
+    for (size_t k = 0; k < n4; k += V::W) {
+        const T r = V::LoadEven(fft + 2 * k);
+        const T i = V::LoadOdd(fft + 2 * k);
+        const T c = V::LoadEven(sinCos + 2 * k);
+        const T s = V::LoadOdd(sinCos + 2 * k);
+        V::Store(r1 + k, V::Add(V::Mul(r, c), V::Mul(i, s)));
+        V::Store(i1 + k, V::Sub(V::Mul(r, s), V::Mul(i, c)));
+    }
+
+    // [0, n/4): out[2m] = -r1[n/8 + m], out[2m + 1] = -i1[n/8 - 1 - m]
+    for (size_t m = 0; m < n8; m += V::W) {
+        V::StoreInterleave(out + 2 * m,
+            V::Neg(V::Load(r1 + n8 + m)),
+            V::Neg(V::Rev(V::Load(i1 + n8 - m - V::W))));
+    }
+    // [n/4, 3n/4): out[n/4 + 2m] = i1[m], out[n/4 + 2m + 1] = r1[n/4 - 1 - m]
+    for (size_t m = 0; m < n4; m += V::W) {
+        V::StoreInterleave(out + n4 + 2 * m, V::Load(i1 + m), V::Rev(V::Load(r1 + n4 - m - V::W)));
+    }
+    // [3n/4, n): out[3n/4 + 2m] = r1[m], out[3n/4 + 2m + 1] = i1[n/4 - 1 - m]
+    for (size_t m = 0; m < n8; m += V::W) {
+        V::StoreInterleave(out + n34 + 2 * m, V::Load(r1 + m), V::Rev(V::Load(i1 + n4 - m - V::W)));
+    }
+}
+
+template<class V>
+constexpr TMDCTKernels MakeKernels(const char* name) {
+    return {name, &VecMdctPre<V>, &VecMdctPost<V>, &VecMidctPre<V>, &VecMidctPost<V>};
+}
+
+} // namespace
+
+} //namespace NMDCT
@@ -17,6 +17,7 @@
  */
 
 #include "mdct.h"
+#include "mdct_batch.h"
 #include "mdct_ut_common.h"
 #include <gtest/gtest.h>
 
@@ -226,3 +227,137 @@ TEST(TMdctTest, MIDCT256_RAND) {
         EXPECT_NEAR(res1[i], res2[i], eps);
     }
 }
+
+TEST(TMdctTest, KernelsMatchScalar) {
+    const TMDCTKernels& ref = GetScalarMDCTKernels();
+    for (const TMDCTKernels* kernels : GetAvailableMDCTKernels()) {
+        SCOPED_TRACE(kernels->Name);
+        for (size_t n : {16, 32, 64, 128, 256, 512}) {
+            SCOPED_TRACE(n);
+            vector<float> in(n);
+            vector<float> sinCos(n / 2);
+            fill_random(in, n, 0x4b524e4cu + n);
+            fill_random(sinCos, n / 2, 0x54574944u + n);
+            for (auto& x : sinCos) {
+                x /= 32768.0f;
+            }
+
+            vector<float> fft1(n / 2), fft2(n / 2), scratch(n / 2);
+            vector<float> out1(n), out2(n);
+
+            ref.MdctPre(in.data(), n, sinCos.data(), fft1.data());
+            kernels->MdctPre(in.data(), n, sinCos.data(), fft2.data());
+            float eps = CalcEps(max_magnitude(fft1, fft2) * 4);
+            for (size_t i = 0; i < n / 2; i++) {
+                EXPECT_NEAR(fft1[i], fft2[i], eps);
+            }
+
+            ref.MdctPost(in.data(), n, sinCos.data(), scratch.data(), out1.data());
+            kernels->MdctPost(in.data(), n, sinCos.data(), scratch.data(), out2.data());
+            eps = CalcEps(max_magnitude(out1, out2) * 4);
+            for (size_t i = 0; i < n / 2; i++) {
+                EXPECT_NEAR(out1[i], out2[i], eps);
+            }
+
+            ref.MidctPre(in.data(), n, sinCos.data(), fft1.data());
+            kernels->MidctPre(in.data(), n, sinCos.data(), fft2.data());
+            eps = CalcEps(max_magnitude(fft1, fft2) * 4);
+            for (size_t i = 0; i < n / 2; i++) {
+                EXPECT_NEAR(fft1[i], fft2[i], eps);
+            }
+
+            ref.MidctPost(in.data(), n, sinCos.data(), scratch.data(), out1.data());
+            kernels->MidctPost(in.data(), n, sinCos.data(), scratch.data(), out2.data());
+            eps = CalcEps(max_magnitude(out1, out2) * 4);
+            for (size_t i = 0; i < n; i++) {
+                EXPECT_NEAR(out1[i], out2[i], eps);
+            }
+        }
+    }
+}
+
+template<size_t N, class TFft>
+static void CheckFFT(uint32_t seed) {
+    vector<float> in(2 * N);
+    fill_random(in, 2 * N, seed);
+    vector<float> out(2 * N);
+    TFft fft;
+    fft(in.data(), out.data());
+
+    vector<float> ref(2 * N);
+    for (size_t k = 0; k < N; k++) {
+        double re = 0, im = 0;
+        for (size_t n = 0; n < N; n++) {
+            const double a = -2.0 * M_PI * ((k * n) % N) / N;
+            re += in[2 * n] * cos(a) - in[2 * n + 1] * sin(a);
+            im += in[2 * n] * sin(a) + in[2 * n + 1] * cos(a);
+        }
+        ref[2 * k] = re;
+        ref[2 * k + 1] = im;
+    }
+    const float eps = CalcEps(max_magnitude(ref, out) * 4);
+    for (size_t i = 0; i < 2 * N; i++) {
+        EXPECT_NEAR(ref[i], out[i], eps) << "N: " << N << " i: " << i;
+    }
+}
+
+TEST(TFFTTest, FixedMatchesDFT) {
+    CheckFFT<2, NFFT::TFixedFFT<2>>(1);
+    CheckFFT<4, NFFT::TFixedFFT<4>>(2);
+    CheckFFT<8, NFFT::TFixedFFT<8>>(3);
+    CheckFFT<16, NFFT::TFixedFFT<16>>(4);
+    CheckFFT<64, NFFT::TFixedFFT<64>>(5);
+    CheckFFT<128, NFFT::TFixedFFT<128>>(6);
+    CheckFFT<1024, NFFT::TFixedFFT<1024>>(7);
+}
+
+TEST(TFFTTest, KissMatchesDFT) {
+    CheckFFT<16, NFFT::TKissFFT<16>>(8);
+    CheckFFT<128, NFFT::TKissFFT<128>>(9);
+}
+
+template<size_t N>
+static void CheckBatch(size_t count) {
+    TMDCT<N> mdct(0.5);
+    TMIDCT<N> midct;
+    TMDCTBatch<N, 4> mdctBatch(0.5);
+    TMIDCTBatch<N, 4> midctBatch;
+
+    vector<vector<float>> src(count, vector<float>(N));
+    vector<vector<float>> spec(count, vector<float>(N / 2));
+    vector<vector<float>> pcm(count, vector<float>(N));
+    vector<const float*> in(count);
+    vector<float*> out(count);
+    for (size_t b = 0; b < count; b++) {
+        fill_random(src[b], N, 0x42415443u + b);
+        in[b] = src[b].data();
+        out[b] = spec[b].data();
+    }
+    mdctBatch(in.data(), out.data(), count);
+
+    for (size_t b = 0; b < count; b++) {
+        const vector<float>& ref = mdct(src[b].data());
+        const float eps = CalcEps(max_magnitude(ref, spec[b]) * 4);
+        for (size_t i = 0; i < N / 2; i++) {
+            EXPECT_NEAR(ref[i], spec[b][i], eps) << "N: " << N << " block: " << b;
+        }
+        in[b] = spec[b].data();
+        out[b] = pcm[b].data();
+    }
+    midctBatch(in.data(), out.data(), count);
+
+    for (size_t b = 0; b < count; b++) {
+        const vector<float>& ref = midct(spec[b].data());
+        const float eps = CalcEps(max_magnitude(ref, pcm[b]) * 4);
+        for (size_t i = 0; i < N; i++) {
+            EXPECT_NEAR(ref[i], pcm[b][i], eps) << "N: " << N << " block: " << b;
+        }
+    }
+}
+
+TEST(TMdctTest, BatchMatchesSingle) {
+    CheckBatch<64>(1);
+    CheckBatch<64>(16);
+    CheckBatch<256>(6);
+    CheckBatch<512>(3);
+}
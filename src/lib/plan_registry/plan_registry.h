@@ -0,0 +1,99 @@
+/*
+ * This file is part of AtracDEnc.
+ *
+ * AtracDEnc is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * AtracDEnc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with AtracDEnc; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace NAtracDEnc {
+
+// Process wide store of read-only DSP data: transform twiddles, windows,
+// lookup tables. Every plan is built on first request, under a lock, and
+// then shared by all codec instances which ask for the same name and key,
+// so a stream object holds only its mutable state. Plans live until exit.
+
+// Heap bytes of a plan, used for the footprint statistics
+template<class T>
+size_t PlanBytes(const std::vector<T>& v) {
+    return v.capacity() * sizeof(T);
+}
+
+// Approximation: payload and the usual three pointers and a color per node
+template<class K, class V>
+size_t PlanBytes(const std::map<K, V>& m) {
+    return m.size() * (sizeof(std::pair<const K, V>) + 4 * sizeof(void*));
+}
+
+class TPlanRegistry {
+public:
+    // make() returns the plan by value. It must not request a plan of the
+    // same type T and key type, the store of this pair is locked meanwhile.
+    template<class T, class TKey, class TMake>
+    static std::shared_ptr<const T> Get(const char* name, const TKey& key, TMake&& make) {
+        TStore<T, TKey>& store = GetStore<T, TKey>();
+        std::lock_guard<std::mutex> lock(store.Lock);
+        std::shared_ptr<const T>& plan = store.Plans[std::make_pair(std::string(name), key)];
+        if (!plan) {
+            std::shared_ptr<T> created = std::make_shared<T>(make());
+            Stat().Bytes += sizeof(T) + PlanBytes(*created);
+            Stat().Plans++;
+            plan = std::move(created);
+        }
+        return plan;
+    }
+
+    // Memory held by all plans built so far
+    static size_t GetSharedBytes() {
+        return Stat().Bytes;
+    }
+
+    static size_t GetNumPlans() {
+        return Stat().Plans;
+    }
+
+private:
+    template<class T, class TKey>
+    struct TStore {
+        std::mutex Lock;
+        std::map<std::pair<std::string, TKey>, std::shared_ptr<const T>> Plans;
+    };
+
+    struct TStat {
+        std::atomic<size_t> Bytes{0};
+        std::atomic<size_t> Plans{0};
+    };
+
+    template<class T, class TKey>
+    static TStore<T, TKey>& GetStore() {
+        static TStore<T, TKey> store;
+        return store;
+    }
+
+    static TStat& Stat() {
+        static TStat stat;
+        return stat;
+    }
+};
+
+} //namespace NAtracDEnc
@@ -0,0 +1,83 @@
+/*
+ * This file is part of AtracDEnc.
+ *
+ * AtracDEnc is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * AtracDEnc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with AtracDEnc; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "plan_registry.h"
+#include <lib/mdct/mdct.h>
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+using namespace NAtracDEnc;
+
+TEST(TPlanRegistry, SameKeySamePlan) {
+    int calls = 0;
+    auto make = [&calls] {
+        calls++;
+        return std::vector<float>(100, 1.0f);
+    };
+    const size_t before = TPlanRegistry::GetSharedBytes();
+    auto a = TPlanRegistry::Get<std::vector<float>>("ut_plan", 7, make);
+    auto b = TPlanRegistry::Get<std::vector<float>>("ut_plan", 7, make);
+    auto c = TPlanRegistry::Get<std::vector<float>>("ut_plan", 8, make);
+    auto d = TPlanRegistry::Get<std::vector<float>>("ut_other", 7, make);
+    EXPECT_EQ(a.get(), b.get());
+    EXPECT_NE(a.get(), c.get());
+    EXPECT_NE(a.get(), d.get());
+    EXPECT_EQ(calls, 3);
+    EXPECT_GE(TPlanRegistry::GetSharedBytes() - before, 3 * 100 * sizeof(float));
+}
+
+TEST(TPlanRegistry, ConcurrentGetBuildsOnce) {
+    std::atomic<int> calls{0};
+    std::vector<std::thread> threads;
+    std::vector<const std::vector<float>*> got(8);
+    for (size_t t = 0; t < got.size(); t++) {
+        threads.emplace_back([&calls, &got, t] {
+            got[t] = TPlanRegistry::Get<std::vector<float>>("ut_concurrent", 1, [&calls] {
+                calls++;
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                return std::vector<float>(16);
+            }).get();
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    EXPECT_EQ(calls, 1);
+    for (size_t t = 1; t < got.size(); t++) {
+        EXPECT_EQ(got[0], got[t]);
+    }
+}
+
+TEST(TPlanRegistry, TransformsShareTwiddles) {
+    NMDCT::TMDCT<256> a(0.5);
+    NMDCT::TMDCT<256> b(0.5);
+    EXPECT_EQ(NMDCT::GetSinCos(256, 0.5).get(), NMDCT::GetSinCos(256, 0.5).get());
+    EXPECT_NE(NMDCT::GetSinCos(256, 0.5).get(), NMDCT::GetSinCos(256, 1.0).get());
+
+    std::vector<float> in(256);
+    for (size_t i = 0; i < in.size(); i++) {
+        in[i] = (float)((i * 37) % 101) / 101.0f - 0.5f;
+    }
+    const std::vector<float> ra = a(in.data());
+    const std::vector<float> rb = b(in.data());
+    EXPECT_EQ(ra, rb);
+}
@@ -18,11 +18,16 @@
 
 #include <algorithm>
 #include <cctype>
+#include <chrono>
 #include <cstring>
 #include <iostream>
 #include <fstream>
+#include <mutex>
 #include <string>
 #include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
 
 #include <getopt.h>
 
@@ -39,6 +44,9 @@
 #include "atrac1denc.h"
 #include "atrac3denc.h"
 #include "atrac3p.h"
+#include "segment_encoder.h"
+#include "pipelined_output.h"
+#include "work_pool.h"
 
 #ifdef PLATFORM_WINDOWS
 #include <windows.h>
@@ -55,6 +63,9 @@ using namespace NAtracDEnc;
 
 typedef std::unique_ptr<TPCMEngine> TPcmEnginePtr;
 typedef std::unique_ptr<IProcessor> TAtracProcessorPtr;
+typedef TSegmentEncoder::TProcessorFactory TAtracProcessorFactory;
+// Number of frames for the container header of the given input length
+typedef std::function<uint32_t(uint64_t totalSamples)> TContainerFrames;
 
 static void printUsage(const char* myName, const string& err = string())
 {
@@ -73,6 +84,15 @@ static void printProgress(int percent)
     fflush(stdout);
 }
 
+static void printStreamProgress(uint64_t seconds)
+{
+    static uint32_t counter;
+    counter++;
+    const char symbols[4] = {'-', '\\', '|', '/'};
+    cout << symbols[counter % 4]<< "  "<< seconds <<" sec done\r";
+    fflush(stdout);
+}
+
 static string GetFileExt(const string& path) {
     size_t dotPos = path.rfind('.');
     std::string ext;
@@ -271,8 +291,43 @@ enum EOptions
     O_ADVANCED_OPT = 7,
     O_YAML_LOG = 8,
     O_CONTAINER = 9,
+    O_THREADS = 10,
+    O_PIPELINE = 11,
+    O_PREFETCH = 12,
+    O_PREFETCH_BLOCK = 13,
+    O_BATCH = 14,
+    O_BATCH_SUMMARY = 15,
+    O_STREAM = 16,
+};
+
+struct TTranscodeOptions {
+    uint32_t Mode = 0;
+    uint32_t BfuIdxConst = 0; //0 - auto, no const
+    bool NoGainControl = false;
+    bool NoTonalComponents = false;
+    string YamlLogFile;
+    EContainer RequestedContainer = EContainer::AUTO;
+    NAtrac1::TAtrac1EncodeSettings::EWindowMode WindowMode = NAtrac1::TAtrac1EncodeSettings::EWindowMode::EWM_AUTO;
+    uint32_t WinMask = 0; //0 - all is long
+    uint32_t Bitrate = 0; //0 - use default for codec
+    uint32_t Threads = 1;
+    uint32_t PipelineDepth = 4; //0 - all encoding stages in one thread
+    uint32_t PrefetchDepth = 0; //0 - read input in the encoding thread
+    uint32_t PrefetchBlock = 65536;
+    bool Stream = false; //ignore input length, read till the end
+    const char* AdvancedOpt = nullptr;
+    // Codecs fill some shared tables on first construction, the batch mode
+    // constructs encoders and decoders under this lock
+    std::mutex* InitLock = nullptr;
 };
 
+static std::unique_lock<std::mutex> LockInit(std::mutex* initLock)
+{
+    return initLock ? std::unique_lock<std::mutex>(*initLock) : std::unique_lock<std::mutex>();
+}
+
+typedef std::vector<std::pair<string, string>> TBatchJobs;
+
 static void CheckInputFormat(const TWav* p)
 {
 //    if (p->IsFormatSupported() == false)
@@ -282,62 +337,84 @@ static void CheckInputFormat(const TWav* p)
         throw std::runtime_error("unsupported sample rate");
 }
 
-static TWavPtr OpenWavFile(const string& inFile)
+static TWavPtr OpenWavFile(const string& inFile, bool stream = false)
 {
     TWavPtr wavPtr = std::make_unique<TWav>(inFile);
     CheckInputFormat(wavPtr.get());
+    if (stream)
+        wavPtr->IgnoreLength();
     return wavPtr;
 }
 
+// Number of frames for the container header, unitsPerFrame - number of
+// container frames written for each encoded frame
+static uint32_t GetContainerFrames(uint64_t totalSamples, uint64_t samplesPerFrame, uint64_t unitsPerFrame = 1)
+{
+    if (totalSamples == TWav::UnknownLength)
+        return ICompressedOutput::UnknownFrames;
+    const uint64_t numFrames = unitsPerFrame * totalSamples / samplesPerFrame;
+    if (numFrames >= UINT32_MAX) {
+        std::cerr << "Number of input samples exceeds output format limitation,"
+            "the result will be incorrect" << std::endl;
+    }
+    return (uint32_t)numFrames;
+}
+
+static string DurationStr(uint64_t totalSamples, size_t sampleRate)
+{
+    if (totalSamples == TWav::UnknownLength)
+        return "unknown";
+    return std::to_string(totalSamples / sampleRate);
+}
+
 static void PrepareAtrac1Encoder(const string& inFile,
                                  const string& outFile,
                                  const bool noStdOut,
                                  EContainer requestedContainer,
-                                 NAtrac1::TAtrac1EncodeSettings&& encoderSettings,
+                                 const NAtrac1::TAtrac1EncodeSettings& encoderSettings,
                                  uint64_t* totalSamples,
-                                 TWavPtr* wavIO,
+                                 const TWavPtr& wavIO,
                                  TPcmEnginePtr* pcmEngine,
-                                 TAtracProcessorPtr* atracProcessor)
+                                 TCompressedOutputPtr* compressedIO,
+                                 TContainerFrames* containerFrames,
+                                 TAtracProcessorFactory* atracProcessorFactory)
 {
     using NAtrac1::TAtrac1Data;
 
-    {
-        TWav* wavPtr = new TWav(inFile);
-        CheckInputFormat(wavPtr);
-        wavIO->reset(wavPtr);
-    }
-    const size_t numChannels = (*wavIO)->GetChannelNum();
-    *totalSamples = (*wavIO)->GetTotalSamples();
-    //TODO: recheck it
-    const uint64_t numFrames = numChannels * (*totalSamples) / TAtrac1Data::NumSamples;
-    if (numFrames >= UINT32_MAX) {
-        std::cerr << "Number of input samples exceeds output format limitation,"
-            "the result will be incorrect" << std::endl;
-    }
+    const size_t numChannels = wavIO->GetChannelNum();
+    *totalSamples = wavIO->GetTotalSamples();
+    // AEA stores one sound unit per channel
+    *containerFrames = [numChannels](uint64_t samples) {
+        return GetContainerFrames(samples, TAtrac1Data::NumSamples, numChannels);
+    };
+    const uint32_t numFrames = (*containerFrames)(*totalSamples);
     const EContainer container = SelectAtrac1Container(outFile, requestedContainer);
     CheckContainer(ECodec::ATRAC1, container);
 
-    TCompressedOutputPtr aeaIO;
     const string contName = ContainerName(container);
     if (container == EContainer::RAW) {
-        aeaIO = CreateRawOutput(outFile, numChannels, TAtrac1Data::SoundUnitSize);
+        *compressedIO = CreateRawOutput(outFile, numChannels, TAtrac1Data::SoundUnitSize);
     } else {
-        aeaIO = CreateAeaOutput(outFile, "test", numChannels, (uint32_t)numFrames);
+        *compressedIO = CreateAeaOutput(outFile, "test", numChannels, numFrames);
     }
 
     pcmEngine->reset(new TPCMEngine(4096,
                                             numChannels,
-                                            TPCMEngine::TReaderPtr((*wavIO)->GetPCMReader())));
+                                            TPCMEngine::TReaderPtr(wavIO->GetPCMReader()),
+                                            TPCMEngine::ELayout::PLANAR));
     if (!noStdOut)
         cout << "Input\n Filename: " << inFile
              << "\n Channels: " << (int)numChannels
-             << "\n SampleRate: " << (*wavIO)->GetSampleRate()
-             << "\n Duration (sec): " << *totalSamples / (*wavIO)->GetSampleRate()
+             << "\n SampleRate: " << wavIO->GetSampleRate()
+             << "\n Duration (sec): " << DurationStr(*totalSamples, wavIO->GetSampleRate())
 	     << "\nOutput:\n Filename: " << outFile
 	     << "\n Codec: ATRAC1"
 	     << "\n Container: " << contName
              << endl;
-    atracProcessor->reset(new TAtrac1Encoder(std::move(aeaIO), std::move(encoderSettings)));
+    *atracProcessorFactory = [encoderSettings](TCompressedOutputPtr&& aeaIO) -> TAtracProcessorPtr {
+        NAtrac1::TAtrac1EncodeSettings settings(encoderSettings);
+        return TAtracProcessorPtr(new TAtrac1Encoder(std::move(aeaIO), std::move(settings)));
+    };
 }
 
 static void PrepareAtrac1Decoder(const string& inFile,
@@ -346,7 +423,8 @@ static void PrepareAtrac1Decoder(const string& inFile,
                                  uint64_t* totalSamples,
                                  TWavPtr* wavIO,
                                  TPcmEnginePtr* pcmEngine,
-                                 TAtracProcessorPtr* atracProcessor)
+                                 TAtracProcessorPtr* atracProcessor,
+                                 std::mutex* initLock)
 {
     TCompressedInputPtr aeaIO = CreateAeaInput(inFile);
     *totalSamples = aeaIO->GetLengthInSamples();
@@ -360,7 +438,9 @@ static void PrepareAtrac1Decoder(const string& inFile,
     wavIO->reset(new TWav(outFile, aeaIO->GetChannelNum(), 44100));
     pcmEngine->reset(new TPCMEngine(4096,
                                             aeaIO->GetChannelNum(),
-                                            TPCMEngine::TWriterPtr((*wavIO)->GetPCMWriter())));
+                                            TPCMEngine::TWriterPtr((*wavIO)->GetPCMWriter()),
+                                            TPCMEngine::ELayout::PLANAR));
+    auto lock = LockInit(initLock);
     atracProcessor->reset(new TAtrac1Decoder(std::move(aeaIO)));
 }
 
@@ -368,24 +448,25 @@ static void PrepareAtrac3Encoder(const string& inFile,
                                  const string& outFile,
                                  const bool noStdOut,
                                  EContainer requestedContainer,
-                                 NAtrac3::TAtrac3EncoderSettings&& encoderSettings,
+                                 const NAtrac3::TAtrac3EncoderSettings& encoderSettings,
                                  uint64_t* totalSamples,
                                  const TWavPtr& wavIO,
                                  TPcmEnginePtr* pcmEngine,
-                                 TAtracProcessorPtr* atracProcessor)
+                                 TCompressedOutputPtr* compressedIO,
+                                 TContainerFrames* containerFrames,
+                                 TAtracProcessorFactory* atracProcessorFactory)
 {
     const int numChannels = encoderSettings.SourceChannels;
     *totalSamples = wavIO->GetTotalSamples();
-    const uint64_t numFrames = (*totalSamples) / 1024;
-    if (numFrames >= UINT32_MAX) {
-        std::cerr << "Number of input samples exceeds output format limitation,"
-            "the result will be incorrect" << std::endl;
-    }
+    *containerFrames = [](uint64_t samples) {
+        return GetContainerFrames(samples, 1024);
+    };
+    const uint32_t numFrames = (*containerFrames)(*totalSamples);
 
     const EContainer container = SelectAtrac3Container(outFile, requestedContainer);
     CheckContainer(ECodec::ATRAC3, container);
 
-    TCompressedOutputPtr omaIO;
+    TCompressedOutputPtr& omaIO = *compressedIO;
 
     const string contName = ContainerName(container);
     if (container == EContainer::RIFF) {
@@ -411,7 +492,7 @@ static void PrepareAtrac3Encoder(const string& inFile,
         cout << "Input:\n Filename: " << inFile
              << "\n Channels: " << (int)numChannels
              << "\n SampleRate: " << wavIO->GetSampleRate()
-             << "\n Duration (sec): " << *totalSamples / wavIO->GetSampleRate()
+             << "\n Duration (sec): " << DurationStr(*totalSamples, wavIO->GetSampleRate())
 	     << "\nOutput:\n Filename: " << outFile
 	     << "\n Codec: ATRAC3"
 	     << "\n Container: " << contName
@@ -420,8 +501,12 @@ static void PrepareAtrac3Encoder(const string& inFile,
 
     pcmEngine->reset(new TPCMEngine(4096,
                                             numChannels,
-                                            TPCMEngine::TReaderPtr(wavIO->GetPCMReader())));
-    atracProcessor->reset(new TAtrac3Encoder(std::move(omaIO), std::move(encoderSettings)));
+                                            TPCMEngine::TReaderPtr(wavIO->GetPCMReader()),
+                                            TPCMEngine::ELayout::PLANAR));
+    *atracProcessorFactory = [encoderSettings](TCompressedOutputPtr&& omaIO) -> TAtracProcessorPtr {
+        NAtrac3::TAtrac3EncoderSettings settings(encoderSettings);
+        return TAtracProcessorPtr(new TAtrac3Encoder(std::move(omaIO), std::move(settings)));
+    };
 }
 
 static void PrepareAtrac3PEncoder(const string& inFile,
@@ -429,23 +514,25 @@ static void PrepareAtrac3PEncoder(const string& inFile,
                                   const bool noStdOut,
                                   EContainer requestedContainer,
                                   int numChannels,
+                                  uint32_t pipelineDepth,
                                   uint64_t* totalSamples,
                                   const TWavPtr& wavIO,
                                   TPcmEnginePtr* pcmEngine,
-                                  TAtracProcessorPtr* atracProcessor,
+                                  TCompressedOutputPtr* compressedIO,
+                                  TContainerFrames* containerFrames,
+                                  TAtracProcessorFactory* atracProcessorFactory,
                                   const char* advancedOpt)
 {
     *totalSamples = wavIO->GetTotalSamples();
-    const uint64_t numFrames = (*totalSamples) / 2048;
-    if (numFrames >= UINT32_MAX) {
-        std::cerr << "Number of input samples exceeds output format limitation,"
-            "the result will be incorrect" << std::endl;
-    }
+    *containerFrames = [](uint64_t samples) {
+        return GetContainerFrames(samples, 2048);
+    };
+    const uint32_t numFrames = (*containerFrames)(*totalSamples);
 
     const EContainer container = SelectAtrac3PlusContainer(outFile, requestedContainer);
     CheckContainer(ECodec::ATRAC3PLUS, container);
 
-    TCompressedOutputPtr omaIO;
+    TCompressedOutputPtr& omaIO = *compressedIO;
 
     const string contName = ContainerName(container);
     if (container == EContainer::RIFF) {
@@ -465,7 +552,7 @@ static void PrepareAtrac3PEncoder(const string& inFile,
         cout << "Input:\n Filename: " << inFile
              << "\n Channels: " << (int)numChannels
              << "\n SampleRate: " << wavIO->GetSampleRate()
-             << "\n Duration (sec): " << *totalSamples / wavIO->GetSampleRate()
+             << "\n Duration (sec): " << DurationStr(*totalSamples, wavIO->GetSampleRate())
 	     << "\nOutput:\n Filename: " << outFile
 	     << "\n Codec: ATRAC3Plus"
 	     << "\n Container: " << contName
@@ -474,14 +561,394 @@ static void PrepareAtrac3PEncoder(const string& inFile,
 
     pcmEngine->reset(new TPCMEngine(4096,
                                             numChannels,
-                                            TPCMEngine::TReaderPtr(wavIO->GetPCMReader())));
+                                            TPCMEngine::TReaderPtr(wavIO->GetPCMReader()),
+                                            TPCMEngine::ELayout::PLANAR));
     TAt3PEnc::TSettings settings;
     if (advancedOpt) {
         TAt3PEnc::ParseAdvancedOpt(advancedOpt, settings);
     }
-    atracProcessor->reset(new TAt3PEnc(std::move(omaIO), numChannels, settings));
+    settings.PipelineDepth = pipelineDepth;
+    *atracProcessorFactory = [numChannels, settings](TCompressedOutputPtr&& omaIO) -> TAtracProcessorPtr {
+        return TAtracProcessorPtr(new TAt3PEnc(std::move(omaIO), numChannels, settings));
+    };
 }
 
+static int EncodeSegments(const string& inFile,
+                          ICompressedOutput* compressedIO,
+                          const TAtracProcessorFactory& atracProcessorFactory,
+                          size_t numChannels,
+                          uint64_t totalSamples,
+                          uint32_t pcmFrameSz,
+                          uint32_t threads,
+                          uint32_t prefetchDepth,
+                          uint32_t prefetchBlock,
+                          bool noStdOut)
+{
+    // Every segment reads the input through its own handle
+    auto readerFactory = [inFile, prefetchDepth, prefetchBlock](uint64_t startSample) -> TPCMEngine::TReaderPtr {
+        std::shared_ptr<TWav> wav = OpenWavFile(inFile);
+        if (wav->Skip(startSample) != startSample)
+            throw std::runtime_error("unable to seek input file");
+        wav->EnablePrefetch(prefetchDepth, prefetchBlock);
+        std::shared_ptr<IPCMReader> reader(wav->GetPCMReader());
+        return TPCMEngine::TReaderPtr(new TWavPcmReader([wav, reader](TPCMBuffer& data, const uint32_t size) {
+            return reader->Read(data, size);
+        }));
+    };
+
+    TSegmentEncoder encoder(readerFactory, atracProcessorFactory, numChannels, totalSamples, pcmFrameSz, threads);
+    if (!noStdOut)
+        cout << "Segments: " << encoder.GetSegmentsNum() << endl;
+
+    std::function<void(int)> progress;
+    if (!noStdOut)
+        progress = printProgress;
+
+    const TSegmentEncoder::TReport report = encoder.Encode(compressedIO, progress);
+
+    size_t notConverged = 0;
+    for (const auto& b : report.Boundaries) {
+        if (!b.Converged)
+            notConverged++;
+    }
+
+    if (!noStdOut) {
+        cout << "\nDone" << endl;
+        for (const auto& b : report.Boundaries) {
+            cout << " boundary at frame " << b.Frame << ": ";
+            if (b.Converged) {
+                cout << "converged, switched after " << b.SpliceOffset << " frame(s)";
+            } else {
+                cout << "not converged";
+            }
+            cout << ", segments disagree on " << b.OverlapMismatched << " of " << b.Overlap << " overlap frame(s)" << endl;
+        }
+    }
+    if (notConverged) {
+        cerr << "Warning: " << notConverged << " of " << report.Boundaries.size()
+             << " segment boundaries did not converge, output may differ from serial encode" << endl;
+    }
+    return 0;
+}
+
+// Encodes or decodes one file. Returns exit code, the message which should be
+// reported to the user (if any) is stored into error.
+static int Transcode(const TTranscodeOptions& opt,
+                     const string& inFile,
+                     const string& outFile,
+                     bool noStdOut,
+                     string* error)
+{
+    TPcmEnginePtr pcmEngine;
+    TAtracProcessorPtr atracProcessor;
+    TCompressedOutputPtr compressedIO;
+    TAtracProcessorFactory atracProcessorFactory;
+    TContainerFrames containerFrames;
+    ICompressedOutput* container = nullptr;
+    uint64_t totalSamples = 0;
+    TWavPtr wavIO;
+    uint32_t pcmFrameSz = 0; //size of one pcm frame to process
+
+    try {
+        switch (opt.Mode) {
+            case E_ENCODE:
+	        {
+                if (opt.BfuIdxConst > 8) {
+                    throw std::invalid_argument("ATRAC1 mode, --bfuidxconst is a index of max used BFU. "
+                        "Values [1;8] is allowed");
+                }
+                using NAtrac1::TAtrac1Data;
+                wavIO = OpenWavFile(inFile, opt.Stream);
+                NAtrac1::TAtrac1EncodeSettings encoderSettings(opt.BfuIdxConst, opt.WindowMode, opt.WinMask, opt.PipelineDepth);
+                PrepareAtrac1Encoder(inFile, outFile, noStdOut, opt.RequestedContainer, encoderSettings,
+                &totalSamples, wavIO, &pcmEngine, &compressedIO, &containerFrames, &atracProcessorFactory);
+                pcmFrameSz = TAtrac1Data::NumSamples;
+            }
+            break;
+            case E_DECODE:
+            {
+                using NAtrac1::TAtrac1Data;
+                PrepareAtrac1Decoder(inFile, outFile, noStdOut,
+                &totalSamples, &wavIO, &pcmEngine, &atracProcessor, opt.InitLock);
+                pcmFrameSz = TAtrac1Data::NumSamples;
+            }
+            break;
+            case (E_ENCODE | E_ATRAC3):
+            {
+                using NAtrac3::TAtrac3Data;
+                wavIO = OpenWavFile(inFile, opt.Stream);
+                std::ostream* yamlOut = nullptr;
+                static std::ofstream yamlLogStream;
+                if (!opt.YamlLogFile.empty()) {
+                    yamlLogStream.open(opt.YamlLogFile);
+                    if (!yamlLogStream) {
+                        *error = "Cannot open yaml-log file: " + opt.YamlLogFile;
+                        return 1;
+                    }
+                    yamlOut = &yamlLogStream;
+                }
+                NAtrac3::TAtrac3EncoderSettings encoderSettings(opt.Bitrate * 1024, opt.NoGainControl,
+                                                                opt.NoTonalComponents, wavIO->GetChannelNum(), opt.BfuIdxConst,
+                                                                yamlOut, opt.PipelineDepth);
+                PrepareAtrac3Encoder(inFile, outFile, noStdOut, opt.RequestedContainer, encoderSettings,
+                &totalSamples, wavIO, &pcmEngine, &compressedIO, &containerFrames, &atracProcessorFactory);
+                pcmFrameSz = TAtrac3Data::NumSamples;;
+            }
+            break;
+            case (E_ENCODE | E_ATRAC3PLUS):
+            {
+                wavIO = OpenWavFile(inFile, opt.Stream);
+                PrepareAtrac3PEncoder(inFile, outFile, noStdOut, opt.RequestedContainer, wavIO->GetChannelNum(),
+                    opt.PipelineDepth, &totalSamples, wavIO, &pcmEngine, &compressedIO, &containerFrames, &atracProcessorFactory, opt.AdvancedOpt);
+                pcmFrameSz = 2048;
+            }
+            break;
+            default:
+            {
+                throw std::runtime_error("Processing mode was not specified");
+            }
+        }
+        if (atracProcessorFactory && opt.Threads > 1 && totalSamples == TWav::UnknownLength) {
+            throw std::runtime_error("--threads requires input of known length");
+        }
+        container = compressedIO.get();
+        if (atracProcessorFactory && opt.Threads == 1) {
+            wavIO->EnablePrefetch(opt.PrefetchDepth, opt.PrefetchBlock);
+            TCompressedOutputPtr output = CreatePipelinedOutput(std::move(compressedIO), opt.PipelineDepth);
+            auto lock = LockInit(opt.InitLock);
+            atracProcessor = atracProcessorFactory(std::move(output));
+        }
+    } catch (const std::exception& ex) {
+        *error = string("Fatal error: ") + ex.what();
+        return 1;
+    }
+
+    if (!atracProcessor) {
+        try {
+            return EncodeSegments(inFile, compressedIO.get(), atracProcessorFactory,
+                wavIO->GetChannelNum(), totalSamples, pcmFrameSz, opt.Threads, opt.PrefetchDepth, opt.PrefetchBlock, noStdOut);
+        } catch (const std::exception& ex) {
+            *error = string("Encode error: ") + ex.what();
+            return 1;
+        }
+    }
+
+    auto atracLambda = atracProcessor->GetLambda();
+
+    // The length of streamed input is known only when its end is reached
+    const bool stream = totalSamples == TWav::UnknownLength;
+    uint64_t processed = 0;
+    try {
+        for (;;) {
+            if (stream) {
+                try {
+                    processed = pcmEngine->ApplyProcess(pcmFrameSz, atracLambda);
+                } catch (const TNoDataToRead&) {
+                    break;
+                }
+                if (wavIO->IsEndOfStream() && processed >= wavIO->GetSamplesRead())
+                    break;
+                if (!noStdOut)
+                    printStreamProgress(processed / wavIO->GetSampleRate());
+            } else {
+                processed = pcmEngine->ApplyProcess(pcmFrameSz, atracLambda);
+                if (processed >= totalSamples)
+                    break;
+                if (!noStdOut)
+                    printProgress(static_cast<int>(processed*100/totalSamples));
+            }
+        }
+        atracProcessor->Flush();
+        if (stream && containerFrames) {
+            container->SetNumFrames(containerFrames(wavIO->GetSamplesRead()));
+        }
+        if (!noStdOut)
+            cout << "\nDone" << endl;
+    }
+    catch (const TAeaIOError& err) {
+        *error = string("Aea IO fatal error: ") + err.what();
+        return 1;
+    }
+    catch (const TNoDataToRead&) {
+        *error = "No more data to read from input";
+        return 0;
+    }
+    catch (const std::exception& ex) {
+        *error = string("Encode/Decode error: ") + ex.what();
+        return 1;
+    }
+    return 0;
+}
+
+// Manifest is a text file with one job per line: input and output path
+// separated by TAB. Empty lines and lines started with '#' are skipped.
+static void ReadBatchManifest(const string& path, TBatchJobs* jobs)
+{
+    std::ifstream manifest(path);
+    if (!manifest)
+        throw std::runtime_error("Cannot open batch manifest: " + path);
+
+    string line;
+    size_t lineNum = 0;
+    while (std::getline(manifest, line)) {
+        lineNum++;
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        if (line.empty() || line[0] == '#')
+            continue;
+        const size_t tab = line.find('\t');
+        if (tab == string::npos || tab == 0 || tab + 1 == line.size()) {
+            throw std::runtime_error(path + ":" + std::to_string(lineNum) + ": expected <input>TAB<output>");
+        }
+        jobs->emplace_back(line.substr(0, tab), line.substr(tab + 1));
+    }
+}
+
+static string JsonEscape(const string& value)
+{
+    string res;
+    res.reserve(value.size());
+    for (unsigned char c : value) {
+        switch (c) {
+            case '"': res += "\\\""; break;
+            case '\\': res += "\\\\"; break;
+            case '\n': res += "\\n"; break;
+            case '\r': res += "\\r"; break;
+            case '\t': res += "\\t"; break;
+            default:
+                if (c < 0x20) {
+                    char buf[8];
+                    snprintf(buf, sizeof(buf), "\\u%04x", c);
+                    res += buf;
+                } else {
+                    res += c;
+                }
+        }
+    }
+    return res;
+}
+
+struct TBatchJobResult {
+    int Rv = 1;
+    string Error;
+    double Seconds = 0;
+    size_t Worker = 0;
+};
+
+static void WriteBatchSummary(std::ostream& out,
+                              const TBatchJobs& jobs,
+                              const std::vector<TBatchJobResult>& results,
+                              size_t workers,
+                              size_t stolen,
+                              double seconds)
+{
+    size_t failed = 0;
+    for (const auto& r : results) {
+        if (r.Rv)
+            failed++;
+    }
+    out << "{\n"
+        << "  \"jobs\": " << jobs.size() << ",\n"
+        << "  \"failed\": " << failed << ",\n"
+        << "  \"workers\": " << workers << ",\n"
+        << "  \"stolen\": " << stolen << ",\n"
+        << "  \"seconds\": " << seconds << ",\n"
+        << "  \"results\": [";
+    for (size_t i = 0; i < jobs.size(); i++) {
+        const TBatchJobResult& r = results[i];
+        out << (i ? ",\n" : "\n")
+            << "    {\"input\": \"" << JsonEscape(jobs[i].first) << "\""
+            << ", \"output\": \"" << JsonEscape(jobs[i].second) << "\""
+            << ", \"status\": \"" << (r.Rv ? "failed" : "ok") << "\""
+            << ", \"error\": \"" << JsonEscape(r.Error) << "\""
+            << ", \"seconds\": " << r.Seconds
+            << ", \"worker\": " << r.Worker << "}";
+    }
+    out << "\n  ]\n}" << endl;
+}
+
+// Runs independent jobs on a work stealing pool. Each job is encoded serially
+// in one worker, all of them share the codec tables of the process.
+static int RunBatch(TTranscodeOptions opt,
+                    const TBatchJobs& jobs,
+                    size_t workers,
+                    const string& summaryFile,
+                    bool noStdOut)
+{
+    typedef std::chrono::steady_clock TClock;
+
+    std::ofstream summary;
+    if (!summaryFile.empty()) {
+        summary.open(summaryFile);
+        if (!summary) {
+            cerr << "Cannot open batch summary file: " << summaryFile << endl;
+            return 1;
+        }
+    }
+
+    // Parallelism comes from the pool, jobs do not start threads on their own
+    std::mutex initLock;
+    opt.Threads = 1;
+    opt.PipelineDepth = 0;
+    opt.PrefetchDepth = 0;
+    opt.InitLock = &initLock;
+
+    workers = std::min(workers, jobs.size());
+    TWorkStealingPool pool(workers);
+    std::vector<TBatchJobResult> results(jobs.size());
+    std::mutex reportLock;
+    size_t finished = 0;
+
+    std::vector<TWorkStealingPool::TTask> tasks;
+    tasks.reserve(jobs.size());
+    for (size_t i = 0; i < jobs.size(); i++) {
+        tasks.push_back([&, i](size_t worker) {
+            TBatchJobResult& r = results[i];
+            r.Worker = worker;
+            const auto start = TClock::now();
+            try {
+                r.Rv = Transcode(opt, jobs[i].first, jobs[i].second, true, &r.Error);
+            } catch (const std::exception& ex) {
+                r.Rv = 1;
+                r.Error = ex.what();
+            }
+            r.Seconds = std::chrono::duration<double>(TClock::now() - start).count();
+
+            std::lock_guard<std::mutex> lock(reportLock);
+            finished++;
+            if (r.Rv) {
+                cerr << jobs[i].first << ": " << r.Error << endl;
+            }
+            if (!noStdOut) {
+                cout << "[" << finished << "/" << jobs.size() << "] " << jobs[i].first
+                     << " -> " << jobs[i].second << ": " << (r.Rv ? "failed" : "ok")
+                     << " (" << r.Seconds << " sec)" << endl;
+            }
+        });
+    }
+
+    const auto start = TClock::now();
+    pool.Run(std::move(tasks));
+    const double seconds = std::chrono::duration<double>(TClock::now() - start).count();
+
+    size_t failed = 0;
+    for (const auto& r : results) {
+        if (r.Rv)
+            failed++;
+    }
+    if (!noStdOut) {
+        cout << "Done: " << jobs.size() - failed << " of " << jobs.size() << " job(s) succeeded, "
+             << seconds << " sec using " << pool.GetWorkersNum() << " worker(s)" << endl;
+    }
+    if (summary.is_open()) {
+        WriteBatchSummary(summary, jobs, results, pool.GetWorkersNum(), pool.GetStolenNum(), seconds);
+        if (!summary) {
+            cerr << "Unable to write batch summary file: " << summaryFile << endl;
+            return 1;
+        }
+    }
+    return failed ? 1 : 0;
+}
 
 int main_(int argc, char* const* argv)
 {
@@ -501,12 +968,22 @@ int main_(int argc, char* const* argv)
         { "advanced", required_argument, NULL, O_ADVANCED_OPT},
         { "yaml-log", required_argument, NULL, O_YAML_LOG},
         { "container", required_argument, NULL, O_CONTAINER},
+        { "threads", required_argument, NULL, O_THREADS},
+        { "pipeline", required_argument, NULL, O_PIPELINE},
+        { "prefetch", required_argument, NULL, O_PREFETCH},
+        { "prefetch-block", required_argument, NULL, O_PREFETCH_BLOCK},
+        { "batch", required_argument, NULL, O_BATCH},
+        { "batch-summary", required_argument, NULL, O_BATCH_SUMMARY},
+        { "stream", no_argument, NULL, O_STREAM},
         { NULL, 0, NULL, 0}
     };
 
     int ch = 0;
-    string inFile;
-    string outFile;
+    std::vector<string> inFiles;
+    std::vector<string> outFiles;
+    string batchManifest;
+    string batchSummary;
+    bool threadsSet = false;
     uint32_t mode = 0;
     uint32_t bfuIdxConst = 0; //0 - auto, no const
     bool noStdOut = false;
@@ -517,6 +994,11 @@ int main_(int argc, char* const* argv)
     NAtrac1::TAtrac1EncodeSettings::EWindowMode windowMode = NAtrac1::TAtrac1EncodeSettings::EWindowMode::EWM_AUTO;
     uint32_t winMask = 0; //0 - all is long
     uint32_t bitrate = 0; //0 - use default for codec
+    uint32_t threads = 1;
+    uint32_t pipelineDepth = 4; //0 - all encoding stages in one thread
+    uint32_t prefetchDepth = 0; //0 - read input in the encoding thread
+    uint32_t prefetchBlock = 65536;
+    bool stream = false;
     while ((ch = getopt_long(argc, argv, "e:dhi:o:m", longopts, NULL)) != -1) {
         switch (ch) {
             case O_ENCODE:
@@ -545,11 +1027,11 @@ int main_(int argc, char* const* argv)
                 mode |= E_DECODE;
                 break;
             case 'i':
-                inFile = optarg;
+                inFiles.push_back(optarg);
                 break;
             case 'o':
-                outFile = optarg;
-                if (outFile == "-")
+                outFiles.push_back(optarg);
+                if (outFiles.back() == "-")
                     noStdOut = true;
                 break;
             case 'h':
@@ -598,6 +1080,28 @@ int main_(int argc, char* const* argv)
                     return 1;
                 }
                 break;
+            case O_THREADS:
+                threads = checkedStoi(optarg, 1, 256, 1);
+                threadsSet = true;
+                break;
+            case O_PIPELINE:
+                pipelineDepth = checkedStoi(optarg, 0, 64, 4);
+                break;
+            case O_PREFETCH:
+                prefetchDepth = checkedStoi(optarg, 0, 64, 0);
+                break;
+            case O_PREFETCH_BLOCK:
+                prefetchBlock = checkedStoi(optarg, 1024, 1 << 20, 65536);
+                break;
+            case O_BATCH:
+                batchManifest = optarg;
+                break;
+            case O_BATCH_SUMMARY:
+                batchSummary = optarg;
+                break;
+            case O_STREAM:
+                stream = true;
+                break;
             default:
                 printUsage(myName);
                 return 1;
@@ -612,113 +1116,108 @@ int main_(int argc, char* const* argv)
         return 1;
     }
 
-    if (inFile.empty()) {
+    if (inFiles.size() > outFiles.size() && outFiles.size() > 0) {
+        cerr << "No out file for input: " << inFiles[outFiles.size()] << endl;
+        return 1;
+    }
+    if (outFiles.size() > inFiles.size() && inFiles.size() > 0) {
+        cerr << "No input file for output: " << outFiles[inFiles.size()] << endl;
+        return 1;
+    }
+
+    TBatchJobs jobs;
+    for (size_t i = 0; i < inFiles.size() && i < outFiles.size(); i++) {
+        jobs.emplace_back(inFiles[i], outFiles[i]);
+    }
+    if (!batchManifest.empty()) {
+        try {
+            ReadBatchManifest(batchManifest, &jobs);
+        } catch (const std::exception& ex) {
+            cerr << "Fatal error: " << ex.what() << endl;
+            return 1;
+        }
+    }
+    const bool batch = !batchManifest.empty() || jobs.size() > 1;
+
+    if (!batch && inFiles.empty()) {
         cerr << "No input file" << endl;
         return 1;
     }
-    if (outFile.empty()) {
+    if (!batch && outFiles.empty()) {
         cerr << "No out file" << endl;
         return 1;
     }
+    if (!batchSummary.empty() && !batch) {
+        cerr << "--batch-summary can only be used in batch mode" << endl;
+        return 1;
+    }
     if (mode == E_DECODE && requestedContainer != EContainer::AUTO) {
         cerr << "--container can only be used when encoding" << endl;
         return 1;
     }
-
-    TPcmEnginePtr pcmEngine;
-    TAtracProcessorPtr atracProcessor;
-    uint64_t totalSamples = 0;
-    TWavPtr wavIO;
-    uint32_t pcmFrameSz = 0; //size of one pcm frame to process
-
-    try {
-        switch (mode) {
-            case E_ENCODE:
-	        {
-                if (bfuIdxConst > 8) {
-                    throw std::invalid_argument("ATRAC1 mode, --bfuidxconst is a index of max used BFU. "
-                        "Values [1;8] is allowed");
-                }
-                using NAtrac1::TAtrac1Data;
-                NAtrac1::TAtrac1EncodeSettings encoderSettings(bfuIdxConst, windowMode, winMask);
-                PrepareAtrac1Encoder(inFile, outFile, noStdOut, requestedContainer, std::move(encoderSettings),
-                &totalSamples, &wavIO, &pcmEngine, &atracProcessor);
-                pcmFrameSz = TAtrac1Data::NumSamples;
-            }
-            break;
-            case E_DECODE:
-            {
-                using NAtrac1::TAtrac1Data;
-                PrepareAtrac1Decoder(inFile, outFile, noStdOut,
-                &totalSamples, &wavIO, &pcmEngine, &atracProcessor);
-                pcmFrameSz = TAtrac1Data::NumSamples;
-            }
-            break;
-            case (E_ENCODE | E_ATRAC3):
-            {
-                using NAtrac3::TAtrac3Data;
-                wavIO = OpenWavFile(inFile);
-                std::ostream* yamlOut = nullptr;
-                static std::ofstream yamlLogStream;
-                if (!yamlLogFile.empty()) {
-                    yamlLogStream.open(yamlLogFile);
-                    if (!yamlLogStream) {
-                        cerr << "Cannot open yaml-log file: " << yamlLogFile << endl;
-                        return 1;
-                    }
-                    yamlOut = &yamlLogStream;
-                }
-                NAtrac3::TAtrac3EncoderSettings encoderSettings(bitrate * 1024, noGainControl,
-                                                                noTonalComponents, wavIO->GetChannelNum(), bfuIdxConst,
-                                                                yamlOut);
-                PrepareAtrac3Encoder(inFile, outFile, noStdOut, requestedContainer, std::move(encoderSettings),
-                &totalSamples, wavIO, &pcmEngine, &atracProcessor);
-                pcmFrameSz = TAtrac3Data::NumSamples;;
-            }
-            break;
-            case (E_ENCODE | E_ATRAC3PLUS):
-            {
-                wavIO = OpenWavFile(inFile);
-                PrepareAtrac3PEncoder(inFile, outFile, noStdOut, requestedContainer, wavIO->GetChannelNum(),
-                    &totalSamples, wavIO, &pcmEngine, &atracProcessor, advancedOpt);
-                pcmFrameSz = 2048;
-            }
-            break;
-            default:
-            {
-                throw std::runtime_error("Processing mode was not specified");
+    if (batch) {
+        for (const auto& job : jobs) {
+            if (job.first == "-" || job.second == "-") {
+                cerr << "stdin/stdout can't be used in batch mode" << endl;
+                return 1;
             }
         }
-    } catch (const std::exception& ex) {
-        cerr << "Fatal error: " << ex.what() << endl;
-        return 1;
+        if (!yamlLogFile.empty()) {
+            cerr << "--yaml-log can't be used in batch mode" << endl;
+            return 1;
+        }
+    } else if (threads > 1) {
+        if (mode == E_DECODE) {
+            cerr << "--threads can only be used when encoding" << endl;
+            return 1;
+        }
+        if (inFiles[0] == "-" || stream) {
+            cerr << "--threads requires seekable input file" << endl;
+            return 1;
+        }
+        if (!yamlLogFile.empty()) {
+            cerr << "--yaml-log can't be used with --threads" << endl;
+            return 1;
+        }
+        // Segments are already encoded in parallel, and frame attribution
+        // of the segment encoder requires synchronous writes
+        pipelineDepth = 0;
     }
 
-    auto atracLambda = atracProcessor->GetLambda();
-
-    uint64_t processed = 0;
-    try {
-        while (totalSamples > (processed = pcmEngine->ApplyProcess(pcmFrameSz, atracLambda)))
-        {
-            if (!noStdOut)
-                printProgress(static_cast<int>(processed*100/totalSamples));
+    TTranscodeOptions opt;
+    opt.Mode = mode;
+    opt.BfuIdxConst = bfuIdxConst;
+    opt.NoGainControl = noGainControl;
+    opt.NoTonalComponents = noTonalComponents;
+    opt.YamlLogFile = yamlLogFile;
+    opt.RequestedContainer = requestedContainer;
+    opt.WindowMode = windowMode;
+    opt.WinMask = winMask;
+    opt.Bitrate = bitrate;
+    opt.Threads = threads;
+    opt.PipelineDepth = pipelineDepth;
+    opt.PrefetchDepth = prefetchDepth;
+    opt.PrefetchBlock = prefetchBlock;
+    opt.Stream = stream;
+    opt.AdvancedOpt = advancedOpt;
+
+    if (batch) {
+        if (jobs.empty()) {
+            cerr << "Batch is empty" << endl;
+            return 1;
         }
-        if (!noStdOut)
-            cout << "\nDone" << endl;
-    }
-    catch (const TAeaIOError& err) {
-        cerr << "Aea IO fatal error: " << err.what() << endl;
-        return 1;
+        // In batch mode --threads is the size of the pool
+        size_t workers = threads;
+        if (!threadsSet)
+            workers = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+        return RunBatch(opt, jobs, workers, batchSummary, noStdOut);
     }
-    catch (const TNoDataToRead&) {
-        cerr << "No more data to read from input" << endl;
-        return 0;
-    }
-    catch (const std::exception& ex) {
-        cerr << "Encode/Decode error: " << ex.what() << endl;
-        return 1;
-    }
-    return 0;
+
+    string error;
+    const int rv = Transcode(opt, inFiles[0], outFiles[0], noStdOut, &error);
+    if (!error.empty())
+        cerr << error << endl;
+    return rv;
 }
 
 int main(int argc, char* const* argv) {
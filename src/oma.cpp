@@ -44,8 +44,8 @@ TOma::~TOma() {
     oma_close(File);
 }
 
-void TOma::WriteFrame(vector<char> data) {
-    if (oma_write(File, &data[0], 1) == -1) {
+void TOma::WriteFrame(const char* data, size_t) {
+    if (oma_write(File, data, 1) == -1) {
         fprintf(stderr, "write error\n");
         abort();
     }
@@ -28,7 +28,7 @@ public:
     TOma(const std::string& filename, const std::string& title, size_t numChannel,
         uint32_t numFrames, int cid, uint32_t framesize, bool jointStereo);
     ~TOma();
-    void WriteFrame(std::vector<char> data) override;
+    void WriteFrame(const char* data, size_t size) override;
     std::string GetName() const override;
     size_t GetChannelNum() const override;
 };
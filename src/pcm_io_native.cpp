@@ -0,0 +1,408 @@
+/*
+ * This file is part of AtracDEnc.
+ *
+ * AtracDEnc is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * AtracDEnc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with AtracDEnc; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "pcm_io_native.h"
+
+#include "utf8_file.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ATDE_PCM_IO_SSE2
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#include <arm_neon.h>
+#define ATDE_PCM_IO_NEON
+#endif
+
+namespace {
+
+enum EWavFormat : uint16_t {
+    WAV_FORMAT_PCM = 1,
+    WAV_FORMAT_IEEE_FLOAT = 3,
+    WAV_FORMAT_EXTENSIBLE = 0xFFFE,
+};
+
+constexpr size_t WavHeaderSize = 44;
+
+uint16_t ReadLE16(const uint8_t* p) {
+    return p[0] | (p[1] << 8);
+}
+
+uint32_t ReadLE32(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+void WriteLE16(uint8_t* p, uint16_t v) {
+    p[0] = v & 0xff;
+    p[1] = v >> 8;
+}
+
+void WriteLE32(uint8_t* p, uint32_t v) {
+    WriteLE16(p, v & 0xffff);
+    WriteLE16(p + 2, v >> 16);
+}
+
+// Same normalisation as libsndfile: 1/0x8000 for PCM16, 1/0x800000 for PCM24
+void ConvertPcm16(const uint8_t* in, size_t n, float* out) {
+    size_t i = 0;
+#if defined(ATDE_PCM_IO_SSE2)
+    const __m128 scale = _mm_set1_ps(1.0f / 0x8000);
+    for (; i + 8 <= n; i += 8) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i * 2));
+        const __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+        const __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+        _mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+    }
+#elif defined(ATDE_PCM_IO_NEON)
+    for (; i + 8 <= n; i += 8) {
+        const int16x8_t v = vld1q_s16(reinterpret_cast<const int16_t*>(in + i * 2));
+        vst1q_f32(out + i, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(v))), 1.0f / 0x8000));
+        vst1q_f32(out + i + 4, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(v))), 1.0f / 0x8000));
+    }
+#endif
+    for (; i < n; i++) {
+        out[i] = (int16_t)ReadLE16(in + i * 2) * (1.0f / 0x8000);
+    }
+}
+
+void ConvertPcm24(const uint8_t* in, size_t n, float* out) {
+    for (size_t i = 0; i < n; i++) {
+        const uint8_t* p = in + i * 3;
+        const int32_t v = (int32_t)((uint32_t)p[0] << 8 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 24) >> 8;
+        out[i] = v * (1.0f / 0x800000);
+    }
+}
+
+// libsndfile converts normalised float to PCM16 with 0x7FFF scale and rounding to nearest
+void ConvertToPcm16(const float* in, size_t n, int16_t* out) {
+    size_t i = 0;
+#if defined(ATDE_PCM_IO_SSE2)
+    const __m128 scale = _mm_set1_ps(0x7FFF);
+    for (; i + 8 <= n; i += 8) {
+        const __m128i lo = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(in + i), scale));
+        const __m128i hi = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(in + i + 4), scale));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packs_epi32(lo, hi));
+    }
+#elif defined(ATDE_PCM_IO_NEON)
+    for (; i + 8 <= n; i += 8) {
+        const int32x4_t lo = vcvtnq_s32_f32(vmulq_n_f32(vld1q_f32(in + i), 0x7FFF));
+        const int32x4_t hi = vcvtnq_s32_f32(vmulq_n_f32(vld1q_f32(in + i + 4), 0x7FFF));
+        vst1q_s16(out + i, vcombine_s16(vqmovn_s32(lo), vqmovn_s32(hi)));
+    }
+#endif
+    for (; i < n; i++) {
+        const long v = lrintf(in[i] * 0x7FFF);
+        out[i] = (int16_t)std::min<long>(std::max<long>(v, INT16_MIN), INT16_MAX);
+    }
+}
+
+class TMappedFile {
+public:
+    // Returns false if the file can't be mapped (missing, empty, pipe...)
+    bool Open(const std::string& path) {
+#ifdef _WIN32
+        const std::wstring wpath = NAtracDEnc::Utf8ToWidePath(path);
+        File = CreateFileW(wpath.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+            FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (File == INVALID_HANDLE_VALUE)
+            return false;
+        LARGE_INTEGER sz;
+        if (!GetFileSizeEx(File, &sz) || sz.QuadPart == 0 || GetFileType(File) != FILE_TYPE_DISK)
+            return false;
+        Mapping = CreateFileMappingW(File, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (!Mapping)
+            return false;
+        Data = static_cast<const uint8_t*>(MapViewOfFile(Mapping, FILE_MAP_READ, 0, 0, 0));
+        Size = (size_t)sz.QuadPart;
+        return Data != nullptr;
+#else
+        Fd = open(path.c_str(), O_RDONLY);
+        if (Fd == -1)
+            return false;
+        struct stat st;
+        if (fstat(Fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0)
+            return false;
+        void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, Fd, 0);
+        if (p == MAP_FAILED)
+            return false;
+        madvise(p, st.st_size, MADV_SEQUENTIAL);
+        Data = static_cast<const uint8_t*>(p);
+        Size = st.st_size;
+        return true;
+#endif
+    }
+
+    ~TMappedFile() {
+#ifdef _WIN32
+        if (Data)
+            UnmapViewOfFile(Data);
+        if (Mapping)
+            CloseHandle(Mapping);
+        if (File != INVALID_HANDLE_VALUE)
+            CloseHandle(File);
+#else
+        if (Data)
+            munmap(const_cast<uint8_t*>(Data), Size);
+        if (Fd != -1)
+            close(Fd);
+#endif
+    }
+
+    const uint8_t* Data = nullptr;
+    size_t Size = 0;
+
+private:
+#ifdef _WIN32
+    HANDLE File = INVALID_HANDLE_VALUE;
+    HANDLE Mapping = NULL;
+#else
+    int Fd = -1;
+#endif
+};
+
+class TPCMIONativeWavReader : public IPCMProviderImpl {
+public:
+    // Returns false if the format is not handled natively
+    bool Open(const std::string& path) {
+        if (!File.Open(path) || File.Size < 12)
+            return false;
+        const uint8_t* p = File.Data;
+        if (memcmp(p, "RIFF", 4) || memcmp(p + 8, "WAVE", 4))
+            return false;
+
+        bool hasFmt = false;
+        size_t pos = 12;
+        while (pos + 8 <= File.Size) {
+            const uint8_t* chunk = p + pos;
+            const uint32_t chunkSz = ReadLE32(chunk + 4);
+            const size_t body = pos + 8;
+            if (!memcmp(chunk, "fmt ", 4)) {
+                if (chunkSz < 16 || body + chunkSz > File.Size)
+                    return false;
+                uint16_t format = ReadLE16(p + body);
+                Channels = ReadLE16(p + body + 2);
+                SampleRate = ReadLE32(p + body + 4);
+                BlockAlign = ReadLE16(p + body + 12);
+                Bits = ReadLE16(p + body + 14);
+                if (format == WAV_FORMAT_EXTENSIBLE) {
+                    if (chunkSz < 40)
+                        return false;
+                    // First two bytes of the sub format GUID are the format tag
+                    format = ReadLE16(p + body + 24);
+                }
+                Float = format == WAV_FORMAT_IEEE_FLOAT;
+                if (format != WAV_FORMAT_PCM && !Float)
+                    return false;
+                hasFmt = true;
+            } else if (!memcmp(chunk, "data", 4)) {
+                if (!hasFmt)
+                    return false;
+                DataPos = body;
+                // A live producer leaves the size unknown: 0 or 0xFFFFFFFF.
+                // Use the rest of the file in this case
+                const size_t avail = File.Size - body;
+                const bool unknown = chunkSz == 0 || chunkSz == 0xFFFFFFFF;
+                const size_t dataSz = unknown ? avail : std::min<size_t>(chunkSz, avail);
+                return SetFormat(dataSz);
+            }
+            pos = body + chunkSz + (chunkSz & 1);
+        }
+        return false;
+    }
+
+    size_t GetChannelsNum() const override {
+        return Channels;
+    }
+
+    size_t GetSampleRate() const override {
+        return SampleRate;
+    }
+
+    size_t GetTotalSamples() const override {
+        return TotalSamples;
+    }
+
+    size_t Read(TPCMBuffer& buf, size_t sz) override {
+        const size_t n = std::min(sz, TotalSamples - Pos);
+        const uint8_t* in = File.Data + DataPos + Pos * BlockAlign;
+        float* out = buf[0];
+        const size_t samples = n * Channels;
+        if (Float) {
+            memcpy(out, in, samples * sizeof(float));
+        } else if (Bits == 16) {
+            ConvertPcm16(in, samples, out);
+        } else {
+            ConvertPcm24(in, samples, out);
+        }
+        Pos += n;
+        return n;
+    }
+
+    size_t Skip(size_t sz) override {
+        const size_t n = std::min(sz, TotalSamples - Pos);
+        Pos += n;
+        return n;
+    }
+
+    size_t Write(const TPCMBuffer&, size_t) override {
+        return 0;
+    }
+
+private:
+    bool SetFormat(size_t dataSz) {
+        if (!Channels || BlockAlign != Channels * Bits / 8)
+            return false;
+        if (Float ? Bits != 32 : (Bits != 16 && Bits != 24))
+            return false;
+        TotalSamples = dataSz / BlockAlign;
+        return true;
+    }
+
+    TMappedFile File;
+    size_t DataPos = 0;
+    uint16_t Channels = 0;
+    uint32_t SampleRate = 0;
+    uint16_t BlockAlign = 0;
+    uint16_t Bits = 0;
+    bool Float = false;
+    size_t TotalSamples = 0;
+    size_t Pos = 0;
+};
+
+class TPCMIONativeWavWriter : public IPCMProviderImpl {
+public:
+    TPCMIONativeWavWriter(const std::string& path, int channels, int sampleRate)
+        : Fp(NAtracDEnc::FOpenUtf8(path, "wb"))
+        , Channels(channels)
+        , SampleRate(sampleRate)
+    {
+        if (!Fp)
+            throw std::runtime_error("unable to open output file '" + path + "'");
+        setvbuf(Fp, nullptr, _IOFBF, 1 << 20);
+        WriteHeader();
+    }
+
+    ~TPCMIONativeWavWriter() {
+        if (NAtracDEnc::IsSeekable(Fp) && fseek(Fp, 0, SEEK_SET) == 0)
+            WriteHeader();
+        fclose(Fp);
+    }
+
+    size_t GetChannelsNum() const override {
+        return Channels;
+    }
+
+    size_t GetSampleRate() const override {
+        return SampleRate;
+    }
+
+    size_t GetTotalSamples() const override {
+        return Written;
+    }
+
+    size_t Read(TPCMBuffer&, size_t) override {
+        return 0;
+    }
+
+    size_t Write(const TPCMBuffer& buf, size_t sz) override {
+        Pcm.resize(sz * Channels);
+        ConvertToPcm16(buf[0], Pcm.size(), Pcm.data());
+#ifdef BIGENDIAN_ORDER
+        for (auto& s : Pcm)
+            s = (int16_t)((uint16_t)s << 8 | (uint16_t)s >> 8);
+#endif
+        const size_t written = fwrite(Pcm.data(), sizeof(int16_t) * Channels, sz, Fp);
+        Written += written;
+        return written;
+    }
+
+private:
+    void WriteHeader() {
+        const uint64_t dataSz = Written * Channels * sizeof(int16_t);
+        const uint32_t dataSz32 = (uint32_t)std::min<uint64_t>(dataSz, UINT32_MAX - WavHeaderSize);
+        uint8_t h[WavHeaderSize];
+        memcpy(h, "RIFF", 4);
+        WriteLE32(h + 4, dataSz32 + WavHeaderSize - 8);
+        memcpy(h + 8, "WAVEfmt ", 8);
+        WriteLE32(h + 16, 16);
+        WriteLE16(h + 20, WAV_FORMAT_PCM);
+        WriteLE16(h + 22, Channels);
+        WriteLE32(h + 24, SampleRate);
+        WriteLE32(h + 28, SampleRate * Channels * sizeof(int16_t));
+        WriteLE16(h + 32, Channels * sizeof(int16_t));
+        WriteLE16(h + 34, 16);
+        memcpy(h + 36, "data", 4);
+        WriteLE32(h + 40, dataSz32);
+        fwrite(h, sizeof(h), 1, Fp);
+    }
+
+    FILE* Fp;
+    const uint16_t Channels;
+    const uint32_t SampleRate;
+    uint64_t Written = 0;
+    std::vector<int16_t> Pcm;
+};
+
+bool IsWavPath(const std::string& path) {
+    if (path == "-")
+        return false;
+    const size_t dot = path.find_last_of('.');
+    if (dot == std::string::npos || dot + 1 == path.size())
+        return true; // libsndfile backend writes WAV by default too
+    std::string ext = path.substr(dot + 1);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return ext == "wav";
+}
+
+} // namespace
+
+IPCMProviderImpl* CreatePCMIONativeReadImpl(const std::string& path) {
+#ifdef BIGENDIAN_ORDER
+    return nullptr;
+#else
+    if (path == "-")
+        return nullptr;
+    std::unique_ptr<TPCMIONativeWavReader> reader(new TPCMIONativeWavReader);
+    if (!reader->Open(path))
+        return nullptr;
+    return reader.release();
+#endif
+}
+
+IPCMProviderImpl* CreatePCMIONativeWriteImpl(const std::string& path, int channels, int sampleRate) {
+    if (!IsWavPath(path))
+        return nullptr;
+    return new TPCMIONativeWavWriter(path, channels, sampleRate);
+}
@@ -0,0 +1,31 @@
+/*
+ * This file is part of AtracDEnc.
+ *
+ * AtracDEnc is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * AtracDEnc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with AtracDEnc; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#pragma once
+
+#include "wav.h"
+
+#include <string>
+
+// Native WAV backend: PCM16, PCM24 and float32 RIFF/WAVE files are memory
+// mapped and converted straight into the engine buffer. Both functions
+// return nullptr for anything else (other formats, stdin/stdout, big-endian
+// host), the caller falls back to libsndfile then.
+IPCMProviderImpl* CreatePCMIONativeReadImpl(const std::string& path);
+// Writes PCM16 WAV through a large stdio buffer
+IPCMProviderImpl* CreatePCMIONativeWriteImpl(const std::string& path, int channels, int sampleRate);
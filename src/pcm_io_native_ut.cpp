@@ -0,0 +1,188 @@
+/*
+ * This file is part of AtracDEnc.
+ *
+ * AtracDEnc is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * AtracDEnc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with AtracDEnc; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "pcm_io_native.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+
+void PutLE(std::vector<uint8_t>& out, uint32_t v, size_t bytes) {
+    for (size_t i = 0; i < bytes; i++) {
+        out.push_back((v >> (8 * i)) & 0xff);
+    }
+}
+
+// Minimal RIFF/WAVE writer, extensible header is used for float samples
+// to check the sub format lookup. dataChunkSz < 0 writes the real size.
+std::string WriteWav(const char* name, uint16_t format, uint16_t bits, uint16_t channels,
+                     const std::vector<uint8_t>& data, bool extensible = false,
+                     int64_t dataChunkSz = -1)
+{
+    const uint16_t blockAlign = channels * bits / 8;
+    std::vector<uint8_t> h;
+    h.insert(h.end(), {'R', 'I', 'F', 'F'});
+    PutLE(h, 0, 4);
+    h.insert(h.end(), {'W', 'A', 'V', 'E', 'f', 'm', 't', ' '});
+    PutLE(h, extensible ? 40 : 16, 4);
+    PutLE(h, extensible ? 0xFFFE : format, 2);
+    PutLE(h, channels, 2);
+    PutLE(h, 44100, 4);
+    PutLE(h, 44100 * blockAlign, 4);
+    PutLE(h, blockAlign, 2);
+    PutLE(h, bits, 2);
+    if (extensible) {
+        PutLE(h, 22, 2);
+        PutLE(h, bits, 2);
+        PutLE(h, 0, 4);
+        PutLE(h, format, 2);
+        h.insert(h.end(), 14, 0);
+    }
+    // Unknown chunk with odd size must be skipped with padding
+    h.insert(h.end(), {'L', 'I', 'S', 'T'});
+    PutLE(h, 3, 4);
+    h.insert(h.end(), 4, 0);
+    h.insert(h.end(), {'d', 'a', 't', 'a'});
+    PutLE(h, dataChunkSz < 0 ? data.size() : dataChunkSz, 4);
+    h.insert(h.end(), data.begin(), data.end());
+
+    const std::string path = std::string("pcm_io_native_ut_") + name + ".wav";
+    FILE* f = fopen(path.c_str(), "wb");
+    EXPECT_NE(f, nullptr);
+    fwrite(h.data(), h.size(), 1, f);
+    fclose(f);
+    return path;
+}
+
+std::vector<float> ReadAll(const std::string& path, size_t expectedChannels) {
+    std::unique_ptr<IPCMProviderImpl> impl(CreatePCMIONativeReadImpl(path));
+    EXPECT_NE(impl, nullptr);
+    if (!impl)
+        return {};
+    EXPECT_EQ(impl->GetChannelsNum(), expectedChannels);
+    EXPECT_EQ(impl->GetSampleRate(), 44100);
+    const size_t total = impl->GetTotalSamples();
+    TPCMBuffer buf(total, expectedChannels);
+    EXPECT_EQ(impl->Read(buf, total), total);
+    EXPECT_EQ(impl->Read(buf, total), 0);
+    return std::vector<float>(buf[0], buf[0] + total * expectedChannels);
+}
+
+} // namespace
+
+TEST(TPCMIONative, ReadPcm16) {
+    // Longer than SIMD block to check the tail too
+    std::vector<int16_t> pcm;
+    for (int i = 0; i < 37; i++) {
+        pcm.push_back(i * 1771 - 32768);
+    }
+    std::vector<uint8_t> data;
+    for (int16_t s : pcm) {
+        PutLE(data, (uint16_t)s, 2);
+    }
+    const std::string path = WriteWav("16", 1, 16, 1, data);
+    const auto res = ReadAll(path, 1);
+    ASSERT_EQ(res.size(), pcm.size());
+    for (size_t i = 0; i < pcm.size(); i++) {
+        EXPECT_EQ(res[i], pcm[i] / 32768.0f);
+    }
+    remove(path.c_str());
+}
+
+TEST(TPCMIONative, ReadPcm24) {
+    const int32_t pcm[] = {-8388608, -1, 0, 1, 8388607, 123456};
+    std::vector<uint8_t> data;
+    for (int32_t s : pcm) {
+        PutLE(data, (uint32_t)s, 3);
+    }
+    const std::string path = WriteWav("24", 1, 24, 2, data);
+    const auto res = ReadAll(path, 2);
+    ASSERT_EQ(res.size(), 6);
+    for (size_t i = 0; i < res.size(); i++) {
+        EXPECT_EQ(res[i], pcm[i] / 8388608.0f);
+    }
+    remove(path.c_str());
+}
+
+TEST(TPCMIONative, ReadFloatExtensible) {
+    const float pcm[] = {0.5f, -0.25f, 1.0f, -1.0f};
+    std::vector<uint8_t> data(sizeof(pcm));
+    memcpy(data.data(), pcm, sizeof(pcm));
+    const std::string path = WriteWav("float", 3, 32, 2, data, true);
+    const auto res = ReadAll(path, 2);
+    ASSERT_EQ(res.size(), 4);
+    EXPECT_EQ(memcmp(res.data(), pcm, sizeof(pcm)), 0);
+    remove(path.c_str());
+}
+
+TEST(TPCMIONative, ReadUnknownDataSize) {
+    // Data chunk of a live producer, the size is not written yet
+    std::vector<uint8_t> data;
+    for (int i = 0; i < 10; i++) {
+        PutLE(data, (uint16_t)(i * 1000), 2);
+    }
+    for (int64_t chunkSz : {0LL, 0xFFFFFFFFLL, 1000LL}) {
+        const std::string path = WriteWav("unknown", 1, 16, 2, data, false, chunkSz);
+        const auto res = ReadAll(path, 2);
+        ASSERT_EQ(res.size(), 10) << "chunk size " << chunkSz;
+        for (size_t i = 0; i < res.size(); i++) {
+            EXPECT_EQ(res[i], i * 1000 / 32768.0f);
+        }
+        remove(path.c_str());
+    }
+}
+
+TEST(TPCMIONative, UnsupportedFallsBack) {
+    // 8 bit PCM is left to libsndfile
+    const std::string path = WriteWav("8", 1, 8, 1, std::vector<uint8_t>(16, 0x80));
+    EXPECT_EQ(CreatePCMIONativeReadImpl(path), nullptr);
+    remove(path.c_str());
+    EXPECT_EQ(CreatePCMIONativeReadImpl("-"), nullptr);
+    EXPECT_EQ(CreatePCMIONativeReadImpl("pcm_io_native_ut_missing.wav"), nullptr);
+    EXPECT_EQ(CreatePCMIONativeWriteImpl("pcm_io_native_ut.aiff", 2, 44100), nullptr);
+}
+
+TEST(TPCMIONative, WriteRoundTrip) {
+    const std::string path = "pcm_io_native_ut_out.wav";
+    const size_t samples = 21;
+    TPCMBuffer buf(samples, 2);
+    for (size_t i = 0; i < samples * 2; i++) {
+        buf[0][i] = (float)i / samples - 1.0f;
+    }
+    buf[0][0] = 1.5f; // saturated
+    {
+        std::unique_ptr<IPCMProviderImpl> impl(CreatePCMIONativeWriteImpl(path, 2, 44100));
+        ASSERT_NE(impl, nullptr);
+        EXPECT_EQ(impl->Write(buf, 10), 10);
+        EXPECT_EQ(impl->Write(buf, samples), samples);
+    }
+    const auto res = ReadAll(path, 2);
+    ASSERT_EQ(res.size(), (10 + samples) * 2);
+    EXPECT_EQ(res[0], 32767 / 32768.0f);
+    for (size_t i = 1; i < samples * 2; i++) {
+        EXPECT_EQ(res[20 + i], lrintf(buf[0][i] * 32767) / 32768.0f);
+    }
+    remove(path.c_str());
+}
@@ -19,6 +19,9 @@
 #include "wav.h"
 
 #include "utf8_file.h"
+#ifdef ATRACDENC_PCM_IO_NATIVE
+#include "pcm_io_native.h"
+#endif
 
 #include <sndfile.hh>
 #include <algorithm>
@@ -106,11 +109,23 @@ public:
         return File.samplerate();
     }
     size_t GetTotalSamples() const override {
+        // Length in the header of a pipe can't be trusted, producer may not know it yet
+        if (File.frames() == SF_COUNT_MAX || File.seek(0, SEEK_CUR) < 0)
+            return UnknownLength;
         return File.frames();
     }
     size_t Read(TPCMBuffer& buf, size_t sz) override {
         return File.readf(buf[0], sz);
     }
+    size_t Skip(size_t sz) override {
+        const sf_count_t cur = File.seek(0, SEEK_CUR);
+        if (cur < 0) {
+            // Not seekable (pipe), fallback to read and discard
+            return IPCMProviderImpl::Skip(sz);
+        }
+        const sf_count_t pos = File.seek(std::min<sf_count_t>(cur + sz, File.frames()), SEEK_SET);
+        return pos < 0 ? 0 : pos - cur;
+    }
     size_t Write(const TPCMBuffer& buf, size_t sz) override {
         return File.writef(buf[0], sz);
     }
@@ -119,9 +134,17 @@ private:
 };
 
 IPCMProviderImpl* CreatePCMIOReadImpl(const std::string& path) {
+#ifdef ATRACDENC_PCM_IO_NATIVE
+    if (IPCMProviderImpl* impl = CreatePCMIONativeReadImpl(path))
+        return impl;
+#endif
     return new TPCMIOSndFile(path); 
 }
 
 IPCMProviderImpl* CreatePCMIOWriteImpl(const std::string& path, int channels, int sampleRate) {
+#ifdef ATRACDENC_PCM_IO_NATIVE
+    if (IPCMProviderImpl* impl = CreatePCMIONativeWriteImpl(path, channels, sampleRate))
+        return impl;
+#endif
     return new TPCMIOSndFile(path, channels, sampleRate);
 }
@@ -0,0 +1,141 @@
+/*
+ * This file is part of AtracDEnc.
+ *
+ * AtracDEnc is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * AtracDEnc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with AtracDEnc; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "pcm_layout.h"
+#include "pcmengin.h"
+
+#include <cstring>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define ATDE_PCM_LAYOUT_SSE
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#include <arm_neon.h>
+#define ATDE_PCM_LAYOUT_NEON
+#endif
+
+namespace NAtracDEnc {
+
+namespace {
+
+size_t DeinterleaveStereo(const float* in, size_t n, float* l, float* r) {
+    size_t i = 0;
+#if defined(ATDE_PCM_LAYOUT_SSE)
+    for (; i + 4 <= n; i += 4) {
+        const __m128 a = _mm_loadu_ps(in + i * 2);
+        const __m128 b = _mm_loadu_ps(in + i * 2 + 4);
+        _mm_storeu_ps(l + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+        _mm_storeu_ps(r + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+    }
+#elif defined(ATDE_PCM_LAYOUT_NEON)
+    for (; i + 4 <= n; i += 4) {
+        const float32x4x2_t v = vld2q_f32(in + i * 2);
+        vst1q_f32(l + i, v.val[0]);
+        vst1q_f32(r + i, v.val[1]);
+    }
+#endif
+    return i;
+}
+
+size_t InterleaveStereo(const float* l, const float* r, size_t n, float* out) {
+    size_t i = 0;
+#if defined(ATDE_PCM_LAYOUT_SSE)
+    for (; i + 4 <= n; i += 4) {
+        const __m128 a = _mm_loadu_ps(l + i);
+        const __m128 b = _mm_loadu_ps(r + i);
+        _mm_storeu_ps(out + i * 2, _mm_unpacklo_ps(a, b));
+        _mm_storeu_ps(out + i * 2 + 4, _mm_unpackhi_ps(a, b));
+    }
+#elif defined(ATDE_PCM_LAYOUT_NEON)
+    for (; i + 4 <= n; i += 4) {
+        float32x4x2_t v;
+        v.val[0] = vld1q_f32(l + i);
+        v.val[1] = vld1q_f32(r + i);
+        vst2q_f32(out + i * 2, v);
+    }
+#endif
+    return i;
+}
+
+} // namespace
+
+void DeinterleavePcm(const float* in, size_t channels, size_t n, float* const* out) {
+    if (channels == 1) {
+        memcpy(out[0], in, n * sizeof(float));
+        return;
+    }
+    size_t i = 0;
+    if (channels == 2)
+        i = DeinterleaveStereo(in, n, out[0], out[1]);
+    for (; i < n; i++) {
+        for (size_t ch = 0; ch < channels; ch++) {
+            out[ch][i] = in[i * channels + ch];
+        }
+    }
+}
+
+void InterleavePcm(const float* const* in, size_t channels, size_t n, float* out) {
+    if (channels == 1) {
+        memcpy(out, in[0], n * sizeof(float));
+        return;
+    }
+    size_t i = 0;
+    if (channels == 2)
+        i = InterleaveStereo(in[0], in[1], n, out);
+    for (; i < n; i++) {
+        for (size_t ch = 0; ch < channels; ch++) {
+            out[i * channels + ch] = in[ch][i];
+        }
+    }
+}
+
+void DeinterleavePcm(const TPCMBuffer& in, size_t n, TPCMBuffer* out) {
+    assert(!in.IsPlanar() && out->IsPlanar() && in.Channels() == out->Channels());
+    const size_t channels = in.Channels();
+    if (channels == 2) {
+        float* planes[2] = {out->Channel(0), out->Channel(1)};
+        DeinterleavePcm(in[0], 2, n, planes);
+        return;
+    }
+    for (size_t ch = 0; ch < channels; ch++) {
+        float* dst = out->Channel(ch);
+        const float* src = in[0];
+        for (size_t i = 0; i < n; i++) {
+            dst[i] = src[i * channels + ch];
+        }
+    }
+}
+
+void InterleavePcm(const TPCMBuffer& in, size_t n, TPCMBuffer* out) {
+    assert(in.IsPlanar() && !out->IsPlanar() && in.Channels() == out->Channels());
+    const size_t channels = in.Channels();
+    if (channels == 2) {
+        const float* planes[2] = {in.Channel(0), in.Channel(1)};
+        InterleavePcm(planes, 2, n, (*out)[0]);
+        return;
+    }
+    for (size_t ch = 0; ch < channels; ch++) {
+        const float* src = in.Channel(ch);
+        float* dst = (*out)[0];
+        for (size_t i = 0; i < n; i++) {
+            dst[i * channels + ch] = src[i];
+        }
+    }
+}
+
+} // namespace NAtracDEnc
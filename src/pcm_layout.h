@@ -0,0 +1,36 @@
+/*
+ * This file is part of AtracDEnc.
+ *
+ * AtracDEnc is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * AtracDEnc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with AtracDEnc; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#pragma once
+
+#include <cstddef>
+
+class TPCMBuffer;
+
+namespace NAtracDEnc {
+
+// Converts n samples of each channel between interleaved (file, API) and
+// planar (codec) layouts. Stereo, the common case, is vectorised.
+void DeinterleavePcm(const float* in, size_t channels, size_t n, float* const* out);
+void InterleavePcm(const float* const* in, size_t channels, size_t n, float* out);
+
+// Same for the first n samples of interleaved and planar buffers
+void DeinterleavePcm(const TPCMBuffer& in, size_t n, TPCMBuffer* out);
+void InterleavePcm(const TPCMBuffer& in, size_t n, TPCMBuffer* out);
+
+} // namespace NAtracDEnc
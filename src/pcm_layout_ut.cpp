@@ -0,0 +1,108 @@
+/*
+ * This file is part of AtracDEnc.
+ *
+ * AtracDEnc is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * AtracDEnc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with AtracDEnc; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "pcm_layout.h"
+#include "pcmengin.h"
+#include "wav.h"
+#include "atrac3denc.h"
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <vector>
+
+using namespace NAtracDEnc;
+
+namespace {
+
+class TMemOutput : public ICompressedOutput {
+public:
+    void WriteFrame(const char* data, size_t size) override {
+        Frames.emplace_back(data, data + size);
+    }
+    std::string GetName() const override {
+        return {};
+    }
+    size_t GetChannelNum() const override {
+        return 2;
+    }
+    std::vector<std::vector<char>> Frames;
+};
+
+static std::vector<std::vector<char>> EncodeAtrac3(TPCMEngine::ELayout layout, uint64_t total) {
+    auto pos = std::make_shared<uint64_t>(0);
+    TPCMEngine::TReaderPtr reader(new TWavPcmReader([pos, total](TPCMBuffer& data, const uint32_t size) {
+        if (*pos >= total)
+            return false;
+        const uint64_t n = std::min<uint64_t>(size, total - *pos);
+        for (uint64_t i = 0; i < n; i++) {
+            const float t = (*pos + i) / 44100.0f;
+            data.At(i, 0) = 0.3f * sinf(2 * M_PI * 440 * t);
+            data.At(i, 1) = 0.2f * sinf(2 * M_PI * 1250 * t);
+        }
+        if (n != size)
+            data.Zero(n, size - n);
+        *pos += n;
+        return true;
+    }));
+
+    TMemOutput* out = new TMemOutput;
+    std::unique_ptr<IProcessor> encoder(new TAtrac3Encoder(TCompressedOutputPtr(out),
+        NAtrac3::TAtrac3EncoderSettings(0, false, false, 2, 0)));
+    auto lambda = encoder->GetLambda();
+    TPCMEngine engine(4096, 2, std::move(reader), layout);
+    while (engine.ApplyProcess(NAtrac3::TAtrac3Data::NumSamples, lambda) < total) {
+    }
+    encoder->Flush();
+    return out->Frames;
+}
+
+} // namespace
+
+TEST(TPcmLayout, RoundTrip) {
+    for (size_t channels = 1; channels <= 3; channels++) {
+        const size_t n = 1031;
+        std::vector<float> in(n * channels);
+        for (size_t i = 0; i < in.size(); i++) {
+            in[i] = i * 0.5f - 7;
+        }
+
+        TPCMBuffer planar(n, channels, TPCMBuffer::ELayout::PLANAR);
+        TPCMBuffer interleaved(n, channels);
+        memcpy(interleaved[0], in.data(), in.size() * sizeof(float));
+        DeinterleavePcm(interleaved, n, &planar);
+        for (size_t ch = 0; ch < channels; ch++) {
+            EXPECT_EQ(reinterpret_cast<uintptr_t>(planar.Channel(ch)) % 64, 0u);
+            for (size_t i = 0; i < n; i++) {
+                ASSERT_EQ(planar.Channel(ch)[i], in[i * channels + ch]);
+            }
+        }
+
+        TPCMBuffer back(n, channels);
+        InterleavePcm(planar, n, &back);
+        EXPECT_EQ(memcmp(back[0], in.data(), in.size() * sizeof(float)), 0);
+    }
+}
+
+TEST(TPcmLayout, PlanarEngineMatchesInterleaved) {
+    const uint64_t total = 44100 + 777;
+    const auto interleaved = EncodeAtrac3(TPCMEngine::ELayout::INTERLEAVED, total);
+    const auto planar = EncodeAtrac3(TPCMEngine::ELayout::PLANAR, total);
+    EXPECT_FALSE(planar.empty());
+    EXPECT_TRUE(interleaved == planar);
+}
@@ -29,6 +29,8 @@
 #include <assert.h>
 #include <string.h>
 
+#include "util.h"
+
 class TNoDataToRead : public std::exception {
 };
 
@@ -52,23 +54,38 @@ class TEndOfRead : public std::exception {
 };
 
 class TPCMBuffer {
-    std::vector<float> Buf_;
+public:
+    enum class ELayout {
+        INTERLEAVED, // sample of each channel one by one
+        PLANAR,      // aligned block of samples per channel
+    };
+
+private:
+    // Keep each channel of planar buffer aligned to 64 bytes
+    static constexpr size_t PlaneAlign = 16;
+
+    std::vector<float, TAlignedAllocator<float>> Buf_;
     size_t NumChannels;
+    size_t NumSamples;
+    size_t Stride; // distance between channels, 0 for interleaved layout
 
 public:
-    TPCMBuffer(uint16_t bufSize, size_t numChannels)
+    TPCMBuffer(size_t bufSize, size_t numChannels, ELayout layout = ELayout::INTERLEAVED)
        : NumChannels(numChannels)
+       , NumSamples(bufSize)
+       , Stride(layout == ELayout::PLANAR ? (bufSize + PlaneAlign - 1) / PlaneAlign * PlaneAlign : 0)
     {
-        Buf_.resize((size_t)bufSize * numChannels);
+        Buf_.resize(Stride ? Stride * numChannels : bufSize * numChannels);
     }
 
-    size_t Size() {
-        return Buf_.size() / NumChannels;
+    size_t Size() const {
+        return NumSamples;
     }
 
+    // Interleaved layout only
     float* operator[](size_t pos) {
         size_t rpos = pos * NumChannels;
-        if (rpos >= Buf_.size()) {
+        if (Stride || rpos >= Buf_.size()) {
             std::cerr << "attempt to access out of buffer pos: " << pos << std::endl;
             std::abort();
         }
@@ -77,20 +94,50 @@ public:
 
     const float* operator[](size_t pos) const {
         size_t rpos = pos * NumChannels;
-        if (rpos >= Buf_.size()) {
+        if (Stride || rpos >= Buf_.size()) {
             std::cerr << "attempt to access out of buffer pos: " << pos << std::endl;
             std::abort();
         }
         return &Buf_[rpos];
     }
 
+    // Planar layout only
+    float* Channel(size_t ch) {
+        assert(Stride && ch < NumChannels);
+        return &Buf_[ch * Stride];
+    }
+
+    const float* Channel(size_t ch) const {
+        assert(Stride && ch < NumChannels);
+        return &Buf_[ch * Stride];
+    }
+
+    float& At(size_t pos, size_t ch) {
+        assert(pos < NumSamples && ch < NumChannels);
+        return Stride ? Buf_[ch * Stride + pos] : Buf_[pos * NumChannels + ch];
+    }
+
+    bool IsPlanar() const {
+        return Stride != 0;
+    }
+
+    size_t ChannelStride() const {
+        return Stride;
+    }
+
     uint16_t Channels() const {
         return NumChannels;
     }
 
     void Zero(size_t pos, size_t len) {
-        assert((pos + len) * NumChannels <= Buf_.size());
-        memset(&Buf_[pos*NumChannels], 0, len*NumChannels);
+        assert(pos + len <= NumSamples);
+        if (Stride) {
+            for (size_t ch = 0; ch < NumChannels; ch++) {
+                memset(&Buf_[ch * Stride + pos], 0, len * sizeof(float));
+            }
+        } else {
+            memset(&Buf_[pos*NumChannels], 0, len*NumChannels*sizeof(float));
+        }
     }
 };
 
@@ -114,6 +161,26 @@ public:
     typedef std::unique_ptr<IPCMReader> TReaderPtr;
     struct ProcessMeta {
         const uint16_t Channels;
+        // Distance between channels of planar data, 0 - samples are interleaved
+        const size_t ChannelStride = 0;
+
+        // Returns n samples of the channel, interleaved samples are gathered into tmp
+        const float* GetChannel(const float* data, size_t ch, size_t n, float* tmp) const {
+            if (ChannelStride)
+                return data + ch * ChannelStride;
+            for (size_t i = 0; i < n; i++)
+                tmp[i] = data[i * Channels + ch];
+            return tmp;
+        }
+
+        void SetChannel(float* data, size_t ch, const float* src, size_t n) const {
+            if (ChannelStride) {
+                memcpy(data + ch * ChannelStride, src, n * sizeof(float));
+                return;
+            }
+            for (size_t i = 0; i < n; i++)
+                data[i * Channels + ch] = src[i];
+        }
     };
 private:
     TPCMBuffer Buffer;
@@ -122,22 +189,25 @@ private:
     uint64_t Processed = 0;
     uint64_t ToDrain = 0;
 public:
-        TPCMEngine(uint16_t bufSize, size_t numChannels)
-           : Buffer(bufSize, numChannels) {
+        typedef TPCMBuffer::ELayout ELayout;
+
+        TPCMEngine(uint16_t bufSize, size_t numChannels, ELayout layout = ELayout::INTERLEAVED)
+           : Buffer(bufSize, numChannels, layout) {
         }
 
-        TPCMEngine(uint16_t bufSize, size_t numChannels, TWriterPtr&& writer)
-            : Buffer(bufSize, numChannels)
+        TPCMEngine(uint16_t bufSize, size_t numChannels, TWriterPtr&& writer, ELayout layout = ELayout::INTERLEAVED)
+            : Buffer(bufSize, numChannels, layout)
             , Writer(std::move(writer)) {
         }
 
-        TPCMEngine(uint16_t bufSize, size_t numChannels, TReaderPtr&& reader)
-            : Buffer(bufSize, numChannels)
+        TPCMEngine(uint16_t bufSize, size_t numChannels, TReaderPtr&& reader, ELayout layout = ELayout::INTERLEAVED)
+            : Buffer(bufSize, numChannels, layout)
             , Reader(std::move(reader)) {
         }
 
-        TPCMEngine(uint16_t bufSize, size_t numChannels, TWriterPtr&& writer, TReaderPtr&& reader)
-            : Buffer(bufSize, numChannels)
+        TPCMEngine(uint16_t bufSize, size_t numChannels, TWriterPtr&& writer, TReaderPtr&& reader,
+                   ELayout layout = ELayout::INTERLEAVED)
+            : Buffer(bufSize, numChannels, layout)
             , Writer(std::move(writer))
             , Reader(std::move(reader)) {
         }
@@ -168,10 +238,11 @@ public:
             }
 
             size_t lastPos = 0;
-            ProcessMeta meta = {Buffer.Channels()};
+            ProcessMeta meta = {Buffer.Channels(), Buffer.ChannelStride()};
 
             for (size_t i = 0; i + step <= Buffer.Size(); i+=step) {
-                auto res = lambda(Buffer[i], meta);
+                float* data = Buffer.IsPlanar() ? Buffer.Channel(0) + i : Buffer[i];
+                auto res = lambda(data, meta);
                 if (res == EProcessResult::PROCESSED) {
                     lastPos += step;
                     if (drain && ToDrain--) {
@@ -195,5 +266,10 @@ public:
 class IProcessor {
 public:
     virtual typename TPCMEngine::TProcessLambda GetLambda() = 0;
+    // Waits until all processed frames are written, rethrows errors of pipeline stages
+    virtual void Flush() {}
+    // Frames which may still be queued to pipeline stages when the lambda returns,
+    // 0 - all output of a frame is written before its lambda call returns
+    virtual uint32_t GetPipelineDepth() const { return 0; }
     virtual ~IProcessor() {}
 };
@@ -0,0 +1,40 @@
+/*
+ * This file is part of AtracDEnc.
+ *
+ * AtracDEnc is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * AtracDEnc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with AtracDEnc; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "pcmengin.h"
+#include <gtest/gtest.h>
+
+TEST(TPCMBuffer, ZeroClearsWholeSamples) {
+    for (auto layout : {TPCMBuffer::ELayout::INTERLEAVED, TPCMBuffer::ELayout::PLANAR}) {
+        const size_t n = 1024;
+        const size_t channels = 2;
+        TPCMBuffer buf(n, channels, layout);
+        for (size_t i = 0; i < n; i++) {
+            for (size_t ch = 0; ch < channels; ch++) {
+                buf.At(i, ch) = 1.0f;
+            }
+        }
+
+        buf.Zero(1000, 24);
+        for (size_t i = 0; i < n; i++) {
+            for (size_t ch = 0; ch < channels; ch++) {
+                ASSERT_EQ(buf.At(i, ch), i < 1000 ? 1.0f : 0.0f) << "sample " << i << " channel " << ch;
+            }
+        }
+    }
+}
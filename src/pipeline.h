@@ -0,0 +1,216 @@
+/*
+ * This file is part of AtracDEnc.
+ *
+ * AtracDEnc is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * AtracDEnc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with AtracDEnc; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace NAtracDEnc {
+
+// Bounded single producer / single consumer ring.
+// TryPush must be called from one thread only, TryPop from another one.
+template<class T>
+class TSpscQueue {
+public:
+    explicit TSpscQueue(size_t capacity)
+        : Ring(capacity)
+    {}
+
+    bool TryPush(T&& item) {
+        const uint64_t tail = Tail.load(std::memory_order_relaxed);
+        if (tail - Head.load(std::memory_order_acquire) == Ring.size())
+            return false;
+        Ring[tail % Ring.size()] = std::move(item);
+        Tail.store(tail + 1, std::memory_order_seq_cst);
+        return true;
+    }
+
+    bool TryPop(T& item) {
+        const uint64_t head = Head.load(std::memory_order_relaxed);
+        if (head == Tail.load(std::memory_order_acquire))
+            return false;
+        item = std::move(Ring[head % Ring.size()]);
+        Head.store(head + 1, std::memory_order_seq_cst);
+        return true;
+    }
+
+    bool Empty() const {
+        return Head.load() == Tail.load();
+    }
+
+    bool Full() const {
+        return Tail.load() - Head.load() == Ring.size();
+    }
+
+private:
+    std::vector<T> Ring;
+    alignas(64) std::atomic<uint64_t> Head{0};
+    alignas(64) std::atomic<uint64_t> Tail{0};
+};
+
+// One stage of the encoding pipeline: items pushed by the producer are handled
+// in order on a dedicated thread. Data goes through the lock free ring, the mutex
+// is taken only when one side has to sleep on an empty or full queue.
+// Depth 0 means no thread at all, the handler is called from Push.
+// Handled items are passed back to the producer through a second ring of
+// depth + 1 slots, so buffers of items can be reused instead of reallocated.
+template<class T>
+class TPipelineStage {
+public:
+    typedef std::function<void(T& item)> THandler;
+
+    TPipelineStage(size_t depth, THandler handler)
+        : Handler(std::move(handler))
+        , Queue(depth ? depth : 1)
+        , Free(depth + 1)
+        , Threaded(depth != 0)
+    {
+        if (Threaded)
+            Worker = std::thread(&TPipelineStage::Run, this);
+    }
+
+    ~TPipelineStage() {
+        if (!Threaded)
+            return;
+        {
+            std::lock_guard<std::mutex> lock(Mutex);
+            Closed = true;
+        }
+        ConsumerCv.notify_one();
+        Worker.join();
+        if (Error && !Reported) {
+            try {
+                std::rethrow_exception(Error);
+            } catch (const std::exception& ex) {
+                std::cerr << "pipeline stage error: " << ex.what() << std::endl;
+            } catch (...) {
+                std::cerr << "pipeline stage error" << std::endl;
+            }
+        }
+    }
+
+    TPipelineStage(const TPipelineStage&) = delete;
+    TPipelineStage& operator=(const TPipelineStage&) = delete;
+
+    void Push(T&& item) {
+        if (!Threaded) {
+            Handler(item);
+            Free.TryPush(std::move(item));
+            return;
+        }
+        CheckError();
+        if (!Queue.TryPush(std::move(item))) {
+            std::unique_lock<std::mutex> lock(Mutex);
+            ProducerWaiting = true;
+            ProducerCv.wait(lock, [this] { return !Queue.Full(); });
+            ProducerWaiting = false;
+            lock.unlock();
+            Queue.TryPush(std::move(item));
+        }
+        Pushed++;
+        if (ConsumerWaiting) {
+            std::lock_guard<std::mutex> lock(Mutex);
+            ConsumerCv.notify_one();
+        }
+    }
+
+    // Moves an already handled item into item, returns false and leaves item
+    // untouched if there is none. Must be called from the producer thread.
+    bool Reclaim(T& item) {
+        return Free.TryPop(item);
+    }
+
+    // Waits until all pushed items are handled, rethrows error of the stage thread
+    void Flush() {
+        if (!Threaded)
+            return;
+        {
+            std::unique_lock<std::mutex> lock(Mutex);
+            ProducerWaiting = true;
+            ProducerCv.wait(lock, [this] { return Handled == Pushed; });
+            ProducerWaiting = false;
+        }
+        CheckError();
+    }
+
+private:
+    void CheckError() {
+        if (Failed && !Reported) {
+            Reported = true;
+            std::rethrow_exception(Error);
+        }
+    }
+
+    void Run() {
+        T item;
+        for (;;) {
+            if (!Queue.TryPop(item)) {
+                std::unique_lock<std::mutex> lock(Mutex);
+                ConsumerWaiting = true;
+                ConsumerCv.wait(lock, [this] { return !Queue.Empty() || Closed; });
+                ConsumerWaiting = false;
+                if (Queue.Empty())
+                    return;
+                continue;
+            }
+            if (!Failed) {
+                try {
+                    Handler(item);
+                } catch (...) {
+                    Error = std::current_exception();
+                    Failed = true;
+                }
+            }
+            Free.TryPush(std::move(item));
+            Handled++;
+            if (ProducerWaiting) {
+                std::lock_guard<std::mutex> lock(Mutex);
+                ProducerCv.notify_one();
+            }
+        }
+    }
+
+    const THandler Handler;
+    TSpscQueue<T> Queue;
+    TSpscQueue<T> Free;
+    const bool Threaded;
+    std::thread Worker;
+
+    std::mutex Mutex;
+    std::condition_variable ConsumerCv;
+    std::condition_variable ProducerCv;
+    std::atomic<bool> ConsumerWaiting{false};
+    std::atomic<bool> ProducerWaiting{false};
+    bool Closed = false;
+
+    uint64_t Pushed = 0;
+    std::atomic<uint64_t> Handled{0};
+    std::exception_ptr Error;
+    std::atomic<bool> Failed{false};
+    bool Reported = false;
+};
+
+} // namespace NAtracDEnc
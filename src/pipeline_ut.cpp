@@ -0,0 +1,99 @@
+/*
+ * This file is part of AtracDEnc.
+ *
+ * AtracDEnc is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * AtracDEnc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with AtracDEnc; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "pipeline.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+using namespace NAtracDEnc;
+
+TEST(TSpscQueue, Bounded) {
+    TSpscQueue<int> queue(2);
+    int v = 0;
+    EXPECT_FALSE(queue.TryPop(v));
+    EXPECT_TRUE(queue.TryPush(1));
+    EXPECT_TRUE(queue.TryPush(2));
+    EXPECT_FALSE(queue.TryPush(3));
+    EXPECT_TRUE(queue.TryPop(v));
+    EXPECT_EQ(v, 1);
+    EXPECT_TRUE(queue.TryPush(3));
+    EXPECT_TRUE(queue.TryPop(v));
+    EXPECT_EQ(v, 2);
+    EXPECT_TRUE(queue.TryPop(v));
+    EXPECT_EQ(v, 3);
+    EXPECT_TRUE(queue.Empty());
+}
+
+TEST(TPipelineStage, KeepsOrder) {
+    for (size_t depth : {0, 1, 4}) {
+        std::vector<int> result;
+        TPipelineStage<std::vector<int>> stage(depth, [&result](std::vector<int>& item) {
+            result.push_back(item[0]);
+        });
+        for (int i = 0; i < 10000; i++) {
+            stage.Push(std::vector<int>(3, i));
+        }
+        stage.Flush();
+        ASSERT_EQ(result.size(), 10000);
+        for (int i = 0; i < 10000; i++) {
+            EXPECT_EQ(result[i], i);
+        }
+    }
+}
+
+TEST(TPipelineStage, RethrowsError) {
+    TPipelineStage<int> stage(2, [](int& item) {
+        if (item == 5)
+            throw std::runtime_error("stage error");
+    });
+    // Error is reported by one of following Push calls or by Flush
+    EXPECT_THROW({
+        for (int i = 0; i < 10; i++) {
+            stage.Push(int(i));
+        }
+        stage.Flush();
+    }, std::runtime_error);
+}
+
+TEST(TPipelineStage, ReclaimsHandledItems) {
+    for (size_t depth : {0, 1, 4}) {
+        TPipelineStage<std::vector<int>> stage(depth, [](std::vector<int>&) {});
+        std::vector<int> item;
+        EXPECT_FALSE(stage.Reclaim(item));
+
+        std::vector<const int*> storage;
+        for (int i = 0; i < 100; i++) {
+            std::vector<int> next;
+            if (!stage.Reclaim(next)) {
+                next.resize(16);
+                storage.push_back(next.data());
+            }
+            ASSERT_EQ(next.size(), 16);
+            stage.Push(std::move(next));
+        }
+        // Allocated items are kept in circulation
+        EXPECT_LE(storage.size(), depth + 2);
+        stage.Flush();
+        ASSERT_TRUE(stage.Reclaim(item));
+        EXPECT_NE(std::find(storage.begin(), storage.end(), item.data()), storage.end());
+    }
+}
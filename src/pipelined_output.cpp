@@ -0,0 +1,68 @@
+/*
+ * This file is part of AtracDEnc.
+ *
+ * AtracDEnc is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * AtracDEnc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with AtracDEnc; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "pipelined_output.h"
+#include "pipeline.h"
+
+namespace {
+
+class TPipelinedOutput : public ICompressedOutput {
+public:
+    TPipelinedOutput(TCompressedOutputPtr&& output, size_t depth)
+        : Output(std::move(output))
+        , Stage(depth, [this](std::vector<char>& data) {
+            Output->WriteFrame(data.data(), data.size());
+        })
+    {}
+
+    void WriteFrame(const char* data, size_t size) override {
+        // Written frames come back from the stage and keep their capacity
+        std::vector<char> buf;
+        Stage.Reclaim(buf);
+        buf.assign(data, data + size);
+        Stage.Push(std::move(buf));
+    }
+
+    void Flush() override {
+        Stage.Flush();
+        Output->Flush();
+    }
+
+    std::string GetName() const override {
+        return Output->GetName();
+    }
+
+    size_t GetChannelNum() const override {
+        return Output->GetChannelNum();
+    }
+
+private:
+    TCompressedOutputPtr Output;
+    // Must be destroyed first, the stage thread writes to Output
+    NAtracDEnc::TPipelineStage<std::vector<char>> Stage;
+};
+
+} // namespace
+
+TCompressedOutputPtr
+CreatePipelinedOutput(TCompressedOutputPtr&& output, size_t depth)
+{
+    if (depth == 0)
+        return std::move(output);
+    return std::unique_ptr<TPipelinedOutput>(new TPipelinedOutput(std::move(output), depth));
+}
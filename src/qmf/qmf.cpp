@@ -22,6 +22,14 @@
 
 #include <iostream>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ATDE_QMF_SSE2
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#include <arm_neon.h>
+#define ATDE_QMF_NEON
+#endif
+
 static const float TapHalf[24] = {
     -0.00001461907,  -0.00009205479, -0.000056157569,  0.00030117269,
     0.0002422519,    -0.00085293897, -0.0005205574,    0.0020340169,
@@ -44,6 +52,106 @@ TQmfCommon::TQmfCommon() noexcept
     }
 }
 
+namespace {
+
+#if defined(ATDE_QMF_SSE2)
+struct TVec {
+    typedef __m128 T;
+    static constexpr size_t W = 4;
+    static T Load(const float* p) { return _mm_loadu_ps(p); }
+    static void Store(float* p, T v) { _mm_storeu_ps(p, v); }
+    static void StoreInterleave(float* p, T a, T b) {
+        _mm_storeu_ps(p, _mm_unpacklo_ps(a, b));
+        _mm_storeu_ps(p + 4, _mm_unpackhi_ps(a, b));
+    }
+    static T Add(T a, T b) { return _mm_add_ps(a, b); }
+    static T Sub(T a, T b) { return _mm_sub_ps(a, b); }
+    static T Mul(T a, T b) { return _mm_mul_ps(a, b); }
+    static T Set1(float x) { return _mm_set1_ps(x); }
+};
+#elif defined(ATDE_QMF_NEON)
+struct TVec {
+    typedef float32x4_t T;
+    static constexpr size_t W = 4;
+    static T Load(const float* p) { return vld1q_f32(p); }
+    static void Store(float* p, T v) { vst1q_f32(p, v); }
+    static void StoreInterleave(float* p, T a, T b) {
+        float32x4x2_t v;
+        v.val[0] = a;
+        v.val[1] = b;
+        vst2q_f32(p, v);
+    }
+    static T Add(T a, T b) { return vaddq_f32(a, b); }
+    static T Sub(T a, T b) { return vsubq_f32(a, b); }
+    // Separate multiply and add, the same rounding as the scalar code
+    static T Mul(T a, T b) { return vmulq_f32(a, b); }
+    static T Set1(float x) { return vdupq_n_f32(x); }
+};
+#else
+struct TVec {
+    typedef float T;
+    static constexpr size_t W = 1;
+    static T Load(const float* p) { return *p; }
+    static void Store(float* p, T v) { *p = v; }
+    static void StoreInterleave(float* p, T a, T b) { p[0] = a; p[1] = b; }
+    static T Add(T a, T b) { return a + b; }
+    static T Sub(T a, T b) { return a - b; }
+    static T Mul(T a, T b) { return a * b; }
+    static T Set1(float x) { return x; }
+};
+#endif
+
+// Two vectors of outputs per band and iteration
+constexpr size_t Step = 2 * TVec::W;
+
+} // namespace
+
+void TQmfCommon::PolyphaseAnalysis(const float* even, const float* odd, size_t half,
+                                   float* lower, float* upper) noexcept
+{
+    using V = TVec;
+    for (size_t j = 0; j < half; j += Step) {
+        V::T lo0 = V::Set1(0.0f), lo1 = V::Set1(0.0f);
+        V::T up0 = V::Set1(0.0f), up1 = V::Set1(0.0f);
+        for (size_t i = 0; i < 24; i++) {
+            const V::T wl = V::Set1(QmfWindow[2 * i]);
+            const V::T wu = V::Set1(QmfWindow[2 * i + 1]);
+            const float* o = odd + j - i;
+            const float* e = even + j - i;
+            lo0 = V::Add(lo0, V::Mul(wl, V::Load(o)));
+            lo1 = V::Add(lo1, V::Mul(wl, V::Load(o + V::W)));
+            up0 = V::Add(up0, V::Mul(wu, V::Load(e)));
+            up1 = V::Add(up1, V::Mul(wu, V::Load(e + V::W)));
+        }
+        V::Store(lower + j, V::Add(lo0, up0));
+        V::Store(lower + j + V::W, V::Add(lo1, up1));
+        V::Store(upper + j, V::Sub(lo0, up0));
+        V::Store(upper + j + V::W, V::Sub(lo1, up1));
+    }
+}
+
+void TQmfCommon::PolyphaseSynthesis(const float* sum, const float* diff, size_t half, float* out) noexcept
+{
+    using V = TVec;
+    for (size_t j = 0; j < half; j += Step) {
+        V::T s10 = V::Set1(0.0f), s11 = V::Set1(0.0f);
+        V::T s20 = V::Set1(0.0f), s21 = V::Set1(0.0f);
+        for (size_t i = 0; i < 24; i++) {
+            const V::T w1 = V::Set1(QmfWindow[2 * i]);
+            const V::T w2 = V::Set1(QmfWindow[2 * i + 1]);
+            const float* s = sum + j + i;
+            const float* d = diff + j + i;
+            s10 = V::Add(s10, V::Mul(V::Load(s), w1));
+            s11 = V::Add(s11, V::Mul(V::Load(s + V::W), w1));
+            s20 = V::Add(s20, V::Mul(V::Load(d), w2));
+            s21 = V::Add(s21, V::Mul(V::Load(d + V::W), w2));
+        }
+        // out[2j] is the odd phase, out[2j + 1] the even one
+        V::StoreInterleave(out + 2 * j, s20, s10);
+        V::StoreInterleave(out + 2 * j + 2 * V::W, s21, s11);
+    }
+}
+
 bool TQmfCommon::CalcFreqResp(size_t sz, float* buf) noexcept
 {
     size_t fftSz = sz * 2;
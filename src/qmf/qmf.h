@@ -20,72 +20,72 @@
 #include <string.h>
 
 #include "../config.h"
+#include "../sliding_buffer.h"
 
 class TQmfCommon {
 protected:
     TQmfCommon() noexcept;
     static float QmfWindow[48];
+    // Polyphase kernels for half outputs of each band, half % 8 == 0.
+    // odd/even point to the first new sample, 23 history samples precede it.
+    static void PolyphaseAnalysis(const float* even, const float* odd, size_t half,
+                                  float* lower, float* upper) noexcept;
+    // sum/diff point to the 23 history samples followed by the new ones
+    static void PolyphaseSynthesis(const float* sum, const float* diff, size_t half, float* out) noexcept;
 public:
     // Compute the frequency response.
     static bool CalcFreqResp(size_t sz, float* buf) noexcept;
 };
 
+// Two band QMF, 48 taps. Both directions are computed in polyphase form:
+// the even and odd samples of the history are kept in separate buffers, so
+// consecutive outputs read consecutive samples and the SIMD kernels compute
+// 8 outputs per iteration. Every tap is accumulated in the original order.
+//
+// The history is kept in sliding buffers, its 23 sample tail is carried
+// back to the front only once every few calls.
 template <size_t nIn>
 class TQmf : public TQmfCommon {
     static const float TapHalf[24];
 
-    float PcmBuffer[nIn + 46];
-    float PcmBufferMerge[nIn + 46];
-public:
-    TQmf() noexcept {
-        for (size_t i = 0; i < sizeof(PcmBuffer)/sizeof(PcmBuffer[0]); i++) {
-            PcmBuffer[i] = 0;
-            PcmBufferMerge[i] = 0;
-        }
-    }
+    static constexpr size_t Half = nIn / 2;
+    static constexpr size_t Hist = 23;
+    static_assert(Half % 8 == 0, "QMF size must be a multiple of 16");
+    typedef NAtracDEnc::TSlidingBuffer<float, Hist + Half, Half> TPhase;
 
-    void Analysis(const float* in, float* lower, float* upper) noexcept {
-        float temp;
+    // Analysis: even and odd input samples
+    TPhase Even;
+    TPhase Odd;
+    // Synthesis: lower + upper and lower - upper
+    TPhase Sum;
+    TPhase Diff;
 
-        memcpy(&PcmBuffer[0], &PcmBuffer[nIn], 46 * sizeof(float));
+public:
+    void Analysis(const float* in, float* lower, float* upper) noexcept {
+        float* even = Even.Get();
+        float* odd = Odd.Get();
+        for (size_t j = 0; j < Half; j++) {
+            even[Hist + j] = in[2 * j];
+            odd[Hist + j] = in[2 * j + 1];
+        }
 
-        memcpy(&PcmBuffer[46], in, nIn * sizeof(float));
+        PolyphaseAnalysis(even + Hist, odd + Hist, Half, lower, upper);
 
-        for (size_t j = 0; j < nIn; j+=2) {
-            lower[j/2] = upper[j/2] = 0.0;
-            for (size_t i = 0; i < 24; i++)  {
-                lower[j/2] += QmfWindow[2*i] * PcmBuffer[48-1+j-(2*i)];
-                upper[j/2] += QmfWindow[(2*i)+1] * PcmBuffer[48-1+j-(2*i)-1];
-            }
-            temp = upper[j/2];
-            upper[j/2] = lower[j/2] - upper[j/2];
-            lower[j/2] += temp;
-        }
+        Even.Advance();
+        Odd.Advance();
     }
 
     void Synthesis(float* out, const float* lower, const float* upper) noexcept {
-        float* newPart = &PcmBufferMerge[46];
-        for (size_t i = 0; i < nIn; i+=4) {
-            newPart[i+0] = lower[i/2] + upper[i/2];
-            newPart[i+1] = lower[i/2] - upper[i/2];
-            newPart[i+2] = lower[i/2 + 1] + upper[i/2 + 1];
-            newPart[i+3] = lower[i/2 + 1] - upper[i/2 + 1];
+        float* sum = Sum.Get();
+        float* diff = Diff.Get();
+        for (size_t j = 0; j < Half; j++) {
+            sum[Hist + j] = lower[j] + upper[j];
+            diff[Hist + j] = lower[j] - upper[j];
         }
 
-        float* winP = &PcmBufferMerge[0];
-        for (size_t j = nIn/2; j != 0; j--) {
-            float s1 = 0;
-            float s2 = 0;
-            for (size_t i = 0; i < 48; i+=2) {
-                s1 += winP[i] * QmfWindow[i];
-                s2 += winP[i+1] * QmfWindow[i+1];
-            }
-            out[0] = s2;
-            out[1] = s1;
-            winP += 2;
-            out += 2;
-        }
-        memcpy(&PcmBufferMerge[0], &PcmBufferMerge[nIn], 46 * sizeof(float));
+        PolyphaseSynthesis(sum, diff, Half, out);
+
+        Sum.Advance();
+        Diff.Advance();
     }
 };
-
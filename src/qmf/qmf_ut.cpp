@@ -0,0 +1,97 @@
+/*
+ * This file is part of AtracDEnc.
+ *
+ * AtracDEnc is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * AtracDEnc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with AtracDEnc; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "qmf.h"
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <vector>
+
+using std::vector;
+
+// Direct form with the shift-copy history
+template <size_t nIn>
+class TRefQmf : public TQmfCommon {
+    float PcmBuffer[nIn + 46] = {};
+    float PcmBufferMerge[nIn + 46] = {};
+public:
+    void Analysis(const float* in, float* lower, float* upper) {
+        memcpy(&PcmBuffer[0], &PcmBuffer[nIn], 46 * sizeof(float));
+        memcpy(&PcmBuffer[46], in, nIn * sizeof(float));
+        for (size_t j = 0; j < nIn; j += 2) {
+            float lo = 0.0, up = 0.0;
+            for (size_t i = 0; i < 24; i++)  {
+                lo += QmfWindow[2*i] * PcmBuffer[48-1+j-(2*i)];
+                up += QmfWindow[(2*i)+1] * PcmBuffer[48-1+j-(2*i)-1];
+            }
+            lower[j/2] = lo + up;
+            upper[j/2] = lo - up;
+        }
+    }
+
+    void Synthesis(float* out, const float* lower, const float* upper) {
+        float* newPart = &PcmBufferMerge[46];
+        for (size_t i = 0; i < nIn / 2; i++) {
+            newPart[2*i] = lower[i] + upper[i];
+            newPart[2*i+1] = lower[i] - upper[i];
+        }
+        for (size_t j = 0; j < nIn / 2; j++) {
+            float s1 = 0, s2 = 0;
+            for (size_t i = 0; i < 48; i += 2) {
+                s1 += PcmBufferMerge[2*j+i] * QmfWindow[i];
+                s2 += PcmBufferMerge[2*j+i+1] * QmfWindow[i+1];
+            }
+            out[2*j] = s2;
+            out[2*j+1] = s1;
+        }
+        memcpy(&PcmBufferMerge[0], &PcmBufferMerge[nIn], 46 * sizeof(float));
+    }
+};
+
+template <size_t nIn>
+static void CheckQmf(size_t frames) {
+    TQmf<nIn> qmf;
+    TRefQmf<nIn> ref;
+    vector<float> in(nIn), lower(nIn / 2), upper(nIn / 2), refLower(nIn / 2), refUpper(nIn / 2);
+    vector<float> out(nIn), refOut(nIn);
+    size_t t = 0;
+    for (size_t f = 0; f < frames; f++) {
+        for (size_t i = 0; i < nIn; i++, t++) {
+            in[i] = 8000.0 * sin(0.01 * t * t / 1000.0) + ((t * 7919) % 61) - 30;
+        }
+        qmf.Analysis(in.data(), lower.data(), upper.data());
+        ref.Analysis(in.data(), refLower.data(), refUpper.data());
+        for (size_t i = 0; i < nIn / 2; i++) {
+            EXPECT_EQ(refLower[i], lower[i]) << "frame " << f << " sample " << i;
+            EXPECT_EQ(refUpper[i], upper[i]) << "frame " << f << " sample " << i;
+        }
+
+        qmf.Synthesis(out.data(), lower.data(), upper.data());
+        ref.Synthesis(refOut.data(), refLower.data(), refUpper.data());
+        for (size_t i = 0; i < nIn; i++) {
+            EXPECT_EQ(refOut[i], out[i]) << "frame " << f << " sample " << i;
+        }
+    }
+}
+
+// More frames than the history buffer holds, so the tail is carried back
+TEST(TQmfTest, PolyphaseMatchesDirect) {
+    CheckQmf<256>(11);
+    CheckQmf<512>(11);
+    CheckQmf<1024>(11);
+}
@@ -20,6 +20,7 @@
 
 #include "file.h"
 #include "utf8_file.h"
+#include <algorithm>
 #include <memory>
 #include <stdexcept>
 
@@ -28,7 +29,7 @@ namespace {
 class TRaw : public ICompressedOutput {
 public:
     TRaw(const std::string& filename, size_t numChannels, uint32_t frameSize)
-        : Fp(NAtracDEnc::FOpenUtf8(filename, "wb"))
+        : Fp(NAtracDEnc::FOpenOutputUtf8(filename))
         , NumChannels(numChannels)
         , FrameSize(frameSize)
     {
@@ -37,11 +38,17 @@ public:
         }
     }
 
-    void WriteFrame(std::vector<char> data) override {
-        if (FrameSize) {
-            data.resize(FrameSize); // zero-pads short frames; truncates trailing bitstream rounding bytes
+    void WriteFrame(const char* data, size_t size) override {
+        // zero-pads short frames; truncates trailing bitstream rounding bytes
+        const size_t sz = FrameSize ? std::min<size_t>(size, FrameSize) : size;
+        static const char zeros[256] = {};
+        bool ok = fwrite(data, 1, sz, Fp.get()) == sz;
+        for (size_t pad = FrameSize ? FrameSize - sz : 0; ok && pad; ) {
+            const size_t n = std::min(pad, sizeof(zeros));
+            ok = fwrite(zeros, 1, n, Fp.get()) == n;
+            pad -= n;
         }
-        if (fwrite(data.data(), 1, data.size(), Fp.get()) != data.size()) {
+        if (!ok) {
             throw std::runtime_error("Cannot write raw ATRAC data to file");
         }
     }
@@ -39,7 +39,7 @@ namespace {
 using std::string;
 
 FILE* OpenFile(const string& filename) {
-    FILE* fp = NAtracDEnc::FOpenUtf8(filename, "wb");
+    FILE* fp = NAtracDEnc::FOpenOutputUtf8(filename);
     if (!fp)
         throw std::runtime_error("unable to open output file '" + filename + "'");
     return fp;
@@ -155,7 +155,12 @@ public:
         , Bitrate_(8 * frameSize * 44100.0 / 1024.0)
 	, Timestamp_(0)
         , FrameNum_(0)
+        , NumFrames_(numFrames)
+        , UnknownLength_(numFrames == UnknownFrames)
     {
+        if (UnknownLength_) {
+            numFrames = 0; // patched at finish
+        }
         WriteRMF(File_);
         WritePROP(frameSize, numFrames);
         WriteMDPR(frameSize, numFrames, numChannels, jointStereo);
@@ -165,6 +170,14 @@ public:
 
     ~TRm() {
 	// TODO: change ICompressedOutput iface to remove this logic from dtor.
+        if (!NAtracDEnc::IsSeekable(File_)) {
+            // Pipe output, sizes are left as is
+            fclose(File_);
+            return;
+        }
+        if (UnknownLength_ && NumFrames_ != UnknownFrames) {
+            PatchLength();
+        }
         int64_t endDataPos = ftell(File_);
         int64_t dataChunkSz = endDataPos - DataHeaderPos_;
         if (dataChunkSz <= 0xffffffff) {
@@ -184,13 +197,17 @@ public:
         fclose(File_);
     }
 
-    void WriteFrame(std::vector<char> data) override {
-        static std::vector<char> tmp(data.size());
-        scramble_data(&data[0], &tmp[0], data.size());
-        WriteAudioPacket(tmp);
+    void WriteFrame(const char* data, size_t size) override {
+        Scrambled_.resize(size);
+        scramble_data(data, Scrambled_.data(), size);
+        WriteAudioPacket(Scrambled_);
         FrameNum_++;
     }
 
+    void SetNumFrames(uint32_t numFrames) override {
+        NumFrames_ = numFrames;
+    }
+
     std::string GetName() const override {
         return {};
     }
@@ -205,9 +222,34 @@ private:
     const uint32_t Bitrate_;
     double Timestamp_;
     uint32_t FrameNum_;
+    uint32_t NumFrames_; // for the header
+    const bool UnknownLength_;
+    std::vector<char> Scrambled_;
 
     int64_t DataHeaderPos_;
 
+    void PatchUint32(int64_t pos, uint32_t val) {
+        char tmp[sizeof(uint32_t)];
+        *reinterpret_cast<uint32_t*>(&tmp[0]) = swapbyte32_on_le(val);
+        if (fseek(File_, pos, SEEK_SET) != 0 || fwrite(tmp, sizeof(uint32_t), 1, File_) != 1) {
+            fprintf(stderr, "Unable to update RM header");
+        }
+    }
+
+    uint32_t Duration(uint32_t numFrames) const {
+        return uint32_t(numFrames * FrameDuration_);
+    }
+
+    void PatchLength() {
+        const int64_t endDataPos = ftell(File_);
+        const uint32_t duration = Duration(NumFrames_);
+        PatchUint32(RMF_HEADER_SZ + 26, NumFrames_); // PROP nb packets
+        PatchUint32(RMF_HEADER_SZ + 30, duration); // PROP duration
+        PatchUint32(RMF_HEADER_SZ + 50 + 36, duration); // MDPR duration
+        PatchUint32(DataHeaderPos_ + 10, NumFrames_); // DATA num packets
+        fseek(File_, endDataPos, SEEK_SET);
+    }
+
     void WriteAudioPacket(const std::vector<char>& data) {
 	switch (FrameNum_ % 3) {
 	    case 0: {
@@ -242,7 +284,7 @@ private:
         *reinterpret_cast<uint32_t*>(buf +  18) = swapbyte32_on_le(frameSize); // max packet size
         *reinterpret_cast<uint32_t*>(buf +  22) = swapbyte32_on_le(frameSize); // avg packet size
         *reinterpret_cast<uint32_t*>(buf +  26) = swapbyte32_on_le(numFrames); // nb packets
-        *reinterpret_cast<uint32_t*>(buf +  30) = swapbyte32_on_le((uint32_t)(numFrames * FrameDuration_)); // duration, ms, FFmpeg use this duration
+        *reinterpret_cast<uint32_t*>(buf +  30) = swapbyte32_on_le(Duration(numFrames)); // duration, ms, FFmpeg use this duration
         *reinterpret_cast<uint32_t*>(buf +  34) = 0; // preroll
         *reinterpret_cast<uint32_t*>(buf +  38) = 0; // index chunk offset
         *reinterpret_cast<uint32_t*>(buf +  42) = swapbyte32_on_le(RMF_HEADER_SZ + PROP_HEADER_SZ + MDPR_HEADER_SZ); // data chunk offset
@@ -264,7 +306,7 @@ private:
         *reinterpret_cast<uint32_t*>(buf +  24) = swapbyte32_on_le(frameSize); //avg packet size
         *reinterpret_cast<uint32_t*>(buf +  28) = swapbyte32_on_le(0); //start time
         *reinterpret_cast<uint32_t*>(buf +  32) = 0; //preroll
-        *reinterpret_cast<uint32_t*>(buf +  36) = swapbyte32_on_le(uint32_t(numFrames * FrameDuration_)); //duration, ms, RA player use this duration
+        *reinterpret_cast<uint32_t*>(buf +  36) = swapbyte32_on_le(Duration(numFrames)); //duration, ms, RA player use this duration
         *reinterpret_cast<uint8_t*>(buf +  40) = sizeof(RA_DESC); //stream desc len
         memcpy(buf + 41, RA_DESC, sizeof(RA_DESC));
         *reinterpret_cast<uint8_t*>(buf +  41 + sizeof(RA_DESC)) = sizeof(RA_MIME); //stream mime type len
@@ -0,0 +1,299 @@
+/*
+ * This file is part of AtracDEnc.
+ *
+ * AtracDEnc is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * AtracDEnc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with AtracDEnc; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "segment_encoder.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <exception>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+namespace NAtracDEnc {
+
+namespace {
+
+struct TSegmentResult {
+    // Kept writes are packed one after another, WriteEnd is the offset after each of them
+    std::vector<char> Bytes;
+    std::vector<size_t> WriteEnd;
+    std::vector<size_t> FrameEnd; // index in WriteEnd after the last write of each kept frame
+    std::atomic<uint64_t> Processed{0};
+    uint64_t Workload = 0;
+    std::exception_ptr Error;
+    bool Keep = false;
+
+    size_t Frames() const {
+        return FrameEnd.size();
+    }
+
+    size_t Begin(size_t frame) const {
+        return frame ? FrameEnd[frame - 1] : 0;
+    }
+
+    size_t WriteBegin(size_t write) const {
+        return write ? WriteEnd[write - 1] : 0;
+    }
+
+    const char* WriteData(size_t write) const {
+        return Bytes.data() + WriteBegin(write);
+    }
+
+    size_t WriteSize(size_t write) const {
+        return WriteEnd[write] - WriteBegin(write);
+    }
+
+    bool Equal(size_t frame, const TSegmentResult& other, size_t otherFrame) const {
+        const size_t b1 = Begin(frame);
+        const size_t b2 = other.Begin(otherFrame);
+        const size_t n = FrameEnd[frame] - b1;
+        if (n != other.FrameEnd[otherFrame] - b2)
+            return false;
+        for (size_t w = 0; w < n; w++) {
+            const size_t sz = WriteSize(b1 + w);
+            if (sz != other.WriteSize(b2 + w) || memcmp(WriteData(b1 + w), other.WriteData(b2 + w), sz))
+                return false;
+        }
+        return true;
+    }
+};
+
+// Keeps encoded frames of a segment in memory.
+class TCollectorOutput : public ICompressedOutput {
+    TSegmentResult* Result;
+    const size_t Channels;
+public:
+    TCollectorOutput(TSegmentResult* result, size_t channels)
+        : Result(result)
+        , Channels(channels)
+    {}
+
+    void WriteFrame(const char* data, size_t size) override {
+        if (Result->Keep) {
+            Result->Bytes.insert(Result->Bytes.end(), data, data + size);
+            Result->WriteEnd.push_back(Result->Bytes.size());
+        }
+    }
+
+    std::string GetName() const override {
+        return {};
+    }
+
+    size_t GetChannelNum() const override {
+        return Channels;
+    }
+};
+
+} // namespace
+
+TSegmentEncoder::TSegmentEncoder(TReaderFactory readerFactory,
+                                 TProcessorFactory processorFactory,
+                                 size_t channels,
+                                 uint64_t totalSamples,
+                                 uint32_t frameSz,
+                                 size_t threads)
+    : ReaderFactory(readerFactory)
+    , ProcessorFactory(processorFactory)
+    , Channels(channels)
+    , TotalSamples(totalSamples)
+    , FrameSz(frameSz)
+{
+    if (frameSz == 0 || BlockSz % frameSz || (PrerollFrames * frameSz) % BlockSz) {
+        throw std::invalid_argument("unsupported frame size for segment encoding: " + std::to_string(frameSz));
+    }
+
+    const uint64_t framesPerBlock = BlockSz / frameSz;
+    const uint64_t totalBlocks = (totalSamples + BlockSz - 1) / BlockSz;
+    const uint64_t prerollBlocks = PrerollFrames / framesPerBlock;
+    // Shorter segments are dominated by pre-roll work
+    const uint64_t minSegBlocks = prerollBlocks;
+
+    threads = std::max<size_t>(threads, 1);
+    const uint64_t segBlocks = std::max<uint64_t>((totalBlocks + threads - 1) / threads, minSegBlocks);
+
+    for (uint64_t b = 0; b < totalBlocks || Segments.empty(); b += segBlocks) {
+        const uint64_t preroll = b > prerollBlocks ? b - prerollBlocks : 0;
+        const uint64_t end = std::min(b + segBlocks, totalBlocks);
+        Segments.push_back({preroll * framesPerBlock, b * framesPerBlock, end * framesPerBlock});
+    }
+}
+
+TSegmentEncoder::TReport TSegmentEncoder::Encode(ICompressedOutput* output, std::function<void(int)> progress)
+{
+    const size_t n = Segments.size();
+
+    std::vector<std::unique_ptr<TSegmentResult>> results;
+    std::vector<std::unique_ptr<IProcessor>> processors;
+    std::vector<TPCMEngine::TProcessLambda> lambdas;
+
+    // Encoders initialize some shared tables on construction, so create them
+    // here before any worker is started.
+    for (size_t i = 0; i < n; i++) {
+        results.emplace_back(new TSegmentResult);
+        TCompressedOutputPtr collector(new TCollectorOutput(results.back().get(), Channels));
+        processors.push_back(ProcessorFactory(std::move(collector)));
+        // Frames are kept or dropped by the state at the time of the write
+        if (processors.back()->GetPipelineDepth()) {
+            throw std::invalid_argument("segment encoding requires encoder without pipeline stages");
+        }
+        lambdas.push_back(processors.back()->GetLambda());
+
+        const uint64_t offset = Segments[i].PrerollFrame * FrameSz;
+        uint64_t workload = TotalSamples - std::min(offset, TotalSamples);
+        if (i + 1 < n) {
+            workload = std::min(workload, (Segments[i].EndFrame + OverrunFrames - Segments[i].PrerollFrame) * FrameSz);
+        }
+        results.back()->Workload = workload;
+    }
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    size_t done = 0;
+
+    auto worker = [&](size_t i) {
+        const TSegment& seg = Segments[i];
+        TSegmentResult& res = *results[i];
+        const bool last = (i + 1 == n);
+        try {
+            const uint64_t offset = seg.PrerollFrame * FrameSz;
+            TPCMEngine engine(BlockSz, Channels, ReaderFactory(offset), TPCMEngine::ELayout::PLANAR);
+
+            const uint64_t skip = seg.FirstFrame - seg.PrerollFrame;
+            const uint64_t need = last ? std::numeric_limits<uint64_t>::max()
+                                       : seg.EndFrame - seg.FirstFrame + OverrunFrames;
+            uint64_t frame = 0;
+            const TPCMEngine::TProcessLambda& encode = lambdas[i];
+            auto lambda = [&](float* data, const TPCMEngine::ProcessMeta& meta) {
+                res.Keep = frame >= skip;
+                auto r = encode(data, meta);
+                if (r == TPCMEngine::EProcessResult::PROCESSED) {
+                    if (res.Keep)
+                        res.FrameEnd.push_back(res.WriteEnd.size());
+                    frame++;
+                }
+                return r;
+            };
+
+            uint64_t processed = 0;
+            try {
+                // Same stop condition as serial encode, see main()
+                while (TotalSamples > offset + processed && res.Frames() < need) {
+                    processed = engine.ApplyProcess(FrameSz, lambda);
+                    res.Processed = processed;
+                }
+            } catch (const TNoDataToRead&) {
+            }
+        } catch (...) {
+            res.Error = std::current_exception();
+        }
+        res.Processed = res.Workload;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        done++;
+        cv.notify_one();
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(n);
+    for (size_t i = 0; i < n; i++) {
+        threads.emplace_back(worker, i);
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (done < n) {
+            cv.wait_for(lock, std::chrono::milliseconds(100));
+            if (progress) {
+                uint64_t processed = 0;
+                uint64_t workload = 0;
+                for (const auto& res : results) {
+                    processed += std::min<uint64_t>(res->Processed, res->Workload);
+                    workload += res->Workload;
+                }
+                lock.unlock();
+                progress(workload ? static_cast<int>(processed * 100 / workload) : 100);
+                lock.lock();
+            }
+        }
+    }
+
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    for (const auto& res : results) {
+        if (res->Error)
+            std::rethrow_exception(res->Error);
+    }
+
+    TReport report;
+    report.Segments = n;
+
+    auto emit = [&](TSegmentResult& res, size_t from, size_t to) {
+        for (size_t f = from; f < to; f++) {
+            for (size_t w = res.Begin(f); w < res.FrameEnd[f]; w++) {
+                output->WriteFrame(res.WriteData(w), res.WriteSize(w));
+            }
+        }
+        report.Frames += to - from;
+    };
+
+    size_t from = 0;
+    for (size_t i = 0; i < n; i++) {
+        TSegmentResult& cur = *results[i];
+        if (i + 1 == n) {
+            emit(cur, from, cur.Frames());
+            break;
+        }
+
+        const size_t to = std::min<size_t>(cur.Frames(), Segments[i].EndFrame - Segments[i].FirstFrame);
+        TSegmentResult& next = *results[i + 1];
+        const size_t overlap = std::min(cur.Frames() - to, next.Frames());
+
+        // Find the earliest frame from which both segments agree till the end of overlap
+        size_t splice = overlap;
+        while (splice > 0 && cur.Equal(to + splice - 1, next, splice - 1)) {
+            splice--;
+        }
+
+        TBoundary boundary;
+        boundary.Frame = Segments[i + 1].FirstFrame;
+        boundary.Overlap = overlap;
+        boundary.SpliceOffset = splice;
+        boundary.OverlapMismatched = 0;
+        for (size_t f = 0; f < overlap; f++) {
+            if (!cur.Equal(to + f, next, f))
+                boundary.OverlapMismatched++;
+        }
+        boundary.Converged = splice < overlap || overlap == 0;
+        report.Boundaries.push_back(boundary);
+
+        emit(cur, from, to + splice);
+        from = splice;
+    }
+
+    return report;
+}
+
+} // namespace NAtracDEnc
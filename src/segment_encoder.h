@@ -0,0 +1,104 @@
+/*
+ * This file is part of AtracDEnc.
+ *
+ * AtracDEnc is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * AtracDEnc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with AtracDEnc; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "compressed_io.h"
+#include "pcmengin.h"
+
+namespace NAtracDEnc {
+
+// Segment-parallel encoder.
+//
+// The input is split into contiguous segments, each one is encoded by its own
+// encoder instance on its own thread. A segment starts PrerollFrames before its
+// nominal boundary so QMF/MDCT overlap, gain look-ahead and loudness tracking
+// have time to settle, and keeps encoding OverrunFrames past its nominal end.
+// During stitching the overrun of the previous segment is compared with the head
+// of the next one and the stream switches to the next segment at the first frame
+// from which both agree till the end of the overlap window. If the window is
+// exhausted without agreement the boundary is reported as not converged.
+//
+// Segment and pre-roll starts are aligned to the PCM engine block size, so each
+// segment sees exactly the same block layout as the serial encode does.
+class TSegmentEncoder {
+public:
+    // Loudness tracking forgets the initial state with factor 0.98 per frame,
+    // it takes about 1000 frames to get the difference below float precision.
+    static constexpr uint32_t PrerollFrames = 1024;
+    static constexpr uint32_t OverrunFrames = 64;
+    static constexpr uint32_t BlockSz = 4096;
+
+    // Opens independent reader positioned at the given sample
+    typedef std::function<TPCMEngine::TReaderPtr(uint64_t startSample)> TReaderFactory;
+    // Creates encoder writing into the given output. The encoder must write all
+    // output of a frame before its lambda returns (GetPipelineDepth() == 0),
+    // otherwise writes can't be attributed to frames and Encode throws.
+    typedef std::function<std::unique_ptr<IProcessor>(TCompressedOutputPtr&& output)> TProcessorFactory;
+
+    // Describes agreement of two neighbour segments in their overlap window.
+    // It is not compared with the serial encode: if both segments settle to
+    // the same wrong state the boundary is still reported as converged.
+    struct TBoundary {
+        uint64_t Frame;             // nominal boundary, index of frame
+        uint32_t Overlap;           // number of frames compared
+        uint32_t SpliceOffset;      // frames taken from previous segment overrun
+        uint32_t OverlapMismatched; // overlap frames on which the two segments disagree
+        bool Converged;             // segments agree from the splice point till the end of overlap
+    };
+
+    struct TReport {
+        size_t Segments = 0;
+        uint64_t Frames = 0;
+        std::vector<TBoundary> Boundaries;
+    };
+
+    TSegmentEncoder(TReaderFactory readerFactory,
+                    TProcessorFactory processorFactory,
+                    size_t channels,
+                    uint64_t totalSamples,
+                    uint32_t frameSz,
+                    size_t threads);
+
+    size_t GetSegmentsNum() const { return Segments.size(); }
+
+    // Encodes the whole input and writes stitched frames to output in order.
+    // The progress callback (may be empty) is called from the calling thread.
+    TReport Encode(ICompressedOutput* output, std::function<void(int)> progress = {});
+
+private:
+    struct TSegment {
+        uint64_t PrerollFrame;
+        uint64_t FirstFrame;
+        uint64_t EndFrame;
+    };
+
+    const TReaderFactory ReaderFactory;
+    const TProcessorFactory ProcessorFactory;
+    const size_t Channels;
+    const uint64_t TotalSamples;
+    const uint32_t FrameSz;
+    std::vector<TSegment> Segments;
+};
+
+} // namespace NAtracDEnc
@@ -0,0 +1,152 @@
+/*
+ * This file is part of AtracDEnc.
+ *
+ * AtracDEnc is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * AtracDEnc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with AtracDEnc; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "segment_encoder.h"
+#include "atrac1denc.h"
+#include "atrac3denc.h"
+#include "wav.h"
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+using namespace NAtracDEnc;
+
+namespace {
+
+static float TestSignal(uint64_t pos, size_t ch) {
+    const float t = pos / 44100.0f;
+    float v = 0.3f * sinf(2 * M_PI * (220 + 40 * ch) * t) * (0.5f + 0.5f * sinf(2 * M_PI * 0.7f * t));
+    if (pos % 11025 < 200)
+        v += 0.3f * sinf(pos * 1.7f);
+    return v;
+}
+
+static TPCMEngine::TReaderPtr CreateTestReader(uint64_t start, uint64_t total, size_t channels) {
+    auto pos = std::make_shared<uint64_t>(start);
+    return TPCMEngine::TReaderPtr(new TWavPcmReader([pos, total, channels](TPCMBuffer& data, const uint32_t size) {
+        if (*pos >= total)
+            return false;
+        const uint64_t n = std::min<uint64_t>(size, total - *pos);
+        for (uint64_t i = 0; i < n; i++) {
+            for (size_t ch = 0; ch < channels; ch++) {
+                data.At(i, ch) = TestSignal(*pos + i, ch);
+            }
+        }
+        if (n != size)
+            data.Zero(n, size - n);
+        *pos += n;
+        return true;
+    }));
+}
+
+class TMemOutput : public ICompressedOutput {
+public:
+    explicit TMemOutput(size_t channels)
+        : Channels(channels)
+    {}
+    void WriteFrame(const char* data, size_t size) override {
+        Frames.emplace_back(data, data + size);
+    }
+    std::string GetName() const override {
+        return {};
+    }
+    size_t GetChannelNum() const override {
+        return Channels;
+    }
+    std::vector<std::vector<char>> Frames;
+private:
+    const size_t Channels;
+};
+
+static TSegmentEncoder CreateAtrac1SegmentEncoder(uint64_t total, size_t channels, size_t threads,
+                                                  uint32_t pipelineDepth = 0) {
+    auto readerFactory = [total, channels](uint64_t start) {
+        return CreateTestReader(start, total, channels);
+    };
+    auto processorFactory = [pipelineDepth](TCompressedOutputPtr&& out) {
+        NAtrac1::TAtrac1EncodeSettings settings(0, NAtrac1::TAtrac1EncodeSettings::EWindowMode::EWM_AUTO, 0, pipelineDepth);
+        return std::unique_ptr<IProcessor>(new TAtrac1Encoder(std::move(out), std::move(settings)));
+    };
+    return TSegmentEncoder(readerFactory, processorFactory, channels, total, NAtrac1::TAtrac1Data::NumSamples, threads);
+}
+
+static TSegmentEncoder CreateAtrac3SegmentEncoder(uint64_t total, size_t channels, size_t threads) {
+    auto readerFactory = [total, channels](uint64_t start) {
+        return CreateTestReader(start, total, channels);
+    };
+    auto processorFactory = [channels](TCompressedOutputPtr&& out) {
+        NAtrac3::TAtrac3EncoderSettings settings(0, false, false, channels, 0);
+        return std::unique_ptr<IProcessor>(new TAtrac3Encoder(std::move(out), std::move(settings)));
+    };
+    return TSegmentEncoder(readerFactory, processorFactory, channels, total, NAtrac3::TAtrac3Data::NumSamples, threads);
+}
+
+// The report only tells whether neighbour segments agree in the overlap window,
+// so the stitched stream is compared with the serial encode directly.
+static void CheckStitchedMatchesSerial(TSegmentEncoder& serialEncoder, TSegmentEncoder& parallelEncoder,
+                                       size_t channels) {
+    TMemOutput serial(channels);
+    ASSERT_EQ(serialEncoder.GetSegmentsNum(), 1);
+    serialEncoder.Encode(&serial);
+
+    TMemOutput parallel(channels);
+    ASSERT_EQ(parallelEncoder.GetSegmentsNum(), 3);
+    const auto report = parallelEncoder.Encode(&parallel);
+
+    ASSERT_EQ(report.Boundaries.size(), 2);
+    for (const auto& b : report.Boundaries) {
+        EXPECT_TRUE(b.Converged);
+        EXPECT_GE(b.Overlap, TSegmentEncoder::OverrunFrames);
+        EXPECT_EQ(b.OverlapMismatched, 0);
+    }
+    ASSERT_EQ(serial.Frames.size(), parallel.Frames.size());
+    EXPECT_TRUE(serial.Frames == parallel.Frames);
+}
+
+} // namespace
+
+TEST(TSegmentEncoder, ShortInputSingleSegment) {
+    auto encoder = CreateAtrac1SegmentEncoder(44100, 2, 8);
+    EXPECT_EQ(encoder.GetSegmentsNum(), 1);
+}
+
+TEST(TSegmentEncoder, RejectsPipelinedEncoder) {
+    TMemOutput output(1);
+    auto encoder = CreateAtrac1SegmentEncoder(44100, 1, 1, 2);
+    EXPECT_THROW(encoder.Encode(&output), std::invalid_argument);
+}
+
+TEST(TSegmentEncoder, Atrac1StitchedMatchesSerial) {
+    const size_t channels = 1;
+    const uint64_t total = 3 * TSegmentEncoder::PrerollFrames * NAtrac1::TAtrac1Data::NumSamples + 1000;
+    auto serialEncoder = CreateAtrac1SegmentEncoder(total, channels, 1);
+    auto parallelEncoder = CreateAtrac1SegmentEncoder(total, channels, 3);
+    CheckStitchedMatchesSerial(serialEncoder, parallelEncoder, channels);
+}
+
+TEST(TSegmentEncoder, Atrac3StitchedMatchesSerial) {
+    const size_t channels = 2;
+    const uint64_t total = 3 * TSegmentEncoder::PrerollFrames * NAtrac3::TAtrac3Data::NumSamples + 1000;
+    auto serialEncoder = CreateAtrac3SegmentEncoder(total, channels, 1);
+    auto parallelEncoder = CreateAtrac3SegmentEncoder(total, channels, 3);
+    CheckStitchedMatchesSerial(serialEncoder, parallelEncoder, channels);
+}
@@ -0,0 +1,64 @@
+/*
+ * This file is part of AtracDEnc.
+ *
+ * AtracDEnc is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * AtracDEnc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with AtracDEnc; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#pragma once
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+
+namespace NAtracDEnc {
+
+// Contiguous window over the last TWindow samples of a stream that moves by
+// TStep samples at a time. The window slides forward over a buffer of
+// TBlocks steps and its history (TWindow - TStep samples) is carried back to
+// the front once every TBlocks steps, so advancing is pointer arithmetic.
+// Pointers into the window are valid until the next Advance().
+template<class T, size_t TWindow, size_t TStep, size_t TBlocks = 4>
+class TSlidingBuffer {
+    static_assert(std::is_trivially_copyable<T>::value, "T must be trivially copyable");
+    static_assert(TStep > 0 && TStep <= TWindow, "step must fit the window");
+    static_assert(TBlocks > 0, "at least one step of space is required");
+public:
+    static constexpr size_t Window = TWindow;
+    static constexpr size_t Step = TStep;
+    static constexpr size_t History = TWindow - TStep;
+
+    TSlidingBuffer() {
+        memset(Buf, 0, sizeof(Buf));
+    }
+
+    T* Get() { return Buf + Pos; }
+    const T* Get() const { return Buf + Pos; }
+
+    // The window moves forward by one step, the last Step samples of the
+    // new window are stale and have to be written by the caller
+    void Advance() {
+        Pos += TStep;
+        if (Pos + TWindow > Cap) {
+            memmove(Buf, Buf + Pos, History * sizeof(T));
+            Pos = 0;
+        }
+    }
+
+private:
+    static constexpr size_t Cap = History + TBlocks * TStep;
+    T Buf[Cap];
+    size_t Pos = 0;
+};
+
+} // namespace NAtracDEnc
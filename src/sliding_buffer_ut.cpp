@@ -0,0 +1,77 @@
+/*
+ * This file is part of AtracDEnc.
+ *
+ * AtracDEnc is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * AtracDEnc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with AtracDEnc; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "sliding_buffer.h"
+#include "delay_buffer.h"
+#include <gtest/gtest.h>
+
+#include <vector>
+
+using namespace NAtracDEnc;
+
+// Every step the window must hold what a buffer shifted by memmove holds
+template<size_t TWindow, size_t TStep, size_t TBlocks>
+static void CheckAgainstShift() {
+    TSlidingBuffer<int, TWindow, TStep, TBlocks> ring;
+    std::vector<int> ref(TWindow, 0);
+    int next = 1;
+    for (int step = 0; step < 25; step++) {
+        for (size_t i = 0; i < TStep; i++) {
+            ring.Get()[TWindow - TStep + i] = next;
+            ref[TWindow - TStep + i] = next;
+            next++;
+        }
+        for (size_t i = 0; i < TWindow; i++) {
+            ASSERT_EQ(ring.Get()[i], ref[i]) << "step " << step << " pos " << i;
+        }
+        ring.Advance();
+        ref.erase(ref.begin(), ref.begin() + TStep);
+        ref.resize(TWindow);
+        for (size_t i = 0; i < TWindow - TStep; i++) {
+            ASSERT_EQ(ring.Get()[i], ref[i]) << "after advance " << step << " pos " << i;
+        }
+    }
+}
+
+TEST(TSlidingBuffer, MatchesShift) {
+    CheckAgainstShift<640, 256, 4>();
+    CheckAgainstShift<151, 128, 4>();
+    CheckAgainstShift<16, 16, 1>();
+    // history longer than the carried distance
+    CheckAgainstShift<40, 8, 2>();
+}
+
+TEST(TDelayBuffer, ShiftMovesSecondToFirst) {
+    TDelayBuffer<float, 2, 4> buf;
+    for (int round = 0; round < 10; round++) {
+        for (int row = 0; row < 2; row++) {
+            for (int i = 0; i < 4; i++) {
+                buf.GetSecond(row)[i] = 100 * round + 10 * row + i;
+            }
+        }
+        const bool erace = round % 2;
+        buf.Shift(erace);
+        for (int row = 0; row < 2; row++) {
+            for (int i = 0; i < 4; i++) {
+                const float old = 100 * round + 10 * row + i;
+                EXPECT_EQ(buf.GetFirst(row)[i], old);
+                EXPECT_EQ(buf.GetSecond(row)[i], erace ? 0.0f : old);
+            }
+        }
+    }
+}
@@ -0,0 +1,359 @@
+/*
+ * This file is part of AtracDEnc.
+ *
+ * AtracDEnc is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * AtracDEnc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with AtracDEnc; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "stream_codec.h"
+
+#include "atrac1denc.h"
+#include "atrac3denc.h"
+#include "atrac3p.h"
+#include "frame_buffer.h"
+#include "pcm_layout.h"
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace NAtracDEnc {
+
+namespace {
+
+// Codecs fill some shared tables on first construction
+std::mutex CreateLock;
+
+void CheckChannels(uint32_t channels) {
+    if (channels < 1 || channels > 2)
+        throw std::invalid_argument("unsupported number of channels: " + std::to_string(channels));
+}
+
+// Keeps frames the same way as the RAW container writes them
+class TQueueOutput : public ICompressedOutput {
+    TFrameQueue* Frames;
+    const size_t Channels;
+    std::vector<char> Unit;
+public:
+    TQueueOutput(TFrameQueue* frames, size_t channels, size_t frameSize)
+        : Frames(frames)
+        , Channels(channels)
+        , Unit(frameSize)
+    {}
+
+    void WriteFrame(const char* data, size_t size) override {
+        if (Unit.empty()) {
+            Frames->Push(data, size);
+            return;
+        }
+        const size_t n = std::min(size, Unit.size());
+        memcpy(Unit.data(), data, n);
+        memset(Unit.data() + n, 0, Unit.size() - n);
+        Frames->Push(Unit.data(), Unit.size());
+    }
+
+    std::string GetName() const override {
+        return {};
+    }
+
+    size_t GetChannelNum() const override {
+        return Channels;
+    }
+};
+
+class TQueueInput : public ICompressedInput {
+    TFrameQueue Frames;
+    const size_t Channels;
+public:
+    explicit TQueueInput(size_t channels)
+        : Channels(channels)
+    {}
+
+    void Push(const char* data, size_t size) {
+        Frames.Push(data, size);
+    }
+
+    size_t ReadFrame(char* buf, size_t size) override {
+        if (Frames.Empty())
+            throw std::logic_error("no compressed frame to decode");
+        return Frames.Pop(buf, size);
+    }
+
+    uint64_t GetLengthInSamples() const override {
+        return 0;
+    }
+
+    std::string GetName() const override {
+        return {};
+    }
+
+    size_t GetChannelNum() const override {
+        return Channels;
+    }
+};
+
+} // namespace
+
+class TStreamEncoder::TImpl {
+public:
+    explicit TImpl(const TSettings& settings)
+        : Channels(settings.Channels)
+    {
+        CheckChannels(Channels);
+
+        std::lock_guard<std::mutex> lock(CreateLock);
+        switch (settings.Codec) {
+            case EStreamCodec::ATRAC1:
+            {
+                FrameSamples = NAtrac1::TAtrac1Data::NumSamples;
+                TCompressedOutputPtr out(new TQueueOutput(&Frames, Channels, NAtrac1::TAtrac1Data::SoundUnitSize));
+                Processor.reset(new TAtrac1Encoder(std::move(out), NAtrac1::TAtrac1EncodeSettings()));
+            }
+            break;
+            case EStreamCodec::ATRAC3:
+            {
+                FrameSamples = NAtrac3::TAtrac3Data::NumSamples;
+                TCompressedOutputPtr out(new TQueueOutput(&Frames, Channels, 0));
+                Processor.reset(new TAtrac3Encoder(std::move(out),
+                    NAtrac3::TAtrac3EncoderSettings(settings.Bitrate * 1024, false, false, Channels, 0)));
+            }
+            break;
+            case EStreamCodec::ATRAC3PLUS:
+            {
+                FrameSamples = 2048;
+                TCompressedOutputPtr out(new TQueueOutput(&Frames, Channels, 0));
+                Processor.reset(new TAt3PEnc(std::move(out), Channels, TAt3PEnc::TSettings()));
+            }
+            break;
+            default:
+                throw std::invalid_argument("unsupported codec");
+        }
+        Lambda = Processor->GetLambda();
+        Pcm.resize(FrameSamples * Channels);
+    }
+
+    uint32_t GetFrameSamples() const {
+        return FrameSamples;
+    }
+
+    template<class TCopy>
+    void Push(size_t samples, TCopy copy) {
+        if (Finished)
+            throw std::logic_error("push after finish");
+        size_t pos = 0;
+        while (pos < samples) {
+            const size_t n = std::min<size_t>(samples - pos, FrameSamples - Filled);
+            float* planes[2] = {&Pcm[Filled], Channels > 1 ? &Pcm[FrameSamples + Filled] : nullptr};
+            copy(planes, pos, n);
+            Filled += n;
+            pos += n;
+            if (Filled == FrameSamples) {
+                Encode();
+                FramesIn++;
+                Filled = 0;
+            }
+        }
+    }
+
+    void Finish() {
+        if (Finished)
+            return;
+        Finished = true;
+        if (Filled) {
+            for (size_t ch = 0; ch < Channels; ch++) {
+                std::fill(&Pcm[ch * FrameSamples + Filled], &Pcm[(ch + 1) * FrameSamples], 0.0f);
+            }
+            Encode();
+            FramesIn++;
+            Filled = 0;
+        }
+        // Same as TPCMEngine drain: feed silence till every input frame is out
+        while (FramesOut < FramesIn) {
+            std::fill(Pcm.begin(), Pcm.end(), 0.0f);
+            Encode();
+        }
+        Processor->Flush();
+    }
+
+    size_t NextFrameSize() const {
+        return Frames.FrontSize();
+    }
+
+    size_t ReadFrame(void* buf, size_t size) {
+        if (Frames.Empty())
+            return 0;
+        return Frames.Pop(static_cast<char*>(buf), size);
+    }
+
+    const size_t Channels;
+
+private:
+    void Encode() {
+        // Planar, one frame per channel
+        const TPCMEngine::ProcessMeta meta = {static_cast<uint16_t>(Channels), FrameSamples};
+        if (Lambda(Pcm.data(), meta) == TPCMEngine::EProcessResult::PROCESSED)
+            FramesOut++;
+    }
+
+    TFrameQueue Frames;
+    std::unique_ptr<IProcessor> Processor;
+    TPCMEngine::TProcessLambda Lambda;
+    uint32_t FrameSamples = 0;
+    std::vector<float, TAlignedAllocator<float>> Pcm;
+    size_t Filled = 0;
+    uint64_t FramesIn = 0;
+    uint64_t FramesOut = 0;
+    bool Finished = false;
+};
+
+TStreamEncoder::TStreamEncoder(const TSettings& settings)
+    : Impl(new TImpl(settings))
+{}
+
+TStreamEncoder::~TStreamEncoder() = default;
+
+uint32_t TStreamEncoder::GetFrameSamples() const {
+    return Impl->GetFrameSamples();
+}
+
+void TStreamEncoder::Push(const float* pcm, size_t samples) {
+    const size_t channels = Impl->Channels;
+    Impl->Push(samples, [pcm, channels](float* const* dst, size_t pos, size_t n) {
+        DeinterleavePcm(pcm + pos * channels, channels, n, dst);
+    });
+}
+
+void TStreamEncoder::PushPlanar(const float* const* pcm, size_t samples) {
+    const size_t channels = Impl->Channels;
+    Impl->Push(samples, [pcm, channels](float* const* dst, size_t pos, size_t n) {
+        for (size_t ch = 0; ch < channels; ch++) {
+            memcpy(dst[ch], pcm[ch] + pos, n * sizeof(float));
+        }
+    });
+}
+
+void TStreamEncoder::Finish() {
+    Impl->Finish();
+}
+
+size_t TStreamEncoder::NextFrameSize() const {
+    return Impl->NextFrameSize();
+}
+
+size_t TStreamEncoder::ReadFrame(void* buf, size_t size) {
+    return Impl->ReadFrame(buf, size);
+}
+
+class TStreamDecoder::TImpl {
+public:
+    explicit TImpl(const TSettings& settings)
+        : Channels(settings.Channels)
+    {
+        CheckChannels(Channels);
+        if (settings.Codec != EStreamCodec::ATRAC1)
+            throw std::invalid_argument("only ATRAC1 decoding is supported");
+
+        Input = new TQueueInput(Channels);
+        TCompressedInputPtr input(Input);
+
+        std::lock_guard<std::mutex> lock(CreateLock);
+        Processor.reset(new TAtrac1Decoder(std::move(input)));
+        Lambda = Processor->GetLambda();
+        UnitSize = NAtrac1::TAtrac1Data::SoundUnitSize;
+        FrameSamples = NAtrac1::TAtrac1Data::NumSamples;
+    }
+
+    void Push(const char* data, size_t size) {
+        const size_t frameBytes = UnitSize * Channels;
+        Pending.insert(Pending.end(), data, data + size);
+        size_t pos = 0;
+        while (Pending.size() - pos >= frameBytes) {
+            for (size_t ch = 0; ch < Channels; ch++) {
+                Input->Push(&Pending[pos + ch * UnitSize], UnitSize);
+            }
+            pos += frameBytes;
+
+            const size_t at = Pcm.size();
+            Pcm.resize(at + FrameSamples * Channels);
+            const TPCMEngine::ProcessMeta meta = {static_cast<uint16_t>(Channels)};
+            Lambda(&Pcm[at], meta);
+        }
+        Pending.erase(Pending.begin(), Pending.begin() + pos);
+    }
+
+    size_t GetSamplesNum() const {
+        return (Pcm.size() - ReadPos) / Channels;
+    }
+
+    template<class TCopy>
+    size_t Read(size_t samples, TCopy copy) {
+        const size_t n = std::min(samples, GetSamplesNum());
+        copy(&Pcm[ReadPos], n);
+        ReadPos += n * Channels;
+        if (ReadPos * 2 >= Pcm.size()) {
+            Pcm.erase(Pcm.begin(), Pcm.begin() + ReadPos);
+            ReadPos = 0;
+        }
+        return n;
+    }
+
+    const size_t Channels;
+
+private:
+    TQueueInput* Input;
+    std::unique_ptr<IProcessor> Processor;
+    TPCMEngine::TProcessLambda Lambda;
+    size_t UnitSize = 0;
+    size_t FrameSamples = 0;
+    std::vector<char> Pending;
+    std::vector<float> Pcm;
+    size_t ReadPos = 0;
+};
+
+TStreamDecoder::TStreamDecoder(const TSettings& settings)
+    : Impl(new TImpl(settings))
+{}
+
+TStreamDecoder::~TStreamDecoder() = default;
+
+void TStreamDecoder::Push(const void* data, size_t size) {
+    Impl->Push(static_cast<const char*>(data), size);
+}
+
+size_t TStreamDecoder::GetSamplesNum() const {
+    return Impl->GetSamplesNum();
+}
+
+size_t TStreamDecoder::Read(float* pcm, size_t samples) {
+    const size_t channels = Impl->Channels;
+    return Impl->Read(samples, [pcm, channels](const float* src, size_t n) {
+        memcpy(pcm, src, n * channels * sizeof(float));
+    });
+}
+
+size_t TStreamDecoder::ReadPlanar(float* const* pcm, size_t samples) {
+    const size_t channels = Impl->Channels;
+    return Impl->Read(samples, [pcm, channels](const float* src, size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            for (size_t ch = 0; ch < channels; ch++) {
+                pcm[ch][i] = src[i * channels + ch];
+            }
+        }
+    });
+}
+
+} // namespace NAtracDEnc
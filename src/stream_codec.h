@@ -0,0 +1,88 @@
+/*
+ * This file is part of AtracDEnc.
+ *
+ * AtracDEnc is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * AtracDEnc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with AtracDEnc; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#pragma once
+
+// C++ interface of libatracdenc, see atracdenc_api.h for conventions.
+// Errors are reported by exceptions derived from std::exception.
+
+#include "atracdenc_api.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace NAtracDEnc {
+
+enum class EStreamCodec {
+    ATRAC1,
+    ATRAC3,
+    ATRAC3PLUS,
+};
+
+class ATRACDENC_API TStreamEncoder {
+public:
+    struct TSettings {
+        EStreamCodec Codec = EStreamCodec::ATRAC1;
+        uint32_t Channels = 2;
+        uint32_t Bitrate = 0; // kbit/s, ATRAC3 only, 0 - codec default
+    };
+
+    explicit TStreamEncoder(const TSettings& settings);
+    ~TStreamEncoder();
+
+    uint32_t GetFrameSamples() const;
+
+    void Push(const float* pcm, size_t samples);
+    void PushPlanar(const float* const* pcm, size_t samples);
+    // Pads the last frame with silence and drains the codec look-ahead
+    void Finish();
+
+    // 0 if there is no frame ready
+    size_t NextFrameSize() const;
+    // Returns size of copied frame or 0 if there is no frame ready,
+    // throws std::length_error if the buffer is smaller than NextFrameSize()
+    size_t ReadFrame(void* buf, size_t size);
+
+private:
+    class TImpl;
+    std::unique_ptr<TImpl> Impl;
+};
+
+class ATRACDENC_API TStreamDecoder {
+public:
+    struct TSettings {
+        EStreamCodec Codec = EStreamCodec::ATRAC1;
+        uint32_t Channels = 2;
+    };
+
+    explicit TStreamDecoder(const TSettings& settings);
+    ~TStreamDecoder();
+
+    void Push(const void* data, size_t size);
+
+    size_t GetSamplesNum() const;
+    size_t Read(float* pcm, size_t samples);
+    size_t ReadPlanar(float* const* pcm, size_t samples);
+
+private:
+    class TImpl;
+    std::unique_ptr<TImpl> Impl;
+};
+
+} // namespace NAtracDEnc
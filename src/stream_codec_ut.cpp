@@ -0,0 +1,231 @@
+/*
+ * This file is part of AtracDEnc.
+ *
+ * AtracDEnc is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * AtracDEnc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with AtracDEnc; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "stream_codec.h"
+#include "atracdenc_api.h"
+#include "atrac1denc.h"
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <vector>
+
+using namespace NAtracDEnc;
+
+namespace {
+
+typedef std::vector<std::vector<char>> TFrames;
+
+static std::vector<float> TestSignal(size_t samples, size_t channels) {
+    std::vector<float> pcm(samples * channels);
+    for (size_t i = 0; i < samples; i++) {
+        const float t = i / 44100.0f;
+        for (size_t ch = 0; ch < channels; ch++) {
+            pcm[i * channels + ch] = 0.4f * sinf(2 * M_PI * (330 + 110 * ch) * t);
+        }
+    }
+    return pcm;
+}
+
+static TFrames ReadAll(TStreamEncoder& encoder) {
+    TFrames frames;
+    while (size_t sz = encoder.NextFrameSize()) {
+        std::vector<char> frame(sz);
+        EXPECT_EQ(encoder.ReadFrame(frame.data(), frame.size()), sz);
+        frames.push_back(std::move(frame));
+    }
+    return frames;
+}
+
+static TFrames EncodeWhole(const TStreamEncoder::TSettings& settings, const std::vector<float>& pcm) {
+    TStreamEncoder encoder(settings);
+    encoder.Push(pcm.data(), pcm.size() / settings.Channels);
+    encoder.Finish();
+    return ReadAll(encoder);
+}
+
+// ATRAC1 RAW container
+class TMemOutput : public ICompressedOutput {
+public:
+    void WriteFrame(const char* data, size_t size) override {
+        std::vector<char> frame(data, data + size);
+        frame.resize(NAtrac1::TAtrac1Data::SoundUnitSize);
+        Frames.push_back(std::move(frame));
+    }
+    std::string GetName() const override {
+        return {};
+    }
+    size_t GetChannelNum() const override {
+        return 2;
+    }
+    TFrames Frames;
+};
+
+} // namespace
+
+TEST(TStreamEncoder, Atrac1MatchesEngine) {
+    const size_t channels = 2;
+    const size_t samples = 4096 * 20;
+    const auto pcm = TestSignal(samples, channels);
+
+    TStreamEncoder::TSettings settings;
+    settings.Codec = EStreamCodec::ATRAC1;
+    settings.Channels = channels;
+    const TFrames frames = EncodeWhole(settings, pcm);
+
+    auto out = new TMemOutput;
+    TCompressedOutputPtr outPtr(out);
+    std::unique_ptr<IProcessor> encoder(new TAtrac1Encoder(std::move(outPtr), NAtrac1::TAtrac1EncodeSettings()));
+    auto lambda = encoder->GetLambda();
+    std::vector<float> buf(pcm);
+    const TPCMEngine::ProcessMeta meta = {static_cast<uint16_t>(channels)};
+    for (size_t i = 0; i < samples; i += NAtrac1::TAtrac1Data::NumSamples) {
+        lambda(&buf[i * channels], meta);
+    }
+
+    EXPECT_EQ(frames.size(), samples / NAtrac1::TAtrac1Data::NumSamples * channels);
+    EXPECT_TRUE(frames == out->Frames);
+}
+
+TEST(TStreamEncoder, ChunkedPushMatchesWhole) {
+    const size_t channels = 2;
+    const size_t samples = 44100 * 2 + 123;
+    const auto pcm = TestSignal(samples, channels);
+
+    for (auto codec : {EStreamCodec::ATRAC1, EStreamCodec::ATRAC3}) {
+        TStreamEncoder::TSettings settings;
+        settings.Codec = codec;
+        settings.Channels = channels;
+        const TFrames whole = EncodeWhole(settings, pcm);
+
+        TStreamEncoder encoder(settings);
+        TFrames chunked;
+        const size_t chunks[] = {1, 7, 500, 1024, 3333};
+        for (size_t pos = 0, i = 0; pos < samples; i++) {
+            const size_t n = std::min(chunks[i % 5], samples - pos);
+            encoder.Push(&pcm[pos * channels], n);
+            pos += n;
+            for (auto& f : ReadAll(encoder)) {
+                chunked.push_back(std::move(f));
+            }
+        }
+        encoder.Finish();
+        for (auto& f : ReadAll(encoder)) {
+            chunked.push_back(std::move(f));
+        }
+        EXPECT_FALSE(whole.empty());
+        EXPECT_TRUE(whole == chunked);
+    }
+}
+
+TEST(TStreamEncoder, PlanarMatchesInterleaved) {
+    const size_t channels = 2;
+    const size_t samples = 44100;
+    const auto pcm = TestSignal(samples, channels);
+
+    std::vector<float> planes[2];
+    for (size_t ch = 0; ch < channels; ch++) {
+        for (size_t i = 0; i < samples; i++) {
+            planes[ch].push_back(pcm[i * channels + ch]);
+        }
+    }
+    const float* planar[2] = {planes[0].data(), planes[1].data()};
+
+    TStreamEncoder::TSettings settings;
+    settings.Codec = EStreamCodec::ATRAC3;
+    settings.Channels = channels;
+    TStreamEncoder encoder(settings);
+    encoder.PushPlanar(planar, samples);
+    encoder.Finish();
+
+    EXPECT_TRUE(EncodeWhole(settings, pcm) == ReadAll(encoder));
+}
+
+TEST(TStreamDecoder, Atrac1RoundTrip) {
+    const size_t channels = 2;
+    const size_t samples = 44100;
+    const auto pcm = TestSignal(samples, channels);
+
+    TStreamEncoder::TSettings settings;
+    settings.Channels = channels;
+    std::vector<char> stream;
+    for (const auto& f : EncodeWhole(settings, pcm)) {
+        stream.insert(stream.end(), f.begin(), f.end());
+    }
+
+    TStreamDecoder::TSettings decSettings;
+    decSettings.Channels = channels;
+    TStreamDecoder decoder(decSettings);
+    // Split in the middle of sound units
+    for (size_t pos = 0; pos < stream.size(); pos += 100) {
+        decoder.Push(&stream[pos], std::min<size_t>(100, stream.size() - pos));
+    }
+
+    const size_t frames = (samples + 511) / 512;
+    ASSERT_EQ(decoder.GetSamplesNum(), frames * 512);
+
+    std::vector<float> out(decoder.GetSamplesNum() * channels);
+    EXPECT_EQ(decoder.Read(out.data(), frames * 512), frames * 512);
+    EXPECT_EQ(decoder.GetSamplesNum(), 0);
+
+    float energy = 0;
+    for (float v : out) {
+        energy += v * v;
+    }
+    // 0.4 amplitude sine, the rest of energy is lost on codec delay and quantization
+    EXPECT_GT(energy / out.size(), 0.4f * 0.4f / 2 * 0.8f);
+}
+
+TEST(AtracdencApi, EncodeDecode) {
+    EXPECT_EQ(atracdenc_encoder_create(ATRACDENC_ATRAC1, 3, 0), nullptr);
+    EXPECT_EQ(atracdenc_decoder_create(ATRACDENC_ATRAC3, 2), nullptr);
+
+    atracdenc_encoder* enc = atracdenc_encoder_create(ATRACDENC_ATRAC1, 1, 0);
+    ASSERT_NE(enc, nullptr);
+    EXPECT_EQ(atracdenc_encoder_frame_samples(enc), 512);
+
+    const auto pcm = TestSignal(1000, 1);
+    EXPECT_EQ(atracdenc_encoder_push(enc, pcm.data(), pcm.size()), ATRACDENC_OK);
+    EXPECT_EQ(atracdenc_encoder_finish(enc), ATRACDENC_OK);
+    EXPECT_EQ(atracdenc_encoder_push(enc, pcm.data(), pcm.size()), ATRACDENC_ERROR);
+    EXPECT_STRNE(atracdenc_encoder_error(enc), "");
+
+    char small[16];
+    EXPECT_EQ(atracdenc_encoder_read_frame(enc, small, sizeof(small)), ATRACDENC_BUFFER_TOO_SMALL);
+
+    atracdenc_decoder* dec = atracdenc_decoder_create(ATRACDENC_ATRAC1, 1);
+    ASSERT_NE(dec, nullptr);
+    char frame[212];
+    size_t frames = 0;
+    ptrdiff_t sz;
+    while ((sz = atracdenc_encoder_read_frame(enc, frame, sizeof(frame))) > 0) {
+        EXPECT_EQ(sz, 212);
+        EXPECT_EQ(atracdenc_decoder_push(dec, frame, sz), ATRACDENC_OK);
+        frames++;
+    }
+    EXPECT_EQ(sz, 0);
+    EXPECT_EQ(frames, 2);
+
+    std::vector<float> out(2 * 512);
+    float* planar[1] = {out.data()};
+    EXPECT_EQ(atracdenc_decoder_samples(dec), 1024);
+    EXPECT_EQ(atracdenc_decoder_read_planar(dec, planar, 2000), 1024);
+
+    atracdenc_decoder_destroy(dec);
+    atracdenc_encoder_destroy(enc);
+}
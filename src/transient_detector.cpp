@@ -27,6 +27,15 @@
 #include <cassert>
 #include <iomanip>
 #include <ostream>
+#include <stdexcept>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ATDE_TD_SSE2
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#include <arm_neon.h>
+#define ATDE_TD_NEON
+#endif
 namespace NAtracDEnc {
 
 using std::vector;
@@ -49,49 +58,161 @@ static float calculatePeak(const float* in, uint32_t n) {
     return s;
 }
 
-void TTransientDetector::HPFilter(const float* in, float* out) {
+static constexpr size_t HPFHistory = 20;
+static constexpr size_t HPFLen = 21;
+
+namespace {
+
+#if defined(ATDE_TD_SSE2)
+struct TVec {
+    typedef __m128 T;
+    static constexpr size_t W = 4;
+    static T Load(const float* p) { return _mm_loadu_ps(p); }
+    static void Store(float* p, T v) { _mm_storeu_ps(p, v); }
+    static T Add(T a, T b) { return _mm_add_ps(a, b); }
+    static T Mul(T a, T b) { return _mm_mul_ps(a, b); }
+    static T Set1(float x) { return _mm_set1_ps(x); }
+};
+#elif defined(ATDE_TD_NEON)
+struct TVec {
+    typedef float32x4_t T;
+    static constexpr size_t W = 4;
+    static T Load(const float* p) { return vld1q_f32(p); }
+    static void Store(float* p, T v) { vst1q_f32(p, v); }
+    static T Add(T a, T b) { return vaddq_f32(a, b); }
+    // Separate multiply and add, the same rounding as the scalar code
+    static T Mul(T a, T b) { return vmulq_f32(a, b); }
+    static T Set1(float x) { return vdupq_n_f32(x); }
+};
+#else
+struct TVec {
+    typedef float T;
+    static constexpr size_t W = 1;
+    static T Load(const float* p) { return *p; }
+    static void Store(float* p, T v) { *p = v; }
+    static T Add(T a, T b) { return a + b; }
+    static T Mul(T a, T b) { return a * b; }
+    static T Set1(float x) { return x; }
+};
+#endif
+
+} // namespace
+
+// 21 tap high pass filter of n samples (multiple of 4), buf holds HPFHistory
+// samples of the previous block then the n new ones and one zero
+static void HPFilter(const float* buf, size_t n, float* out) {
     static const float fircoef[] = {
         -8.65163e-18 * 2.0, -0.00851586 * 2.0, -6.74764e-18 * 2.0, 0.0209036 * 2.0,
         -3.36639e-17 * 2.0, -0.0438162 * 2.0, -1.54175e-17 * 2.0, 0.0931738 * 2.0,
         -5.52212e-17 * 2.0, -0.313819 * 2.0
     };
-    memcpy(HPFBuffer.data() + PrevBufSz, in, BlockSz * sizeof(float));
-    const float* inBuf = HPFBuffer.data();
-    for (size_t i = 0; i < BlockSz; ++i) {
-        float s = inBuf[i + 10];
-        float s2 = 0;
-        for (size_t j = 0; j < ((FIRLen - 1) / 2) - 1 ; j += 2) {
-            s += fircoef[j] * (inBuf[i + j] + inBuf[i + FIRLen - j]);
-            s2 += fircoef[j + 1] * (inBuf[i + j + 1] + inBuf[i + FIRLen - j - 1]);
+    using V = TVec;
+    const V::T half = V::Set1(0.5f);
+    for (size_t i = 0; i < n; i += V::W) {
+        const float* in = buf + i;
+        V::T s = V::Load(in + 10);
+        V::T s2 = V::Set1(0.0f);
+        for (size_t j = 0; j < ((HPFLen - 1) / 2) - 1 ; j += 2) {
+            s = V::Add(s, V::Mul(V::Set1(fircoef[j]), V::Add(V::Load(in + j), V::Load(in + HPFLen - j))));
+            s2 = V::Add(s2, V::Mul(V::Set1(fircoef[j + 1]), V::Add(V::Load(in + j + 1), V::Load(in + HPFLen - j - 1))));
         }
-        out[i] = (s + s2)/2;
+        // halving is exact, same as the division
+        V::Store(out + i, V::Mul(V::Add(s, s2), half));
     }
-    memcpy(HPFBuffer.data(), in + (BlockSz - PrevBufSz),  PrevBufSz * sizeof(float));
 }
 
-
-bool TTransientDetector::Detect(const float* buf) {
-    const uint16_t nBlocksToAnalize = NShortBlocks + 1;
-    float* rmsPerShortBlock = reinterpret_cast<float*>(alloca(sizeof(float) * nBlocksToAnalize));
-    std::vector<float> filtered(BlockSz);
-    HPFilter(buf, filtered.data());
+// Level of each short block against the previous one, lastEnergy carries
+// the level of the last short block between calls.
+// Four blocks are summed side by side to break the add dependency chains,
+// each sum keeps the order of calculateRMS.
+static bool ScanShortBlocks(const float* filtered, uint16_t shortSz, uint16_t nShortBlocks,
+                            float& lastEnergy, uint16_t& lastTransientPos) {
+    constexpr uint16_t group = 4;
     bool trans = false;
-    rmsPerShortBlock[0] = LastEnergy;
-    for (uint16_t i = 1; i < nBlocksToAnalize; ++i) {
-        rmsPerShortBlock[i] = 19.0 * log10(calculateRMS(&filtered[(size_t)(i - 1) * ShortSz], ShortSz));
-        if (rmsPerShortBlock[i] - rmsPerShortBlock[i - 1] > 16) {
-            trans = true;
-            LastTransientPos = i;
+    float prev = lastEnergy;
+    for (uint16_t b = 0; b < nShortBlocks; b += group) {
+        const uint16_t cnt = std::min<uint16_t>(group, nShortBlocks - b);
+        const float* x = filtered + (size_t)b * shortSz;
+        float sum[group] = {0};
+        for (uint16_t i = 0; i < shortSz; ++i) {
+            for (uint16_t l = 0; l < group; ++l) {
+                const float v = l < cnt ? x[(size_t)l * shortSz + i] : 0.0f;
+                sum[l] += v * v;
+            }
         }
-        if (rmsPerShortBlock[i - 1] - rmsPerShortBlock[i] > 20) {
-            trans = true;
-            LastTransientPos = i;
+        for (uint16_t l = 0; l < cnt; ++l) {
+            const float cur = 19.0 * log10(sqrt(sum[l] / shortSz));
+            if (cur - prev > 16) {
+                trans = true;
+                lastTransientPos = b + l + 1;
+            }
+            if (prev - cur > 20) {
+                trans = true;
+                lastTransientPos = b + l + 1;
+            }
+            prev = cur;
         }
     }
-    LastEnergy = rmsPerShortBlock[NShortBlocks];
+    lastEnergy = prev;
     return trans;
 }
 
+bool TTransientDetector::Detect(const float* buf) {
+    memcpy(HPFBuffer.data() + PrevBufSz, buf, BlockSz * sizeof(float));
+    HPFilter(HPFBuffer.data(), BlockSz, Filtered.data());
+    memcpy(HPFBuffer.data(), buf + (BlockSz - PrevBufSz),  PrevBufSz * sizeof(float));
+    return ScanShortBlocks(Filtered.data(), ShortSz, NShortBlocks, LastEnergy, LastTransientPos);
+}
+
+TMultiBandTransientDetector::TMultiBandTransientDetector(uint32_t channels, const std::vector<TBand>& bands)
+    : NumBands(bands.size())
+{
+    size_t historySz = 0;
+    size_t maxBlockSz = 0;
+    for (uint32_t ch = 0; ch < channels; ch++) {
+        for (const TBand& band : bands) {
+            if (band.BlockSz % band.ShortSz || band.BlockSz % 4 || band.BlockSz < HPFHistory) {
+                throw std::runtime_error("unsupported transient detector band");
+            }
+            TState state;
+            state.Band = band;
+            state.HistoryOffset = historySz;
+            States.push_back(state);
+            historySz += band.BlockSz + HPFLen;
+            maxBlockSz = std::max<size_t>(maxBlockSz, band.BlockSz);
+        }
+    }
+    History.resize(historySz);
+    Filtered.resize(maxBlockSz);
+}
+
+void TMultiBandTransientDetector::Detect(const float* const* in, TResult* res, uint32_t channels) {
+    assert(channels * NumBands <= States.size());
+    float* filtered = Filtered.data();
+    for (size_t b = 0; b < channels * NumBands; b++) {
+        TState& state = States[b];
+        const size_t n = state.Band.BlockSz;
+        const float* src = in[b];
+        float* hist = History.data() + state.HistoryOffset;
+        float* dst = hist + HPFHistory;
+        if (state.Band.Inverted) {
+            // same as InvertSpectr: even samples change sign
+            for (size_t i = 0; i < n; i += 2) {
+                dst[i] = -src[i];
+                dst[i + 1] = src[i + 1];
+            }
+        } else {
+            memcpy(dst, src, n * sizeof(float));
+        }
+        HPFilter(hist, n, filtered);
+        memmove(hist, hist + n, HPFHistory * sizeof(float));
+
+        res[b].Transient = ScanShortBlocks(filtered, state.Band.ShortSz, n / state.Band.ShortSz,
+                                           state.LastEnergy, state.LastTransientPos);
+        res[b].Pos = state.LastTransientPos;
+    }
+}
+
 std::vector<float> AnalyzeGain(const float* in, const uint32_t len, const uint32_t maxPoints, bool useRms,
                                std::vector<float>* subframeLow,
                                std::vector<float>* subframeHigh) {
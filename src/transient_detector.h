@@ -33,8 +33,8 @@ class TTransientDetector {
     const uint16_t NShortBlocks;
     static const uint16_t PrevBufSz = 20;
     static const uint16_t FIRLen = 21;
-    void HPFilter(const float* in, float* out);
     std::vector<float> HPFBuffer;
+    std::vector<float> Filtered;
     float LastEnergy = 0.0;
     uint16_t LastTransientPos = 0;
 public:
@@ -44,11 +44,44 @@ public:
         , NShortBlocks(blockSz/shortSz)
     {
         HPFBuffer.resize(BlockSz + FIRLen); 
+        Filtered.resize(BlockSz);
     }
     bool Detect(const float* buf);
     uint32_t GetLastTransientPos() const { return LastTransientPos; }
 };
 
+// The same detection for every band of every channel of a frame in one call.
+// Bands with an inverted spectrum (odd QMF branches) are inverted while they
+// are copied into the filter history, so no intermediate buffer is created.
+// No allocation after construction.
+class TMultiBandTransientDetector {
+public:
+    struct TBand {
+        uint16_t ShortSz;
+        uint16_t BlockSz;
+        bool Inverted;
+    };
+    struct TResult {
+        bool Transient;
+        uint16_t Pos; // last short block with a transient, as GetLastTransientPos()
+    };
+    TMultiBandTransientDetector(uint32_t channels, const std::vector<TBand>& bands);
+    // in[channel * bands + band]: BlockSz samples of the first channels,
+    // res is filled in the same order
+    void Detect(const float* const* in, TResult* res, uint32_t channels);
+private:
+    struct TState {
+        TBand Band;
+        size_t HistoryOffset;
+        float LastEnergy = 0.0;
+        uint16_t LastTransientPos = 0;
+    };
+    const size_t NumBands;
+    std::vector<TState> States;
+    std::vector<float> History;
+    std::vector<float> Filtered;
+};
+
 std::vector<float> AnalyzeGain(const float* in, uint32_t len, uint32_t maxPoints, bool useRms,
                                std::vector<float>* subframeLow = nullptr,
                                std::vector<float>* subframeHigh = nullptr);
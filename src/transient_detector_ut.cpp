@@ -17,6 +17,7 @@
  */
 
 #include "transient_detector.h"
+#include "util.h"
 #include <gtest/gtest.h>
 
 #include <vector>
@@ -52,3 +53,49 @@ TEST(AnalyzeGain, AnalyzeGainSimple) {
     for (int i = 9; i < 32; ++i)
         EXPECT_EQ(res[i], 0.5);
 }
+
+TEST(TransientDetector, MultiBandMatchesSingleBand) {
+    const uint16_t blockSz[3] = {128, 128, 256};
+    vector<TTransientDetector> single;
+    for (int ch = 0; ch < 2; ++ch)
+        for (int band = 0; band < 3; ++band)
+            single.emplace_back(16, blockSz[band]);
+    TMultiBandTransientDetector multi(2, {{16, 128, false}, {16, 128, true}, {16, 256, true}});
+
+    uint32_t seed = 1;
+    vector<float> in[6];
+    size_t found = 0;
+    for (int frame = 0; frame < 64; ++frame) {
+        const float* bands[6];
+        for (int b = 0; b < 6; ++b) {
+            in[b].resize(blockSz[b % 3]);
+            // quiet noise with bursts at varying places to trigger detection
+            const size_t burst = (frame * 37 + b * 11) % in[b].size();
+            for (size_t i = 0; i < in[b].size(); ++i) {
+                seed = seed * 1664525u + 1013904223u;
+                const float noise = (float)(seed >> 8) / (1 << 24) - 0.5f;
+                const bool loud = (frame % 3 == b % 3) && i >= burst && i < burst + 24;
+                in[b][i] = noise * (loud ? 2000.0f : 1.0f);
+            }
+            bands[b] = in[b].data();
+        }
+
+        TMultiBandTransientDetector::TResult res[6];
+        multi.Detect(bands, res, 2);
+
+        for (int b = 0; b < 6; ++b) {
+            bool trans;
+            if (b % 3 == 0) {
+                trans = single[b].Detect(bands[b]);
+            } else if (b % 3 == 1) {
+                trans = single[b].Detect(InvertSpectr<128>(bands[b]).data());
+            } else {
+                trans = single[b].Detect(InvertSpectr<256>(bands[b]).data());
+            }
+            EXPECT_EQ(res[b].Transient, trans) << "frame " << frame << " band " << b;
+            EXPECT_EQ(res[b].Pos, single[b].GetLastTransientPos()) << "frame " << frame << " band " << b;
+            found += trans;
+        }
+    }
+    EXPECT_GT(found, 0u);
+}
@@ -19,7 +19,10 @@
 #include "transient_spectral_upsampler.h"
 
 #include "lib/fft/kissfft_impl/tools/kiss_fftr.h"
+#include "lib/plan_registry/plan_registry.h"
 
+#include <algorithm>
+#include <cassert>
 #include <cmath>
 
 #ifndef M_PI
@@ -28,12 +31,7 @@
 
 namespace NAtracDEnc {
 
-TSpectralUpsampler::TSpectralUpsampler(float sampleRate, float lowCutHz, float epsilon)
-    // Round up so that lowCutHz itself is passed through.
-    : LowCutBin(static_cast<int>(std::ceil(lowCutHz * kInN / sampleRate)))
-    , Win(kInN)
-    , FwdCfg(static_cast<void*>(kiss_fftr_alloc(kInN,  0, nullptr, nullptr)))
-    , InvCfg(static_cast<void*>(kiss_fftr_alloc(kOutN, 1, nullptr, nullptr)))
+std::vector<float> TSpectralUpsampler::CalcWindow(float epsilon)
 {
     // Planck-taper window: smooth logistic taper; flat top = 1 in the middle.
     //
@@ -49,42 +47,81 @@ TSpectralUpsampler::TSpectralUpsampler(float sampleRate, float lowCutHz, float e
     //   ε=0.15 → eN=76.8,  flat top n in [77..435]
     //   ε=0.20 → eN=102.4, flat top n in [103..409]
     // All fully contain the analysis region [128..384).
+    std::vector<float> win(kInN);
     const float eN = epsilon * static_cast<float>(kInN);
     const float fN = static_cast<float>(kInN);
     for (int n = 0; n < kInN; ++n) {
         const float fn = static_cast<float>(n);
         if (n == 0) {
-            Win[n] = 0.0f;
+            win[n] = 0.0f;
         } else if (fn < eN) {
             const float Zp = eN * (1.0f / fn + 1.0f / (fn - eN));
-            Win[n] = 1.0f / (1.0f + std::exp(Zp));
+            win[n] = 1.0f / (1.0f + std::exp(Zp));
         } else if (fn <= fN - eN) {
-            Win[n] = 1.0f;
+            win[n] = 1.0f;
         } else {
             const float m  = fN - fn;
             const float Zp = eN * (1.0f / m + 1.0f / (m - eN));
-            Win[n] = 1.0f / (1.0f + std::exp(Zp));
+            win[n] = 1.0f / (1.0f + std::exp(Zp));
         }
     }
+    return win;
+}
+
+std::vector<float> TSpectralUpsampler::CalcTwist()
+{
+    std::vector<float> twist(kUpsample * (kInN / 2 + 1) * 2);
+    for (int r = 0; r < kUpsample; ++r) {
+        float* t = &twist[r * (kInN / 2 + 1) * 2];
+        for (int k = 0; k < kInN / 2; ++k) {
+            const double a = 2.0 * M_PI * k * r / kOutN;
+            t[2 * k]     = static_cast<float>(std::cos(a) / kOutN);
+            t[2 * k + 1] = static_cast<float>(std::sin(a) / kOutN);
+        }
+        t[kInN]     = static_cast<float>(2.0 * std::cos(M_PI * r / kUpsample) / kOutN);
+        t[kInN + 1] = 0.0f;
+    }
+    return twist;
+}
+
+TSpectralUpsampler::TSpectralUpsampler(float sampleRate, float lowCutHz, float epsilon)
+    // Round up so that lowCutHz itself is passed through.
+    : LowCutBin(static_cast<int>(std::ceil(lowCutHz * kInN / sampleRate)))
+    , Win(TPlanRegistry::Get<std::vector<float>>("upsampler_window", epsilon,
+        [epsilon] { return CalcWindow(epsilon); }))
+    , FwdCfg(static_cast<void*>(kiss_fftr_alloc(kInN,  0, nullptr, nullptr)))
+    , Twist(TPlanRegistry::Get<std::vector<float>>("upsampler_twist", kInN, CalcTwist))
+    , Windowed(kInN)
+    , Spectrum((kInN / 2 + 1) * 2)
+    , PhaseIn(2 * kInN * kPhaseLanes)
+    , PhaseOut(2 * kInN * kPhaseLanes)
+{
 }
 
 TSpectralUpsampler::~TSpectralUpsampler()
 {
     kiss_fftr_free(static_cast<kiss_fftr_cfg>(FwdCfg));
-    kiss_fftr_free(static_cast<kiss_fftr_cfg>(InvCfg));
 }
 
-TProcessResult TSpectralUpsampler::Process(const float* in) const
+TProcessResult TSpectralUpsampler::Process(const float* in)
 {
+    std::vector<float> output(kOutN);
+    const float highFreqRatio = Process(in, output.data(), 0, kOutN);
+    return TProcessResult{std::move(output), highFreqRatio};
+}
+
+float TSpectralUpsampler::Process(const float* in, float* out, int begin, int end)
+{
+    assert(0 <= begin && begin <= end && end <= kOutN);
+
     // 1. Apply Planck-taper window.
-    std::vector<float> windowed(kInN);
+    const float* win = Win->data();
     for (int n = 0; n < kInN; ++n)
-        windowed[n] = in[n] * Win[n];
+        Windowed[n] = in[n] * win[n];
 
     // 2. Forward real FFT: kInN real → kInN/2+1 complex bins.
-    const int kInBins = kInN / 2 + 1;  // 257
-    std::vector<kiss_fft_cpx> fwdOut(kInBins);
-    kiss_fftr(static_cast<kiss_fftr_cfg>(FwdCfg), windowed.data(), fwdOut.data());
+    kiss_fft_cpx* fwdOut = reinterpret_cast<kiss_fft_cpx*>(Spectrum.data());
+    kiss_fftr(static_cast<kiss_fftr_cfg>(FwdCfg), Windowed.data(), fwdOut);
 
     // 2a. Filtered high-frequency energy ratio.
     //
@@ -117,7 +154,8 @@ TProcessResult TSpectralUpsampler::Process(const float* in) const
     const float highFreqRatio = (totalE > 0.0)
                               ? static_cast<float>(filtHighE / totalE) : 0.0f;
 
-    // 3. Build the kOutN/2+1 frequency-domain input for the inverse FFT.
+    // 3. Filter and scale the kept bins in place; bins above kInN/2 are the
+    //    zero-padding of the kOutN-point spectrum and are never stored.
     //
     //    Upsampling by kUpsample in the frequency domain, with a 3-bin
     //    raised-cosine high-pass filter H[k] = 0.5*(1 - cos(π·i/2)):
@@ -132,19 +170,16 @@ TProcessResult TSpectralUpsampler::Process(const float* in) const
     //
     //      Y[k] = kUpsample * X[k] * H[k]   for k in [0, kInN/2)
     //      Y[kInN/2] = kUpsample/2 * X[kInN/2].r * H[kInN/2]  (Nyquist)
-    //      Y[k] = 0  for k in [kInN/2+1, kOutN/2]  (zero-padding)
     //
-    //    After kiss_fftri (which returns kOutN * IFFT(Y)), dividing by kOutN
-    //    yields amplitudes equal to those of the original windowed signal.
-    const int kOutBins = kOutN / 2 + 1;  // 2049
-    std::vector<kiss_fft_cpx> invIn(kOutBins, {0.0f, 0.0f});
-
+    //    The 1/kOutN normalization of the inverse transform is in Twist.
     const float scale = static_cast<float>(kUpsample);
 
     // Full passband bins (above the transition, or all bins when no cut).
     const int passbandStart = (LowCutBin == 0) ? 0 : LowCutBin + 2;
+    for (int k = 0; k < std::min(LowCutBin, kInN / 2); ++k)
+        fwdOut[k] = {0.0f, 0.0f};
     for (int k = passbandStart; k < kInN / 2; ++k)
-        invIn[k] = {fwdOut[k].r * scale, fwdOut[k].i * scale};
+        fwdOut[k] = {fwdOut[k].r * scale, fwdOut[k].i * scale};
 
     // 3-bin raised-cosine transition: H[i] = 0.5*(1 - cos(π·i/2)), i in [0..2].
     // i=0 (LowCutBin-1) stays zero; i=1 → H=0.5, i=2 → H=1.0 (passband start).
@@ -154,7 +189,7 @@ TProcessResult TSpectralUpsampler::Process(const float* in) const
             const int k = LowCutBin - 1 + i;
             if (k >= kInN / 2) continue;
             const float w = 0.5f * (1.0f - std::cos(static_cast<float>(M_PI) * i / 2.0f));
-            invIn[k] = {fwdOut[k].r * scale * w, fwdOut[k].i * scale * w};
+            fwdOut[k] = {fwdOut[k].r * scale * w, fwdOut[k].i * scale * w};
         }
     }
 
@@ -163,20 +198,46 @@ TProcessResult TSpectralUpsampler::Process(const float* in) const
     // of the kOutN-point spectrum sums to the correct amplitude.
     // Apply the same H[kInN/2] as any other passband bin (almost always 1).
     if (LowCutBin + 2 <= kInN / 2)
-        invIn[kInN / 2] = {fwdOut[kInN / 2].r * scale * 0.5f, 0.0f};
+        fwdOut[kInN / 2] = {fwdOut[kInN / 2].r * scale * 0.5f, 0.0f};
+    else
+        fwdOut[kInN / 2] = {0.0f, 0.0f};
+
+    // 4. Per phase pair (a, b) = (2l, 2l+1) in lane l, the 512-point input
+    //    W = Za + i·Zb, Z = Y·twist, Hermitian extended to bins above kInN/2.
+    //    It is conjugated so that the forward FFT computes the inverse.
+    static constexpr int L = kPhaseLanes;
+    float* x = PhaseIn.data();
+    for (int l = 0; l < L; ++l) {
+        const float* ta = Twist->data() + (2 * l) * (kInN / 2 + 1) * 2;
+        const float* tb = Twist->data() + (2 * l + 1) * (kInN / 2 + 1) * 2;
+        for (int k = 0; k <= kInN / 2; ++k) {
+            const float yr = fwdOut[k].r, yi = fwdOut[k].i;
+            const float par = yr * ta[2 * k] - yi * ta[2 * k + 1];
+            const float pai = yr * ta[2 * k + 1] + yi * ta[2 * k];
+            const float pbr = yr * tb[2 * k] - yi * tb[2 * k + 1];
+            const float pbi = yr * tb[2 * k + 1] + yi * tb[2 * k];
+            x[2 * L * k + l]     = par - pbi;
+            x[2 * L * k + L + l] = -(pai + pbr);
+            if (k != 0 && k != kInN / 2) {
+                const int m = kInN - k;
+                x[2 * L * m + l]     = par + pbi;
+                x[2 * L * m + L + l] = pai - pbr;
+            }
+        }
+    }
 
-    // Bins [kInN/2+1 .. kOutBins-1] remain zero (zero-padding).
+    PhaseFFT(PhaseIn.data(), PhaseOut.data());
 
-    // 4. Inverse real FFT: kOutBins complex → kOutN real.
-    std::vector<float> output(kOutN);
-    kiss_fftri(static_cast<kiss_fftr_cfg>(InvCfg), invIn.data(), output.data());
-
-    // 5. Normalize: kiss_fftri is unnormalized (output = kOutN * IFFT(input)).
-    const float norm = 1.0f / static_cast<float>(kOutN);
-    for (float& v : output)
-        v *= norm;
+    // 5. Sample 8m + 2l is the real part of lane l at m, 8m + 2l + 1 the
+    //    negated imaginary part.
+    const float* y = PhaseOut.data();
+    for (int n = begin; n < end; ++n) {
+        const int m = n / kUpsample;
+        const int l = (n % kUpsample) / 2;
+        out[n - begin] = (n & 1) ? -y[2 * L * m + L + l] : y[2 * L * m + l];
+    }
 
-    return TProcessResult{std::move(output), highFreqRatio};
+    return highFreqRatio;
 }
 
 } // namespace NAtracDEnc
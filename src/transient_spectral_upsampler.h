@@ -18,6 +18,9 @@
 
 #pragma once
 
+#include <lib/fft/fft.h>
+
+#include <memory>
 #include <vector>
 
 namespace NAtracDEnc {
@@ -52,6 +55,14 @@ struct TProcessResult {
 //      region and scaling remaining bins to preserve amplitude.
 //   5. Inverse real FFT (4096-point).
 //
+// Step 5 is not computed as a 4096-point transform: only 513 of its bins are
+// non-zero, so output phase r of 8 (samples 8m + r) is the 512-point inverse
+// FFT of the kept bins twisted by e^{2πi·k·r/4096}.  Two phases share one
+// complex transform (real and imaginary part) and the four transforms run
+// batched across SIMD lanes.  Every phase is needed for any range of 8 or
+// more samples, and the gain region covers half of each phase transform, so
+// the transforms are not pruned.  Only the requested range is copied out.
+//
 // The analysis region maps to [1024..3071] in the 4096-sample output.
 // Passing each kInN/kUpsample-sample subframe of this region to AnalyzeGain
 // gives 8× more stable RMS estimates than operating on the raw 8-sample
@@ -72,6 +83,11 @@ public:
     // cutoff into the 3-bin transition region (H² = 0.25 at LowCutBin).
     static constexpr float kHighFreqThreshold = 0.05f;
 
+    // Output range read by the ATRAC3 gain analysis: the analysis region and
+    // the first 64 samples of the upsampled look-ahead.
+    static constexpr int kGainRegionBegin = 1024;
+    static constexpr int kGainRegionEnd   = 3072 + 64;
+
     // sampleRate : sample rate of the input (e.g. 11024 Hz for ATRAC3 sub-band)
     // lowCutHz   : frequencies below this are zeroed in the FFT domain
     // epsilon    : Planck-taper taper fraction in (0, 0.5); default 0.15
@@ -80,13 +96,34 @@ public:
 
     // Process a kInN-sample input window.
     // Returns the upsampled signal and its high-frequency energy ratio.
-    TProcessResult Process(const float* in) const;
+    TProcessResult Process(const float* in);
+
+    // Process a kInN-sample input window, writing only the upsampled samples
+    // [begin, end) to out, 0 <= begin <= end <= kOutN.  All kOutN samples are
+    // still computed.  Returns the high-frequency energy ratio.
+    float Process(const float* in, float* out, int begin, int end);
 
 private:
+    static constexpr int kPhaseLanes = kUpsample / 2;
+
+    static std::vector<float> CalcWindow(float epsilon);
+    static std::vector<float> CalcTwist();
+
+    // Win and Twist are shared by all upsamplers. The kiss_fftr plan is not:
+    // it keeps its scratch buffer in the configuration.
     const int          LowCutBin;  // first kept bin (inclusive); bins [0,LowCutBin) are zeroed
-    std::vector<float> Win;
+    std::shared_ptr<const std::vector<float>> Win;
     void*              FwdCfg;     // kiss_fftr_cfg: kInN-point  forward real FFT plan
-    void*              InvCfg;     // kiss_fftr_cfg: kOutN-point inverse real FFT plan
+    // e^{2πi·k·r/kOutN} / kOutN as (re, im) for r < kUpsample, k < kInN/2.
+    // k = kInN/2 holds 2·cos(π·r/kUpsample) / kOutN: the Nyquist bin and its
+    // mirror land on the same bin of the 512-point transform.
+    std::shared_ptr<const std::vector<float>> Twist;
+    NFFT::TFixedFFT<kInN, kPhaseLanes> PhaseFFT;
+
+    std::vector<float> Windowed;
+    std::vector<float> Spectrum;   // kInN/2+1 complex bins
+    std::vector<float> PhaseIn;
+    std::vector<float> PhaseOut;
 };
 
 } // namespace NAtracDEnc
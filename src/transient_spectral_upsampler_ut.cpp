@@ -19,9 +19,11 @@
 #include "transient_spectral_upsampler.h"
 #include "transient_detector.h"
 
+#include <fft/kissfft_impl/tools/kiss_fftr.h>
 #include <gtest/gtest.h>
 
 #include <cmath>
+#include <utility>
 #include <vector>
 
 using namespace NAtracDEnc;
@@ -49,36 +51,78 @@ static void FillSine(float* buf, size_t len, float freqHz, float sampleRate)
     }
 }
 
+// Planck-taper window value at n of an inN-point window, using the same
+// formula as the class.
+static float PlanckWindow(int n, int inN, float eps)
+{
+    const float eN = eps * static_cast<float>(inN);
+    const float fN = static_cast<float>(inN);
+    const float fn = static_cast<float>(n);
+    if (n == 0) {
+        return 0.0f;
+    } else if (fn < eN) {
+        const float Zp = eN * (1.0f / fn + 1.0f / (fn - eN));
+        return 1.0f / (1.0f + std::exp(Zp));
+    } else if (fn <= fN - eN) {
+        return 1.0f;
+    } else {
+        const float m  = fN - fn;
+        const float Zp = eN * (1.0f / m + 1.0f / (m - eN));
+        return 1.0f / (1.0f + std::exp(Zp));
+    }
+}
+
 // Compute the Planck-taper-windowed RMS for the analysis region [128..384)
-// of a kInN-point window, using the same formula as the class.
+// of a kInN-point window.
 static float PlanckWindowedRms(const float* in, int inN, float eps)
 {
     static constexpr int kStart = 128;
     static constexpr int kEnd   = 384;
-    const float eN = eps * static_cast<float>(inN);
-    const float fN = static_cast<float>(inN);
     double acc = 0.0;
     for (int i = kStart; i < kEnd; ++i) {
-        float w;
-        const float fn = static_cast<float>(i);
-        if (i == 0) {
-            w = 0.0f;
-        } else if (fn < eN) {
-            const float Zp = eN * (1.0f / fn + 1.0f / (fn - eN));
-            w = 1.0f / (1.0f + std::exp(Zp));
-        } else if (fn <= fN - eN) {
-            w = 1.0f;
-        } else {
-            const float m  = fN - fn;
-            const float Zp = eN * (1.0f / m + 1.0f / (m - eN));
-            w = 1.0f / (1.0f + std::exp(Zp));
-        }
-        const float v = in[i] * w;
+        const float v = in[i] * PlanckWindow(i, inN, eps);
         acc += static_cast<double>(v) * v;
     }
     return static_cast<float>(std::sqrt(acc / (kEnd - kStart)));
 }
 
+// The upsampled signal computed the straightforward way: zero-pad the
+// filtered spectrum to kOutN/2+1 bins and run a kOutN-point inverse real FFT.
+static std::vector<float> ReferenceUpsample(const float* in, float lowCutHz)
+{
+    constexpr int kInN = TSpectralUpsampler::kInN;
+    constexpr int kOutN = TSpectralUpsampler::kOutN;
+    const float scale = static_cast<float>(TSpectralUpsampler::kUpsample);
+    const int lowCutBin = static_cast<int>(std::ceil(lowCutHz * kInN / kSampleRate));
+
+    std::vector<float> windowed(kInN);
+    for (int n = 0; n < kInN; ++n)
+        windowed[n] = in[n] * PlanckWindow(n, kInN, TSpectralUpsampler::kDefaultEps);
+
+    kiss_fftr_cfg fwd = kiss_fftr_alloc(kInN, 0, nullptr, nullptr);
+    std::vector<kiss_fft_cpx> spec(kInN / 2 + 1);
+    kiss_fftr(fwd, windowed.data(), spec.data());
+    kiss_fftr_free(fwd);
+
+    std::vector<kiss_fft_cpx> invIn(kOutN / 2 + 1, {0.0f, 0.0f});
+    for (int k = 0; k < kInN / 2; ++k) {
+        float h = 1.0f;
+        if (lowCutBin > 0 && k < lowCutBin + 2)
+            h = k < lowCutBin ? 0.0f : 0.5f * (1.0f - std::cos(static_cast<float>(M_PI) * (k - lowCutBin + 1) / 2.0f));
+        invIn[k] = {spec[k].r * scale * h, spec[k].i * scale * h};
+    }
+    if (lowCutBin + 2 <= kInN / 2)
+        invIn[kInN / 2] = {spec[kInN / 2].r * scale * 0.5f, 0.0f};
+
+    kiss_fftr_cfg inv = kiss_fftr_alloc(kOutN, 1, nullptr, nullptr);
+    std::vector<float> out(kOutN);
+    kiss_fftri(inv, invIn.data(), out.data());
+    kiss_fftr_free(inv);
+    for (float& v : out)
+        v /= kOutN;
+    return out;
+}
+
 // ──────────────────────────────────────────────────────────────────────────────
 // Basic structural tests
 // ──────────────────────────────────────────────────────────────────────────────
@@ -91,6 +135,66 @@ TEST(TSpectralUpsampler, OutputSize)
     EXPECT_EQ(static_cast<int>(result.signal.size()), TSpectralUpsampler::kOutN);
 }
 
+// The phase transforms give the same signal as one kOutN-point inverse FFT.
+TEST(TSpectralUpsampler, MatchesFullInverseFFT)
+{
+    std::vector<float> input(TSpectralUpsampler::kInN);
+    FillSine(input.data(), input.size(), 3100.0f, kSampleRate);
+    for (size_t i = 0; i < input.size(); ++i)
+        input[i] += 0.3f * std::sin(0.7f * i * i);
+
+    for (float lowCutHz : {0.0f, 500.0f}) {
+        TSpectralUpsampler proc(kSampleRate, lowCutHz);
+        const auto result = proc.Process(input.data());
+        const auto ref = ReferenceUpsample(input.data(), lowCutHz);
+        for (int n = 0; n < TSpectralUpsampler::kOutN; ++n)
+            ASSERT_NEAR(result.signal[n], ref[n], 1e-5f) << "cut " << lowCutHz << " sample " << n;
+    }
+}
+
+// Any range, aligned to kUpsample or not, is the same slice of the reference.
+TEST(TSpectralUpsampler, RegionMatchesFullInverseFFT)
+{
+    TSpectralUpsampler proc(kSampleRate, 500.0f);
+    std::vector<float> input(TSpectralUpsampler::kInN);
+    FillSine(input.data(), input.size(), 3100.0f, kSampleRate);
+    for (size_t i = 0; i < input.size(); ++i)
+        input[i] += 0.3f * std::sin(0.7f * i * i);
+
+    const auto ref = ReferenceUpsample(input.data(), 500.0f);
+    const float fullRatio = proc.Process(input.data()).highFreqRatio;
+    const std::pair<int, int> ranges[] = {
+        {TSpectralUpsampler::kGainRegionBegin, TSpectralUpsampler::kGainRegionEnd},
+        {1027, 2051},
+        {3, 5},
+        {4093, TSpectralUpsampler::kOutN},
+    };
+    for (const auto& range : ranges) {
+        std::vector<float> region(range.second - range.first + 1, 123.0f);
+        const float ratio = proc.Process(input.data(), region.data(), range.first, range.second);
+        EXPECT_EQ(ratio, fullRatio);
+        for (int i = 0; i < range.second - range.first; ++i)
+            ASSERT_NEAR(region[i], ref[range.first + i], 1e-5f) << "begin " << range.first << " sample " << i;
+        // Nothing is written past end
+        EXPECT_EQ(region.back(), 123.0f);
+    }
+}
+
+// Without the low cut, every kUpsample-th output sample is the windowed input
+// itself; the window is flat over the analysis region.
+TEST(TSpectralUpsampler, PhaseZeroReproducesInput)
+{
+    TSpectralUpsampler proc(kSampleRate, 0.0f);
+    std::vector<float> input(TSpectralUpsampler::kInN);
+    for (size_t i = 0; i < input.size(); ++i)
+        input[i] = std::sin(0.05f * i) + 0.5f * std::sin(0.9f * i + 0.3f) + ((i * 37) % 11) * 0.01f;
+
+    const auto result = proc.Process(input.data());
+    for (int n = 128; n < 384; ++n) {
+        EXPECT_NEAR(result.signal[n * TSpectralUpsampler::kUpsample], input[n], 1e-5f) << "sample " << n;
+    }
+}
+
 // ──────────────────────────────────────────────────────────────────────────────
 // Low-cut filter: DC and low-frequency content must be suppressed
 // ──────────────────────────────────────────────────────────────────────────────
@@ -24,6 +24,10 @@
 
 #ifdef _WIN32
 #include <windows.h>
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <unistd.h>
 #endif
 
 namespace NAtracDEnc {
@@ -54,4 +58,25 @@ inline FILE* FOpenUtf8(const std::string& path, const char* mode) {
 #endif
 }
 
+// Opens output file for binary writing, "-" means standard output.
+// Stdout is duplicated so the result can be closed as a regular file.
+inline FILE* FOpenOutputUtf8(const std::string& path) {
+    if (path != "-")
+        return FOpenUtf8(path, "wb");
+    fflush(stdout);
+#ifdef _WIN32
+    _setmode(_fileno(stdout), _O_BINARY);
+    const int fd = _dup(_fileno(stdout));
+    return fd == -1 ? nullptr : _fdopen(fd, "wb");
+#else
+    const int fd = dup(fileno(stdout));
+    return fd == -1 ? nullptr : fdopen(fd, "wb");
+#endif
+}
+
+// False for pipes and terminals, header of such output can't be patched
+inline bool IsSeekable(FILE* fp) {
+    return ftell(fp) >= 0;
+}
+
 } // namespace NAtracDEnc
@@ -25,6 +25,7 @@
 
 #include "config.h"
 #include <cstring>
+#include <new>
 
 #ifdef NDEBUG
 #define ASSERT(x) do { ((void)(x));} while (0)
@@ -107,3 +108,35 @@ inline int ToInt(float x) {
     return lrint(x);
 #endif
 }
+
+// Allocator for std::vector which keeps data aligned for SIMD loads
+template<class T, size_t Align = 64>
+struct TAlignedAllocator {
+    typedef T value_type;
+
+    template<class U>
+    struct rebind {
+        typedef TAlignedAllocator<U, Align> other;
+    };
+
+    TAlignedAllocator() = default;
+    template<class U>
+    TAlignedAllocator(const TAlignedAllocator<U, Align>&) {}
+
+    T* allocate(size_t n) {
+        return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(Align)));
+    }
+
+    void deallocate(T* p, size_t) {
+        ::operator delete(p, std::align_val_t(Align));
+    }
+
+    template<class U>
+    bool operator==(const TAlignedAllocator<U, Align>&) const {
+        return true;
+    }
+    template<class U>
+    bool operator!=(const TAlignedAllocator<U, Align>&) const {
+        return false;
+    }
+};
@@ -20,18 +20,171 @@
 #include <memory>
 #include <cerrno>
 #include <algorithm>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include <sys/stat.h>
 #include <string.h>
 
 #include "wav.h"
 #include "pcmengin.h"
+#include "pcm_layout.h"
 
 IPCMProviderImpl* CreatePCMIOReadImpl(const std::string& path);
 
 IPCMProviderImpl* CreatePCMIOWriteImpl(const std::string& path, int channels, int sampleRate);
 
+size_t IPCMProviderImpl::Skip(size_t sz) {
+    TPCMBuffer buf(4096, GetChannelsNum());
+    size_t skipped = 0;
+    while (skipped < sz) {
+        const size_t toRead = std::min(sz - skipped, buf.Size());
+        const size_t read = Read(buf, toRead);
+        skipped += read;
+        if (read != toRead)
+            break;
+    }
+    return skipped;
+}
+
+namespace {
+
+// Reads the wrapped provider on a background thread in to a ring of blocks.
+// The consumer gets exactly the same data and short read at the end of the
+// stream as it would get reading the wrapped provider directly.
+class TPrefetchPCMProvider : public IPCMProviderImpl {
+public:
+    TPrefetchPCMProvider(std::unique_ptr<IPCMProviderImpl>&& impl, size_t depth, size_t blockSz)
+        : Impl(std::move(impl))
+    {
+        Blocks.reserve(depth);
+        for (size_t i = 0; i < depth; i++) {
+            Blocks.emplace_back(blockSz, Impl->GetChannelsNum());
+        }
+        Worker = std::thread(&TPrefetchPCMProvider::Run, this);
+    }
+
+    ~TPrefetchPCMProvider() {
+        {
+            std::lock_guard<std::mutex> lock(Mutex);
+            Stop = true;
+        }
+        Cv.notify_all();
+        Worker.join();
+    }
+
+    size_t GetChannelsNum() const override {
+        return Impl->GetChannelsNum();
+    }
+
+    size_t GetSampleRate() const override {
+        return Impl->GetSampleRate();
+    }
+
+    size_t GetTotalSamples() const override {
+        return Impl->GetTotalSamples();
+    }
+
+    size_t Read(TPCMBuffer& buf, size_t sz) override {
+        const size_t channels = Impl->GetChannelsNum();
+        size_t done = 0;
+        while (done < sz) {
+            TBlock* block = nullptr;
+            {
+                std::unique_lock<std::mutex> lock(Mutex);
+                Cv.wait(lock, [this] { return Filled > Consumed || Eof || Error; });
+                if (Filled == Consumed) {
+                    if (Error)
+                        std::rethrow_exception(Error);
+                    break;
+                }
+                block = &Blocks[Consumed % Blocks.size()];
+            }
+
+            const size_t n = std::min(sz - done, block->Samples - block->Pos);
+            memcpy(buf[done], block->Buf[block->Pos], n * channels * sizeof(float));
+            block->Pos += n;
+            done += n;
+
+            if (block->Pos == block->Samples) {
+                {
+                    std::lock_guard<std::mutex> lock(Mutex);
+                    Consumed++;
+                }
+                Cv.notify_all();
+            }
+        }
+        return done;
+    }
+
+    size_t Write(const TPCMBuffer&, size_t) override {
+        return 0;
+    }
+
+private:
+    struct TBlock {
+        TBlock(size_t sz, size_t channels)
+            : Buf(sz, channels)
+        {}
+        TPCMBuffer Buf;
+        size_t Samples = 0;
+        size_t Pos = 0;
+    };
+
+    void Run() {
+        for (;;) {
+            TBlock* block = nullptr;
+            {
+                std::unique_lock<std::mutex> lock(Mutex);
+                Cv.wait(lock, [this] { return Filled - Consumed < Blocks.size() || Stop; });
+                if (Stop)
+                    return;
+                block = &Blocks[Filled % Blocks.size()];
+            }
+
+            size_t read = 0;
+            std::exception_ptr error;
+            try {
+                read = Impl->Read(block->Buf, block->Buf.Size());
+            } catch (...) {
+                error = std::current_exception();
+            }
+            block->Samples = read;
+            block->Pos = 0;
+
+            {
+                std::lock_guard<std::mutex> lock(Mutex);
+                if (read)
+                    Filled++;
+                if (read != block->Buf.Size())
+                    Eof = true;
+                Error = error;
+            }
+            Cv.notify_all();
+            if (Eof)
+                return;
+        }
+    }
+
+    std::unique_ptr<IPCMProviderImpl> Impl;
+    std::vector<TBlock> Blocks;
+    std::thread Worker;
+
+    std::mutex Mutex;
+    std::condition_variable Cv;
+    uint64_t Filled = 0;
+    uint64_t Consumed = 0;
+    bool Eof = false;
+    bool Stop = false;
+    std::exception_ptr Error;
+};
+
+} // namespace
+
 TWav::TWav(const std::string& path)
     : Impl(CreatePCMIOReadImpl(path))
 { }
@@ -48,8 +201,13 @@ IPCMReader* TWav::GetPCMReader() const {
         if (data.Channels() != Impl->GetChannelsNum())
             throw TWrongReadBuffer();
 
-        size_t read;
-        if ((read = Impl->Read(data, size)) != size) {
+        // Backends read interleaved samples, planar buffer is filled in one pass
+        const size_t read = data.IsPlanar()
+            ? ReadPlanar(data, size)
+            : Impl->Read(data, size);
+        SamplesRead += read;
+        if (read != size) {
+            EndOfStream = true;
             if (!read)
                 return false;
 
@@ -64,14 +222,61 @@ IPCMWriter* TWav::GetPCMWriter() {
     return new TWavPcmWriter([this](const TPCMBuffer& data, const uint32_t size) {
         if (data.Channels() != Impl->GetChannelsNum())
             throw TWrongReadBuffer();
-        if (Impl->Write(data, size) != size) {
+        const size_t written = data.IsPlanar()
+            ? WritePlanar(data, size)
+            : Impl->Write(data, size);
+        if (written != size) {
             fprintf(stderr, "can't write block\n");
         }
     });
 }
 
+TPCMBuffer& TWav::GetInterleavedBuf(const TPCMBuffer& data) const {
+    if (!Interleaved || Interleaved->Size() < data.Size())
+        Interleaved.reset(new TPCMBuffer(data.Size(), data.Channels()));
+    return *Interleaved;
+}
+
+size_t TWav::ReadPlanar(TPCMBuffer& data, size_t size) const {
+    TPCMBuffer& buf = GetInterleavedBuf(data);
+    const size_t read = Impl->Read(buf, size);
+    NAtracDEnc::DeinterleavePcm(buf, read, &data);
+    return read;
+}
+
+size_t TWav::WritePlanar(const TPCMBuffer& data, size_t size) {
+    TPCMBuffer& buf = GetInterleavedBuf(data);
+    NAtracDEnc::InterleavePcm(data, size, &buf);
+    return Impl->Write(buf, size);
+}
+
 uint64_t TWav::GetTotalSamples() const {
-    return Impl->GetTotalSamples();
+    const size_t total = Impl->GetTotalSamples();
+    if (LengthIgnored || total == IPCMProviderImpl::UnknownLength)
+        return UnknownLength;
+    return total;
+}
+
+void TWav::IgnoreLength() {
+    LengthIgnored = true;
+}
+
+uint64_t TWav::GetSamplesRead() const {
+    return SamplesRead;
+}
+
+bool TWav::IsEndOfStream() const {
+    return EndOfStream;
+}
+
+uint64_t TWav::Skip(uint64_t sz) {
+    return Impl->Skip(sz);
+}
+
+void TWav::EnablePrefetch(size_t depth, size_t blockSz) {
+    if (depth == 0 || blockSz == 0)
+        return;
+    Impl.reset(new TPrefetchPCMProvider(std::move(Impl), depth, blockSz));
 }
 
 size_t TWav::GetChannelNum() const {
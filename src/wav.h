@@ -18,6 +18,8 @@
 
 #pragma once
 
+#include <cstdint>
+#include <limits>
 #include <memory>
 #include <string>
 
@@ -54,28 +56,55 @@ public:
 
 class IPCMProviderImpl {
 public:
+    static constexpr size_t UnknownLength = std::numeric_limits<size_t>::max();
     virtual ~IPCMProviderImpl() = default;
     virtual size_t GetChannelsNum() const = 0;
     virtual size_t GetSampleRate() const = 0;
+    // UnknownLength if the input is not seekable (pipe) or its header does not tell
     virtual size_t GetTotalSamples() const = 0;
     virtual size_t Read(TPCMBuffer& buf, size_t sz) = 0;
+    // Moves read position forward by sz samples, returns number of skipped samples.
+    // Default implementation reads and discards, backends able to seek should override it.
+    virtual size_t Skip(size_t sz);
     virtual size_t Write(const TPCMBuffer& buf, size_t sz) = 0;
 };
 
 //TODO: split for reader/writer
 class TWav {
     mutable std::unique_ptr<IPCMProviderImpl> Impl;
+    bool LengthIgnored = false;
+    mutable uint64_t SamplesRead = 0;
+    mutable bool EndOfStream = false;
+    // Backends work with interleaved samples, used to convert planar buffers
+    mutable std::unique_ptr<TPCMBuffer> Interleaved;
+
+    TPCMBuffer& GetInterleavedBuf(const TPCMBuffer& data) const;
+    size_t ReadPlanar(TPCMBuffer& data, size_t size) const;
+    size_t WritePlanar(const TPCMBuffer& data, size_t size);
 public:
     enum Mode {
         E_READ,
         E_WRITE
     };
+    static constexpr uint64_t UnknownLength = std::numeric_limits<uint64_t>::max();
     TWav(const std::string& filename); // reading
     TWav(const std::string& filename, size_t channels, size_t sampleRate); //writing
     ~TWav();
     size_t GetChannelNum() const;
     size_t GetSampleRate() const;
+    // UnknownLength for streamed input, it must be read till the end
     uint64_t GetTotalSamples() const;
+    // Handles the input as a stream of unknown length even if its header
+    // contains the length (e.g. provisional header written by a live producer)
+    void IgnoreLength();
+    // Number of samples got from the input and whether its end was reached,
+    // the length of a stream is known only after that
+    uint64_t GetSamplesRead() const;
+    bool IsEndOfStream() const;
+    uint64_t Skip(uint64_t sz);
+    // Reads the input on a background thread in blocks of blockSz samples,
+    // up to depth blocks ahead of the consumer. Must be called before reading.
+    void EnablePrefetch(size_t depth, size_t blockSz);
 
     IPCMReader* GetPCMReader() const;
 
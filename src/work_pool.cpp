@@ -0,0 +1,107 @@
+/*
+ * This file is part of AtracDEnc.
+ *
+ * AtracDEnc is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * AtracDEnc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with AtracDEnc; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "work_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <thread>
+
+namespace NAtracDEnc {
+
+TWorkStealingPool::TWorkStealingPool(size_t workers)
+{
+    workers = std::max<size_t>(workers, 1);
+    for (size_t i = 0; i < workers; i++) {
+        Queues.emplace_back(new TQueue);
+    }
+}
+
+bool TWorkStealingPool::Pop(size_t worker, TTask& task)
+{
+    TQueue& q = *Queues[worker];
+    std::lock_guard<std::mutex> lock(q.Mutex);
+    if (q.Tasks.empty())
+        return false;
+    task = std::move(q.Tasks.front());
+    q.Tasks.pop_front();
+    return true;
+}
+
+bool TWorkStealingPool::Steal(size_t worker, TTask& task)
+{
+    // Start from the neighbour so thieves do not all hit the same victim
+    for (size_t i = 1; i < Queues.size(); i++) {
+        TQueue& q = *Queues[(worker + i) % Queues.size()];
+        std::lock_guard<std::mutex> lock(q.Mutex);
+        if (q.Tasks.empty())
+            continue;
+        task = std::move(q.Tasks.back());
+        q.Tasks.pop_back();
+        return true;
+    }
+    return false;
+}
+
+void TWorkStealingPool::Run(std::vector<TTask> tasks)
+{
+    const size_t n = Queues.size();
+    for (size_t i = 0; i < tasks.size(); i++) {
+        Queues[i % n]->Tasks.push_back(std::move(tasks[i]));
+    }
+
+    // Tasks are never added during the run, so an empty sweep means we are done
+    std::atomic<size_t> stolen{0};
+    std::mutex errorMutex;
+    std::exception_ptr error;
+
+    auto worker = [&](size_t w) {
+        TTask task;
+        for (;;) {
+            if (!Pop(w, task)) {
+                if (!Steal(w, task))
+                    return;
+                stolen++;
+            }
+            try {
+                task(w);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(errorMutex);
+                if (!error)
+                    error = std::current_exception();
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(n - 1);
+    for (size_t w = 1; w < n; w++) {
+        threads.emplace_back(worker, w);
+    }
+    worker(0);
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    Stolen = stolen;
+    if (error)
+        std::rethrow_exception(error);
+}
+
+} // namespace NAtracDEnc
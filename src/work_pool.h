@@ -0,0 +1,64 @@
+/*
+ * This file is part of AtracDEnc.
+ *
+ * AtracDEnc is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * AtracDEnc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with AtracDEnc; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace NAtracDEnc {
+
+// Fixed size pool of workers, each one owns a queue of tasks.
+// A worker takes tasks from the front of its own queue, when the queue is empty
+// it steals from the back of the other ones. So long jobs (big files) do not
+// leave the rest of workers idle at the end of the batch.
+class TWorkStealingPool {
+public:
+    // Argument is index of worker which runs the task
+    typedef std::function<void(size_t worker)> TTask;
+
+    explicit TWorkStealingPool(size_t workers);
+
+    size_t GetWorkersNum() const { return Queues.size(); }
+
+    // Distributes tasks round robin between workers, runs them and waits for
+    // completion. The first exception thrown by a task is rethrown after all
+    // workers are joined, the remaining tasks are still executed.
+    void Run(std::vector<TTask> tasks);
+
+    // Number of tasks executed by a worker other than the initial owner during last Run
+    size_t GetStolenNum() const { return Stolen; }
+
+private:
+    struct TQueue {
+        std::mutex Mutex;
+        std::deque<TTask> Tasks;
+    };
+
+    bool Pop(size_t worker, TTask& task);
+    bool Steal(size_t worker, TTask& task);
+
+    std::vector<std::unique_ptr<TQueue>> Queues;
+    size_t Stolen = 0;
+};
+
+} // namespace NAtracDEnc
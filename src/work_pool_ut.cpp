@@ -0,0 +1,80 @@
+/*
+ * This file is part of AtracDEnc.
+ *
+ * AtracDEnc is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * AtracDEnc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with AtracDEnc; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "work_pool.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using namespace NAtracDEnc;
+
+TEST(TWorkStealingPool, RunsEveryTaskOnce) {
+    TWorkStealingPool pool(4);
+    std::vector<std::atomic<int>> hits(1000);
+    std::vector<TWorkStealingPool::TTask> tasks;
+    for (size_t i = 0; i < hits.size(); i++) {
+        tasks.push_back([&hits, i](size_t) { hits[i]++; });
+    }
+    pool.Run(std::move(tasks));
+    for (const auto& h : hits) {
+        EXPECT_EQ(h, 1);
+    }
+}
+
+TEST(TWorkStealingPool, IdleWorkerSteals) {
+    // Task 0 blocks worker 0 until every other task is done, the tasks queued
+    // behind it on worker 0 can only be completed by stealing.
+    TWorkStealingPool pool(2);
+    const size_t n = 16;
+    std::atomic<size_t> done{0};
+    bool drained = false;
+    std::vector<TWorkStealingPool::TTask> tasks;
+    tasks.push_back([&](size_t) {
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        while (done < n - 1 && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        drained = done == n - 1;
+    });
+    for (size_t i = 1; i < n; i++) {
+        tasks.push_back([&](size_t) { done++; });
+    }
+    pool.Run(std::move(tasks));
+    EXPECT_TRUE(drained);
+    EXPECT_GE(pool.GetStolenNum(), n / 2 - 1);
+}
+
+TEST(TWorkStealingPool, RethrowsAfterAllTasks) {
+    TWorkStealingPool pool(3);
+    std::atomic<size_t> done{0};
+    std::vector<TWorkStealingPool::TTask> tasks;
+    for (size_t i = 0; i < 10; i++) {
+        tasks.push_back([&done, i](size_t) {
+            done++;
+            if (i == 3)
+                throw std::runtime_error("task failed");
+        });
+    }
+    EXPECT_THROW(pool.Run(std::move(tasks)), std::runtime_error);
+    EXPECT_EQ(done, 10);
+}
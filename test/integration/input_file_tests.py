@@ -20,8 +20,8 @@ def write_wav(path, samples=2048):
         wav.writeframes(struct.pack("<{}h".format(samples), *([0] * samples)))
 
 
-def run_command(args):
-    return subprocess.run(args, stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+def run_command(args, stdin=None):
+    return subprocess.run(args, stdin=stdin, stdout=subprocess.PIPE, stderr=subprocess.PIPE)
 
 
 def decode(data):
@@ -55,6 +55,18 @@ def encode(exe, in_file, out_file, codec, container=None):
     return run_command(args)
 
 
+def encode_stream(exe, in_file, out_file, codec):
+    with in_file.open("rb") as stdin:
+        return run_command([
+            str(exe),
+            "-e", codec,
+            "--nostdout",
+            "--stream",
+            "-i", "-",
+            "-o", str(out_file),
+        ], stdin=stdin)
+
+
 def decode_atrac1(exe, in_file, out_file):
     return run_command([
         str(exe),
@@ -202,6 +214,27 @@ def check_explicit_container(exe, work_dir):
         fail("ATRAC3PLUS invalid container error did not explain the rejected combination", proc)
 
 
+def check_stream_header(exe, work_dir, codec, suffix):
+    # Length is not a multiple of the PCM engine block
+    in_file = work_dir / "stream-header-input.wav"
+    write_wav(in_file, samples=10000)
+
+    file_out = work_dir / ("stream-header-file" + suffix)
+    proc = encode(exe, in_file, file_out, codec)
+    if proc.returncode != 0:
+        fail("encoding of {} from file failed".format(suffix), proc)
+    require_output_file(file_out, proc, "encoding of {} from file did not create output".format(suffix))
+
+    stream_out = work_dir / ("stream-header-stdin" + suffix)
+    proc = encode_stream(exe, in_file, stream_out, codec)
+    if proc.returncode != 0:
+        fail("encoding of {} from stdin failed".format(suffix), proc)
+    require_output_file(stream_out, proc, "encoding of {} from stdin did not create output".format(suffix))
+
+    if file_out.read_bytes() != stream_out.read_bytes():
+        fail("{} header patched after unknown length input differs from known length one".format(suffix), proc)
+
+
 def main():
     parser = argparse.ArgumentParser()
     parser.add_argument("--exe", required=True)
@@ -217,6 +250,8 @@ def main():
         "utf8-decode-input",
         "explicit-container",
         "utf8-decode-output",
+        "stream-header-aea",
+        "stream-header-rm",
     ])
     args = parser.parse_args()
 
@@ -244,6 +279,10 @@ def main():
         check_utf8_decode_output(exe, work_dir)
     elif args.case == "explicit-container":
         check_explicit_container(exe, work_dir)
+    elif args.case == "stream-header-aea":
+        check_stream_header(exe, work_dir, "atrac1", ".aea")
+    elif args.case == "stream-header-rm":
+        check_stream_header(exe, work_dir, "atrac3", ".rm")
 
 
 if __name__ == "__main__":